@@ -21,6 +21,18 @@ static int show_softirqs(struct seq_file *p, void *v)
 			seq_printf(p, " %10u", kstat_softirqs_cpu(i, j));
 		seq_putc(p, '\n');
 	}
+#ifdef CONFIG_PREEMPT_SOFTIRQ_SPLIT
+	/* Time spent in each vector, in microseconds */
+	for (i = 0; i < NR_SOFTIRQS; i++) {
+		seq_printf(p, "%9s_us:", softirq_to_name[i]);
+		for_each_possible_cpu(j) {
+			seq_printf(p, " %10llu", (unsigned long long)
+				   div_u64(kstat_softirq_time_cpu(i, j),
+					   NSEC_PER_USEC));
+		}
+		seq_putc(p, '\n');
+	}
+#endif
 	return 0;
 }
 
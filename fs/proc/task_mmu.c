@@ -460,8 +460,9 @@ static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 
 	if (pmd_trans_huge_lock(pmd, vma) == 1) {
 		smaps_pte_entry(*(pte_t *)pmd, addr, HPAGE_PMD_SIZE, walk);
+		if (PageAnon(pmd_page(*pmd)))
+			mss->anonymous_thp += HPAGE_PMD_SIZE;
 		spin_unlock(&walk->mm->page_table_lock);
-		mss->anonymous_thp += HPAGE_PMD_SIZE;
 		return 0;
 	}
 
@@ -597,7 +598,19 @@ static int clear_refs_pte_range(pmd_t *pmd, unsigned long addr,
 	spinlock_t *ptl;
 	struct page *page;
 
-	split_huge_page_pmd(walk->mm, pmd);
+	/* a split would unmap page cache, age its huge pmd instead */
+	if (vma->vm_ops && pmd_trans_huge_lock(pmd, vma) == 1) {
+		int i;
+
+		page = pmd_page(*pmd);
+		pmdp_test_and_clear_young(vma, addr, pmd);
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			ClearPageReferenced(page + i);
+		spin_unlock(&walk->mm->page_table_lock);
+		return 0;
+	}
+
+	split_huge_page_pmd_mm(walk->mm, addr, pmd);
 	if (pmd_trans_unstable(pmd))
 		return 0;
 
@@ -375,6 +375,9 @@ void page_alloc_init(void);
 void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp);
 void drain_all_pages(void);
 void drain_local_pages(void *dummy);
+#if defined(CONFIG_NUMA) && defined(CONFIG_PREEMPT_RT_BASE)
+void drain_remote_pages(unsigned int cpu);
+#endif
 
 /*
  * gfp_allowed_mask is set to GFP_BOOT_MASK during early boot to restrict what
@@ -19,7 +19,9 @@
 #include <linux/ktime.h>
 #include <linux/init.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/wait.h>
+#include <linux/wait-simple.h>
 #include <linux/percpu.h>
 #include <linux/timer.h>
 #include <linux/timerqueue.h>
@@ -55,11 +57,14 @@ enum hrtimer_restart {
  * 0x01		enqueued into rbtree
  * 0x02		callback function running
  * 0x04		timer is migrated to another cpu
+ * 0x08		callback queued for the softirq (PREEMPT_RT_BASE)
  *
  * Special cases:
  * 0x03		callback function running and enqueued
  *		(was requeued on another CPU)
  * 0x05		timer was migrated on CPU hotunplug
+ * 0x0a		expired timer handed to the softirq. It counts as
+ *		running, so cancellation waits for the callback.
  *
  * The "callback function running and enqueued" status is only possible on
  * SMP. It happens for example when a posix timer expired and the callback
@@ -81,6 +86,7 @@ enum hrtimer_restart {
 #define HRTIMER_STATE_ENQUEUED	0x01
 #define HRTIMER_STATE_CALLBACK	0x02
 #define HRTIMER_STATE_MIGRATE	0x04
+#define HRTIMER_STATE_PENDING	0x08
 
 /**
  * struct hrtimer - the basic hrtimer structure
@@ -111,7 +117,9 @@ struct hrtimer {
 	enum hrtimer_restart		(*function)(struct hrtimer *);
 	struct hrtimer_clock_base	*base;
 	unsigned long			state;
-	struct list_head		cb_entry;
+#ifdef CONFIG_PREEMPT_RT_BASE
+	struct llist_node		cb_entry;
+#endif
 	int				irqsafe;
 #ifdef CONFIG_MISSED_TIMER_OFFSETS_HIST
 	ktime_t				praecox;
@@ -152,7 +160,6 @@ struct hrtimer_clock_base {
 	int			index;
 	clockid_t		clockid;
 	struct timerqueue_head	active;
-	struct list_head	expired;
 	ktime_t			resolution;
 	ktime_t			(*get_time)(void);
 	ktime_t			softirq_time;
@@ -180,6 +187,8 @@ enum  hrtimer_base_type {
  * @nr_retries:		Total number of hrtimer interrupt retries
  * @nr_hangs:		Total number of hrtimer interrupt hangs
  * @max_hang_time:	Maximum time spent in hrtimer_interrupt
+ * @wait:		waitqueue for cancellation of softirq based timers (RT)
+ * @expired:		expired timers handed to the softirq (RT)
  * @clock_base:		array of clock bases for this cpu
  */
 struct hrtimer_cpu_base {
@@ -196,7 +205,8 @@ struct hrtimer_cpu_base {
 	ktime_t				max_hang_time;
 #endif
 #ifdef CONFIG_PREEMPT_RT_BASE
-	wait_queue_head_t		wait;
+	struct swait_head		wait;
+	struct llist_head		expired;
 #endif
 	struct hrtimer_clock_base	clock_base[HRTIMER_MAX_CLOCK_BASES];
 };
@@ -483,6 +483,27 @@ static inline struct task_struct *this_cpu_ksoftirqd(void)
 	return this_cpu_read(ksoftirqd);
 }
 
+#ifdef CONFIG_PREEMPT_SOFTIRQ_SPLIT
+DECLARE_PER_CPU(struct task_struct * [NR_SOFTIRQS], ksoftirqd_vec);
+
+/* The sirq threads of this cpu take the place of its ksoftirqd */
+static inline bool this_cpu_is_ksoftirqd(struct task_struct *p)
+{
+	int i;
+
+	for (i = 0; i < NR_SOFTIRQS; i++) {
+		if (this_cpu_read(ksoftirqd_vec[i]) == p)
+			return true;
+	}
+	return false;
+}
+#else
+static inline bool this_cpu_is_ksoftirqd(struct task_struct *p)
+{
+	return this_cpu_ksoftirqd() == p;
+}
+#endif
+
 /* Try to send a softirq to a remote cpu.  If this cannot be done, the
  * work will be queued to the local cpu.
  */
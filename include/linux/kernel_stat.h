@@ -40,6 +40,9 @@ struct kernel_stat {
 #endif
 	unsigned long irqs_sum;
 	unsigned int softirqs[NR_SOFTIRQS];
+#ifdef CONFIG_PREEMPT_SOFTIRQ_SPLIT
+	u64 softirq_time[NR_SOFTIRQS];
+#endif
 };
 
 DECLARE_PER_CPU(struct kernel_stat, kstat);
@@ -90,6 +93,19 @@ static inline unsigned int kstat_softirqs_cpu(unsigned int irq, int cpu)
        return kstat_cpu(cpu).softirqs[irq];
 }
 
+#ifdef CONFIG_PREEMPT_SOFTIRQ_SPLIT
+static inline void kstat_add_softirq_time_this_cpu(unsigned int irq, u64 ns)
+{
+	__this_cpu_add(kstat.softirq_time[irq], ns);
+}
+
+/* Nanoseconds spent in softirq handler @irq on @cpu */
+static inline u64 kstat_softirq_time_cpu(unsigned int irq, int cpu)
+{
+	return kstat_cpu(cpu).softirq_time[irq];
+}
+#endif
+
 /*
  * Number of interrupts per specific IRQ source, since bootup
  */
@@ -137,6 +137,8 @@ struct lock_class_stats {
 	struct lock_time		read_holdtime;
 	struct lock_time		write_holdtime;
 	unsigned long			bounces[nr_bounce_types];
+	unsigned long			contended_spin;
+	unsigned long			contended_sleep;
 };
 
 struct lock_class_stats lock_stats(struct lock_class *class);
@@ -420,6 +422,8 @@ struct lock_class_key { };
 
 extern void lock_contended(struct lockdep_map *lock, unsigned long ip);
 extern void lock_acquired(struct lockdep_map *lock, unsigned long ip);
+extern void lock_acquired_adaptive(struct lockdep_map *lock, unsigned long ip,
+				   int slept);
 
 #define LOCK_CONTENDED(_lock, try, lock)			\
 do {								\
@@ -434,6 +438,8 @@ do {								\
 
 #define lock_contended(lockdep_map, ip) do {} while (0)
 #define lock_acquired(lockdep_map, ip) do {} while (0)
+#define lock_acquired_adaptive(lockdep_map, ip, slept) \
+	do { (void)(slept); } while (0)
 
 #define LOCK_CONTENDED(_lock, try, lock) \
 	lock(_lock)
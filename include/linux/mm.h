@@ -207,6 +207,11 @@ struct vm_operations_struct {
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
+	/* map a huge page at an empty pmd, or return VM_FAULT_FALLBACK to
+	 * have the fault handled with ptes by fault() instead */
+	int (*pmd_fault)(struct vm_area_struct *vma, unsigned long address,
+			 pmd_t *pmd, unsigned int flags);
+
 	/* notification that a previously read-only page is about to become
 	 * writable, if an error is returned it will cause a SIGBUS */
 	int (*page_mkwrite)(struct vm_area_struct *vma, struct vm_fault *vmf);
@@ -872,6 +877,7 @@ static inline int page_mapped(struct page *page)
 #define VM_FAULT_NOPAGE	0x0100	/* ->fault installed the pte, not return page */
 #define VM_FAULT_LOCKED	0x0200	/* ->fault locked the returned page */
 #define VM_FAULT_RETRY	0x0400	/* ->fault blocked, must retry */
+#define VM_FAULT_FALLBACK 0x0800	/* ->pmd_fault: use ptes instead */
 
 #define VM_FAULT_HWPOISON_LARGE_MASK 0xf000 /* encodes hpage index for large hwpoison */
 
@@ -1558,6 +1564,20 @@ static inline pgprot_t vm_get_page_prot(unsigned long vm_flags)
 }
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * NUMA hinting scans take all access away from the ptes of a vma, so
+ * that the next access faults and tells where the memory is used.
+ */
+static inline pgprot_t vma_prot_none(struct vm_area_struct *vma)
+{
+	return vm_get_page_prot(vma->vm_flags & ~(VM_READ|VM_WRITE|VM_EXEC));
+}
+
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			       unsigned long start, unsigned long end);
+#endif
+
 struct vm_area_struct *find_extend_vma(struct mm_struct *, unsigned long addr);
 int remap_pfn_range(struct vm_area_struct *, unsigned long addr,
 			unsigned long pfn, unsigned long size, pgprot_t);
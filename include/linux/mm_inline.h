@@ -2,6 +2,7 @@
 #define LINUX_MM_INLINE_H
 
 #include <linux/huge_mm.h>
+#include <linux/rcupdate.h>
 
 /**
  * page_is_file_cache - should the page be on a file LRU or anon LRU?
@@ -21,6 +22,90 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+/*
+ * The lruvec of a page changes when the page is charged to a memcg,
+ * uncharged while off the lru, or moved to another memcg.  This is done
+ * under the lru_lock of the lruvec the page leaves, so a page which is
+ * found to belong to a locked lruvec stays there until the lock is
+ * dropped.  The lruvecs of a memcg live in its per-node info, which is
+ * only freed together with the memcg after an RCU grace period (see
+ * free_work() in mm/memcontrol.c).  So under rcu_read_lock() the lock
+ * stays valid while it is taken for a page which just left its lruvec.
+ */
+
+/**
+ * lock_page_lruvec_irq - lock the lruvec of a page
+ * @page: the page
+ *
+ * Returns the locked lruvec.  If the page is on an lru list, it is on one
+ * of the lists of the returned lruvec.
+ */
+static inline struct lruvec *lock_page_lruvec_irq(struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+	for (;;) {
+		lruvec = mem_cgroup_page_lruvec(page, zone);
+		spin_lock_irq(&lruvec->lru_lock);
+		if (likely(lruvec == mem_cgroup_page_lruvec(page, zone)))
+			break;
+		spin_unlock_irq(&lruvec->lru_lock);
+	}
+	rcu_read_unlock();
+	return lruvec;
+}
+
+static inline struct lruvec *lock_page_lruvec_irqsave(struct page *page,
+						      unsigned long *flags)
+{
+	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+	for (;;) {
+		lruvec = mem_cgroup_page_lruvec(page, zone);
+		spin_lock_irqsave(&lruvec->lru_lock, *flags);
+		if (likely(lruvec == mem_cgroup_page_lruvec(page, zone)))
+			break;
+		spin_unlock_irqrestore(&lruvec->lru_lock, *flags);
+	}
+	rcu_read_unlock();
+	return lruvec;
+}
+
+/**
+ * relock_page_lruvec_irq - lock the lruvec of a page, dropping another
+ * @page: the page
+ * @locked: the lruvec which is locked, or NULL
+ *
+ * For going through a batch of pages which mostly belong to the same
+ * lruvec: @locked is kept if the page belongs to it.
+ */
+static inline struct lruvec *relock_page_lruvec_irq(struct page *page,
+						    struct lruvec *locked)
+{
+	if (locked) {
+		if (mem_cgroup_page_lruvec(page, page_zone(page)) == locked)
+			return locked;
+		spin_unlock_irq(&locked->lru_lock);
+	}
+	return lock_page_lruvec_irq(page);
+}
+
+static inline struct lruvec *relock_page_lruvec_irqsave(struct page *page,
+							struct lruvec *locked,
+							unsigned long *flags)
+{
+	if (locked) {
+		if (mem_cgroup_page_lruvec(page, page_zone(page)) == locked)
+			return locked;
+		spin_unlock_irqrestore(&locked->lru_lock, *flags);
+	}
+	return lock_page_lruvec_irqsave(page, flags);
+}
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
@@ -116,7 +116,7 @@ struct page {
 	/* Third double word block */
 	union {
 		struct list_head lru;	/* Pageout list, eg. active_list
-					 * protected by zone->lru_lock !
+					 * protected by lruvec->lru_lock !
 					 */
 		struct {		/* slub per cpu partial pages */
 			struct page *next;	/* Next partial slab */
@@ -406,6 +406,14 @@ struct mm_struct {
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	/* jiffies when the next NUMA hinting scan is due */
+	unsigned long numa_next_scan;
+	/* address the next scan starts at */
+	unsigned long numa_scan_offset;
+	/* bumped when a scan wraps around the address space */
+	int numa_scan_seq;
+#endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
@@ -88,10 +88,10 @@ struct free_area {
 struct pglist_data;
 
 /*
- * zone->lock and zone->lru_lock are two of the hottest locks in the kernel.
- * So add a wild amount of padding here to ensure that they fall into separate
- * cachelines.  There are very few zone structures in the machine, so space
- * consumption is not a concern here.
+ * zone->lock and the lru_lock of zone->lruvec are two of the hottest locks in
+ * the kernel.  So add a wild amount of padding here to ensure that they fall
+ * into separate cachelines.  There are very few zone structures in the
+ * machine, so space consumption is not a concern here.
  */
 #if defined(CONFIG_SMP)
 struct zone_padding {
@@ -198,7 +198,12 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+/*
+ * The lru lists of a zone, or of a memcg in a zone.  lru_lock protects the
+ * lists and the lru flags of the pages on them, see lock_page_lruvec_irq().
+ */
 struct lruvec {
+	spinlock_t lru_lock;
 	struct list_head lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat reclaim_stat;
 #ifdef CONFIG_MEMCG
@@ -407,7 +412,6 @@ struct zone {
 	ZONE_PADDING(_pad1_)
 
 	/* Fields commonly accessed by the page reclaim scanner */
-	spinlock_t		lru_lock;
 	struct lruvec		lruvec;
 
 	unsigned long		pages_scanned;	   /* since last reclaim */
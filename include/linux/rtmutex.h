@@ -15,9 +15,28 @@
 #include <linux/linkage.h>
 #include <linux/plist.h>
 #include <linux/spinlock_types_raw.h>
+#include <linux/threads.h>
 
 extern int max_lock_depth; /* for sysctl */
 
+#ifdef CONFIG_PREEMPT_RT_FULL
+extern int rt_rwlock_reader_limit; /* for sysctl */
+
+/* A task reads a lock at most once, more readers than tasks are moot */
+#define RT_RWLOCK_READER_LIMIT_MAX	PID_MAX_LIMIT
+
+#define RT_MAX_READ_LOCK_DEPTH	8
+
+/*
+ * A rwlock_t or rw_semaphore read-locked by a task, so that
+ * recursive read locking does not block on a waiting writer.
+ */
+struct rt_reader_lock {
+	void			*lock;
+	int			count;
+};
+#endif
+
 /**
  * The rt_mutex structure
  *
@@ -30,6 +49,9 @@ struct rt_mutex {
 	struct plist_head	wait_list;
 	struct task_struct	*owner;
 	int			save_state;
+#if defined(CONFIG_PREEMPT_RT_FULL) && defined(CONFIG_SMP)
+	atomic_t		osq;	/* queue of optimistic spinners */
+#endif
 #ifdef CONFIG_DEBUG_RT_MUTEXES
 	const char		*file;
 	const char		*name;
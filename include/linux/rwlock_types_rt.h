@@ -6,10 +6,11 @@
 #endif
 
 /*
- * rwlocks - rtmutex which allows single reader recursion
+ * rwlocks - rtmutex for writers plus a bounded count of readers
  */
 typedef struct {
 	struct rt_mutex		lock;
+	atomic_t		readers;
 	int			read_depth;
 	unsigned int		break_lock;
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
@@ -6,20 +6,22 @@
 #endif
 
 /*
- * RW-semaphores are a spinlock plus a reader-depth count.
+ * RW-semaphores are a rtmutex plus a reader count.
  *
  * Note that the semantics are different from the usual
- * Linux rw-sems, in PREEMPT_RT mode we do not allow
- * multiple readers to hold the lock at once, we only allow
- * a read-lock owner to read-lock recursively. This is
- * better for latency, makes the implementation inherently
- * fair and makes it simpler as well.
+ * Linux rw-sems, in PREEMPT_RT mode writers take the rtmutex,
+ * so readers blocking on a writer boost it, while the number
+ * of readers which hold the lock at once is bounded by
+ * rt_rwlock_reader_limit. A writer can not boost the readers
+ * it waits for, so the limit bounds the inversion it can
+ * suffer.
  */
 
 #include <linux/rtmutex.h>
 
 struct rw_semaphore {
 	struct rt_mutex		lock;
+	atomic_t		readers;
 	int			read_depth;
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
@@ -55,7 +57,11 @@ extern void  rt_up_write(struct rw_semaphore *rwsem);
 extern void  rt_downgrade_write(struct rw_semaphore *rwsem);
 
 #define init_rwsem(sem)		rt_init_rwsem(sem)
-#define rwsem_is_locked(s)	rt_mutex_is_locked(&(s)->lock)
+
+static inline int rwsem_is_locked(struct rw_semaphore *sem)
+{
+	return atomic_read(&sem->readers) || rt_mutex_is_locked(&sem->lock);
+}
 
 static inline void down_read(struct rw_semaphore *sem)
 {
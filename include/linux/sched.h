@@ -39,6 +39,7 @@
 #define SCHED_BATCH		3
 /* SCHED_ISO: reserved but not implemented yet */
 #define SCHED_IDLE		5
+#define SCHED_DEADLINE		6
 /* Can be ORed in to make sure the process is reverted back to SCHED_NORMAL on fork */
 #define SCHED_RESET_ON_FORK     0x40000000
 
@@ -104,6 +105,54 @@ struct fs_struct;
 struct perf_event_context;
 struct blk_plug;
 
+/*
+ * Extended scheduling parameters data structure, used by
+ * sched_setattr() and sched_getattr().
+ *
+ * SCHED_DEADLINE tasks are described by three parameters: a task
+ * gets sched_runtime nanoseconds of cpu time every sched_period
+ * nanoseconds, within sched_deadline nanoseconds from the beginning
+ * of the period. sched_period == 0 means sched_period ==
+ * sched_deadline, and
+ *
+ *   sched_runtime <= sched_deadline <= sched_period
+ *
+ * must hold. The sum of sched_runtime/sched_period of all the
+ * SCHED_DEADLINE tasks is subject to admission control, see
+ * Documentation/scheduler/sched-deadline.txt.
+ *
+ * @size: size of the structure, for forward/backward compatibility
+ * @sched_policy: task's scheduling policy
+ * @sched_flags: for customizing the scheduler behaviour
+ * @sched_nice: task's nice value (SCHED_NORMAL/BATCH)
+ * @sched_priority: task's static priority (SCHED_FIFO/RR)
+ * @sched_runtime: representative of the task's runtime
+ * @sched_deadline: representative of the task's deadline
+ * @sched_period: representative of the task's period
+ */
+#define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+
+struct sched_attr {
+	u32 size;
+
+	u32 sched_policy;
+	u64 sched_flags;
+
+	/* SCHED_NORMAL, SCHED_BATCH */
+	s32 sched_nice;
+
+	/* SCHED_FIFO, SCHED_RR */
+	u32 sched_priority;
+
+	/* SCHED_DEADLINE */
+	u64 sched_runtime;
+	u64 sched_deadline;
+	u64 sched_period;
+};
+
+/* SCHED_RESET_ON_FORK for sched_attr::sched_flags */
+#define SCHED_FLAG_RESET_ON_FORK	0x01
+
 /*
  * List of flags we want to share for kernel threads,
  * if only because they are not used by them anyway.
@@ -274,6 +323,28 @@ extern void init_idle_bootup_task(struct task_struct *idle);
 
 extern int runqueue_is_locked(int cpu);
 
+#ifdef CONFIG_SMP
+extern bool housekeeping_full;
+extern const struct cpumask *housekeeping_cpumask(void);
+extern int housekeeping_any_cpu(void);
+
+static inline bool is_housekeeping_cpu(int cpu)
+{
+	if (likely(!housekeeping_full))
+		return true;
+	return cpumask_test_cpu(cpu, housekeeping_cpumask());
+}
+#else
+#define housekeeping_full	false
+
+static inline const struct cpumask *housekeeping_cpumask(void)
+{
+	return cpu_possible_mask;
+}
+static inline int housekeeping_any_cpu(void) { return 0; }
+static inline bool is_housekeeping_cpu(int cpu) { return true; }
+#endif
+
 #if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ)
 extern void select_nohz_load_balancer(int stop_tick);
 extern void set_cpu_sd_state_idle(void);
@@ -928,6 +999,29 @@ static inline unsigned int group_first_cpu(struct sched_group *group)
 	return cpumask_first(sched_group_cpus(group));
 }
 
+/*
+ * Idle state of the cpus of a last level cache domain, for the wakeup
+ * path, see select_idle_sibling().  The two cpumasks hold the idle cpus
+ * and the cpus all of whose SMT siblings are idle.  Every cpu updates
+ * its own bits when it enters and leaves idle, the masks are hints.
+ */
+struct sched_domain_shared {
+	atomic_t ref;
+
+	unsigned long cpumask[0];	/* idle cpus, then idle cores */
+};
+
+static inline struct cpumask *sds_idle_cpus(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->cpumask);
+}
+
+static inline struct cpumask *sds_idle_cores(struct sched_domain_shared *sds)
+{
+	return to_cpumask((unsigned long *)((char *)sds->cpumask +
+					    cpumask_size()));
+}
+
 struct sched_domain_attr {
 	int relax_domain_level;
 };
@@ -943,6 +1037,7 @@ struct sched_domain {
 	struct sched_domain *parent;	/* top domain must be null terminated */
 	struct sched_domain *child;	/* bottom domain must be null terminated */
 	struct sched_group *groups;	/* the balancing groups of the domain */
+	struct sched_domain_shared *shared; /* SD_SHARE_PKG_RESOURCES only */
 	unsigned long min_interval;	/* Minimum balance interval ms */
 	unsigned long max_interval;	/* Maximum balance interval ms */
 	unsigned int busy_factor;	/* less balancing by factor if busy */
@@ -1090,6 +1185,7 @@ struct sched_domain;
 #else
 #define ENQUEUE_WAKING		0
 #endif
+#define ENQUEUE_REPLENISH	8	/* SCHED_DEADLINE: new instance */
 
 #define DEQUEUE_SLEEP		1
 
@@ -1108,6 +1204,7 @@ struct sched_class {
 
 #ifdef CONFIG_SMP
 	int  (*select_task_rq)(struct task_struct *p, int sd_flag, int flags);
+	void (*migrate_task_rq)(struct task_struct *p, int next_cpu);
 
 	void (*pre_schedule) (struct rq *this_rq, struct task_struct *task);
 	void (*post_schedule) (struct rq *this_rq);
@@ -1124,6 +1221,7 @@ struct sched_class {
 	void (*set_curr_task) (struct rq *rq);
 	void (*task_tick) (struct rq *rq, struct task_struct *p, int queued);
 	void (*task_fork) (struct task_struct *p);
+	void (*task_dead) (struct task_struct *p);
 
 	void (*switched_from) (struct rq *this_rq, struct task_struct *task);
 	void (*switched_to) (struct rq *this_rq, struct task_struct *task);
@@ -1178,6 +1276,18 @@ struct sched_statistics {
 };
 #endif
 
+struct sched_avg {
+	/*
+	 * These sums represent an infinite geometric series and so are bound
+	 * above by 1024/(1-y).  Thus we only need a u32 to store them for all
+	 * choices of y < 1-2^(-32)*1024.
+	 */
+	u32 runnable_avg_sum, runnable_avg_period;
+	u64 last_runnable_update;
+	s64 decay_count;
+	unsigned long load_avg_contrib;
+};
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1202,6 +1312,11 @@ struct sched_entity {
 	/* rq "owned" by this entity/group: */
 	struct cfs_rq		*my_q;
 #endif
+
+#ifdef CONFIG_SMP
+	/* Per-entity load-tracking */
+	struct sched_avg	avg;
+#endif
 };
 
 struct sched_rt_entity {
@@ -1219,6 +1334,50 @@ struct sched_rt_entity {
 #endif
 };
 
+struct sched_dl_entity {
+	struct rb_node	rb_node;
+
+	/*
+	 * Original scheduling parameters. Copied here from sched_attr
+	 * during sched_setattr(), they will remain the same until
+	 * the next sched_setattr(). dl_bw is dl_runtime / dl_period
+	 * as accounted by the admission control.
+	 */
+	u64 dl_runtime;		/* maximum runtime for each instance	*/
+	u64 dl_deadline;	/* relative deadline of each instance	*/
+	u64 dl_period;		/* separation of two instances (period) */
+	u64 dl_bw;		/* dl_runtime / dl_period		*/
+
+	/*
+	 * Actual scheduling parameters. Initialized with the values above,
+	 * they are continuously updated during task execution by the
+	 * Constant Bandwidth Server rules. Note that the remaining runtime
+	 * could be less than zero when the task overruns its instance.
+	 */
+	s64 runtime;		/* remaining runtime for this instance	*/
+	u64 deadline;		/* absolute deadline for this instance	*/
+
+	/*
+	 * @dl_throttled tells if we exhausted the runtime. If so, the
+	 * task has to wait for a replenishment to be performed at the
+	 * next firing of dl_timer.
+	 *
+	 * @dl_new tells if a new instance arrived. If so we must
+	 * start executing it with full runtime and reset its absolute
+	 * deadline.
+	 *
+	 * @dl_yielded tells if the task gave up the cpu before
+	 * consuming all its available runtime.
+	 */
+	int dl_throttled, dl_new, dl_yielded;
+
+	/*
+	 * Bandwidth enforcement timer. Each -deadline task has its
+	 * own bandwidth to be enforced, thus we need one timer per task.
+	 */
+	struct hrtimer dl_timer;
+};
+
 /*
  * default timeslice is 100 msecs (used only for SCHED_RR tasks).
  * Timeslices get refilled after they expire.
@@ -1253,6 +1412,7 @@ struct task_struct {
 	const struct sched_class *sched_class;
 	struct sched_entity se;
 	struct sched_rt_entity rt;
+	struct sched_dl_entity dl;
 #ifdef CONFIG_CGROUP_SCHED
 	struct task_group *sched_task_group;
 #endif
@@ -1278,6 +1438,8 @@ struct task_struct {
 	unsigned int policy;
 #ifdef CONFIG_PREEMPT_RT_FULL
 	int migrate_disable;
+	/* Only written by the task itself, see migrate_disable() */
+	int migrate_disable_update;
 # ifdef CONFIG_SCHED_DEBUG
 	int migrate_disable_atomic;
 # endif
@@ -1304,6 +1466,7 @@ struct task_struct {
 	struct list_head tasks;
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
+	struct rb_node pushable_dl_tasks;
 #endif
 
 	struct mm_struct *mm, *active_mm;
@@ -1463,6 +1626,9 @@ struct task_struct {
 #endif
 #ifdef CONFIG_PREEMPT_RT_FULL
 	int pagefault_disabled;
+	/* rwlock_t/rw_semaphore read locks held, see kernel/rt.c */
+	int reader_lock_count;
+	struct rt_reader_lock owned_read_locks[RT_MAX_READ_LOCK_DEPTH];
 #endif
 #ifdef CONFIG_TRACE_IRQFLAGS
 	unsigned int irq_events;
@@ -1543,6 +1709,21 @@ struct task_struct {
 	struct mempolicy *mempolicy;	/* Protected by alloc_lock */
 	short il_next;
 	short pref_node_fork;
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	int numa_scan_seq;
+	unsigned int numa_scan_period;	/* msecs of runtime between scans */
+	u64 node_stamp;			/* runtime of the last scan */
+	struct callback_head numa_work;
+
+	/*
+	 * Hinting faults per node: the decaying totals in the first
+	 * nr_node_ids entries, the faults since the last placement
+	 * in the next nr_node_ids.
+	 */
+	unsigned long *numa_faults;
+	unsigned long numa_faults_locality[2];	/* remote, local */
+	int numa_preferred_nid;
 #endif
 	struct rcu_head rcu;
 
@@ -1649,6 +1830,8 @@ static inline bool pagefault_disabled(void)
  * priority is 0..MAX_RT_PRIO-1, and SCHED_NORMAL/SCHED_BATCH
  * tasks are in the range MAX_RT_PRIO..MAX_PRIO-1. Priority
  * values are inverted: lower p->prio value means higher priority.
+ * SCHED_DEADLINE tasks are above all of them, at MAX_DL_PRIO-1,
+ * and are ordered by their deadline rather than by priority.
  *
  * The MAX_USER_RT_PRIO value allows the actual maximum
  * RT priority to be separate from the value exported to
@@ -1657,12 +1840,26 @@ static inline bool pagefault_disabled(void)
  * MAX_RT_PRIO must not be smaller than MAX_USER_RT_PRIO.
  */
 
+#define MAX_DL_PRIO		0
+
 #define MAX_USER_RT_PRIO	100
 #define MAX_RT_PRIO		MAX_USER_RT_PRIO
 
 #define MAX_PRIO		(MAX_RT_PRIO + 40)
 #define DEFAULT_PRIO		(MAX_RT_PRIO + 20)
 
+static inline int dl_prio(int prio)
+{
+	if (unlikely(prio < MAX_DL_PRIO))
+		return 1;
+	return 0;
+}
+
+static inline int dl_task(struct task_struct *p)
+{
+	return dl_prio(p->prio);
+}
+
 static inline int rt_prio(int prio)
 {
 	if (unlikely(prio < MAX_RT_PRIO))
@@ -2143,6 +2340,20 @@ static inline void sched_autogroup_exit(struct signal_struct *sig) { }
 extern unsigned int sysctl_sched_cfs_bandwidth_slice;
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING
+extern unsigned int sysctl_numa_balancing;
+extern unsigned int sysctl_numa_balancing_scan_delay;
+extern unsigned int sysctl_numa_balancing_scan_period_min;
+extern unsigned int sysctl_numa_balancing_scan_period_max;
+extern unsigned int sysctl_numa_balancing_scan_size;
+
+extern void task_numa_fault(int node, int pages, bool local);
+extern void task_numa_free(struct task_struct *p);
+#else
+static inline void task_numa_fault(int node, int pages, bool local) { }
+static inline void task_numa_free(struct task_struct *p) { }
+#endif
+
 #ifdef CONFIG_RT_MUTEXES
 extern int rt_mutex_getprio(struct task_struct *p);
 extern void rt_mutex_setprio(struct task_struct *p, int prio);
@@ -2179,6 +2390,8 @@ extern int sched_setscheduler(struct task_struct *, int,
 			      const struct sched_param *);
 extern int sched_setscheduler_nocheck(struct task_struct *, int,
 				      const struct sched_param *);
+extern int sched_setattr(struct task_struct *,
+			 const struct sched_attr *);
 extern struct task_struct *idle_task(int cpu);
 /**
  * is_idle_task - is the specified task an idle task?
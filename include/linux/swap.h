@@ -175,6 +175,24 @@ enum {
 #define COUNT_CONTINUED	0x80	/* See swap_map continuation for full count */
 #define SWAP_MAP_SHMEM	0xbf	/* Owned by shmem/tmpfs, in first swap_map */
 
+/*
+ * Swap slots are grouped into clusters of SWAPFILE_CLUSTER slots.  On solid
+ * state devices each CPU allocates from a cluster of its own, so the pages
+ * reclaimed together are written next to each other.
+ */
+#define SWAPFILE_CLUSTER	256
+
+struct swap_cluster_info {
+	unsigned short count;		/* slots in use or beyond the device */
+	unsigned short flags;		/* CLUSTER_FLAG_* in swapfile.c */
+	unsigned int next;		/* next cluster on the free list */
+};
+
+struct percpu_cluster {
+	unsigned int cluster;		/* cluster this CPU allocates from */
+	unsigned int next;		/* likely offset of the next slot */
+};
+
 /*
  * The in-memory structure used to track swap areas.
  */
@@ -193,6 +211,10 @@ struct swap_info_struct {
 	unsigned int cluster_nr;	/* countdown to next cluster search */
 	unsigned int lowest_alloc;	/* while preparing discard cluster */
 	unsigned int highest_alloc;	/* while preparing discard cluster */
+	struct swap_cluster_info *cluster_info; /* SSD only: cluster usage */
+	unsigned int free_cluster_head;	/* first cluster on the free list */
+	unsigned int free_cluster_tail;	/* last cluster on the free list */
+	struct percpu_cluster __percpu *percpu_cluster; /* cluster of each cpu */
 	struct swap_extent *curr_swap_extent;
 	struct swap_extent first_swap_extent;
 	struct block_device *bdev;	/* swap device or bdev of swap file */
@@ -321,8 +343,11 @@ static inline void mem_cgroup_uncharge_swap(swp_entry_t ent)
 /* linux/mm/page_io.c */
 extern int swap_readpage(struct page *);
 extern int swap_writepage(struct page *page, struct writeback_control *wbc);
+extern int __swap_writepage(struct page *page, struct writeback_control *wbc,
+			    void (*end_write_func)(struct bio *, int));
 extern int swap_set_page_dirty(struct page *page);
 extern void end_swap_bio_read(struct bio *bio, int err);
+extern void end_swap_bio_write(struct bio *bio, int err);
 
 int add_swap_extent(struct swap_info_struct *sis, unsigned long start_page,
 		unsigned long nr_pages, sector_t start_block);
@@ -335,6 +360,7 @@ extern struct address_space swapper_space;
 extern void show_swap_cache_info(void);
 extern int add_to_swap(struct page *);
 extern int add_to_swap_cache(struct page *, swp_entry_t, gfp_t);
+extern int __add_to_swap_cache(struct page *page, swp_entry_t entry);
 extern void __delete_from_swap_cache(struct page *);
 extern void delete_from_swap_cache(struct page *);
 extern void free_page_and_swap_cache(struct page *);
@@ -360,6 +386,8 @@ extern void swapcache_free(swp_entry_t, struct page *page);
 extern int free_swap_and_cache(swp_entry_t);
 extern int swap_type_of(dev_t, sector_t, struct block_device **);
 extern unsigned int count_swap_pages(int, int);
+extern void swap_readahead_window(swp_entry_t, unsigned long,
+				  unsigned long *, unsigned long *);
 extern sector_t map_swap_page(struct page *, struct block_device **);
 extern sector_t swapdev_block(int, pgoff_t);
 extern int page_swapcount(struct page *);
@@ -10,6 +10,7 @@
 #include <linux/bitops.h>
 #include <linux/lockdep.h>
 #include <linux/threads.h>
+#include <linux/numa.h>
 #include <linux/atomic.h>
 
 struct workqueue_struct;
@@ -54,9 +55,9 @@ enum {
 	WORK_NR_COLORS		= (1 << WORK_STRUCT_COLOR_BITS) - 1,
 	WORK_NO_COLOR		= WORK_NR_COLORS,
 
-	/* special cpu IDs */
+	/* special cpu IDs, the per node unbound gcwqs follow UNBOUND */
 	WORK_CPU_UNBOUND	= NR_CPUS,
-	WORK_CPU_NONE		= NR_CPUS + 1,
+	WORK_CPU_NONE		= NR_CPUS + 1 + MAX_NUMNODES,
 	WORK_CPU_LAST		= WORK_CPU_NONE,
 
 	/*
@@ -80,6 +81,9 @@ struct work_struct {
 	atomic_long_t data;
 	struct list_head entry;
 	work_func_t func;
+#ifdef CONFIG_PREEMPT_RT_FULL
+	int prio;		/* priority of the queuer, for WQ_RT */
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
@@ -254,9 +258,11 @@ enum {
 	WQ_MEM_RECLAIM		= 1 << 3, /* may be used for memory reclaim */
 	WQ_HIGHPRI		= 1 << 4, /* high priority */
 	WQ_CPU_INTENSIVE	= 1 << 5, /* cpu instensive workqueue */
+	WQ_RT			= 1 << 8, /* run works at the queuer's priority */
 
 	WQ_DRAINING		= 1 << 6, /* internal: workqueue is draining */
 	WQ_RESCUER		= 1 << 7, /* internal: workqueue has rescuer */
+	WQ_ORDERED		= 1 << 9, /* internal: unbound, max_active 1 */
 
 	WQ_MAX_ACTIVE		= 512,	  /* I like 512, better ideas? */
 	WQ_MAX_UNBOUND_PER_CPU	= 4,	  /* 4 * #cpus for unbound wq */
@@ -267,6 +273,19 @@ enum {
 #define WQ_UNBOUND_MAX_ACTIVE	\
 	max_t(int, WQ_MAX_ACTIVE, num_possible_cpus() * WQ_MAX_UNBOUND_PER_CPU)
 
+/*
+ * Affinity scopes of unbound workqueues: the works are served by the
+ * workers of the NUMA node of the cpu they were queued on, or by the
+ * workers of the whole system.  Ordered workqueues are always
+ * WQ_AFFN_SYSTEM.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_NUMA,
+	WQ_AFFN_SYSTEM,
+
+	WQ_AFFN_NR,
+};
+
 /*
  * System-wide workqueues which are always present.
  *
@@ -285,7 +304,8 @@ enum {
  * system_unbound_wq is unbound workqueue.  Workers are not bound to
  * any specific CPU, not concurrency managed, and all queued works are
  * executed immediately as long as max_active limit is not reached and
- * resources are available.
+ * resources are available.  On NUMA machines the works run on the node
+ * they were queued on.
  *
  * system_freezable_wq is equivalent to system_wq except that it's
  * freezable.
@@ -397,6 +417,8 @@ extern bool cancel_delayed_work_sync(struct delayed_work *dwork);
 
 extern void workqueue_set_max_active(struct workqueue_struct *wq,
 				     int max_active);
+extern int workqueue_set_affinity_scope(struct workqueue_struct *wq,
+					enum wq_affn_scope scope);
 extern bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq);
 extern unsigned int work_cpu(struct work_struct *work);
 extern unsigned int work_busy(struct work_struct *work);
@@ -237,6 +237,42 @@ TRACE_EVENT(rcu_fqs,
 		  __entry->cpu, __entry->qsevent)
 );
 
+/*
+ * Tracepoint for the end of an expedited grace period.  These trace
+ * events include the type of RCU, the expedited grace-period sequence
+ * number, the number of online CPUs, the number of CPUs that were
+ * disturbed by an IPI, and how many of those had to be rescheduled
+ * because the IPI hit a read-side critical section.  The other online
+ * CPUs were idle or in another extended quiescent state.
+ */
+TRACE_EVENT(rcu_exp_grace_period,
+
+	TP_PROTO(char *rcuname, unsigned long seq, int online, int ipis,
+		 int resched),
+
+	TP_ARGS(rcuname, seq, online, ipis, resched),
+
+	TP_STRUCT__entry(
+		__field(char *, rcuname)
+		__field(unsigned long, seq)
+		__field(int, online)
+		__field(int, ipis)
+		__field(int, resched)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname = rcuname;
+		__entry->seq = seq;
+		__entry->online = online;
+		__entry->ipis = ipis;
+		__entry->resched = resched;
+	),
+
+	TP_printk("%s %lu online=%d ipis=%d resched=%d",
+		  __entry->rcuname, __entry->seq, __entry->online,
+		  __entry->ipis, __entry->resched)
+);
+
 #endif /* #if defined(CONFIG_TREE_RCU) || defined(CONFIG_TREE_PREEMPT_RCU) */
 
 /*
@@ -596,6 +632,8 @@ TRACE_EVENT(rcu_barrier,
 					 grplo, grphi, gp_tasks) do { } \
 	while (0)
 #define trace_rcu_fqs(rcuname, gpnum, cpu, qsevent) do { } while (0)
+#define trace_rcu_exp_grace_period(rcuname, seq, online, ipis, resched) \
+	do { } while (0)
 #define trace_rcu_dyntick(polarity, oldnesting, newnesting) do { } while (0)
 #define trace_rcu_prep_idle(reason) do { } while (0)
 #define trace_rcu_callback(rcuname, rhp, qlen_lazy, qlen) do { } while (0)
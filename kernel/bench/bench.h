@@ -0,0 +1,35 @@
+#ifndef _KERNEL_BENCH_H
+#define _KERNEL_BENCH_H
+
+#include <linux/types.h>
+
+struct kernel_bench {
+	const char	*name;
+	/* Returns 0 or a negative errno, the results go to the kernel log */
+	int		(*run)(void);
+};
+
+/* Time lost to interruptions of a busy loop, see bench_measure_gaps() */
+struct bench_gaps {
+	unsigned long	nr;
+	u64		total;
+	u64		max;
+};
+
+extern int bench_run_thread(int cpu, int (*fn)(void *), void *arg,
+			    const char *name);
+extern void bench_wait_stop(void);
+extern void bench_measure_gaps(struct bench_gaps *gaps, int secs,
+			       u64 threshold_ns);
+
+extern int bench_rwlock(void);
+extern int bench_hrtimer(void);
+extern int bench_migrate(void);
+extern int bench_isolation(void);
+extern int bench_sched_balance(void);
+extern int bench_wq_flush(void);
+extern int bench_rt_push(void);
+extern int bench_wq_numa(void);
+extern int bench_timer(void);
+
+#endif /* _KERNEL_BENCH_H */
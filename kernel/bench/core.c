@@ -0,0 +1,168 @@
+/*
+ * Benchmarks of kernel internals
+ *
+ * All benchmarks run one after the other when the module is loaded and
+ * print their results to the kernel log. The tests= parameter selects a
+ * subset of them by name, e.g. "modprobe kernel_bench tests=hrtimer,timer";
+ * the parameters of each benchmark are prefixed with its name.
+ */
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "bench.h"
+
+static char *tests;
+module_param(tests, charp, 0444);
+MODULE_PARM_DESC(tests, "comma separated list of benchmarks to run (default: all)");
+
+static const struct kernel_bench benchmarks[] = {
+#ifdef CONFIG_PREEMPT_RT_FULL
+	{ "rwlock",	bench_rwlock },
+#endif
+	{ "hrtimer",	bench_hrtimer },
+	{ "migrate",	bench_migrate },
+#ifdef CONFIG_SMP
+	{ "isolation",	bench_isolation },
+#endif
+#ifdef CONFIG_SMP
+	{ "sched_balance",	bench_sched_balance },
+#endif
+	{ "wq_flush",	bench_wq_flush },
+#ifdef CONFIG_SMP
+	{ "rt_push",	bench_rt_push },
+#endif
+	{ "wq_numa",	bench_wq_numa },
+	{ "timer",	bench_timer },
+};
+
+struct bench_kthread {
+	struct completion	done;
+	int			(*fn)(void *);
+	void			*arg;
+	int			ret;
+};
+
+/* Park the calling kthread until kthread_stop() is called on it */
+void bench_wait_stop(void)
+{
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+}
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_kthread *bt = arg;
+
+	bt->ret = bt->fn(bt->arg);
+	complete(&bt->done);
+	bench_wait_stop();
+	return 0;
+}
+
+/*
+ * Run @fn(@arg) in a kthread bound to @cpu, or unbound if @cpu is
+ * negative, and return its return value.
+ */
+int bench_run_thread(int cpu, int (*fn)(void *), void *arg, const char *name)
+{
+	struct bench_kthread bt = { .fn = fn, .arg = arg };
+	struct task_struct *task;
+
+	init_completion(&bt.done);
+	task = kthread_create_on_node(bench_thread_fn, &bt,
+				      cpu < 0 ? -1 : cpu_to_node(cpu), name);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	if (cpu >= 0)
+		kthread_bind(task, cpu);
+	wake_up_process(task);
+	wait_for_completion(&bt.done);
+	kthread_stop(task);
+	return bt.ret;
+}
+
+/*
+ * Read local_clock() back to back for @secs seconds. A gap longer than
+ * @threshold_ns is time taken by an interrupt, a softirq or another
+ * task.
+ */
+void bench_measure_gaps(struct bench_gaps *gaps, int secs, u64 threshold_ns)
+{
+	u64 now, last, gap, end, resched;
+
+	last = local_clock();
+	end = last + (u64)secs * NSEC_PER_SEC;
+	resched = last + NSEC_PER_MSEC;
+
+	while (last < end && !kthread_should_stop()) {
+		now = local_clock();
+		gap = now - last;
+		if (gap > threshold_ns) {
+			gaps->nr++;
+			gaps->total += gap;
+			gaps->max = max(gaps->max, gap);
+		}
+		/* Let !PREEMPT kernels run other work, counts as a gap */
+		if (now > resched) {
+			cond_resched();
+			resched = now + NSEC_PER_MSEC;
+		}
+		last = now;
+	}
+}
+
+static bool bench_selected(const char *name)
+{
+	char *list, *p, *tok;
+	bool ret = false;
+
+	if (!tests || !*tests)
+		return true;
+
+	list = p = kstrdup(tests, GFP_KERNEL);
+	if (!list)
+		return false;
+	while ((tok = strsep(&p, ",")) != NULL) {
+		if (!strcmp(strim(tok), name)) {
+			ret = true;
+			break;
+		}
+	}
+	kfree(list);
+	return ret;
+}
+
+static int __init kernel_bench_init(void)
+{
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+		if (!bench_selected(benchmarks[i].name))
+			continue;
+		ret = benchmarks[i].run();
+		if (ret) {
+			pr_err("kernel_bench: %s failed: %d\n",
+			       benchmarks[i].name, ret);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static void __exit kernel_bench_exit(void)
+{
+}
+
+module_init(kernel_bench_init);
+module_exit(kernel_bench_exit);
+
+MODULE_DESCRIPTION("Benchmarks of kernel internals");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,190 @@
+/*
+ * hrtimer expiry stress test and benchmark
+ *
+ * Arms a large number of periodic hrtimers spread over the online
+ * cpus and measures how late their callbacks run relative to the
+ * programmed (soft) expiry time for hrtimer_run_time seconds.
+ *
+ * On PREEMPT_RT timers which are not irqsafe expire in the
+ * HRTIMER_SOFTIRQ, so by default this measures the softirq handoff.
+ * Load with hrtimer_irqsafe=1 to compare with expiry in hard interrupt
+ * context.
+ */
+#include <linux/hrtimer.h>
+#include <linux/cpu.h>
+#include <linux/delay.h>
+#include <linux/module.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/log2.h>
+
+#include "bench.h"
+
+/* Jitter histogram buckets: < 1us, < 2us, < 4us ... >= 2^(N-2) us */
+#define JITTER_BUCKETS	16
+
+static int nr_timers = 100000;
+module_param_named(hrtimer_nr_timers, nr_timers, int, 0444);
+MODULE_PARM_DESC(hrtimer_nr_timers, "# of active timers");
+
+static int period_us = 10000;
+module_param_named(hrtimer_period_us, period_us, int, 0444);
+MODULE_PARM_DESC(hrtimer_period_us, "timer period in usecs");
+
+static int run_time = 10;
+module_param_named(hrtimer_run_time, run_time, int, 0444);
+MODULE_PARM_DESC(hrtimer_run_time, "seconds per run");
+
+static bool irqsafe;
+module_param_named(hrtimer_irqsafe, irqsafe, bool, 0444);
+MODULE_PARM_DESC(hrtimer_irqsafe, "expire the timers in hard interrupt context (RT)");
+
+struct bench_timer {
+	struct hrtimer	timer;
+	u64		max_jitter;
+};
+
+struct bench_stats {
+	unsigned long	expiries;
+	u64		total_jitter;
+	unsigned long	hist[JITTER_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct bench_stats, bench_stats);
+
+static struct bench_timer *timers;
+static ktime_t period;
+static bool running;
+
+static enum hrtimer_restart bench_timer_fn(struct hrtimer *timer)
+{
+	struct bench_timer *bt = container_of(timer, struct bench_timer, timer);
+	ktime_t now = timer->base->get_time();
+	u64 jitter = 0;
+	int bucket;
+
+	if (now.tv64 > hrtimer_get_softexpires_tv64(timer))
+		jitter = now.tv64 - hrtimer_get_softexpires_tv64(timer);
+	if (jitter > bt->max_jitter)
+		bt->max_jitter = jitter;
+
+	bucket = jitter < NSEC_PER_USEC ? 0 :
+		 ilog2(jitter / NSEC_PER_USEC) + 1;
+	if (bucket >= JITTER_BUCKETS)
+		bucket = JITTER_BUCKETS - 1;
+
+	/* The callback can be preempted on RT, hence no __this_cpu ops */
+	this_cpu_inc(bench_stats.expiries);
+	this_cpu_add(bench_stats.total_jitter, jitter);
+	this_cpu_inc(bench_stats.hist[bucket]);
+
+	if (!ACCESS_ONCE(running))
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward(timer, now, period);
+	return HRTIMER_RESTART;
+}
+
+/*
+ * Distribute the timers round robin over the online cpus and stagger
+ * their expiry over one period. The thread migrates to each cpu in
+ * turn, as pinned timers are queued on the cpu which starts them.
+ */
+static void bench_start_timers(void)
+{
+	int nr_cpus, idx = 0, cpu, i;
+	ktime_t start;
+
+	get_online_cpus();
+	nr_cpus = num_online_cpus();
+	start = ktime_add(ktime_get(), period);
+	for_each_online_cpu(cpu) {
+		set_cpus_allowed_ptr(current, cpumask_of(cpu));
+		for (i = idx++; i < nr_timers; i += nr_cpus) {
+			u64 offs = div_u64((u64)ktime_to_ns(period) * i,
+					   nr_timers);
+
+			hrtimer_start(&timers[i].timer,
+				      ktime_add_ns(start, offs),
+				      HRTIMER_MODE_ABS_PINNED);
+			cond_resched();
+		}
+	}
+	set_cpus_allowed_ptr(current, cpu_all_mask);
+	put_online_cpus();
+}
+
+static void bench_report(void)
+{
+	unsigned long expiries = 0, hist[JITTER_BUCKETS] = { };
+	u64 total = 0, max = 0;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct bench_stats *st = &per_cpu(bench_stats, cpu);
+
+		expiries += st->expiries;
+		total += st->total_jitter;
+		for (i = 0; i < JITTER_BUCKETS; i++)
+			hist[i] += st->hist[i];
+	}
+	for (i = 0; i < nr_timers; i++)
+		max = max(max, timers[i].max_jitter);
+
+	pr_info("hrtimer_bench: %d timers (%s), period %d us: "
+		"%lu expiries/s, avg jitter %llu ns, max jitter %llu ns\n",
+		nr_timers, irqsafe ? "hardirq" : "softirq", period_us,
+		expiries / run_time,
+		expiries ? (unsigned long long)div64_u64(total, expiries) : 0,
+		(unsigned long long)max);
+	for (i = 0; i < JITTER_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		if (i == JITTER_BUCKETS - 1)
+			pr_info("hrtimer_bench:   >= %6u us: %lu\n",
+				1U << (i - 1), hist[i]);
+		else
+			pr_info("hrtimer_bench:    < %6u us: %lu\n",
+				1U << i, hist[i]);
+	}
+}
+
+static int hrtimer_bench_fn(void *arg)
+{
+	int i;
+
+	running = true;
+	bench_start_timers();
+
+	msleep(run_time * MSEC_PER_SEC);
+
+	running = false;
+	for (i = 0; i < nr_timers; i++)
+		hrtimer_cancel(&timers[i].timer);
+	bench_report();
+	return 0;
+}
+
+int bench_hrtimer(void)
+{
+	int i, ret;
+
+	if (nr_timers <= 0 || period_us <= 0 || run_time <= 0)
+		return -EINVAL;
+
+	timers = vzalloc(sizeof(*timers) * nr_timers);
+	if (!timers)
+		return -ENOMEM;
+
+	period = ns_to_ktime((u64)period_us * NSEC_PER_USEC);
+	for (i = 0; i < nr_timers; i++) {
+		hrtimer_init(&timers[i].timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_ABS_PINNED);
+		timers[i].timer.function = bench_timer_fn;
+		timers[i].timer.irqsafe = irqsafe;
+	}
+
+	ret = bench_run_thread(-1, hrtimer_bench_fn, NULL, "hrtimer_bench");
+	vfree(timers);
+	return ret;
+}
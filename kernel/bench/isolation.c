@@ -0,0 +1,126 @@
+/*
+ * CPU isolation jitter benchmark
+ *
+ * Runs bench_measure_gaps() in a kthread bound to each selected cpu
+ * for isolation_run_time seconds: every gap longer than
+ * isolation_threshold_ns means the loop got interrupted by an
+ * interrupt, a softirq or another task. The number of interruptions
+ * per second, the time lost per second and the longest gap are
+ * printed per cpu to the kernel log.
+ *
+ * By default the cpus isolated with "isolcpus=full," are measured, or
+ * all online cpus if there are none.
+ */
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+
+#include "bench.h"
+
+static char *cpus;
+module_param_named(isolation_cpus, cpus, charp, 0444);
+MODULE_PARM_DESC(isolation_cpus, "cpu list to measure (default: isolated cpus)");
+
+static int run_time = 10;
+module_param_named(isolation_run_time, run_time, int, 0444);
+MODULE_PARM_DESC(isolation_run_time, "seconds to measure");
+
+static int threshold_ns = 1000;
+module_param_named(isolation_threshold_ns, threshold_ns, int, 0444);
+MODULE_PARM_DESC(isolation_threshold_ns, "gap in ns which counts as interruption");
+
+struct jitter_thread {
+	struct task_struct	*task;
+	struct completion	done;
+	struct bench_gaps	gaps;
+};
+
+static int jitter_thread_fn(void *arg)
+{
+	struct jitter_thread *jt = arg;
+
+	bench_measure_gaps(&jt->gaps, run_time, threshold_ns);
+	complete(&jt->done);
+	bench_wait_stop();
+	return 0;
+}
+
+int bench_isolation(void)
+{
+	struct jitter_thread *threads;
+	cpumask_var_t mask;
+	int cpu, ret = 0;
+
+	if (run_time <= 0 || threshold_ns <= 0)
+		return -EINVAL;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	threads = kcalloc(nr_cpu_ids, sizeof(*threads), GFP_KERNEL);
+	if (!threads) {
+		ret = -ENOMEM;
+		goto out_mask;
+	}
+
+	get_online_cpus();
+	if (cpus) {
+		ret = cpulist_parse(cpus, mask);
+		if (ret)
+			goto out;
+	} else {
+		cpumask_andnot(mask, cpu_online_mask, housekeeping_cpumask());
+		if (cpumask_empty(mask))
+			cpumask_copy(mask, cpu_online_mask);
+	}
+	cpumask_and(mask, mask, cpu_online_mask);
+	if (cpumask_empty(mask)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for_each_cpu(cpu, mask) {
+		struct jitter_thread *jt = &threads[cpu];
+
+		init_completion(&jt->done);
+		jt->task = kthread_create_on_node(jitter_thread_fn, jt,
+						  cpu_to_node(cpu),
+						  "isol_jitter/%d", cpu);
+		if (IS_ERR(jt->task)) {
+			ret = PTR_ERR(jt->task);
+			jt->task = NULL;
+			goto out_stop;
+		}
+		kthread_bind(jt->task, cpu);
+	}
+
+	for_each_cpu(cpu, mask)
+		wake_up_process(threads[cpu].task);
+
+	for_each_cpu(cpu, mask) {
+		struct jitter_thread *jt = &threads[cpu];
+
+		wait_for_completion(&jt->done);
+		pr_info("isol_jitter: cpu%d: %lu interruptions/s, "
+			"%llu us/s interrupted, max %llu ns\n", cpu,
+			jt->gaps.nr / run_time,
+			(unsigned long long)div_u64(jt->gaps.total,
+						    run_time * NSEC_PER_USEC),
+			(unsigned long long)jt->gaps.max);
+	}
+
+out_stop:
+	for_each_cpu(cpu, mask) {
+		if (threads[cpu].task)
+			kthread_stop(threads[cpu].task);
+	}
+out:
+	put_online_cpus();
+	kfree(threads);
+out_mask:
+	free_cpumask_var(mask);
+	return ret;
+}
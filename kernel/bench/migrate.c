@@ -0,0 +1,123 @@
+/*
+ * migrate_disable()/migrate_enable() microbenchmark
+ *
+ * Measures the cost of a migrate_disable()/migrate_enable() pair, both
+ * as the outermost pair and nested inside another one, and of an
+ * uncontended spin_lock()/spin_unlock() pair, which on PREEMPT_RT_FULL
+ * is a sleeping lock calling migrate_disable(). Every case runs
+ * migrate_loops pairs, migrate_runs times; the best and the average
+ * run are printed to the kernel log in ns per pair. On !PREEMPT_RT_FULL kernels
+ * migrate_disable() is preempt_disable(), which gives the baseline.
+ */
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/preempt.h>
+#include <linux/sched.h>
+
+#include "bench.h"
+
+static int loops = 1000000;
+module_param_named(migrate_loops, loops, int, 0444);
+MODULE_PARM_DESC(migrate_loops, "# of lock/unlock pairs per run");
+
+static int runs = 5;
+module_param_named(migrate_runs, runs, int, 0444);
+MODULE_PARM_DESC(migrate_runs, "# of runs per case");
+
+static DEFINE_SPINLOCK(bench_outer_lock);
+static DEFINE_SPINLOCK(bench_lock);
+
+static void case_migrate(void)
+{
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		migrate_disable();
+		migrate_enable();
+	}
+}
+
+static void case_migrate_nested(void)
+{
+	int i;
+
+	migrate_disable();
+	for (i = 0; i < loops; i++) {
+		migrate_disable();
+		migrate_enable();
+	}
+	migrate_enable();
+}
+
+static void case_spinlock(void)
+{
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		spin_lock(&bench_lock);
+		spin_unlock(&bench_lock);
+	}
+}
+
+static void case_spinlock_nested(void)
+{
+	int i;
+
+	spin_lock(&bench_outer_lock);
+	for (i = 0; i < loops; i++) {
+		spin_lock(&bench_lock);
+		spin_unlock(&bench_lock);
+	}
+	spin_unlock(&bench_outer_lock);
+}
+
+static const struct {
+	const char	*name;
+	void		(*fn)(void);
+} bench_cases[] = {
+	{ "migrate_disable/enable",		case_migrate },
+	{ "migrate_disable/enable nested",	case_migrate_nested },
+	{ "spin_lock/unlock",			case_spinlock },
+	{ "spin_lock/unlock nested",		case_spinlock_nested },
+};
+
+/* Run one case and return the time per pair in units of 0.1ns */
+static u64 bench_run(void (*fn)(void))
+{
+	u64 start, delta;
+
+	start = local_clock();
+	fn();
+	delta = local_clock() - start;
+	cond_resched();
+
+	return div_u64(delta * 10, loops);
+}
+
+int bench_migrate(void)
+{
+	int i, r;
+
+	if (loops <= 0 || runs <= 0)
+		return -EINVAL;
+
+	for (i = 0; i < ARRAY_SIZE(bench_cases); i++) {
+		u64 t, best = ~0ULL, total = 0, best_ns, avg_ns;
+		u32 best_rem, avg_rem;
+
+		for (r = 0; r < runs; r++) {
+			t = bench_run(bench_cases[i].fn);
+			best = min(best, t);
+			total += t;
+		}
+		total = div_u64(total, runs);
+
+		best_ns = div_u64_rem(best, 10, &best_rem);
+		avg_ns = div_u64_rem(total, 10, &avg_rem);
+		pr_info("migrate_bench: %-30s best %llu.%u ns, avg %llu.%u ns per pair\n",
+			bench_cases[i].name,
+			(unsigned long long)best_ns, best_rem,
+			(unsigned long long)avg_ns, avg_rem);
+	}
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * RT push/pull benchmark
+ *
+ * Many unbound SCHED_FIFO kthreads at different priorities (4 per cpu
+ * by default) sleep until their next period and run a short busy
+ * burst. The periods of the threads are staggered, so the cpus keep
+ * getting RT overloaded and dropping their priority again when a
+ * thread goes to sleep, i.e. the RT class keeps pushing and pulling.
+ *
+ * The number of migrations per second and the average and maximum
+ * delay between the programmed wakeup and the thread running
+ * (wake-to-run latency) are printed to the kernel log, overall and for
+ * the threads of the highest priority.
+ *
+ * Compare the results with and without the RT_PUSH_IPI scheduler
+ * feature (echo NO_RT_PUSH_IPI > /sys/kernel/debug/sched_features),
+ * and the rq->lock contention in /proc/lock_stat with LOCK_STAT.
+ */
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#include "bench.h"
+
+static int threads;
+module_param_named(rt_push_threads, threads, int, 0444);
+MODULE_PARM_DESC(rt_push_threads, "# of RT threads (default: 4 per cpu)");
+
+static int prio_levels = 8;
+module_param_named(rt_push_prio_levels, prio_levels, int, 0444);
+MODULE_PARM_DESC(rt_push_prio_levels, "# of different SCHED_FIFO priorities");
+
+static int base_prio = 10;
+module_param_named(rt_push_base_prio, base_prio, int, 0444);
+MODULE_PARM_DESC(rt_push_base_prio, "lowest SCHED_FIFO priority used");
+
+static int period_us = 1000;
+module_param_named(rt_push_period_us, period_us, int, 0444);
+MODULE_PARM_DESC(rt_push_period_us, "wakeup period of each thread in usecs");
+
+static int run_us = 150;
+module_param_named(rt_push_run_us, run_us, int, 0444);
+MODULE_PARM_DESC(rt_push_run_us, "busy time after each wakeup in usecs");
+
+static int loops = 2000;
+module_param_named(rt_push_loops, loops, int, 0444);
+MODULE_PARM_DESC(rt_push_loops, "# of wakeups per thread");
+
+struct push_thread {
+	struct task_struct	*task;
+	struct completion	done;
+	ktime_t			start;
+	int			prio;
+	u64			migrations;
+	u64			lat_total;
+	u64			lat_max;
+};
+
+static int push_thread_fn(void *arg)
+{
+	struct push_thread *pt = arg;
+	struct sched_param param = { .sched_priority = pt->prio };
+	ktime_t target = pt->start, now, end;
+	u64 migrations;
+	s64 lat;
+	int i;
+
+	sched_setscheduler_nocheck(current, SCHED_FIFO, &param);
+	migrations = current->se.nr_migrations;
+
+	for (i = 0; i < loops; i++) {
+		target = ktime_add_us(target, period_us);
+
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout_range(&target, 0, HRTIMER_MODE_ABS);
+
+		now = ktime_get();
+		lat = ktime_to_ns(ktime_sub(now, target));
+		if (lat > 0) {
+			pt->lat_total += lat;
+			pt->lat_max = max_t(u64, pt->lat_max, lat);
+		}
+
+		end = ktime_add_us(now, run_us);
+		while (ktime_to_ns(ktime_sub(end, ktime_get())) > 0)
+			cpu_relax();
+	}
+	pt->migrations = current->se.nr_migrations - migrations;
+	complete(&pt->done);
+	bench_wait_stop();
+	return 0;
+}
+
+int bench_rt_push(void)
+{
+	struct push_thread *pt;
+	u64 migrations = 0, lat_total = 0, lat_max = 0;
+	u64 top_total = 0, top_max = 0;
+	int i, nr_top = 0, top_prio, ret = 0;
+	ktime_t start;
+	s64 elapsed;
+
+	if (!threads)
+		threads = 4 * num_online_cpus();
+
+	if (threads <= 0 || prio_levels <= 0 || base_prio <= 0 ||
+	    base_prio + prio_levels > MAX_USER_RT_PRIO || period_us <= 0 ||
+	    run_us < 0 || loops <= 0)
+		return -EINVAL;
+
+	pt = kcalloc(threads, sizeof(*pt), GFP_KERNEL);
+	if (!pt)
+		return -ENOMEM;
+
+	top_prio = base_prio + min(prio_levels, threads) - 1;
+	for (i = 0; i < threads; i++) {
+		init_completion(&pt[i].done);
+		pt[i].prio = base_prio + i % prio_levels;
+		pt[i].task = kthread_create(push_thread_fn, &pt[i],
+					    "rt_push/%d", i);
+		if (IS_ERR(pt[i].task)) {
+			ret = PTR_ERR(pt[i].task);
+			pt[i].task = NULL;
+			goto out_stop;
+		}
+	}
+
+	/* Stagger the periods, the first wakeup is one period away */
+	start = ktime_get();
+	for (i = 0; i < threads; i++) {
+		pt[i].start = ktime_add_ns(start,
+				div_u64((u64)i * period_us * NSEC_PER_USEC,
+					threads));
+		wake_up_process(pt[i].task);
+	}
+	for (i = 0; i < threads; i++)
+		wait_for_completion(&pt[i].done);
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < threads; i++) {
+		migrations += pt[i].migrations;
+		lat_total += pt[i].lat_total;
+		lat_max = max(lat_max, pt[i].lat_max);
+		if (pt[i].prio == top_prio) {
+			nr_top++;
+			top_total += pt[i].lat_total;
+			top_max = max(top_max, pt[i].lat_max);
+		}
+	}
+
+	pr_info("rt_push: %d threads on %d cpus, %d us every %d us, "
+		"%llu migrations/s\n", threads, num_online_cpus(), run_us,
+		period_us, div64_u64(migrations * NSEC_PER_SEC, elapsed));
+	pr_info("rt_push: wake-to-run all: avg %llu us, max %llu us, "
+		"prio %d: avg %llu us, max %llu us\n",
+		div64_u64(lat_total, (u64)threads * loops * NSEC_PER_USEC),
+		div64_u64(lat_max, NSEC_PER_USEC), top_prio,
+		div64_u64(top_total, (u64)nr_top * loops * NSEC_PER_USEC),
+		div64_u64(top_max, NSEC_PER_USEC));
+out_stop:
+	for (i = 0; i < threads; i++) {
+		if (pt[i].task)
+			kthread_stop(pt[i].task);
+	}
+	kfree(pt);
+	return ret;
+}
@@ -0,0 +1,200 @@
+/*
+ * Lock contention benchmark for the PREEMPT_RT_FULL rwlock_t and
+ * rw_semaphore implementation
+ *
+ * Every run starts reader threads bound round-robin to the online
+ * CPUs and writer threads which take the lock every write_delay
+ * milliseconds. The "single" runs let the readers take the write
+ * side, which is how RT serialized readers before it allowed
+ * multiple of them; the "multi" runs use the read side and thus
+ * the rwlock_reader_limit sysctl.
+ */
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/rwsem.h>
+#include <linux/delay.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#include "bench.h"
+
+static int readers;
+module_param_named(rwlock_readers, readers, int, 0444);
+MODULE_PARM_DESC(rwlock_readers, "# of reader threads (default: # of online cpus)");
+
+static int writers = 1;
+module_param_named(rwlock_writers, writers, int, 0444);
+MODULE_PARM_DESC(rwlock_writers, "# of writer threads");
+
+static int run_time = 5;
+module_param_named(rwlock_run_time, run_time, int, 0444);
+MODULE_PARM_DESC(rwlock_run_time, "seconds per run");
+
+static int read_hold = 2;
+module_param_named(rwlock_read_hold, read_hold, int, 0444);
+MODULE_PARM_DESC(rwlock_read_hold, "usecs a reader holds the lock");
+
+static int write_hold = 2;
+module_param_named(rwlock_write_hold, write_hold, int, 0444);
+MODULE_PARM_DESC(rwlock_write_hold, "usecs a writer holds the lock");
+
+static int write_delay = 1;
+module_param_named(rwlock_write_delay, write_delay, int, 0444);
+MODULE_PARM_DESC(rwlock_write_delay, "msecs a writer sleeps between locks");
+
+enum bench_lock_type {
+	BENCH_RWLOCK,
+	BENCH_RWSEM,
+};
+
+static DEFINE_RWLOCK(test_rwlock);
+static DECLARE_RWSEM(test_rwsem);
+
+struct bench_thread {
+	struct task_struct	*task;
+	enum bench_lock_type	type;
+	bool			writer;
+	bool			exclusive;
+	unsigned long		ops;
+	u64			max_wait;
+};
+
+static void bench_lock(struct bench_thread *bt, bool excl)
+{
+	if (bt->type == BENCH_RWLOCK) {
+		if (excl)
+			write_lock(&test_rwlock);
+		else
+			read_lock(&test_rwlock);
+	} else {
+		if (excl)
+			down_write(&test_rwsem);
+		else
+			down_read(&test_rwsem);
+	}
+}
+
+static void bench_unlock(struct bench_thread *bt, bool excl)
+{
+	if (bt->type == BENCH_RWLOCK) {
+		if (excl)
+			write_unlock(&test_rwlock);
+		else
+			read_unlock(&test_rwlock);
+	} else {
+		if (excl)
+			up_write(&test_rwsem);
+		else
+			up_read(&test_rwsem);
+	}
+}
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	bool excl = bt->writer || bt->exclusive;
+	u64 start, wait;
+
+	while (!kthread_should_stop()) {
+		start = local_clock();
+		bench_lock(bt, excl);
+		wait = local_clock() - start;
+		udelay(bt->writer ? write_hold : read_hold);
+		bench_unlock(bt, excl);
+
+		bt->ops++;
+		if (wait > bt->max_wait)
+			bt->max_wait = wait;
+
+		if (bt->writer)
+			msleep(write_delay);
+		else
+			cond_resched();
+	}
+	return 0;
+}
+
+static int bench_run(struct bench_thread *threads, enum bench_lock_type type,
+		     bool exclusive)
+{
+	unsigned long rops = 0, wops = 0;
+	u64 rwait = 0, wwait = 0;
+	int i, cpu = -1, nr = readers + writers;
+
+	memset(threads, 0, sizeof(*threads) * nr);
+
+	for (i = 0; i < nr; i++) {
+		struct bench_thread *bt = &threads[i];
+
+		bt->type = type;
+		bt->writer = i >= readers;
+		bt->exclusive = exclusive;
+		bt->task = kthread_create(bench_thread_fn, bt, "rwlock_bench/%d", i);
+		if (IS_ERR(bt->task)) {
+			int ret = PTR_ERR(bt->task);
+
+			while (--i >= 0)
+				kthread_stop(threads[i].task);
+			return ret;
+		}
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		kthread_bind(bt->task, cpu);
+	}
+
+	for (i = 0; i < nr; i++)
+		wake_up_process(threads[i].task);
+
+	msleep(run_time * MSEC_PER_SEC);
+
+	for (i = 0; i < nr; i++) {
+		struct bench_thread *bt = &threads[i];
+
+		kthread_stop(bt->task);
+		if (bt->writer) {
+			wops += bt->ops;
+			wwait = max(wwait, bt->max_wait);
+		} else {
+			rops += bt->ops;
+			rwait = max(rwait, bt->max_wait);
+		}
+	}
+
+	pr_info("rwlock_bench: %s %s: %lu reads/s %lu writes/s, "
+		"max read wait %llu ns, max write wait %llu ns\n",
+		type == BENCH_RWLOCK ? "rwlock_t" : "rw_semaphore",
+		exclusive ? "single" : "multi",
+		rops / run_time, wops / run_time,
+		(unsigned long long)rwait, (unsigned long long)wwait);
+	return 0;
+}
+
+int bench_rwlock(void)
+{
+	struct bench_thread *threads;
+	int ret = 0;
+
+	if (readers <= 0)
+		readers = num_online_cpus();
+	if (writers < 0 || run_time <= 0)
+		return -EINVAL;
+
+	threads = kcalloc(readers + writers, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	pr_info("rwlock_bench: %d readers, %d writers\n", readers, writers);
+
+	ret = bench_run(threads, BENCH_RWLOCK, true);
+	if (!ret)
+		ret = bench_run(threads, BENCH_RWLOCK, false);
+	if (!ret)
+		ret = bench_run(threads, BENCH_RWSEM, true);
+	if (!ret)
+		ret = bench_run(threads, BENCH_RWSEM, false);
+
+	kfree(threads);
+	return ret;
+}
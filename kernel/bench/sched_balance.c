@@ -0,0 +1,322 @@
+/*
+ * CFS load balancing benchmark
+ *
+ * Runs two workloads with unbound kthreads and reports how often the
+ * scheduler migrated them and how quickly woken threads got to run:
+ *
+ * 1) hackbench: groups of senders and receivers pass messages through
+ *    a shallow per group pipe, every message is a wakeup. Prints the
+ *    message rate and the migrations per second.
+ * 2) bursty: threads sleep until the same absolute time every period
+ *    and then run a short busy burst, so all of them wake up at once
+ *    and have to be spread over the cpus quickly. Prints the
+ *    migrations per second and the average and maximum delay between
+ *    the programmed wakeup and the thread running (wake-to-run
+ *    latency).
+ *
+ * The migrations are counted with se.nr_migrations of the benchmark
+ * threads, the results go to the kernel log.
+ */
+#include <linux/completion.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+
+#include "bench.h"
+
+static int groups = 10;
+module_param_named(sched_balance_groups, groups, int, 0444);
+MODULE_PARM_DESC(sched_balance_groups, "# of hackbench groups");
+
+static int group_size = 20;
+module_param_named(sched_balance_group_size, group_size, int, 0444);
+MODULE_PARM_DESC(sched_balance_group_size, "# of senders and of receivers per group");
+
+static int messages = 1000;
+module_param_named(sched_balance_messages, messages, int, 0444);
+MODULE_PARM_DESC(sched_balance_messages, "# of messages per sender");
+
+static int pipe_depth = 16;
+module_param_named(sched_balance_pipe_depth, pipe_depth, int, 0444);
+MODULE_PARM_DESC(sched_balance_pipe_depth, "# of messages a group's pipe can hold");
+
+static int bursty_threads;
+module_param_named(sched_balance_bursty_threads, bursty_threads, int, 0444);
+MODULE_PARM_DESC(sched_balance_bursty_threads, "# of bursty threads (default: 2 per cpu)");
+
+static int period_us = 10000;
+module_param_named(sched_balance_period_us, period_us, int, 0444);
+MODULE_PARM_DESC(sched_balance_period_us, "bursty wakeup period in usecs");
+
+static int burst_us = 2000;
+module_param_named(sched_balance_burst_us, burst_us, int, 0444);
+MODULE_PARM_DESC(sched_balance_burst_us, "busy time after each wakeup in usecs");
+
+static int bursts = 500;
+module_param_named(sched_balance_bursts, bursts, int, 0444);
+MODULE_PARM_DESC(sched_balance_bursts, "# of wakeups per bursty thread");
+
+struct balance_group {
+	spinlock_t		lock;
+	wait_queue_head_t	data;
+	wait_queue_head_t	space;
+	unsigned int		pending;
+	unsigned long		to_receive;
+};
+
+struct balance_thread {
+	struct task_struct	*task;
+	struct completion	done;
+	void			(*work)(struct balance_thread *bt);
+	struct balance_group	*group;
+	ktime_t			start;
+	u64			migrations;
+	u64			lat_total;
+	u64			lat_max;
+};
+
+static bool group_send(struct balance_group *g)
+{
+	bool sent = false;
+
+	spin_lock(&g->lock);
+	if (g->pending < pipe_depth) {
+		g->pending++;
+		sent = true;
+	}
+	spin_unlock(&g->lock);
+	return sent;
+}
+
+static bool group_receive(struct balance_group *g, bool *done)
+{
+	bool received = false;
+
+	spin_lock(&g->lock);
+	if (!g->to_receive) {
+		*done = true;
+		received = true;
+	} else if (g->pending) {
+		g->pending--;
+		g->to_receive--;
+		*done = !g->to_receive;
+		received = true;
+	}
+	spin_unlock(&g->lock);
+	return received;
+}
+
+static void sender_work(struct balance_thread *bt)
+{
+	struct balance_group *g = bt->group;
+	int i;
+
+	for (i = 0; i < messages; i++) {
+		wait_event(g->space, group_send(g));
+		wake_up(&g->data);
+	}
+}
+
+static void receiver_work(struct balance_thread *bt)
+{
+	struct balance_group *g = bt->group;
+	bool done = false;
+
+	while (!done) {
+		wait_event(g->data, group_receive(g, &done));
+		wake_up(&g->space);
+	}
+	/* The last message is gone, release the other receivers */
+	wake_up_all(&g->data);
+}
+
+static void bursty_work(struct balance_thread *bt)
+{
+	ktime_t target = bt->start, now, end;
+	s64 lat;
+	int i;
+
+	for (i = 0; i < bursts; i++) {
+		target = ktime_add_us(target, period_us);
+
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout_range(&target, 0, HRTIMER_MODE_ABS);
+
+		now = ktime_get();
+		lat = ktime_to_ns(ktime_sub(now, target));
+		if (lat > 0) {
+			bt->lat_total += lat;
+			bt->lat_max = max_t(u64, bt->lat_max, lat);
+		}
+
+		end = ktime_add_us(now, burst_us);
+		while (ktime_to_ns(ktime_sub(end, ktime_get())) > 0)
+			cond_resched();
+	}
+}
+
+static int balance_thread_fn(void *arg)
+{
+	struct balance_thread *bt = arg;
+	u64 migrations = current->se.nr_migrations;
+
+	bt->work(bt);
+	bt->migrations = current->se.nr_migrations - migrations;
+	complete(&bt->done);
+	bench_wait_stop();
+	return 0;
+}
+
+/*
+ * Start nr threads, wait for all of them to finish their work and
+ * return the elapsed time in ns, or a negative error code.
+ */
+static s64 balance_run(struct balance_thread *threads, int nr)
+{
+	ktime_t start;
+	s64 ret;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct balance_thread *bt = &threads[i];
+
+		init_completion(&bt->done);
+		bt->task = kthread_create(balance_thread_fn, bt,
+					  "sched_balance/%d", i);
+		if (IS_ERR(bt->task)) {
+			ret = PTR_ERR(bt->task);
+			bt->task = NULL;
+			goto out_stop;
+		}
+	}
+
+	start = ktime_get();
+	for (i = 0; i < nr; i++) {
+		threads[i].start = start;
+		wake_up_process(threads[i].task);
+	}
+	for (i = 0; i < nr; i++)
+		wait_for_completion(&threads[i].done);
+	ret = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+out_stop:
+	for (i = 0; i < nr; i++) {
+		if (threads[i].task)
+			kthread_stop(threads[i].task);
+	}
+	return ret;
+}
+
+static u64 balance_migrations(struct balance_thread *threads, int nr)
+{
+	u64 migrations = 0;
+	int i;
+
+	for (i = 0; i < nr; i++)
+		migrations += threads[i].migrations;
+	return migrations;
+}
+
+static int balance_hackbench(void)
+{
+	struct balance_thread *threads;
+	struct balance_group *group;
+	int g, i, nr = groups * group_size * 2;
+	u64 migrations;
+	s64 elapsed;
+
+	group = kcalloc(groups, sizeof(*group), GFP_KERNEL);
+	threads = kcalloc(nr, sizeof(*threads), GFP_KERNEL);
+	if (!group || !threads) {
+		elapsed = -ENOMEM;
+		goto out;
+	}
+
+	for (g = 0; g < groups; g++) {
+		spin_lock_init(&group[g].lock);
+		init_waitqueue_head(&group[g].data);
+		init_waitqueue_head(&group[g].space);
+		group[g].to_receive = (unsigned long)group_size * messages;
+
+		for (i = 0; i < group_size * 2; i++) {
+			struct balance_thread *bt;
+
+			bt = &threads[g * group_size * 2 + i];
+
+			bt->group = &group[g];
+			bt->work = i < group_size ? sender_work : receiver_work;
+		}
+	}
+
+	elapsed = balance_run(threads, nr);
+	if (elapsed <= 0)
+		goto out;
+
+	migrations = balance_migrations(threads, nr);
+	pr_info("sched_balance: hackbench: %d groups of %d senders/receivers, "
+		"%llu msgs/s, %llu migrations/s, %llu ms\n", groups, group_size,
+		div64_u64((u64)groups * group_size * messages * NSEC_PER_SEC,
+			  elapsed),
+		div64_u64(migrations * NSEC_PER_SEC, elapsed),
+		div64_u64(elapsed, NSEC_PER_MSEC));
+out:
+	kfree(threads);
+	kfree(group);
+	return elapsed < 0 ? elapsed : 0;
+}
+
+static int balance_bursty(void)
+{
+	struct balance_thread *threads;
+	int i, nr = bursty_threads;
+	u64 migrations, lat_total = 0, lat_max = 0;
+	s64 elapsed;
+
+	threads = kcalloc(nr, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++)
+		threads[i].work = bursty_work;
+
+	elapsed = balance_run(threads, nr);
+	if (elapsed <= 0)
+		goto out;
+
+	for (i = 0; i < nr; i++) {
+		lat_total += threads[i].lat_total;
+		lat_max = max(lat_max, threads[i].lat_max);
+	}
+	migrations = balance_migrations(threads, nr);
+	pr_info("sched_balance: bursty: %d threads, %d us burst every %d us, "
+		"%llu migrations/s, wake-to-run avg %llu us, max %llu us\n",
+		nr, burst_us, period_us,
+		div64_u64(migrations * NSEC_PER_SEC, elapsed),
+		div64_u64(lat_total, (u64)nr * bursts * NSEC_PER_USEC),
+		div64_u64(lat_max, NSEC_PER_USEC));
+out:
+	kfree(threads);
+	return elapsed < 0 ? elapsed : 0;
+}
+
+int bench_sched_balance(void)
+{
+	int ret;
+
+	if (!bursty_threads)
+		bursty_threads = 2 * num_online_cpus();
+
+	if (groups <= 0 || group_size <= 0 || messages <= 0 ||
+	    pipe_depth <= 0 || bursty_threads <= 0 || period_us <= 0 ||
+	    burst_us < 0 || bursts <= 0)
+		return -EINVAL;
+
+	ret = balance_hackbench();
+	if (ret)
+		return ret;
+
+	return balance_bursty();
+}
@@ -0,0 +1,156 @@
+/*
+ * Timer wheel benchmark
+ *
+ * A kthread bound to one cpu arms a large number of timers on that cpu
+ * with timeouts spread evenly between timer_min_ms and timer_max_ms,
+ * like the retransmit and keepalive timers of many TCP connections, and
+ * cancels them again. The cost of an arm (mod_timer_pinned()) and of a
+ * cancel (del_timer()) are printed to the kernel log.
+ *
+ * The tick processing time is measured with bench_measure_gaps() for
+ * timer_run_time seconds before arming the timers and while they are
+ * pending. The time lost per second and the longest gap are printed for
+ * both runs, the difference is what the pending timers cost the tick.
+ *
+ * The default timer_run_time covers 16384 jiffies at HZ=1000: a
+ * cascading timer wheel re-sorts all timers due within the next 16384
+ * jiffies once in that period, in one tick.
+ */
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/vmalloc.h>
+
+#include "bench.h"
+
+static int cpu;
+module_param_named(timer_cpu, cpu, int, 0444);
+MODULE_PARM_DESC(timer_cpu, "cpu the timers are armed on");
+
+static int timers = 1000000;
+module_param_named(timer_timers, timers, int, 0444);
+MODULE_PARM_DESC(timer_timers, "# of timers armed");
+
+static int min_ms = 30000;
+module_param_named(timer_min_ms, min_ms, int, 0444);
+MODULE_PARM_DESC(timer_min_ms, "shortest timeout in msecs");
+
+static int max_ms = 120000;
+module_param_named(timer_max_ms, max_ms, int, 0444);
+MODULE_PARM_DESC(timer_max_ms, "longest timeout in msecs");
+
+static int run_time = 20;
+module_param_named(timer_run_time, run_time, int, 0444);
+MODULE_PARM_DESC(timer_run_time, "seconds to measure the tick for");
+
+static int threshold_ns = 1000;
+module_param_named(timer_threshold_ns, threshold_ns, int, 0444);
+MODULE_PARM_DESC(timer_threshold_ns, "gap in ns which counts as interruption");
+
+struct wheel_bench {
+	struct timer_list	*timers;
+	struct bench_gaps	empty;
+	struct bench_gaps	loaded;
+	u64			arm_ns;
+	u64			cancel_ns;
+	int			nr_cancelled;
+};
+
+static atomic_t nr_expired;
+
+static void bench_timer_fn(unsigned long data)
+{
+	atomic_inc(&nr_expired);
+}
+
+static void arm_timers(struct wheel_bench *wb)
+{
+	u32 range = max_ms - min_ms + 1;
+	u64 start;
+	int i;
+
+	start = local_clock();
+	for (i = 0; i < timers; i++) {
+		unsigned long timeout = min_ms + random32() % range;
+
+		mod_timer_pinned(&wb->timers[i],
+				 jiffies + msecs_to_jiffies(timeout));
+		if (!(i & 1023))
+			cond_resched();
+	}
+	wb->arm_ns = local_clock() - start;
+}
+
+static void cancel_timers(struct wheel_bench *wb)
+{
+	u64 start;
+	int i;
+
+	start = local_clock();
+	for (i = 0; i < timers; i++) {
+		if (del_timer(&wb->timers[i]))
+			wb->nr_cancelled++;
+		if (!(i & 1023))
+			cond_resched();
+	}
+	wb->cancel_ns = local_clock() - start;
+}
+
+static int wheel_bench_fn(void *arg)
+{
+	struct wheel_bench *wb = arg;
+
+	bench_measure_gaps(&wb->empty, run_time, threshold_ns);
+	arm_timers(wb);
+	bench_measure_gaps(&wb->loaded, run_time, threshold_ns);
+	cancel_timers(wb);
+	return 0;
+}
+
+static void print_tick_stats(const char *name, struct bench_gaps *ts)
+{
+	pr_info("timer_wheel_bench: tick %s: %lu interruptions/s, "
+		"%llu us/s interrupted, max %llu us\n", name,
+		ts->nr / run_time,
+		(unsigned long long)div_u64(ts->total,
+					    run_time * NSEC_PER_USEC),
+		(unsigned long long)div_u64(ts->max, NSEC_PER_USEC));
+}
+
+int bench_timer(void)
+{
+	struct wheel_bench wb = { };
+	int i, ret;
+
+	if (timers <= 0 || min_ms < 0 || max_ms < min_ms || run_time <= 0 ||
+	    threshold_ns <= 0 || cpu < 0 || cpu >= nr_cpu_ids ||
+	    !cpu_online(cpu))
+		return -EINVAL;
+
+	wb.timers = vmalloc(timers * sizeof(*wb.timers));
+	if (!wb.timers)
+		return -ENOMEM;
+	for (i = 0; i < timers; i++)
+		setup_timer(&wb.timers[i], bench_timer_fn, 0);
+	atomic_set(&nr_expired, 0);
+
+	ret = bench_run_thread(cpu, wheel_bench_fn, &wb, "timer_wheel_bench");
+	if (ret)
+		goto out_free;
+
+	/* A timer which expired may still be running its callback */
+	for (i = 0; i < timers; i++)
+		del_timer_sync(&wb.timers[i]);
+
+	pr_info("timer_wheel_bench: cpu%d: %d timers of %d-%d ms, "
+		"arm %llu ns, cancel %llu ns, %d expired, %d cancelled\n",
+		cpu, timers, min_ms, max_ms,
+		div64_u64(wb.arm_ns, timers), div64_u64(wb.cancel_ns, timers),
+		atomic_read(&nr_expired), wb.nr_cancelled);
+	print_tick_stats("without timers", &wb.empty);
+	print_tick_stats("with timers", &wb.loaded);
+out_free:
+	vfree(wb.timers);
+	return ret;
+}
@@ -0,0 +1,178 @@
+/*
+ * Workqueue flush latency benchmark
+ *
+ * A SCHED_FIFO thread queues a short work item every wq_flush_period_us
+ * and waits for it with flush_work(), while bulk work items keep the
+ * same workqueue busy on all online cpus like a background writeback
+ * load: each of them spins for wq_flush_bulk_us and requeues itself.
+ * The average and maximum time from queueing the item to flush_work()
+ * returning are printed to the kernel log, once for a normal workqueue
+ * and once for a WQ_RT one.
+ *
+ * On a normal workqueue the item queues up behind the bulk items of the
+ * cpu, on a WQ_RT workqueue it goes in front of them and is run at the
+ * priority of the flusher.  Without PREEMPT_RT_FULL WQ_RT falls back to
+ * WQ_HIGHPRI.
+ */
+#include <linux/cpu.h>
+#include <linux/hrtimer.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "bench.h"
+
+static int cpu;
+module_param_named(wq_flush_cpu, cpu, int, 0444);
+MODULE_PARM_DESC(wq_flush_cpu, "cpu the flusher runs on");
+
+static int flush_prio = 50;
+module_param_named(wq_flush_flush_prio, flush_prio, int, 0444);
+MODULE_PARM_DESC(wq_flush_flush_prio, "SCHED_FIFO priority of the flusher");
+
+static int flushes = 1000;
+module_param_named(wq_flush_flushes, flushes, int, 0444);
+MODULE_PARM_DESC(wq_flush_flushes, "# of flushed work items per run");
+
+static int period_us = 1000;
+module_param_named(wq_flush_period_us, period_us, int, 0444);
+MODULE_PARM_DESC(wq_flush_period_us, "usecs between two flushed work items");
+
+static int bulk_items = 4;
+module_param_named(wq_flush_bulk_items, bulk_items, int, 0444);
+MODULE_PARM_DESC(wq_flush_bulk_items, "# of bulk work items per cpu");
+
+static int bulk_us = 1000;
+module_param_named(wq_flush_bulk_us, bulk_us, int, 0444);
+MODULE_PARM_DESC(wq_flush_bulk_us, "usecs a bulk work item runs");
+
+struct bulk_work {
+	struct work_struct	work;
+	struct workqueue_struct	*wq;
+	int			cpu;
+};
+
+struct flush_bench {
+	struct workqueue_struct	*wq;
+	struct work_struct	work;
+	u64			lat_total;
+	u64			lat_max;
+};
+
+static bool bulk_stop;
+
+static void bulk_work_fn(struct work_struct *work)
+{
+	struct bulk_work *bw = container_of(work, struct bulk_work, work);
+	ktime_t end = ktime_add_us(ktime_get(), bulk_us);
+
+	while (ktime_to_ns(ktime_sub(end, ktime_get())) > 0)
+		cond_resched();
+
+	if (!ACCESS_ONCE(bulk_stop))
+		queue_work_on(bw->cpu, bw->wq, &bw->work);
+}
+
+static void flush_work_fn(struct work_struct *work)
+{
+}
+
+static int flush_thread_fn(void *arg)
+{
+	struct sched_param param = { .sched_priority = flush_prio };
+	struct flush_bench *fb = arg;
+	ktime_t next = ktime_get();
+	int i;
+
+	sched_setscheduler_nocheck(current, SCHED_FIFO, &param);
+
+	for (i = 0; i < flushes; i++) {
+		ktime_t start;
+		u64 lat;
+
+		next = ktime_add_us(next, period_us);
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+
+		start = ktime_get();
+		queue_work_on(cpu, fb->wq, &fb->work);
+		flush_work(&fb->work);
+		lat = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		fb->lat_total += lat;
+		fb->lat_max = max(fb->lat_max, lat);
+	}
+	return 0;
+}
+
+static int flush_bench_run(const char *name, unsigned int flags)
+{
+	struct flush_bench fb = { };
+	struct bulk_work *bulk;
+	int c, i, nr = 0, ret = 0;
+
+	bulk = kcalloc(nr_cpu_ids * bulk_items, sizeof(*bulk), GFP_KERNEL);
+	if (!bulk)
+		return -ENOMEM;
+
+	fb.wq = alloc_workqueue("wq_flush_bench", flags, 0);
+	if (!fb.wq) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	INIT_WORK(&fb.work, flush_work_fn);
+
+	/* start the background load */
+	ACCESS_ONCE(bulk_stop) = false;
+	for_each_online_cpu(c) {
+		for (i = 0; i < bulk_items; i++, nr++) {
+			struct bulk_work *bw = &bulk[nr];
+
+			INIT_WORK(&bw->work, bulk_work_fn);
+			bw->wq = fb.wq;
+			bw->cpu = c;
+			queue_work_on(c, fb.wq, &bw->work);
+		}
+	}
+
+	ret = bench_run_thread(cpu, flush_thread_fn, &fb, "wq_flush_bench");
+
+	ACCESS_ONCE(bulk_stop) = true;
+	for (i = 0; i < nr; i++)
+		cancel_work_sync(&bulk[i].work);
+	if (ret)
+		goto out_wq;
+
+	pr_info("wq_flush_bench: %s: %d flushes under %d bulk works, "
+		"avg %llu us, max %llu us\n", name, flushes, nr,
+		div64_u64(fb.lat_total, (u64)flushes * NSEC_PER_USEC),
+		div64_u64(fb.lat_max, NSEC_PER_USEC));
+out_wq:
+	destroy_workqueue(fb.wq);
+out_free:
+	kfree(bulk);
+	return ret;
+}
+
+int bench_wq_flush(void)
+{
+	int ret;
+
+	if (flush_prio <= 0 || flush_prio >= MAX_USER_RT_PRIO ||
+	    flushes <= 0 || period_us <= 0 || bulk_items < 0 || bulk_us < 0)
+		return -EINVAL;
+
+	get_online_cpus();
+	if (cpu < 0 || cpu >= nr_cpu_ids || !cpu_online(cpu)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = flush_bench_run("normal", 0);
+	if (!ret)
+		ret = flush_bench_run("WQ_RT", WQ_RT);
+out:
+	put_online_cpus();
+	return ret;
+}
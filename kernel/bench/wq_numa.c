@@ -0,0 +1,207 @@
+/*
+ * Unbound workqueue NUMA locality benchmark
+ *
+ * Like dm-crypt, a submitter thread on every online cpu hands buffers
+ * to an unbound workqueue, which "encrypts" them: every work item XORs
+ * its buffer with a key stream and checksums it.  The buffers are
+ * allocated on the node of the submitter, each submitter keeps
+ * wq_numa_depth buffers in flight.
+ *
+ * The run is done once with the system wide affinity scope and once
+ * with the NUMA one (see workqueue_set_affinity_scope()).  The
+ * throughput and the share of the work items which ran on another
+ * node than their buffer are printed to the kernel log.  On a machine
+ * with a single node, or with workqueue.disable_numa, both runs are the
+ * same.
+ */
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+
+#include "bench.h"
+
+static int requests = 2000;
+module_param_named(wq_numa_requests, requests, int, 0444);
+MODULE_PARM_DESC(wq_numa_requests, "# of buffers each submitter hands off");
+
+static int depth = 8;
+module_param_named(wq_numa_depth, depth, int, 0444);
+MODULE_PARM_DESC(wq_numa_depth, "# of buffers in flight per submitter");
+
+static int buf_size = 65536;
+module_param_named(wq_numa_buf_size, buf_size, int, 0444);
+MODULE_PARM_DESC(wq_numa_buf_size, "buffer size in bytes");
+
+struct crypt_req {
+	struct work_struct	work;
+	struct completion	done;
+	unsigned long		*buf;
+	int			node;
+	unsigned long		sum;
+};
+
+struct submitter {
+	struct task_struct	*task;
+	struct completion	done;
+	struct workqueue_struct	*wq;
+	struct crypt_req	*reqs;
+	int			node;
+};
+
+static atomic_t nr_remote;
+
+static void crypt_work_fn(struct work_struct *work)
+{
+	struct crypt_req *req = container_of(work, struct crypt_req, work);
+	unsigned long key = 0x5deece66, sum = 0;
+	int i;
+
+	for (i = 0; i < buf_size / sizeof(long); i++) {
+		key = key * 1103515245 + 12345;
+		req->buf[i] ^= key;
+		sum += req->buf[i];
+	}
+	req->sum = sum;
+
+	if (numa_node_id() != req->node)
+		atomic_inc(&nr_remote);
+	complete(&req->done);
+}
+
+static int submitter_fn(void *arg)
+{
+	struct submitter *sub = arg;
+	int i, n;
+
+	for (n = 0; n < requests; n += depth) {
+		for (i = 0; i < depth; i++) {
+			INIT_COMPLETION(sub->reqs[i].done);
+			queue_work(sub->wq, &sub->reqs[i].work);
+		}
+		for (i = 0; i < depth; i++)
+			wait_for_completion(&sub->reqs[i].done);
+	}
+	complete(&sub->done);
+	bench_wait_stop();
+	return 0;
+}
+
+static void free_submitters(struct submitter *subs)
+{
+	int cpu, i;
+
+	for_each_online_cpu(cpu) {
+		struct submitter *sub = &subs[cpu];
+
+		if (sub->task)
+			kthread_stop(sub->task);
+		for (i = 0; sub->reqs && i < depth; i++)
+			kfree(sub->reqs[i].buf);
+		kfree(sub->reqs);
+	}
+	kfree(subs);
+}
+
+static int numa_bench_run(enum wq_affn_scope scope, const char *name)
+{
+	struct workqueue_struct *wq;
+	struct submitter *subs;
+	int cpu, i, nr = 0, ret;
+	ktime_t start;
+	u64 total, kb;
+	s64 elapsed;
+
+	wq = alloc_workqueue("wq_numa_bench", WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!wq)
+		return -ENOMEM;
+	ret = workqueue_set_affinity_scope(wq, scope);
+	if (ret)
+		goto out_wq;
+
+	subs = kcalloc(nr_cpu_ids, sizeof(*subs), GFP_KERNEL);
+	if (!subs) {
+		ret = -ENOMEM;
+		goto out_wq;
+	}
+
+	for_each_online_cpu(cpu) {
+		struct submitter *sub = &subs[cpu];
+
+		sub->node = cpu_to_node(cpu);
+		sub->wq = wq;
+		init_completion(&sub->done);
+		sub->reqs = kzalloc_node(depth * sizeof(*sub->reqs),
+					 GFP_KERNEL, sub->node);
+		if (!sub->reqs) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+		for (i = 0; i < depth; i++) {
+			struct crypt_req *req = &sub->reqs[i];
+
+			INIT_WORK(&req->work, crypt_work_fn);
+			init_completion(&req->done);
+			req->node = sub->node;
+			req->buf = kzalloc_node(buf_size, GFP_KERNEL,
+						sub->node);
+			if (!req->buf) {
+				ret = -ENOMEM;
+				goto out_free;
+			}
+		}
+
+		sub->task = kthread_create_on_node(submitter_fn, sub,
+						   sub->node,
+						   "wq_numa_bench/%d", cpu);
+		if (IS_ERR(sub->task)) {
+			ret = PTR_ERR(sub->task);
+			sub->task = NULL;
+			goto out_free;
+		}
+		kthread_bind(sub->task, cpu);
+		nr++;
+	}
+
+	atomic_set(&nr_remote, 0);
+	start = ktime_get();
+	for_each_online_cpu(cpu)
+		wake_up_process(subs[cpu].task);
+	for_each_online_cpu(cpu)
+		wait_for_completion(&subs[cpu].done);
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	/* every submitter rounds requests up to a multiple of depth */
+	total = (u64)nr * DIV_ROUND_UP(requests, depth) * depth;
+	kb = total * buf_size >> 10;
+	pr_info("wq_numa_bench: %s: %d submitters on %d nodes, %llu reqs/s, "
+		"%llu MB/s, %llu%% on a remote node\n", name, nr,
+		num_online_nodes(), div64_u64(total * NSEC_PER_SEC, elapsed),
+		div64_u64(kb * NSEC_PER_SEC, elapsed) >> 10,
+		div64_u64((u64)atomic_read(&nr_remote) * 100, total));
+	ret = 0;
+out_free:
+	free_submitters(subs);
+out_wq:
+	destroy_workqueue(wq);
+	return ret;
+}
+
+int bench_wq_numa(void)
+{
+	int ret;
+
+	if (requests <= 0 || depth <= 0 || buf_size < (int)sizeof(long))
+		return -EINVAL;
+
+	get_online_cpus();
+	ret = numa_bench_run(WQ_AFFN_SYSTEM, "system");
+	if (!ret)
+		ret = numa_bench_run(WQ_AFFN_NUMA, "numa");
+	put_online_cpus();
+	return ret;
+}
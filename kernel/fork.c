@@ -239,6 +239,7 @@ void __put_task_struct(struct task_struct *tsk)
 	security_task_free(tsk);
 	exit_creds(tsk);
 	delayacct_tsk_free(tsk);
+	task_numa_free(tsk);
 	put_signal_struct(tsk->signal);
 
 	if (!profile_handoff_task(tsk))
@@ -532,6 +533,16 @@ static void mm_init_aio(struct mm_struct *mm)
 #endif
 }
 
+static void mm_init_numa_balancing(struct mm_struct *mm)
+{
+#ifdef CONFIG_NUMA_BALANCING
+	mm->numa_next_scan = jiffies +
+		msecs_to_jiffies(sysctl_numa_balancing_scan_delay);
+	mm->numa_scan_offset = 0;
+	mm->numa_scan_seq = 0;
+#endif
+}
+
 static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 {
 	atomic_set(&mm->mm_users, 1);
@@ -548,6 +559,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 	mm->cached_hole_size = ~0UL;
 	mm_init_aio(mm);
 	mm_init_owner(mm, p);
+	mm_init_numa_balancing(mm);
 
 	if (likely(!mm_alloc_pgd(mm))) {
 		mm->def_flags = 0;
@@ -1327,6 +1339,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 #endif
 #ifdef CONFIG_PREEMPT_RT_FULL
 	p->pagefault_disabled = 0;
+	p->reader_lock_count = 0;
 #endif
 #ifdef CONFIG_LOCKDEP
 	p->lockdep_depth = 0; /* no locks held yet */
@@ -160,7 +160,8 @@ struct hrtimer_clock_base *lock_hrtimer_base(const struct hrtimer *timer,
 static int hrtimer_get_target(int this_cpu, int pinned)
 {
 #ifdef CONFIG_NO_HZ
-	if (!pinned && get_sysctl_timer_migration() && idle_cpu(this_cpu))
+	if (!pinned && get_sysctl_timer_migration() &&
+	    (idle_cpu(this_cpu) || !is_housekeeping_cpu(this_cpu)))
 		return get_nohz_timer_target();
 #endif
 	return this_cpu;
@@ -874,7 +875,7 @@ u64 hrtimer_forward(struct hrtimer *timer, ktime_t now, ktime_t interval)
 EXPORT_SYMBOL_GPL(hrtimer_forward);
 
 #ifdef CONFIG_PREEMPT_RT_BASE
-# define wake_up_timer_waiters(b)	wake_up(&(b)->wait)
+# define wake_up_timer_waiters(b)	swait_wake_all(&(b)->wait)
 
 /**
  * hrtimer_wait_for_timer - Wait for a running timer
@@ -891,8 +892,8 @@ void hrtimer_wait_for_timer(const struct hrtimer *timer)
 	struct hrtimer_clock_base *base = timer->base;
 
 	if (base && base->cpu_base && !timer->irqsafe)
-		wait_event(base->cpu_base->wait,
-			   !(timer->state & HRTIMER_STATE_CALLBACK));
+		swait_event(base->cpu_base->wait,
+			    !(timer->state & HRTIMER_STATE_CALLBACK));
 }
 
 #else
@@ -942,11 +943,6 @@ static void __remove_hrtimer(struct hrtimer *timer,
 	if (!(timer->state & HRTIMER_STATE_ENQUEUED))
 		goto out;
 
-	if (unlikely(!list_empty(&timer->cb_entry))) {
-		list_del_init(&timer->cb_entry);
-		goto out;
-	}
-
 	next_timer = timerqueue_getnext(&base->active);
 	timerqueue_del(&base->active, &timer->node);
 	if (&timer->node == next_timer) {
@@ -1232,7 +1228,6 @@ static void __hrtimer_init(struct hrtimer *timer, clockid_t clock_id,
 
 	base = hrtimer_clockid_to_base(clock_id);
 	timer->base = &cpu_base->clock_base[base];
-	INIT_LIST_HEAD(&timer->cb_entry);
 	timerqueue_init(&timer->node);
 
 #ifdef CONFIG_TIMER_STATS
@@ -1319,9 +1314,56 @@ static void __run_hrtimer(struct hrtimer *timer, ktime_t *now)
 static enum hrtimer_restart hrtimer_wakeup(struct hrtimer *timer);
 
 #ifdef CONFIG_PREEMPT_RT_BASE
-static void hrtimer_rt_reprogram(int restart, struct hrtimer *timer,
-				 struct hrtimer_clock_base *base)
+/*
+ * Timers which are not irqsafe are expired in the softirq. The timer
+ * interrupt removes them from the rbtree and hands them over on the
+ * per cpu expired list without the softirq having to touch the base
+ * lock for each of them. They are marked CALLBACK right away, so
+ * hrtimer_try_to_cancel() waits for them and switch_hrtimer_base()
+ * keeps them on this cpu until the softirq is done.
+ *
+ * Called with cpu_base->lock held.
+ */
+static int hrtimer_rt_defer(struct hrtimer *timer)
 {
+	unsigned long state = timer->state;
+
+	if (timer->irqsafe)
+		return 0;
+
+	debug_deactivate(timer);
+	timer_stats_account_hrtimer(timer);
+	__remove_hrtimer(timer, timer->base,
+			 (state & ~HRTIMER_STATE_ENQUEUED) |
+			 HRTIMER_STATE_CALLBACK | HRTIMER_STATE_PENDING, 0);
+	/*
+	 * A timer which was rearmed and expired again before the
+	 * softirq got to it is still queued. One callback covers
+	 * both expiries.
+	 */
+	if (!(state & HRTIMER_STATE_PENDING))
+		llist_add(&timer->cb_entry, &timer->base->cpu_base->expired);
+	return 1;
+}
+
+/*
+ * Requeue a timer after its callback ran in the softirq. Returns 1
+ * when the timer became the first timer of its base.
+ *
+ * Called with cpu_base->lock held.
+ */
+static int hrtimer_rt_requeue(struct hrtimer *timer, int restart)
+{
+	struct hrtimer_clock_base *base = timer->base;
+	int leftmost = 0;
+
+	/*
+	 * If the timer was rearmed on another CPU or is already queued
+	 * again, that wins over the restart request of the callback.
+	 */
+	if (timer->state & HRTIMER_STATE_PENDING)
+		return 0;
+
 	/*
 	 * Note, we clear the callback flag before we requeue the
 	 * timer otherwise we trigger the callback_running() check
@@ -1329,100 +1371,109 @@ static void hrtimer_rt_reprogram(int restart, struct hrtimer *timer,
 	 */
 	timer->state &= ~HRTIMER_STATE_CALLBACK;
 
-	if (restart != HRTIMER_NORESTART) {
-		BUG_ON(hrtimer_active(timer));
-		/*
-		 * Enqueue the timer, if it's the leftmost timer then
-		 * we need to reprogram it.
-		 */
-		if (!enqueue_hrtimer(timer, base))
-			return;
+	if (hrtimer_is_queued(timer))
+		leftmost = &timer->node == base->active.next;
+	else if (restart != HRTIMER_NORESTART)
+		leftmost = enqueue_hrtimer(timer, base);
 
-#ifndef CONFIG_HIGH_RES_TIMERS
-	}
-#else
-		if (base->cpu_base->hres_active &&
-		    hrtimer_reprogram(timer, base))
-			goto requeue;
+	return leftmost;
+}
 
-	} else if (hrtimer_active(timer)) {
-		/*
-		 * If the timer was rearmed on another CPU, reprogram
-		 * the event device.
-		 */
-		if (&timer->node == base->active.next &&
-		    base->cpu_base->hres_active &&
-		    hrtimer_reprogram(timer, base))
-			goto requeue;
-	}
-	return;
+/*
+ * Reprogram the event device for the bases whose first timer changed
+ * while requeueing. Returns 1 when one of them is expired already.
+ *
+ * Called with cpu_base->lock held.
+ */
+static int hrtimer_rt_reprogram(struct hrtimer_cpu_base *cpu_base,
+				unsigned int bases)
+{
+#ifdef CONFIG_HIGH_RES_TIMERS
+	struct hrtimer_clock_base *base;
+	struct timerqueue_node *node;
+	int index;
 
-requeue:
-	/*
-	 * Timer is expired. Thus move it from tree to pending list
-	 * again.
-	 */
-	__remove_hrtimer(timer, base, timer->state, 0);
-	list_add_tail(&timer->cb_entry, &base->expired);
+	if (!cpu_base->hres_active)
+		return 0;
+
+	for (index = 0; bases; index++, bases >>= 1) {
+		if (!(bases & 1))
+			continue;
+		base = &cpu_base->clock_base[index];
+		node = timerqueue_getnext(&base->active);
+		if (node && hrtimer_reprogram(container_of(node,
+					struct hrtimer, node), base))
+			return 1;
+	}
 #endif
+	return 0;
 }
 
+/* Number of timers whose callbacks run per acquisition of the base lock */
+#define HRTIMER_RT_BATCH	16
+
 /*
  * The changes in mainline which removed the callback modes from
  * hrtimer are not yet working with -rt. The non wakeup_process()
  * based callbacks which involve sleeping locks need to be treated
  * seperately.
+ *
+ * The softirq takes the handed over timers off the list without
+ * the lock and runs them in batches. Each lock section requeues the
+ * batch whose callbacks just ran, reprograms the event device once
+ * and takes the next batch.
  */
 static void hrtimer_rt_run_pending(void)
 {
-	enum hrtimer_restart (*fn)(struct hrtimer *);
+	struct hrtimer *batch[HRTIMER_RT_BATCH];
+	int restart[HRTIMER_RT_BATCH];
 	struct hrtimer_cpu_base *cpu_base;
-	struct hrtimer_clock_base *base;
-	struct hrtimer *timer;
-	int index, restart;
-
-	local_irq_disable();
-	cpu_base = &per_cpu(hrtimer_bases, smp_processor_id());
+	struct llist_node *pending = NULL;
+	unsigned int bases;
+	int i, nr = 0, ran, expired;
 
-	raw_spin_lock(&cpu_base->lock);
+	/* The softirq runs with migration disabled */
+	cpu_base = &__get_cpu_var(hrtimer_bases);
 
-	for (index = 0; index < HRTIMER_MAX_CLOCK_BASES; index++) {
-		base = &cpu_base->clock_base[index];
-
-		while (!list_empty(&base->expired)) {
-			timer = list_first_entry(&base->expired,
-						 struct hrtimer, cb_entry);
-
-			/*
-			 * Same as the above __run_hrtimer function
-			 * just we run with interrupts enabled.
-			 */
-			debug_hrtimer_deactivate(timer);
-			__remove_hrtimer(timer, base, HRTIMER_STATE_CALLBACK, 0);
-			timer_stats_account_hrtimer(timer);
-			fn = timer->function;
-
-			raw_spin_unlock_irq(&cpu_base->lock);
-			restart = fn(timer);
-			raw_spin_lock_irq(&cpu_base->lock);
-
-			hrtimer_rt_reprogram(restart, timer, base);
+	for (;;) {
+		if (!pending) {
+			pending = llist_del_all(&cpu_base->expired);
+			pending = llist_reverse_order(pending);
 		}
-	}
-
-	raw_spin_unlock_irq(&cpu_base->lock);
+		if (!nr && !pending)
+			break;
+
+		bases = 0;
+		ran = nr;
+		raw_spin_lock_irq(&cpu_base->lock);
+		for (i = 0; i < ran; i++) {
+			if (hrtimer_rt_requeue(batch[i], restart[i]))
+				bases |= 1 << batch[i]->base->index;
+		}
+		expired = ran ? hrtimer_rt_reprogram(cpu_base, bases) : 0;
+		/*
+		 * Once PENDING is cleared the timer can be queued on the
+		 * expired list again, which reuses cb_entry. Only do that
+		 * for the timers we take into this batch.
+		 */
+		for (nr = 0; pending && nr < HRTIMER_RT_BATCH; nr++) {
+			batch[nr] = llist_entry(pending, struct hrtimer,
+						cb_entry);
+			pending = pending->next;
+			batch[nr]->state &= ~HRTIMER_STATE_PENDING;
+		}
+		raw_spin_unlock_irq(&cpu_base->lock);
 
-	wake_up_timer_waiters(cpu_base);
-}
+		if (ran)
+			wake_up_timer_waiters(cpu_base);
 
-static int hrtimer_rt_defer(struct hrtimer *timer)
-{
-	if (timer->irqsafe)
-		return 0;
+		/* Hand timers which expired meanwhile over to the list */
+		if (expired)
+			hrtimer_peek_ahead_timers();
 
-	__remove_hrtimer(timer, timer->base, timer->state, 0);
-	list_add_tail(&timer->cb_entry, &timer->base->expired);
-	return 1;
+		for (i = 0; i < nr; i++)
+			restart[i] = batch[i]->function(batch[i]);
+	}
 }
 
 #else
@@ -1861,12 +1912,12 @@ static void __cpuinit init_hrtimers_cpu(int cpu)
 	for (i = 0; i < HRTIMER_MAX_CLOCK_BASES; i++) {
 		cpu_base->clock_base[i].cpu_base = cpu_base;
 		timerqueue_init_head(&cpu_base->clock_base[i].active);
-		INIT_LIST_HEAD(&cpu_base->clock_base[i].expired);
 	}
 
 	hrtimer_init_hres(cpu_base);
 #ifdef CONFIG_PREEMPT_RT_BASE
-	init_waitqueue_head(&cpu_base->wait);
+	init_swait_head(&cpu_base->wait);
+	init_llist_head(&cpu_base->expired);
 #endif
 }
 
@@ -1877,10 +1928,18 @@ static void migrate_hrtimer_list(struct hrtimer_clock_base *old_base,
 {
 	struct hrtimer *timer;
 	struct timerqueue_node *node;
+	unsigned long state;
 
 	while ((node = timerqueue_getnext(&old_base->active))) {
 		timer = container_of(node, struct hrtimer, node);
-		BUG_ON(hrtimer_callback_running(timer));
+		/*
+		 * Only timers which were rearmed while their callback
+		 * was queued for the softirq can be running here. They
+		 * move along with the expired list below.
+		 */
+		state = timer->state &
+			(HRTIMER_STATE_CALLBACK | HRTIMER_STATE_PENDING);
+		BUG_ON(state == HRTIMER_STATE_CALLBACK);
 		debug_deactivate(timer);
 
 		/*
@@ -1888,7 +1947,8 @@ static void migrate_hrtimer_list(struct hrtimer_clock_base *old_base,
 		 * timer could be seen as !active and just vanish away
 		 * under us on another CPU
 		 */
-		__remove_hrtimer(timer, old_base, HRTIMER_STATE_MIGRATE, 0);
+		__remove_hrtimer(timer, old_base,
+				 HRTIMER_STATE_MIGRATE | state, 0);
 		timer->base = new_base;
 		/*
 		 * Enqueue the timers on the new cpu. This does not
@@ -1905,10 +1965,36 @@ static void migrate_hrtimer_list(struct hrtimer_clock_base *old_base,
 	}
 }
 
+#ifdef CONFIG_PREEMPT_RT_BASE
+/* Hand the timers still queued for the softirq of the dead cpu over */
+static int migrate_hrtimer_pending(struct hrtimer_cpu_base *old_base,
+				   struct hrtimer_cpu_base *new_base)
+{
+	struct llist_node *node = llist_del_all(&old_base->expired);
+	struct hrtimer *timer;
+	int moved = 0;
+
+	while (node) {
+		timer = llist_entry(node, struct hrtimer, cb_entry);
+		node = node->next;
+		timer->base = &new_base->clock_base[timer->base->index];
+		llist_add(&timer->cb_entry, &new_base->expired);
+		moved = 1;
+	}
+	return moved;
+}
+#else
+static inline int migrate_hrtimer_pending(struct hrtimer_cpu_base *old_base,
+					  struct hrtimer_cpu_base *new_base)
+{
+	return 0;
+}
+#endif
+
 static void migrate_hrtimers(int scpu)
 {
 	struct hrtimer_cpu_base *old_base, *new_base;
-	int i;
+	int i, pending;
 
 	BUG_ON(cpu_online(scpu));
 	tick_cancel_sched_timer(scpu);
@@ -1927,10 +2013,14 @@ static void migrate_hrtimers(int scpu)
 		migrate_hrtimer_list(&old_base->clock_base[i],
 				     &new_base->clock_base[i]);
 	}
+	pending = migrate_hrtimer_pending(old_base, new_base);
 
 	raw_spin_unlock(&old_base->lock);
 	raw_spin_unlock(&new_base->lock);
 
+	if (pending)
+		raise_softirq_irqoff(HRTIMER_SOFTIRQ);
+
 	/* Check, if we got expired work to do */
 	__hrtimer_peek_ahead_timers();
 	local_irq_enable();
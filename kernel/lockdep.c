@@ -225,6 +225,9 @@ struct lock_class_stats lock_stats(struct lock_class *class)
 
 		for (i = 0; i < ARRAY_SIZE(stats.bounces); i++)
 			stats.bounces[i] += pcs->bounces[i];
+
+		stats.contended_spin += pcs->contended_spin;
+		stats.contended_sleep += pcs->contended_sleep;
 	}
 
 	return stats;
@@ -3691,8 +3694,12 @@ found_it:
 	put_lock_stats(stats);
 }
 
+/*
+ * @slept: for adaptive locks, whether a contended acquisition had to
+ * block (1) or got the lock while spinning (0); -1 otherwise.
+ */
 static void
-__lock_acquired(struct lockdep_map *lock, unsigned long ip)
+__lock_acquired(struct lockdep_map *lock, unsigned long ip, int slept)
 {
 	struct task_struct *curr = current;
 	struct held_lock *hlock, *prev_hlock;
@@ -3746,6 +3753,10 @@ found_it:
 	}
 	if (lock->cpu != cpu)
 		stats->bounces[bounce_acquired + !!hlock->read]++;
+	if (slept > 0)
+		stats->contended_sleep++;
+	else if (!slept)
+		stats->contended_spin++;
 	put_lock_stats(stats);
 
 	lock->cpu = cpu;
@@ -3772,7 +3783,8 @@ void lock_contended(struct lockdep_map *lock, unsigned long ip)
 }
 EXPORT_SYMBOL_GPL(lock_contended);
 
-void lock_acquired(struct lockdep_map *lock, unsigned long ip)
+static void lock_acquired_slept(struct lockdep_map *lock, unsigned long ip,
+				int slept)
 {
 	unsigned long flags;
 
@@ -3785,11 +3797,28 @@ void lock_acquired(struct lockdep_map *lock, unsigned long ip)
 	raw_local_irq_save(flags);
 	check_flags(flags);
 	current->lockdep_recursion = 1;
-	__lock_acquired(lock, ip);
+	__lock_acquired(lock, ip, slept);
 	current->lockdep_recursion = 0;
 	raw_local_irq_restore(flags);
 }
+
+void lock_acquired(struct lockdep_map *lock, unsigned long ip)
+{
+	lock_acquired_slept(lock, ip, -1);
+}
 EXPORT_SYMBOL_GPL(lock_acquired);
+
+/*
+ * Contended acquisition of a lock which spins before it blocks, such
+ * as the PREEMPT_RT spinlocks. @slept tells whether the lock was
+ * acquired while spinning or after blocking.
+ */
+void lock_acquired_adaptive(struct lockdep_map *lock, unsigned long ip,
+			    int slept)
+{
+	lock_acquired_slept(lock, ip, !!slept);
+}
+EXPORT_SYMBOL_GPL(lock_acquired_adaptive);
 #endif
 
 /*
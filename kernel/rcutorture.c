@@ -64,6 +64,7 @@ static int fqs_duration;	/* Duration of bursts (us), 0 to disable. */
 static int fqs_holdoff;		/* Hold time within burst (us). */
 static int fqs_stutter = 3;	/* Wait time between bursts (s). */
 static int n_barrier_cbs;	/* Number of callbacks to test RCU barriers. */
+static bool test_nocb;		/* Post callbacks from each CPU in turn. */
 static int onoff_interval;	/* Wait time between CPU hotplugs, 0=disable. */
 static int onoff_holdoff;	/* Seconds after boot before CPU hotplugs. */
 static int shutdown_secs;	/* Shutdown time (s).  <=0 for no shutdown. */
@@ -98,6 +99,8 @@ module_param(fqs_stutter, int, 0444);
 MODULE_PARM_DESC(fqs_stutter, "Wait time between fqs bursts (s)");
 module_param(n_barrier_cbs, int, 0444);
 MODULE_PARM_DESC(n_barrier_cbs, "# of callbacks/kthreads for barrier testing");
+module_param(test_nocb, bool, 0444);
+MODULE_PARM_DESC(test_nocb, "Test callbacks posted from each CPU (rcu_nocbs=)");
 module_param(onoff_interval, int, 0444);
 MODULE_PARM_DESC(onoff_interval, "Time between CPU hotplugs (s), 0=disable");
 module_param(onoff_holdoff, int, 0444);
@@ -143,6 +146,7 @@ static struct task_struct *onoff_task;
 static struct task_struct *stall_task;
 static struct task_struct **barrier_cbs_tasks;
 static struct task_struct *barrier_task;
+static struct task_struct *nocb_task;
 
 #define RCU_TORTURE_PIPE_LEN 10
 
@@ -180,6 +184,9 @@ static long n_online_attempts;
 static long n_online_successes;
 static long n_barrier_attempts;
 static long n_barrier_successes;
+static long n_nocb_attempts;
+static long n_nocb_successes;
+static long n_rcu_torture_nocb_error;
 static struct list_head rcu_torture_removed;
 static cpumask_var_t shuffle_tmp_mask;
 
@@ -209,6 +216,8 @@ static bool barrier_phase;		/* Test phase. */
 static atomic_t barrier_cbs_invoked;	/* Barrier callbacks invoked. */
 static wait_queue_head_t *barrier_cbs_wq; /* Coordinate barrier testing. */
 static DECLARE_WAIT_QUEUE_HEAD(barrier_wq);
+static struct rcu_head *nocb_heads;	/* One callback per CPU. */
+static atomic_t nocb_cbs_invoked;	/* Per-CPU callbacks invoked. */
 
 /* Mediate rmmod and system shutdown.  Concurrent rmmod & shutdown illegal! */
 
@@ -1219,13 +1228,18 @@ rcu_torture_printk(char *page)
 		       n_online_attempts,
 		       n_offline_successes,
 		       n_offline_attempts);
-	cnt += sprintf(&page[cnt], "barrier: %ld/%ld:%ld",
+	cnt += sprintf(&page[cnt], "barrier: %ld/%ld:%ld ",
 		       n_barrier_successes,
 		       n_barrier_attempts,
 		       n_rcu_torture_barrier_error);
+	cnt += sprintf(&page[cnt], "nocb: %ld/%ld:%ld",
+		       n_nocb_successes,
+		       n_nocb_attempts,
+		       n_rcu_torture_nocb_error);
 	cnt += sprintf(&page[cnt], "\n%s%s ", torture_type, TORTURE_FLAG);
 	if (atomic_read(&n_rcu_torture_mberror) != 0 ||
 	    n_rcu_torture_barrier_error != 0 ||
+	    n_rcu_torture_nocb_error != 0 ||
 	    n_rcu_torture_boost_ktrerror != 0 ||
 	    n_rcu_torture_boost_rterror != 0 ||
 	    n_rcu_torture_boost_failure != 0 ||
@@ -1387,13 +1401,13 @@ rcu_torture_print_module_parms(struct rcu_torture_ops *cur_ops, char *tag)
 		"fqs_duration=%d fqs_holdoff=%d fqs_stutter=%d "
 		"test_boost=%d/%d test_boost_interval=%d "
 		"test_boost_duration=%d shutdown_secs=%d "
-		"onoff_interval=%d onoff_holdoff=%d\n",
+		"onoff_interval=%d onoff_holdoff=%d test_nocb=%d\n",
 		torture_type, tag, nrealreaders, nfakewriters,
 		stat_interval, verbose, test_no_idle_hz, shuffle_interval,
 		stutter, irqreader, fqs_duration, fqs_holdoff, fqs_stutter,
 		test_boost, cur_ops->can_boost,
 		test_boost_interval, test_boost_duration, shutdown_secs,
-		onoff_interval, onoff_holdoff);
+		onoff_interval, onoff_holdoff, test_nocb);
 }
 
 static struct notifier_block rcutorture_shutdown_nb = {
@@ -1783,6 +1797,93 @@ static void rcu_torture_barrier_cleanup(void)
 	}
 }
 
+/* Callback function for per-CPU callback testing. */
+static void rcu_torture_nocb_cbf(struct rcu_head *rcu)
+{
+	atomic_inc(&nocb_cbs_invoked);
+}
+
+/*
+ * kthread function that moves itself to each online CPU in turn and
+ * posts a callback there, then checks that the barrier primitive waits
+ * for all of them.  On CPUs listed in rcu_nocbs= the callbacks are
+ * invoked by the rcuo kthreads.
+ */
+static int rcu_torture_nocb(void *arg)
+{
+	int cpu;
+	int posted;
+
+	VERBOSE_PRINTK_STRING("rcu_torture_nocb task started");
+	do {
+		atomic_set(&nocb_cbs_invoked, 0);
+		posted = 0;
+		for_each_online_cpu(cpu) {
+			if (set_cpus_allowed_ptr(current, cpumask_of(cpu)))
+				continue;
+			cur_ops->call(&nocb_heads[cpu], rcu_torture_nocb_cbf);
+			posted++;
+		}
+		set_cpus_allowed_ptr(current, cpu_possible_mask);
+		n_nocb_attempts++;
+		cur_ops->cb_barrier();
+		if (atomic_read(&nocb_cbs_invoked) != posted) {
+			n_rcu_torture_nocb_error++;
+			WARN_ON_ONCE(1);
+		} else {
+			n_nocb_successes++;
+		}
+		schedule_timeout_interruptible(HZ / 10);
+		rcu_stutter_wait("rcu_torture_nocb");
+	} while (!kthread_should_stop() && fullstop == FULLSTOP_DONTSTOP);
+	VERBOSE_PRINTK_STRING("rcu_torture_nocb task stopping");
+	rcutorture_shutdown_absorb("rcu_torture_nocb");
+	while (!kthread_should_stop())
+		schedule_timeout_interruptible(1);
+	return 0;
+}
+
+/* Initialize per-CPU callback testing. */
+static int rcu_torture_nocb_init(void)
+{
+	int ret;
+
+	if (!test_nocb)
+		return 0;
+	if (cur_ops->call == NULL || cur_ops->cb_barrier == NULL) {
+		printk(KERN_ALERT "%s" TORTURE_FLAG
+		       " Call or barrier ops missing for %s,\n",
+		       torture_type, cur_ops->name);
+		printk(KERN_ALERT "%s" TORTURE_FLAG
+		       " RCU nocb testing omitted from run.\n",
+		       torture_type);
+		return 0;
+	}
+	nocb_heads = kcalloc(nr_cpu_ids, sizeof(nocb_heads[0]), GFP_KERNEL);
+	if (nocb_heads == NULL)
+		return -ENOMEM;
+	nocb_task = kthread_run(rcu_torture_nocb, NULL, "rcu_torture_nocb");
+	if (IS_ERR(nocb_task)) {
+		ret = PTR_ERR(nocb_task);
+		VERBOSE_PRINTK_ERRSTRING("Failed to create rcu_torture_nocb");
+		nocb_task = NULL;
+		return ret;
+	}
+	return 0;
+}
+
+/* Clean up after per-CPU callback testing. */
+static void rcu_torture_nocb_cleanup(void)
+{
+	if (nocb_task != NULL) {
+		VERBOSE_PRINTK_STRING("Stopping rcu_torture_nocb task");
+		kthread_stop(nocb_task);
+		nocb_task = NULL;
+	}
+	kfree(nocb_heads);
+	nocb_heads = NULL;
+}
+
 static int rcutorture_cpu_notify(struct notifier_block *self,
 				 unsigned long action, void *hcpu)
 {
@@ -1825,6 +1926,7 @@ rcu_torture_cleanup(void)
 	fullstop = FULLSTOP_RMMOD;
 	mutex_unlock(&fullstop_mutex);
 	unregister_reboot_notifier(&rcutorture_shutdown_nb);
+	rcu_torture_nocb_cleanup();
 	rcu_torture_barrier_cleanup();
 	rcu_torture_stall_cleanup();
 	if (stutter_task) {
@@ -2143,6 +2245,11 @@ rcu_torture_init(void)
 		firsterr = retval;
 		goto unwind;
 	}
+	retval = rcu_torture_nocb_init();
+	if (retval != 0) {
+		firsterr = retval;
+		goto unwind;
+	}
 	rcutorture_record_test_transition();
 	mutex_unlock(&fullstop_mutex);
 	return 0;
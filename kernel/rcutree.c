@@ -51,7 +51,7 @@
 #include <linux/kthread.h>
 #include <linux/prefetch.h>
 #include <linux/delay.h>
-#include <linux/stop_machine.h>
+#include <linux/wait-simple.h>
 
 #include "rcutree.h"
 #include <trace/events/rcu.h>
@@ -62,7 +62,7 @@
 
 static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 
-#define RCU_STATE_INITIALIZER(sname, cr) { \
+#define RCU_STATE_INITIALIZER(sname, sabbr, cr) { \
 	.level = { &sname##_state.node[0] }, \
 	.call = cr, \
 	.fqs_state = RCU_GP_IDLE, \
@@ -74,13 +74,15 @@ static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 	.barrier_mutex = __MUTEX_INITIALIZER(sname##_state.barrier_mutex), \
 	.fqslock = __RAW_SPIN_LOCK_UNLOCKED(&sname##_state.fqslock), \
 	.name = #sname, \
+	.abbr = sabbr, \
 }
 
 struct rcu_state rcu_sched_state =
-	RCU_STATE_INITIALIZER(rcu_sched, call_rcu_sched);
+	RCU_STATE_INITIALIZER(rcu_sched, 's', call_rcu_sched);
 DEFINE_PER_CPU(struct rcu_data, rcu_sched_data);
 
-struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, call_rcu_bh);
+struct rcu_state rcu_bh_state =
+	RCU_STATE_INITIALIZER(rcu_bh, 'b', call_rcu_bh);
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data);
 
 static struct rcu_state *rcu_state;
@@ -165,6 +167,24 @@ static int rcu_gp_in_progress(struct rcu_state *rsp)
 	return ACCESS_ONCE(rsp->completed) != ACCESS_ONCE(rsp->gpnum);
 }
 
+/*
+ * Set when a synchronize_sched_expedited() IPI interrupted an RCU
+ * read-side critical section on this CPU.  The next context switch or
+ * interrupt from user mode or idle reports the quiescent state to the
+ * expedited grace period.
+ */
+static DEFINE_PER_CPU(bool, rcu_sched_exp_needed);
+static void rcu_sched_exp_report(void);
+
+/* Report a quiescent state owed to synchronize_sched_expedited(). */
+static void rcu_sched_exp_qs(int cpu)
+{
+	if (unlikely(per_cpu(rcu_sched_exp_needed, cpu))) {
+		per_cpu(rcu_sched_exp_needed, cpu) = false;
+		rcu_sched_exp_report();
+	}
+}
+
 /*
  * Note a quiescent state.  Because we do not need to know
  * how many quiescent states passed, just if there was at least
@@ -212,6 +232,7 @@ void rcu_note_context_switch(int cpu)
 	trace_rcu_utilization("Start context switch");
 	rcu_sched_qs(cpu);
 	rcu_preempt_note_context_switch(cpu);
+	rcu_sched_exp_qs(cpu); /* After queuing a preempted reader. */
 	trace_rcu_utilization("End context switch");
 }
 EXPORT_SYMBOL_GPL(rcu_note_context_switch);
@@ -1414,6 +1435,10 @@ static void rcu_adopt_orphan_cbs(struct rcu_state *rsp)
 	    rsp->rcu_barrier_in_progress != current)
 		return;
 
+	/* No-CBs CPUs are handled specially. */
+	if (rcu_nocb_adopt_orphan_cbs(rsp, rdp))
+		return;
+
 	/* Do the accounting first. */
 	rdp->qlen_lazy += rsp->qlen_lazy;
 	rdp->qlen += rsp->qlen;
@@ -1667,6 +1692,7 @@ void rcu_check_callbacks(int cpu, int user)
 
 		rcu_sched_qs(cpu);
 		rcu_bh_qs(cpu);
+		rcu_sched_exp_qs(cpu);
 
 	} else if (!in_softirq()) {
 
@@ -1680,6 +1706,7 @@ void rcu_check_callbacks(int cpu, int user)
 		rcu_bh_qs(cpu);
 	}
 	rcu_preempt_check_callbacks(cpu);
+	do_nocb_deferred_wakeups();
 	if (rcu_pending(cpu))
 		invoke_rcu_core();
 	trace_rcu_utilization("End scheduler-tick");
@@ -1954,6 +1981,12 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* Offloaded CPUs hand the callback to their rcuo kthread. */
+	if (__call_rcu_nocb(rdp, head, lazy, flags)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	ACCESS_ONCE(rdp->qlen)++;
 	if (lazy)
@@ -2075,22 +2108,61 @@ EXPORT_SYMBOL_GPL(synchronize_rcu_bh);
 
 static atomic_t sync_sched_expedited_started = ATOMIC_INIT(0);
 static atomic_t sync_sched_expedited_done = ATOMIC_INIT(0);
+static DEFINE_MUTEX(sync_sched_expedited_mutex);
+static atomic_t sync_sched_expedited_pending;
+static atomic_t sync_sched_expedited_resched;
+static DEFINE_SWAIT_HEAD(sync_sched_expedited_wq);
 
-static int synchronize_sched_expedited_cpu_stop(void *data)
+/*
+ * Report a quiescent state for the current synchronize_sched_expedited(),
+ * waking it up if this was the last CPU it waited for.
+ */
+static void rcu_sched_exp_report(void)
 {
-	/*
-	 * There must be a full memory barrier on each affected CPU
-	 * between the time that try_stop_cpus() is called and the
-	 * time that it returns.
-	 *
-	 * In the current initial implementation of cpu_stop, the
-	 * above condition is already met when the control reaches
-	 * this point and the following smp_mb() is not strictly
-	 * necessary.  Do smp_mb() anyway for documentation and
-	 * robustness against future implementation changes.
-	 */
-	smp_mb(); /* See above comment block. */
-	return 0;
+	if (atomic_dec_and_test(&sync_sched_expedited_pending))
+		swait_wake(&sync_sched_expedited_wq);
+}
+
+/*
+ * Could the interrupted context of this IPI be within an RCU-sched
+ * read-side critical section?  Only kernels with CONFIG_PREEMPT_COUNT
+ * track preempt_disable() in preempt_count(), the others have to assume
+ * the worst unless the IPI interrupted the idle loop.
+ *
+ * A task within rcu_read_lock() counts as well, because
+ * synchronize_rcu_expedited() relies on the context switch to queue
+ * such a task on its rcu_node's ->blkd_tasks list.
+ */
+static bool rcu_sched_exp_rrupt_in_reader(void)
+{
+	if (rcu_is_cpu_rrupt_from_idle())
+		return false;
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	if (current->rcu_read_lock_nesting)
+		return true;
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+#ifdef CONFIG_PREEMPT_COUNT
+	return preempt_count() != HARDIRQ_OFFSET;
+#else /* #ifdef CONFIG_PREEMPT_COUNT */
+	return true;
+#endif /* #else #ifdef CONFIG_PREEMPT_COUNT */
+}
+
+/*
+ * IPI handler for synchronize_sched_expedited().  If the IPI did not
+ * interrupt an RCU-sched read-side critical section, this is a quiescent
+ * state.  Otherwise force a context switch and let rcu_sched_qs() report
+ * the quiescent state once it happens.
+ */
+static void synchronize_sched_expedited_ipi(void *data)
+{
+	if (!rcu_sched_exp_rrupt_in_reader()) {
+		rcu_sched_exp_report();
+		return;
+	}
+	atomic_inc(&sync_sched_expedited_resched);
+	__this_cpu_write(rcu_sched_exp_needed, true);
+	set_need_resched();
 }
 
 /**
@@ -2098,99 +2170,113 @@ static int synchronize_sched_expedited_cpu_stop(void *data)
  *
  * Wait for an RCU-sched grace period to elapse, but use a "big hammer"
  * approach to force the grace period to end quickly.  This consumes
- * significant time on all CPUs and is unfriendly to real-time workloads,
- * so is thus not recommended for any sort of common-case code.  In fact,
- * if you are using synchronize_sched_expedited() in a loop, please
- * restructure your code to batch your updates, and then use a single
- * synchronize_sched() instead.
+ * significant time on all non-idle CPUs and is unfriendly to real-time
+ * workloads, so is thus not recommended for any sort of common-case
+ * code.  In fact, if you are using synchronize_sched_expedited() in a
+ * loop, please restructure your code to batch your updates, and then use
+ * a single synchronize_sched() instead.
  *
  * Note that it is illegal to call this function while holding any lock
  * that is acquired by a CPU-hotplug notifier.  And yes, it is also illegal
  * to call this function from a CPU-hotplug notifier.  Failing to observe
  * these restriction will result in deadlock.
  *
+ * The online CPUs whose rcu_dynticks counter shows them in an extended
+ * quiescent state (dyntick-idle, or user mode with CONFIG_RCU_USER_QS)
+ * are left alone, as are the CPUs running the idle loop, so the isolated
+ * CPUs of a real-time system are only disturbed if they are busy.  All
+ * other CPUs get an IPI.  If the IPI finds a CPU within an RCU read-side
+ * critical section, the CPU is asked to reschedule and reports its
+ * quiescent state at the next context switch.
+ *
  * This implementation can be thought of as an application of ticket
  * locking to RCU, with sync_sched_expedited_started and
  * sync_sched_expedited_done taking on the roles of the halves
  * of the ticket-lock word.  Each task atomically increments
  * sync_sched_expedited_started upon entry, snapshotting the old value,
- * then attempts to stop all the CPUs.  If this succeeds, then each
- * CPU will have executed a context switch, resulting in an RCU-sched
- * grace period.  We are then done, so we use atomic_cmpxchg() to
- * update sync_sched_expedited_done to match our snapshot -- but
- * only if someone else has not already advanced past our snapshot.
- *
- * On the other hand, if try_stop_cpus() fails, we check the value
- * of sync_sched_expedited_done.  If it has advanced past our
- * initial snapshot, then someone else must have forced a grace period
- * some time after we took our snapshot.  In this case, our work is
- * done for us, and we can simply return.  Otherwise, we try again,
- * but keep our initial snapshot for purposes of checking for someone
- * doing our work for us.
- *
- * If we fail too many times in a row, we fall back to synchronize_sched().
+ * then waits for sync_sched_expedited_mutex.  Once it has the mutex, it
+ * checks sync_sched_expedited_done.  If that has advanced past the
+ * initial snapshot, then someone else forced a grace period some time
+ * after the snapshot was taken, and we can simply return.  Otherwise we
+ * force the grace period and update sync_sched_expedited_done to the
+ * most recent value of sync_sched_expedited_started we saw before
+ * starting, which lets later callers piggyback on our grace period.
  */
 void synchronize_sched_expedited(void)
 {
-	int firstsnap, s, snap, trycount = 0;
+	int cpu, firstsnap, snap, online = 0, ipis = 0;
+	cpumask_var_t cm;
 
 	/* Note that atomic_inc_return() implies full memory barrier. */
-	firstsnap = snap = atomic_inc_return(&sync_sched_expedited_started);
+	firstsnap = atomic_inc_return(&sync_sched_expedited_started);
+
+	if (!alloc_cpumask_var(&cm, GFP_KERNEL)) {
+		synchronize_sched();
+		return;
+	}
+
+	mutex_lock(&sync_sched_expedited_mutex);
+
+	/* Check to see if someone else did our work for us. */
+	if (UINT_CMP_GE((unsigned)atomic_read(&sync_sched_expedited_done),
+			(unsigned)firstsnap)) {
+		smp_mb(); /* ensure test happens before caller kfree */
+		goto out;
+	}
+
+	/*
+	 * Refetching sync_sched_expedited_started allows later callers
+	 * to piggyback on our grace period, which starts after they did.
+	 */
+	snap = atomic_read(&sync_sched_expedited_started);
+	smp_mb(); /* ensure read is before the dynticks snapshots. */
+
 	get_online_cpus();
 	WARN_ON_ONCE(cpu_is_offline(raw_smp_processor_id()));
+	cpumask_clear(cm);
+	atomic_set(&sync_sched_expedited_pending, 1);
+	atomic_set(&sync_sched_expedited_resched, 0);
 
 	/*
-	 * Each pass through the following loop attempts to force a
-	 * context switch on each CPU.
+	 * The current CPU runs us and is thus in a quiescent state.  A CPU
+	 * whose dynticks counter is even is in an extended quiescent state,
+	 * and the full memory barrier implied by atomic_add_return() orders
+	 * its next read-side critical section after our caller's updates.
 	 */
-	while (try_stop_cpus(cpu_online_mask,
-			     synchronize_sched_expedited_cpu_stop,
-			     NULL) == -EAGAIN) {
-		put_online_cpus();
-
-		/* No joy, try again later.  Or just synchronize_sched(). */
-		if (trycount++ < 10) {
-			udelay(trycount * num_online_cpus());
-		} else {
-			synchronize_sched();
-			return;
-		}
+	preempt_disable();
+	for_each_online_cpu(cpu) {
+		online++;
+		if (cpu == smp_processor_id())
+			continue;
+		if (!(atomic_add_return(0, &per_cpu(rcu_dynticks, cpu).dynticks)
+		      & 0x1))
+			continue;
+		cpumask_set_cpu(cpu, cm);
+		ipis++;
+	}
+	atomic_add(ipis, &sync_sched_expedited_pending);
+	smp_call_function_many(cm, synchronize_sched_expedited_ipi, NULL, 1);
+	preempt_enable();
 
-		/* Check to see if someone else did our work for us. */
-		s = atomic_read(&sync_sched_expedited_done);
-		if (UINT_CMP_GE((unsigned)s, (unsigned)firstsnap)) {
-			smp_mb(); /* ensure test happens before caller kfree */
-			return;
-		}
+	/* Drop the initial count and wait for the remaining CPUs. */
+	if (!atomic_dec_and_test(&sync_sched_expedited_pending))
+		swait_event(sync_sched_expedited_wq,
+			    !atomic_read(&sync_sched_expedited_pending));
+	put_online_cpus();
 
-		/*
-		 * Refetching sync_sched_expedited_started allows later
-		 * callers to piggyback on our grace period.  We subtract
-		 * 1 to get the same token that the last incrementer got.
-		 * We retry after they started, so our grace period works
-		 * for them, and they started after our first try, so their
-		 * grace period works for us.
-		 */
-		get_online_cpus();
-		snap = atomic_read(&sync_sched_expedited_started);
-		smp_mb(); /* ensure read is before try_stop_cpus(). */
-	}
+	trace_rcu_exp_grace_period(rcu_sched_state.name, snap, online, ipis,
+				   atomic_read(&sync_sched_expedited_resched));
 
 	/*
 	 * Everyone up to our most recent fetch is covered by our grace
-	 * period.  Update the counter, but only if our work is still
-	 * relevant -- which it won't be if someone who started later
-	 * than we did beat us to the punch.
+	 * period, and the mutex keeps anyone else from advancing the
+	 * counter meanwhile.
 	 */
-	do {
-		s = atomic_read(&sync_sched_expedited_done);
-		if (UINT_CMP_GE((unsigned)s, (unsigned)snap)) {
-			smp_mb(); /* ensure test happens before caller kfree */
-			break;
-		}
-	} while (atomic_cmpxchg(&sync_sched_expedited_done, s, snap) != s);
-
-	put_online_cpus();
+	smp_mb(); /* ensure the grace period before the counter update. */
+	atomic_set(&sync_sched_expedited_done, snap);
+out:
+	mutex_unlock(&sync_sched_expedited_mutex);
+	free_cpumask_var(cm);
 }
 EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
 
@@ -2290,9 +2376,12 @@ static int rcu_cpu_has_callbacks(int cpu)
 	struct rcu_state *rsp;
 
 	/* RCU callbacks either ready or pending? */
-	for_each_rcu_flavor(rsp)
-		if (per_cpu_ptr(rsp->rda, cpu)->nxtlist)
+	for_each_rcu_flavor(rsp) {
+		struct rcu_data *rdp = per_cpu_ptr(rsp->rda, cpu);
+
+		if (rdp->nxtlist || rcu_nocb_need_deferred_wakeup(rdp))
 			return 1;
+	}
 	return 0;
 }
 
@@ -2420,7 +2509,11 @@ static void _rcu_barrier(struct rcu_state *rsp)
 	for_each_possible_cpu(cpu) {
 		preempt_disable();
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		if (cpu_is_offline(cpu)) {
+		if (rcu_nocb_barrier(rsp, rdp)) {
+			_rcu_barrier_trace(rsp, "NoCB", cpu,
+					   rsp->n_barrier_done);
+			preempt_enable();
+		} else if (cpu_is_offline(cpu)) {
 			_rcu_barrier_trace(rsp, "Offline", cpu,
 					   rsp->n_barrier_done);
 			preempt_enable();
@@ -2519,6 +2612,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -27,6 +27,7 @@
 #include <linux/threads.h>
 #include <linux/cpumask.h>
 #include <linux/seqlock.h>
+#include <linux/wait-simple.h>
 
 /*
  * Define shape of hierarchy based on NR_CPUS, CONFIG_RCU_FANOUT, and
@@ -318,6 +319,20 @@ struct rcu_data {
 	/* 6) _rcu_barrier() callback. */
 	struct rcu_head barrier_head;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 7) Callback offloading. */
+	struct rcu_head *nocb_head;	/* CBs waiting for kthread. */
+	struct rcu_head **nocb_tail;
+	atomic_long_t nocb_q_count;	/* # CBs waiting for kthread */
+	atomic_long_t nocb_q_count_lazy; /*  (approximate). */
+	long nocb_p_count;		/* # CBs being invoked by kthread */
+	long nocb_p_count_lazy;		/*  (approximate). */
+	bool nocb_defer_wakeup;		/* Kthread wakeup left to the tick. */
+	struct swait_head nocb_wq;	/* For nocb kthreads to sleep on. */
+	struct task_struct *nocb_kthread;
+	unsigned long n_cbs_offloaded;	/* # CBs invoked by kthread. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 	struct rcu_state *rsp;
 };
@@ -423,6 +438,7 @@ struct rcu_state {
 	unsigned long gp_max;			/* Maximum GP duration in */
 						/*  jiffies. */
 	char *name;				/* Name of structure. */
+	char abbr;				/* Abbreviated name. */
 	struct list_head flavors;		/* List of RCU flavors. */
 };
 
@@ -510,5 +526,13 @@ static void print_cpu_stall_info(struct rcu_state *rsp, int cpu);
 static void print_cpu_stall_info_end(void);
 static void zero_cpu_stall_ticks(struct rcu_data *rdp);
 static void increment_cpu_stall_ticks(void);
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy, unsigned long flags);
+static bool rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+				      struct rcu_data *rdp);
+static bool rcu_nocb_barrier(struct rcu_state *rsp, struct rcu_data *rdp);
+static bool rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp);
+static void do_nocb_deferred_wakeups(void);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp);
 
 #endif /* #ifndef RCU_TREE_NONCORE */
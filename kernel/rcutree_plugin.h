@@ -34,6 +34,12 @@
 #define RCU_BOOST_PRIO RCU_KTHREAD_PRIO
 #endif
 
+#ifdef CONFIG_RCU_NOCB_CPU
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static char __initdata nocb_buf[NR_CPUS * 5];
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 /*
  * Check the RCU kernel configuration parameters and print informative
  * messages about anything out of the ordinary.  If you like #ifdef, you
@@ -74,12 +80,19 @@ static void __init rcu_bootup_announce_oddness(void)
 		printk(KERN_INFO "\tExperimental boot-time adjustment of leaf fanout to %d.\n", rcu_fanout_leaf);
 	if (nr_cpu_ids != NR_CPUS)
 		printk(KERN_INFO "\tRCU restricting CPUs from NR_CPUS=%d to nr_cpu_ids=%d.\n", NR_CPUS, nr_cpu_ids);
+#ifdef CONFIG_RCU_NOCB_CPU
+	if (have_rcu_nocb_mask) {
+		cpulist_scnprintf(nocb_buf, sizeof(nocb_buf), rcu_nocb_mask);
+		printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n",
+		       nocb_buf);
+	}
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 }
 
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
 struct rcu_state rcu_preempt_state =
-	RCU_STATE_INITIALIZER(rcu_preempt, call_rcu);
+	RCU_STATE_INITIALIZER(rcu_preempt, 'p', call_rcu);
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -675,7 +688,7 @@ void synchronize_rcu(void)
 }
 EXPORT_SYMBOL_GPL(synchronize_rcu);
 
-static DECLARE_WAIT_QUEUE_HEAD(sync_rcu_preempt_exp_wq);
+static DEFINE_SWAIT_HEAD(sync_rcu_preempt_exp_wq);
 static long sync_rcu_preempt_exp_count;
 static DEFINE_MUTEX(sync_rcu_preempt_exp_mutex);
 
@@ -733,7 +746,7 @@ static void rcu_report_exp_rnp(struct rcu_state *rsp, struct rcu_node *rnp,
 		if (rnp->parent == NULL) {
 			raw_spin_unlock_irqrestore(&rnp->lock, flags);
 			if (wake)
-				wake_up(&sync_rcu_preempt_exp_wq);
+				swait_wake(&sync_rcu_preempt_exp_wq);
 			break;
 		}
 		mask = rnp->grpmask;
@@ -838,8 +851,8 @@ void synchronize_rcu_expedited(void)
 
 	/* Wait for snapshotted ->blkd_tasks lists to drain. */
 	rnp = rcu_get_root(rsp);
-	wait_event(sync_rcu_preempt_exp_wq,
-		   sync_rcu_preempt_exp_done(rnp));
+	swait_event(sync_rcu_preempt_exp_wq,
+		    sync_rcu_preempt_exp_done(rnp));
 
 	/* Clean up and exit. */
 	smp_mb(); /* ensure expedited GP seen before counter increment. */
@@ -2232,3 +2245,354 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocb_mask.  For each CPU in the set, there is a
+ * kthread for each flavor of RCU ("rcuos", "rcuob" and "rcuop") that
+ * waits for callbacks to be posted, waits for the grace period itself
+ * by posting a callback of its own from whatever CPU it happens to be
+ * running on, and then invokes the callbacks.  The kthreads are affine
+ * to the housekeeping CPUs, so that the offloaded CPUs are left with
+ * little more RCU work than responding to the grace periods.
+ *
+ * The boot CPU is never offloaded, so that at least one CPU always
+ * handles its callbacks from softirq.
+ */
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	if (cpumask_test_cpu(cpu, rcu_nocb_mask)) {
+		pr_warn("rcu_nocbs: boot cpu %d keeps its callbacks\n", cpu);
+		cpumask_clear_cpu(cpu, rcu_nocb_mask);
+	}
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the specified string of rcu_head structures onto the specified
+ * CPU's no-CBs lists.  The CPU is specified by rdp, the head of the
+ * string by rhp, and the tail of the string by rhtp.  The non-lazy/lazy
+ * counts are supplied by rhcount and rhcount_lazy.
+ *
+ * If the list was empty, the CPU's rcuo kthread is awakened, unless
+ * "defer" is set, in which case the wakeup is left to the next
+ * scheduling-clock interrupt.  The deferral is used when interrupts are
+ * disabled, as the caller might then hold scheduler locks.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp,
+				    struct rcu_head **rhtp,
+				    int rhcount, int rhcount_lazy,
+				    bool defer)
+{
+	struct rcu_head **old_rhpp;
+	struct task_struct *t;
+
+	/* Enqueue the callback on the nocb list and update counts. */
+	atomic_long_add(rhcount, &rdp->nocb_q_count);
+	atomic_long_add(rhcount_lazy, &rdp->nocb_q_count_lazy);
+	old_rhpp = xchg(&rdp->nocb_tail, rhtp);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+
+	/* If there is a kthread and the list was empty, awaken it. */
+	t = ACCESS_ONCE(rdp->nocb_kthread);
+	if (!t || old_rhpp != &rdp->nocb_head)
+		return;
+	if (defer)
+		ACCESS_ONCE(rdp->nocb_defer_wakeup) = true;
+	else
+		swait_wake(&rdp->nocb_wq);
+}
+
+/* Callback used by the rcuo kthreads to wait for a grace period. */
+static void rcu_nocb_gp_done(struct rcu_head *rhp);
+
+/*
+ * This is a helper for __call_rcu(), which invokes this when the normal
+ * callback queue is inoperable.  If this is not a no-CBs CPU, this
+ * function returns failure back to __call_rcu(), which can complete the
+ * enqueuing of the callback onto the normal callback list.
+ *
+ * The callbacks the rcuo kthreads use to wait for their grace periods
+ * are never offloaded, as the kthread would otherwise wait for itself.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy, unsigned long flags)
+{
+	if (!is_nocb_cpu(rdp->cpu) || rhp->func == rcu_nocb_gp_done)
+		return 0;
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, lazy,
+				irqs_disabled_flags(flags));
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 atomic_long_read(&rdp->nocb_q_count_lazy),
+					 atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+	return 1;
+}
+
+/*
+ * Adopt orphaned callbacks on a no-CBs CPU, or return 0 if this is
+ * not a no-CBs CPU.  The callbacks are handed to the rcuo kthread,
+ * which waits for a new grace period before invoking them.
+ */
+static bool __maybe_unused rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+						     struct rcu_data *rdp)
+{
+	long ql = rsp->qlen;
+	long qll = rsp->qlen_lazy;
+
+	/* If this is not a no-CBs CPU, tell the caller to do it the old way. */
+	if (!is_nocb_cpu(rdp->cpu))
+		return 0;
+	rdp->n_cbs_adopted += ql;
+	rsp->qlen = 0;
+	rsp->qlen_lazy = 0;
+
+	/* First, enqueue the donelist, if any.  This preserves CB ordering. */
+	if (rsp->orphan_donelist != NULL) {
+		__call_rcu_nocb_enqueue(rdp, rsp->orphan_donelist,
+					rsp->orphan_donetail, ql, qll, 0);
+		ql = qll = 0;
+		rsp->orphan_donelist = NULL;
+		rsp->orphan_donetail = &rsp->orphan_donelist;
+	}
+	if (rsp->orphan_nxtlist != NULL) {
+		__call_rcu_nocb_enqueue(rdp, rsp->orphan_nxtlist,
+					rsp->orphan_nxttail, ql, qll, 0);
+		ql = qll = 0;
+		rsp->orphan_nxtlist = NULL;
+		rsp->orphan_nxttail = &rsp->orphan_nxtlist;
+	}
+	return 1;
+}
+
+/*
+ * Queue the _rcu_barrier() callback of a no-CBs CPU behind the callbacks
+ * already handed to its rcuo kthread, or return 0 if this is not a
+ * no-CBs CPU.  No IPI is needed, and it does not matter whether the
+ * CPU is online, as the kthread invokes the callbacks in order.
+ */
+static bool rcu_nocb_barrier(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	if (!is_nocb_cpu(rdp->cpu))
+		return 0;
+	if (!ACCESS_ONCE(rdp->nocb_kthread))
+		return 1;
+	atomic_inc(&rsp->barrier_cpu_count);
+	debug_rcu_head_queue(&rdp->barrier_head);
+	rdp->barrier_head.func = rcu_barrier_callback;
+	rdp->barrier_head.next = NULL;
+	smp_mb(); /* Count before the callback can be invoked. */
+	__call_rcu_nocb_enqueue(rdp, &rdp->barrier_head,
+				&rdp->barrier_head.next, 1, 0, 0);
+	return 1;
+}
+
+/* Does this CPU owe its rcuo kthread a wakeup? */
+static bool rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
+{
+	return ACCESS_ONCE(rdp->nocb_defer_wakeup);
+}
+
+/*
+ * Do the rcuo kthread wakeups that __call_rcu() left to the
+ * scheduling-clock interrupt of this CPU.
+ */
+static void do_nocb_deferred_wakeups(void)
+{
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+
+	for_each_rcu_flavor(rsp) {
+		rdp = __this_cpu_ptr(rsp->rda);
+		if (!rcu_nocb_need_deferred_wakeup(rdp))
+			continue;
+		ACCESS_ONCE(rdp->nocb_defer_wakeup) = false;
+		swait_wake(&rdp->nocb_wq);
+	}
+}
+
+struct rcu_nocb_gp {
+	struct rcu_head		head;
+	struct completion	done;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *rhp)
+{
+	struct rcu_nocb_gp *gp = container_of(rhp, struct rcu_nocb_gp, head);
+
+	complete(&gp->done);
+}
+
+/* Wait for a grace period of the rcuo kthread's flavor of RCU. */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_nocb_gp gp;
+
+	init_rcu_head_on_stack(&gp.head);
+	init_completion(&gp.done);
+	rdp->rsp->call(&gp.head, rcu_nocb_gp_done);
+	wait_for_completion(&gp.done);
+	destroy_rcu_head_on_stack(&gp.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	int c, cl;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		swait_event_interruptible(rdp->nocb_wq,
+					  ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			flush_signals(current);
+			continue;
+		}
+
+		/* Move callbacks to wait-for-GP list, which is empty. */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = ACCESS_ONCE(list->next);
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			list = next;
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+		rdp->n_cbs_offloaded += c;
+	}
+	return 0;
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_swait_head(&rdp->nocb_wq);
+}
+
+/*
+ * Create a kthread for each RCU flavor for each no-CBs CPU, affine to
+ * the housekeeping CPUs which are not offloaded themselves.  This
+ * always includes the boot CPU.
+ */
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	int cpu;
+	cpumask_var_t cm;
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+	struct task_struct *t;
+
+	if (!have_rcu_nocb_mask || cpumask_empty(rcu_nocb_mask))
+		return 0;
+	if (!alloc_cpumask_var(&cm, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(cm, housekeeping_cpumask(), rcu_nocb_mask);
+	cpumask_set_cpu(smp_processor_id(), cm);
+
+	for_each_rcu_flavor(rsp) {
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			t = kthread_create(rcu_nocb_kthread, rdp,
+					   "rcuo%c/%d", rsp->abbr, cpu);
+			if (IS_ERR(t)) {
+				pr_err("rcu_nocbs: failed to spawn rcuo%c/%d\n",
+				       rsp->abbr, cpu);
+				continue;
+			}
+			set_cpus_allowed_ptr(t, cm);
+			ACCESS_ONCE(rdp->nocb_kthread) = t;
+			wake_up_process(t);
+		}
+	}
+	free_cpumask_var(cm);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy, unsigned long flags)
+{
+	return 0;
+}
+
+static bool __maybe_unused rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+						     struct rcu_data *rdp)
+{
+	return 0;
+}
+
+static bool rcu_nocb_barrier(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	return 0;
+}
+
+static bool rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
+{
+	return 0;
+}
+
+static void do_nocb_deferred_wakeups(void)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
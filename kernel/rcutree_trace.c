@@ -116,8 +116,12 @@ static void print_one_rcu_data(struct seq_file *m, struct rcu_data *rdp)
 		   per_cpu(rcu_cpu_kthread_loops, rdp->cpu) & 0xffff);
 #endif /* #ifdef CONFIG_RCU_BOOST */
 	seq_printf(m, " b=%ld", rdp->blimit);
-	seq_printf(m, " ci=%lu co=%lu ca=%lu\n",
+	seq_printf(m, " ci=%lu co=%lu ca=%lu",
 		   rdp->n_cbs_invoked, rdp->n_cbs_orphaned, rdp->n_cbs_adopted);
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_printf(m, " cof=%lu", rdp->n_cbs_offloaded);
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+	seq_puts(m, "\n");
 }
 
 static int show_rcudata(struct seq_file *m, void *unused)
@@ -177,8 +181,12 @@ static void print_one_rcu_data_csv(struct seq_file *m, struct rcu_data *rdp)
 					  rdp->cpu)));
 #endif /* #ifdef CONFIG_RCU_BOOST */
 	seq_printf(m, ",%ld", rdp->blimit);
-	seq_printf(m, ",%lu,%lu,%lu\n",
+	seq_printf(m, ",%lu,%lu,%lu",
 		   rdp->n_cbs_invoked, rdp->n_cbs_orphaned, rdp->n_cbs_adopted);
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_printf(m, ",%lu", rdp->n_cbs_offloaded);
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+	seq_puts(m, "\n");
 }
 
 static int show_rcudata_csv(struct seq_file *m, void *unused)
@@ -192,7 +200,11 @@ static int show_rcudata_csv(struct seq_file *m, void *unused)
 #ifdef CONFIG_RCU_BOOST
 	seq_puts(m, "\"kt\",\"ktl\"");
 #endif /* #ifdef CONFIG_RCU_BOOST */
-	seq_puts(m, ",\"b\",\"ci\",\"co\",\"ca\"\n");
+	seq_puts(m, ",\"b\",\"ci\",\"co\",\"ca\"");
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_puts(m, ",\"cof\"");
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+	seq_puts(m, "\n");
 	for_each_rcu_flavor(rsp) {
 		seq_printf(m, "\"%s:\"\n", rsp->name);
 		for_each_possible_cpu(cpu)
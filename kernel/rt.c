@@ -175,12 +175,324 @@ void __lockfunc _mutex_unlock(struct mutex *lock)
 }
 EXPORT_SYMBOL(_mutex_unlock);
 
+/*
+ * Multi-reader rwlock_t and rw_semaphore
+ *
+ * ->readers counts the tasks which hold the lock for read. Readers
+ * get in with a cmpxchg on ->readers as long as no writer is around
+ * and fewer than rt_rwlock_reader_limit readers hold the lock.
+ *
+ * A writer takes the rtmutex first, so readers which come in after
+ * it block on the rtmutex and boost the writer. It then adds
+ * RT_RW_WRITER_BIAS to ->readers, which keeps out the reader fast
+ * path, and waits for the active readers to leave. The last one
+ * wakes the rtmutex owner. The writer can not boost the readers it
+ * waits for, the reader limit bounds that inversion.
+ *
+ * Readers which hit the limit take the rtmutex as well and wait for
+ * a reader to leave while holding it. Such a reader sets
+ * RT_RW_READER_WAITING in ->readers, so only then leaving readers
+ * wake the rtmutex owner.
+ *
+ * Read locks held by a task are recorded in current->owned_read_locks,
+ * so recursive read locking never blocks behind a waiting writer or
+ * the reader limit. The write owner can take read locks recursively,
+ * these are counted in ->read_depth.
+ *
+ * A task which holds RT_MAX_READ_LOCK_DEPTH read locks already takes
+ * further ones like a write lock. Recursion is then recognized by
+ * the rtmutex owner, at the price of keeping out other readers.
+ */
+#define RT_RW_WRITER_BIAS	INT_MIN
+#define RT_RW_READER_WAITING	(1 << 30)
+
+int rt_rwlock_reader_limit = NR_CPUS;
+
+static struct rt_reader_lock *rt_reader_lock_find(void *rw)
+{
+	struct task_struct *self = current;
+	int i;
+
+	for (i = self->reader_lock_count - 1; i >= 0; i--) {
+		if (self->owned_read_locks[i].lock == rw)
+			return &self->owned_read_locks[i];
+	}
+	return NULL;
+}
+
+static inline int rt_reader_locks_full(void)
+{
+	return current->reader_lock_count >= RT_MAX_READ_LOCK_DEPTH;
+}
+
+static void rt_reader_lock_add(void *rw, int count)
+{
+	struct task_struct *self = current;
+	struct rt_reader_lock *rl;
+
+	rl = &self->owned_read_locks[self->reader_lock_count++];
+	rl->lock = rw;
+	rl->count = count;
+}
+
+/*
+ * Returns 1 when current holds @rw already and the read lock
+ * was taken recursively.
+ */
+static int rt_read_nest(void *rw, struct rt_mutex *lock, int *read_depth)
+{
+	struct rt_reader_lock *rl;
+
+	if (rt_mutex_owner(lock) == current) {
+		(*read_depth)++;
+		return 1;
+	}
+
+	rl = rt_reader_lock_find(rw);
+	if (rl) {
+		rl->count++;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Returns 1 when only a recursive read lock was dropped and @rw
+ * is still held by current. With 0 the read lock is released, from
+ * the rtmutex if current owns it, see rt_reader_locks_full().
+ */
+static int rt_read_unnest(void *rw, struct rt_mutex *lock, int *read_depth)
+{
+	struct task_struct *self = current;
+	struct rt_reader_lock *rl;
+
+	if (rt_mutex_owner(lock) == self) {
+		if (!*read_depth)
+			return 0;
+		(*read_depth)--;
+		return 1;
+	}
+
+	rl = rt_reader_lock_find(rw);
+	if (!rl)
+		return 0;
+	if (--rl->count)
+		return 1;
+
+	/* Read locks are not necessarily dropped in reverse order */
+	*rl = self->owned_read_locks[--self->reader_lock_count];
+	return 0;
+}
+
+static inline void rt_rw_mutex_lock(struct rt_mutex *lock)
+{
+	if (lock->save_state)
+		__rt_spin_lock(lock);
+	else
+		rt_mutex_lock(lock);
+}
+
+static inline void rt_rw_mutex_unlock(struct rt_mutex *lock)
+{
+	if (lock->save_state)
+		__rt_spin_unlock(lock);
+	else
+		rt_mutex_unlock(lock);
+}
+
+static inline int rt_rw_read_tryinc(atomic_t *readers)
+{
+	int limit = ACCESS_ONCE(rt_rwlock_reader_limit);
+	int r = atomic_read(readers);
+
+	while (r >= 0 && (r & ~RT_RW_READER_WAITING) < limit) {
+		int old = atomic_cmpxchg(readers, r, r + 1);
+
+		if (likely(old == r))
+			return 1;
+		r = old;
+	}
+	return 0;
+}
+
+/*
+ * Block until the rtmutex owner can proceed. Sleeping spinlock
+ * style locks keep the task state in ->saved_state, see
+ * rt_spin_lock_slowlock().
+ */
+static void rt_rw_set_blocked(struct rt_mutex *lock, int save)
+{
+	struct task_struct *self = current;
+
+	if (!lock->save_state) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		return;
+	}
+
+	raw_spin_lock_irq(&self->pi_lock);
+	if (save)
+		self->saved_state = self->state;
+	__set_current_state(TASK_UNINTERRUPTIBLE);
+	raw_spin_unlock_irq(&self->pi_lock);
+}
+
+static void rt_rw_clear_blocked(struct rt_mutex *lock)
+{
+	struct task_struct *self = current;
+
+	if (!lock->save_state) {
+		__set_current_state(TASK_RUNNING);
+		return;
+	}
+
+	raw_spin_lock_irq(&self->pi_lock);
+	__set_current_state(self->saved_state);
+	self->saved_state = TASK_RUNNING;
+	raw_spin_unlock_irq(&self->pi_lock);
+}
+
+/*
+ * Called with @lock held: a writer waits for the active readers
+ * to leave, a reader for a slot below the reader limit.
+ */
+static void __sched
+rt_rw_wait_for_readers(struct rt_mutex *lock, atomic_t *readers, int writer)
+{
+	raw_spin_lock(&lock->wait_lock);
+	if (!writer)
+		atomic_add(RT_RW_READER_WAITING, readers);
+	rt_rw_set_blocked(lock, 1);
+
+	for (;;) {
+		if (writer) {
+			if (atomic_read(readers) == RT_RW_WRITER_BIAS)
+				break;
+		} else if (rt_rw_read_tryinc(readers)) {
+			break;
+		}
+
+		raw_spin_unlock(&lock->wait_lock);
+
+		schedule_rt_mutex(lock);
+
+		raw_spin_lock(&lock->wait_lock);
+		rt_rw_set_blocked(lock, 0);
+	}
+
+	if (!writer)
+		atomic_sub(RT_RW_READER_WAITING, readers);
+	rt_rw_clear_blocked(lock);
+	raw_spin_unlock(&lock->wait_lock);
+}
+
+static void rt_rw_wake_owner(struct rt_mutex *lock)
+{
+	struct task_struct *owner;
+
+	raw_spin_lock(&lock->wait_lock);
+	/* The owner might drop the rtmutex through the fast path */
+	rcu_read_lock();
+	owner = rt_mutex_owner(lock);
+	if (owner) {
+		if (lock->save_state)
+			wake_up_lock_sleeper(owner);
+		else
+			wake_up_process(owner);
+	}
+	rcu_read_unlock();
+	raw_spin_unlock(&lock->wait_lock);
+}
+
+static void __rt_rw_read_lock(struct rt_mutex *lock, atomic_t *readers)
+{
+	if (likely(rt_rw_read_tryinc(readers)))
+		return;
+
+	/* Either a writer is around or the reader limit is reached */
+	rt_rw_mutex_lock(lock);
+	if (!rt_rw_read_tryinc(readers))
+		rt_rw_wait_for_readers(lock, readers, 0);
+	rt_rw_mutex_unlock(lock);
+}
+
+static void __rt_rw_read_unlock(struct rt_mutex *lock, atomic_t *readers)
+{
+	int r = atomic_dec_return(readers);
+
+	/*
+	 * Wake a writer when the last reader leaves, or a reader which
+	 * is waiting for a slot below the limit.
+	 */
+	if (unlikely(r == RT_RW_WRITER_BIAS ||
+		     (r >= 0 && (r & RT_RW_READER_WAITING))))
+		rt_rw_wake_owner(lock);
+}
+
+static void __rt_rw_write_lock(struct rt_mutex *lock, atomic_t *readers)
+{
+	rt_rw_mutex_lock(lock);
+	if (atomic_add_return(RT_RW_WRITER_BIAS, readers) != RT_RW_WRITER_BIAS)
+		rt_rw_wait_for_readers(lock, readers, 1);
+}
+
+static int __rt_rw_write_trylock(struct rt_mutex *lock, atomic_t *readers)
+{
+	if (!rt_mutex_trylock(lock))
+		return 0;
+	if (atomic_cmpxchg(readers, 0, RT_RW_WRITER_BIAS) == 0)
+		return 1;
+	rt_rw_mutex_unlock(lock);
+	return 0;
+}
+
+static void __rt_rw_write_unlock(struct rt_mutex *lock, atomic_t *readers)
+{
+	/* Readers can not touch ->readers while a writer holds the lock */
+	smp_mb();
+	atomic_set(readers, 0);
+	rt_rw_mutex_unlock(lock);
+}
+
+/*
+ * Read locks taken while current->owned_read_locks was full are
+ * held like a write lock.
+ */
+static void rt_rw_read_lock_tracked(void *rw, struct rt_mutex *lock,
+				    atomic_t *readers)
+{
+	if (unlikely(rt_reader_locks_full())) {
+		__rt_rw_write_lock(lock, readers);
+		return;
+	}
+	__rt_rw_read_lock(lock, readers);
+	rt_reader_lock_add(rw, 1);
+}
+
+static int rt_rw_read_trylock_tracked(void *rw, struct rt_mutex *lock,
+				      atomic_t *readers)
+{
+	if (unlikely(rt_reader_locks_full()))
+		return __rt_rw_write_trylock(lock, readers);
+	if (!rt_rw_read_tryinc(readers))
+		return 0;
+	rt_reader_lock_add(rw, 1);
+	return 1;
+}
+
+static void rt_rw_read_unlock_tracked(struct rt_mutex *lock, atomic_t *readers)
+{
+	if (unlikely(rt_mutex_owner(lock) == current))
+		__rt_rw_write_unlock(lock, readers);
+	else
+		__rt_rw_read_unlock(lock, readers);
+}
+
 /*
  * rwlock_t functions
  */
 int __lockfunc rt_write_trylock(rwlock_t *rwlock)
 {
-	int ret = rt_mutex_trylock(&rwlock->lock);
+	int ret = __rt_rw_write_trylock(&rwlock->lock, &rwlock->readers);
 
 	migrate_disable();
 	if (ret)
@@ -207,26 +519,21 @@ EXPORT_SYMBOL(rt_write_trylock_irqsave);
 
 int __lockfunc rt_read_trylock(rwlock_t *rwlock)
 {
-	struct rt_mutex *lock = &rwlock->lock;
 	int ret = 1;
 
 	/*
-	 * recursive read locks succeed when current owns the lock,
-	 * but not when read_depth == 0 which means that the lock is
-	 * write locked.
+	 * recursive read locks succeed when current holds the lock
+	 * for read or write already.
 	 */
 	migrate_disable();
-	if (rt_mutex_owner(lock) != current) {
-		ret = rt_mutex_trylock(lock);
+	if (!rt_read_nest(rwlock, &rwlock->lock, &rwlock->read_depth)) {
+		ret = rt_rw_read_trylock_tracked(rwlock, &rwlock->lock,
+						 &rwlock->readers);
 		if (ret)
-			rwlock_acquire(&rwlock->dep_map, 0, 1, _RET_IP_);
-	} else if (!rwlock->read_depth) {
-		ret = 0;
+			rwlock_acquire_read(&rwlock->dep_map, 0, 1, _RET_IP_);
 	}
 
-	if (ret)
-		rwlock->read_depth++;
-	else
+	if (!ret)
 		migrate_enable();
 
 	return ret;
@@ -236,22 +543,20 @@ EXPORT_SYMBOL(rt_read_trylock);
 void __lockfunc rt_write_lock(rwlock_t *rwlock)
 {
 	rwlock_acquire(&rwlock->dep_map, 0, 0, _RET_IP_);
-	__rt_spin_lock(&rwlock->lock);
+	__rt_rw_write_lock(&rwlock->lock, &rwlock->readers);
 }
 EXPORT_SYMBOL(rt_write_lock);
 
 void __lockfunc rt_read_lock(rwlock_t *rwlock)
 {
-	struct rt_mutex *lock = &rwlock->lock;
-
 	/*
-	 * recursive read locks succeed when current owns the lock
+	 * recursive read locks succeed when current holds the lock
 	 */
-	if (rt_mutex_owner(lock) != current) {
-		rwlock_acquire(&rwlock->dep_map, 0, 0, _RET_IP_);
-		__rt_spin_lock(lock);
-	}
-	rwlock->read_depth++;
+	if (rt_read_nest(rwlock, &rwlock->lock, &rwlock->read_depth))
+		return;
+
+	rwlock_acquire_read(&rwlock->dep_map, 0, 0, _RET_IP_);
+	rt_rw_read_lock_tracked(rwlock, &rwlock->lock, &rwlock->readers);
 }
 
 EXPORT_SYMBOL(rt_read_lock);
@@ -260,17 +565,18 @@ void __lockfunc rt_write_unlock(rwlock_t *rwlock)
 {
 	/* NOTE: we always pass in '1' for nested, for simplicity */
 	rwlock_release(&rwlock->dep_map, 1, _RET_IP_);
-	__rt_spin_unlock(&rwlock->lock);
+	__rt_rw_write_unlock(&rwlock->lock, &rwlock->readers);
 }
 EXPORT_SYMBOL(rt_write_unlock);
 
 void __lockfunc rt_read_unlock(rwlock_t *rwlock)
 {
-	/* Release the lock only when read_depth is down to 0 */
-	if (--rwlock->read_depth == 0) {
-		rwlock_release(&rwlock->dep_map, 1, _RET_IP_);
-		__rt_spin_unlock(&rwlock->lock);
-	}
+	/* Release the lock only when the outermost read lock is dropped */
+	if (rt_read_unnest(rwlock, &rwlock->lock, &rwlock->read_depth))
+		return;
+
+	rwlock_release(&rwlock->dep_map, 1, _RET_IP_);
+	rt_rw_read_unlock_tracked(&rwlock->lock, &rwlock->readers);
 }
 EXPORT_SYMBOL(rt_read_unlock);
 
@@ -300,6 +606,7 @@ void __rt_rwlock_init(rwlock_t *rwlock, char *name, struct lock_class_key *key)
 	lockdep_init_map(&rwlock->dep_map, name, key, 0);
 #endif
 	rwlock->lock.save_state = 1;
+	atomic_set(&rwlock->readers, 0);
 	rwlock->read_depth = 0;
 }
 EXPORT_SYMBOL(__rt_rwlock_init);
@@ -311,33 +618,45 @@ EXPORT_SYMBOL(__rt_rwlock_init);
 void  rt_up_write(struct rw_semaphore *rwsem)
 {
 	rwsem_release(&rwsem->dep_map, 1, _RET_IP_);
-	rt_mutex_unlock(&rwsem->lock);
+	__rt_rw_write_unlock(&rwsem->lock, &rwsem->readers);
 }
 EXPORT_SYMBOL(rt_up_write);
 
 void  rt_up_read(struct rw_semaphore *rwsem)
 {
-	if (--rwsem->read_depth == 0) {
-		rwsem_release(&rwsem->dep_map, 1, _RET_IP_);
-		rt_mutex_unlock(&rwsem->lock);
-	}
+	if (rt_read_unnest(rwsem, &rwsem->lock, &rwsem->read_depth))
+		return;
+
+	rwsem_release(&rwsem->dep_map, 1, _RET_IP_);
+	rt_rw_read_unlock_tracked(&rwsem->lock, &rwsem->readers);
 }
 EXPORT_SYMBOL(rt_up_read);
 
 /*
  * downgrade a write lock into a read lock
- * - just wake up any readers at the front of the queue
+ * - the writer becomes the only reader and lets the others in
  */
 void  rt_downgrade_write(struct rw_semaphore *rwsem)
 {
 	BUG_ON(rt_mutex_owner(&rwsem->lock) != current);
-	rwsem->read_depth = 1;
+
+	/* Without a free slot the rwsem stays held like a write lock */
+	if (unlikely(rt_reader_locks_full()))
+		return;
+
+	/* Recursive read locks of the write owner are kept */
+	rt_reader_lock_add(rwsem, rwsem->read_depth + 1);
+	rwsem->read_depth = 0;
+
+	smp_mb();
+	atomic_set(&rwsem->readers, 1);
+	rt_mutex_unlock(&rwsem->lock);
 }
 EXPORT_SYMBOL(rt_downgrade_write);
 
 int  rt_down_write_trylock(struct rw_semaphore *rwsem)
 {
-	int ret = rt_mutex_trylock(&rwsem->lock);
+	int ret = __rt_rw_write_trylock(&rwsem->lock, &rwsem->readers);
 
 	if (ret)
 		rwsem_acquire(&rwsem->dep_map, 0, 1, _RET_IP_);
@@ -348,50 +667,42 @@ EXPORT_SYMBOL(rt_down_write_trylock);
 void  rt_down_write(struct rw_semaphore *rwsem)
 {
 	rwsem_acquire(&rwsem->dep_map, 0, 0, _RET_IP_);
-	rt_mutex_lock(&rwsem->lock);
+	__rt_rw_write_lock(&rwsem->lock, &rwsem->readers);
 }
 EXPORT_SYMBOL(rt_down_write);
 
 void  rt_down_write_nested(struct rw_semaphore *rwsem, int subclass)
 {
 	rwsem_acquire(&rwsem->dep_map, subclass, 0, _RET_IP_);
-	rt_mutex_lock(&rwsem->lock);
+	__rt_rw_write_lock(&rwsem->lock, &rwsem->readers);
 }
 EXPORT_SYMBOL(rt_down_write_nested);
 
 int  rt_down_read_trylock(struct rw_semaphore *rwsem)
 {
-	struct rt_mutex *lock = &rwsem->lock;
-	int ret = 1;
+	int ret;
 
 	/*
-	 * recursive read locks succeed when current owns the rwsem,
-	 * but not when read_depth == 0 which means that the rwsem is
-	 * write locked.
+	 * recursive read locks succeed when current holds the rwsem
+	 * for read or write already.
 	 */
-	if (rt_mutex_owner(lock) != current) {
-		ret = rt_mutex_trylock(&rwsem->lock);
-		if (ret)
-			rwsem_acquire(&rwsem->dep_map, 0, 1, _RET_IP_);
-	} else if (!rwsem->read_depth) {
-		ret = 0;
-	}
+	if (rt_read_nest(rwsem, &rwsem->lock, &rwsem->read_depth))
+		return 1;
 
+	ret = rt_rw_read_trylock_tracked(rwsem, &rwsem->lock, &rwsem->readers);
 	if (ret)
-		rwsem->read_depth++;
+		rwsem_acquire_read(&rwsem->dep_map, 0, 1, _RET_IP_);
 	return ret;
 }
 EXPORT_SYMBOL(rt_down_read_trylock);
 
 static void __rt_down_read(struct rw_semaphore *rwsem, int subclass)
 {
-	struct rt_mutex *lock = &rwsem->lock;
+	if (rt_read_nest(rwsem, &rwsem->lock, &rwsem->read_depth))
+		return;
 
-	if (rt_mutex_owner(lock) != current) {
-		rwsem_acquire(&rwsem->dep_map, subclass, 0, _RET_IP_);
-		rt_mutex_lock(&rwsem->lock);
-	}
-	rwsem->read_depth++;
+	rwsem_acquire_read(&rwsem->dep_map, subclass, 0, _RET_IP_);
+	rt_rw_read_lock_tracked(rwsem, &rwsem->lock, &rwsem->readers);
 }
 
 void  rt_down_read(struct rw_semaphore *rwsem)
@@ -416,6 +727,7 @@ void  __rt_rwsem_init(struct rw_semaphore *rwsem, char *name,
 	debug_check_no_locks_freed((void *)rwsem, sizeof(*rwsem));
 	lockdep_init_map(&rwsem->dep_map, name, key, 0);
 #endif
+	atomic_set(&rwsem->readers, 0);
 	rwsem->read_depth = 0;
 	rwsem->lock.save_state = 0;
 }
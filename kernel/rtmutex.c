@@ -116,11 +116,22 @@ static inline void init_lists(struct rt_mutex *lock)
  */
 int rt_mutex_getprio(struct task_struct *task)
 {
+	int prio;
+
 	if (likely(!task_has_pi_waiters(task)))
 		return task->normal_prio;
 
-	return min(task_top_pi_waiter(task)->pi_list_entry.prio,
-		   task->normal_prio);
+	prio = task_top_pi_waiter(task)->pi_list_entry.prio;
+
+	/*
+	 * There is no deadline inheritance: a -deadline waiter boosts
+	 * the owner to the highest RT priority, it does not lend it
+	 * its runtime and deadline.
+	 */
+	if (dl_prio(prio))
+		prio = 0;
+
+	return min(prio, task->normal_prio);
 }
 
 /*
@@ -653,7 +664,7 @@ void rt_mutex_adjust_pi(struct task_struct *task)
  * preemptible spin_lock functions:
  */
 static inline void rt_spin_lock_fastlock(struct rt_mutex *lock,
-					 void  (*slowfn)(struct rt_mutex *lock))
+					 int  (*slowfn)(struct rt_mutex *lock))
 {
 	might_sleep();
 
@@ -708,6 +719,259 @@ static int adaptive_wait(struct rt_mutex *lock,
 }
 #endif
 
+#if defined(CONFIG_SMP) && defined(__HAVE_ARCH_CMPXCHG) && \
+	!defined(CONFIG_DEBUG_RT_MUTEXES)
+/*
+ * Optimistic spinning for rtmutex based spinlocks:
+ *
+ * Most spinlock sections are short, so a contender which finds the
+ * owner running on another cpu is better off spinning for the lock
+ * than queueing a waiter, blocking and getting woken up again.
+ *
+ * Spinners queue up on a MCS style queue (lock->osq) first. Only the
+ * head of the queue polls the lock, the others spin on their own per
+ * cpu node, which keeps the cache line of the lock quiet when many
+ * cpus contend.
+ *
+ * Spinners are not on the wait list, so they neither boost the owner
+ * nor get boosted. That is fine as they only spin while the owner is
+ * running. Once the lock has waiters the spinners leave it to the
+ * slow path, which hands the lock out by priority and thereby keeps
+ * the PI semantics of the wait list.
+ */
+struct rt_spin_osq_node {
+	struct rt_spin_osq_node	*next, *prev;
+	int			locked;
+	int			cpu;	/* encoded, see below */
+};
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct rt_spin_osq_node, rt_spin_osq_nodes);
+
+/* 0 in lock->osq means no spinner, so cpu numbers are stored + 1 */
+static inline int osq_encode_cpu(int cpu)
+{
+	return cpu + 1;
+}
+
+static inline struct rt_spin_osq_node *osq_decode_cpu(int val)
+{
+	return &per_cpu(rt_spin_osq_nodes, val - 1);
+}
+
+/*
+ * Get a stable @node->next pointer, either for unlock() or unqueue()
+ * purposes. Can return NULL in case we were the last queued and we
+ * updated @osq back to @prev.
+ */
+static struct rt_spin_osq_node *
+rt_spin_osq_wait_next(atomic_t *osq, struct rt_spin_osq_node *node,
+		      struct rt_spin_osq_node *prev)
+{
+	struct rt_spin_osq_node *next = NULL;
+	int curr = node->cpu;
+	int old = prev ? prev->cpu : 0;
+
+	for (;;) {
+		if (atomic_read(osq) == curr &&
+		    atomic_cmpxchg(osq, curr, old) == curr) {
+			/*
+			 * We were the last queued, we moved @osq back.
+			 * @prev will now observe @osq and will complete
+			 * its unlock()/unqueue().
+			 */
+			break;
+		}
+
+		/*
+		 * We must xchg() the @node->next value, because if we
+		 * were to leave it in, a concurrent unlock()/unqueue()
+		 * from @node->next might complete Step-A and think its
+		 * @prev is still valid.
+		 */
+		if (node->next) {
+			next = xchg(&node->next, NULL);
+			if (next)
+				break;
+		}
+		cpu_relax();
+	}
+	return next;
+}
+
+/*
+ * Queue up as a spinner. Returns true when we are the head of the
+ * queue, false when we gave up because we need to reschedule.
+ * Called with preemption disabled.
+ */
+static bool rt_spin_osq_lock(atomic_t *osq)
+{
+	struct rt_spin_osq_node *node = &__get_cpu_var(rt_spin_osq_nodes);
+	struct rt_spin_osq_node *prev, *next;
+	int curr = osq_encode_cpu(smp_processor_id());
+	int old;
+
+	node->locked = 0;
+	node->next = NULL;
+	node->cpu = curr;
+
+	old = atomic_xchg(osq, curr);
+	if (!old)
+		return true;
+
+	prev = osq_decode_cpu(old);
+	node->prev = prev;
+	ACCESS_ONCE(prev->next) = node;
+
+	while (!ACCESS_ONCE(node->locked)) {
+		if (need_resched())
+			goto unqueue;
+		cpu_relax();
+	}
+	return true;
+
+unqueue:
+	/*
+	 * Step - A  -- stabilize @prev
+	 *
+	 * Undo our @prev->next assignment; this will make @prev's
+	 * unlock()/unqueue() wait for a next pointer since @osq
+	 * points to us (or later).
+	 */
+	for (;;) {
+		if (prev->next == node &&
+		    cmpxchg(&prev->next, node, NULL) == node)
+			break;
+
+		/*
+		 * We can only fail the cmpxchg() racing against an
+		 * unlock(), in which case we should observe
+		 * @node->locked becoming true.
+		 */
+		if (ACCESS_ONCE(node->locked))
+			return true;
+
+		cpu_relax();
+
+		/*
+		 * Or we race against a concurrent unqueue()'s step-B,
+		 * in which case its step-C will write us a new
+		 * @node->prev pointer.
+		 */
+		prev = ACCESS_ONCE(node->prev);
+	}
+
+	/*
+	 * Step - B -- stabilize @next
+	 *
+	 * Similar to unlock(), wait for @node->next or move @osq
+	 * back to @prev.
+	 */
+	next = rt_spin_osq_wait_next(osq, node, prev);
+	if (!next)
+		return false;
+
+	/*
+	 * Step - C -- unlink
+	 *
+	 * @prev is stable because its still waiting for a new
+	 * @prev->next pointer, @next is stable because our
+	 * @node->next pointer is NULL and it will wait in Step-A.
+	 */
+	ACCESS_ONCE(next->prev) = prev;
+	ACCESS_ONCE(prev->next) = next;
+
+	return false;
+}
+
+/* Leave the spinner queue and pass the head to the next spinner */
+static void rt_spin_osq_unlock(atomic_t *osq)
+{
+	struct rt_spin_osq_node *node = &__get_cpu_var(rt_spin_osq_nodes);
+	struct rt_spin_osq_node *next;
+
+	/* Fast path for the uncontended case */
+	if (likely(atomic_cmpxchg(osq, node->cpu, 0) == node->cpu))
+		return;
+
+	/* Second most likely case */
+	next = xchg(&node->next, NULL);
+	if (next) {
+		ACCESS_ONCE(next->locked) = 1;
+		return;
+	}
+
+	next = rt_spin_osq_wait_next(osq, node, NULL);
+	if (next)
+		ACCESS_ONCE(next->locked) = 1;
+}
+
+/*
+ * Spin while @owner holds @lock and runs. Returns 0 when the owner
+ * got scheduled out, waiters got queued or we need to reschedule,
+ * 1 when the lock changed hands.
+ */
+static int rt_spin_on_owner(struct rt_mutex *lock, struct task_struct *owner)
+{
+	int ret = 1;
+
+	rcu_read_lock();
+	while (ACCESS_ONCE(lock->owner) == owner) {
+		/*
+		 * Ensure that owner->on_cpu is dereferenced _after_
+		 * checking the above to be valid.
+		 */
+		barrier();
+		if (!owner->on_cpu || need_resched()) {
+			ret = 0;
+			break;
+		}
+		cpu_relax();
+	}
+	rcu_read_unlock();
+	return ret;
+}
+
+/*
+ * Try to acquire @lock by spinning on its owner. Returns 1 when the
+ * lock was acquired.
+ */
+static int rt_spin_lock_optimistic_spin(struct rt_mutex *lock)
+{
+	struct task_struct *owner;
+	int taken = 0;
+
+	preempt_disable();
+	if (!rt_spin_osq_lock(&lock->osq))
+		goto out;
+
+	for (;;) {
+		owner = ACCESS_ONCE(lock->owner);
+		/* Waiters are handled by the slow path */
+		if ((unsigned long)owner & RT_MUTEX_HAS_WAITERS)
+			break;
+		if (owner && !rt_spin_on_owner(lock, owner))
+			break;
+		if (!owner && rt_mutex_cmpxchg(lock, NULL, current)) {
+			rt_mutex_deadlock_account_lock(lock, current);
+			taken = 1;
+			break;
+		}
+		if (need_resched())
+			break;
+		cpu_relax();
+	}
+	rt_spin_osq_unlock(&lock->osq);
+out:
+	preempt_enable();
+	return taken;
+}
+#else
+static inline int rt_spin_lock_optimistic_spin(struct rt_mutex *lock)
+{
+	return 0;
+}
+#endif
+
 # define pi_lock(lock)			raw_spin_lock_irq(lock)
 # define pi_unlock(lock)		raw_spin_unlock_irq(lock)
 
@@ -717,12 +981,17 @@ static int adaptive_wait(struct rt_mutex *lock,
  *
  * We store the current state under p->pi_lock in p->saved_state and
  * the try_to_wake_up() code handles this accordingly.
+ *
+ * Returns 1 when we had to block for the lock, 0 otherwise.
  */
-static void  noinline __sched rt_spin_lock_slowlock(struct rt_mutex *lock)
+static int  noinline __sched rt_spin_lock_slowlock(struct rt_mutex *lock)
 {
 	struct task_struct *lock_owner, *self = current;
 	struct rt_mutex_waiter waiter, *top_waiter;
-	int ret;
+	int ret, slept = 0;
+
+	if (rt_spin_lock_optimistic_spin(lock))
+		return 0;
 
 	rt_mutex_init_waiter(&waiter, true);
 
@@ -731,7 +1000,7 @@ static void  noinline __sched rt_spin_lock_slowlock(struct rt_mutex *lock)
 
 	if (__try_to_take_rt_mutex(lock, self, NULL, STEAL_LATERAL)) {
 		raw_spin_unlock(&lock->wait_lock);
-		return;
+		return 0;
 	}
 
 	BUG_ON(rt_mutex_owner(lock) == self);
@@ -762,8 +1031,10 @@ static void  noinline __sched rt_spin_lock_slowlock(struct rt_mutex *lock)
 
 		debug_rt_mutex_print_deadlock(&waiter);
 
-		if (top_waiter != &waiter || adaptive_wait(lock, lock_owner))
+		if (top_waiter != &waiter || adaptive_wait(lock, lock_owner)) {
 			schedule_rt_mutex(lock);
+			slept = 1;
+		}
 
 		raw_spin_lock(&lock->wait_lock);
 
@@ -796,6 +1067,8 @@ static void  noinline __sched rt_spin_lock_slowlock(struct rt_mutex *lock)
 	raw_spin_unlock(&lock->wait_lock);
 
 	debug_rt_mutex_free_waiter(&waiter);
+
+	return slept;
 }
 
 /*
@@ -823,10 +1096,30 @@ static void  noinline __sched rt_spin_lock_slowunlock(struct rt_mutex *lock)
 	rt_mutex_adjust_prio(current);
 }
 
+/*
+ * Acquire a spinlock_t and tell lock_stat whether a contended
+ * acquisition was resolved by spinning or by blocking.
+ */
+static inline void rt_spin_lock_contended(spinlock_t *lock, unsigned long ip)
+{
+	struct rt_mutex *rtm = &lock->lock;
+	int slept;
+
+	if (likely(rt_mutex_cmpxchg(rtm, NULL, current))) {
+		rt_mutex_deadlock_account_lock(rtm, current);
+		lock_acquired(&lock->dep_map, ip);
+		return;
+	}
+	lock_contended(&lock->dep_map, ip);
+	slept = rt_spin_lock_slowlock(rtm);
+	lock_acquired_adaptive(&lock->dep_map, ip, slept);
+}
+
 void __lockfunc rt_spin_lock(spinlock_t *lock)
 {
-	rt_spin_lock_fastlock(&lock->lock, rt_spin_lock_slowlock);
+	might_sleep();
 	spin_acquire(&lock->dep_map, 0, 0, _RET_IP_);
+	rt_spin_lock_contended(lock, _RET_IP_);
 }
 EXPORT_SYMBOL(rt_spin_lock);
 
@@ -839,8 +1132,9 @@ EXPORT_SYMBOL(__rt_spin_lock);
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 void __lockfunc rt_spin_lock_nested(spinlock_t *lock, int subclass)
 {
-	rt_spin_lock_fastlock(&lock->lock, rt_spin_lock_slowlock);
+	might_sleep();
 	spin_acquire(&lock->dep_map, subclass, 0, _RET_IP_);
+	rt_spin_lock_contended(lock, _RET_IP_);
 }
 EXPORT_SYMBOL(rt_spin_lock_nested);
 #endif
@@ -1291,6 +1585,9 @@ void __rt_mutex_init(struct rt_mutex *lock, const char *name)
 {
 	lock->owner = NULL;
 	plist_head_init(&lock->wait_list);
+#if defined(CONFIG_PREEMPT_RT_FULL) && defined(CONFIG_SMP)
+	atomic_set(&lock->osq, 0);
+#endif
 
 	debug_rt_mutex_init(lock, name);
 }
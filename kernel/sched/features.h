@@ -75,4 +75,21 @@ SCHED_FEAT(PREEMPT_LAZY, true)
 
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
+
+/*
+ * Instead of taking the rq locks of all the RT overloaded cpus to pull
+ * from them, a cpu lowering its priority sends an IPI to the ones with
+ * a task to give and lets them push.
+ */
+SCHED_FEAT(RT_PUSH_IPI, true)
+
 SCHED_FEAT(LB_MIN, false)
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Let the load balancer move a task to the node it has most of its
+ * memory on, and treat it as cache hot on that node.
+ */
+SCHED_FEAT(NUMA_FAVOUR_HIGHER, true)
+SCHED_FEAT(NUMA_RESIST_LOWER, false)
+#endif
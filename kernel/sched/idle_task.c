@@ -25,6 +25,7 @@ static void check_preempt_curr_idle(struct rq *rq, struct task_struct *p, int fl
 static struct task_struct *pick_next_task_idle(struct rq *rq)
 {
 	schedstat_inc(rq, sched_goidle);
+	update_llc_idle(cpu_of(rq), true);
 	return rq->idle;
 }
 
@@ -43,6 +44,7 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
+	update_llc_idle(cpu_of(rq), false);
 }
 
 static void task_tick_idle(struct rq *rq, struct task_struct *curr, int queued)
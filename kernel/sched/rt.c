@@ -7,29 +7,20 @@
 
 #include <linux/slab.h>
 
-static int do_sched_rt_period_timer(struct rt_bandwidth *rt_b, int overrun);
+static void do_sched_rt_period_timer(struct rq *rq);
 
 struct rt_bandwidth def_rt_bandwidth;
 
 static enum hrtimer_restart sched_rt_period_timer(struct hrtimer *timer)
 {
-	struct rt_bandwidth *rt_b =
-		container_of(timer, struct rt_bandwidth, rt_period_timer);
-	ktime_t now;
-	int overrun;
-	int idle = 0;
+	struct rq *rq = container_of(timer, struct rq, rt_period_timer);
 
-	for (;;) {
-		now = hrtimer_cb_get_time(timer);
-		overrun = hrtimer_forward(timer, now, rt_b->rt_period);
+	/* Rearms the timer itself, see start_rt_period_timer() */
+	raw_spin_lock(&rq->lock);
+	do_sched_rt_period_timer(rq);
+	raw_spin_unlock(&rq->lock);
 
-		if (!overrun)
-			break;
-
-		idle = do_sched_rt_period_timer(rt_b, overrun);
-	}
-
-	return idle ? HRTIMER_NORESTART : HRTIMER_RESTART;
+	return HRTIMER_NORESTART;
 }
 
 void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime)
@@ -38,26 +29,40 @@ void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime)
 	rt_b->rt_runtime = runtime;
 
 	raw_spin_lock_init(&rt_b->rt_runtime_lock);
+}
+
+void init_rt_period_timer(struct rq *rq)
+{
+	INIT_LIST_HEAD(&rq->rt_throttled_list);
 
-	hrtimer_init(&rt_b->rt_period_timer,
-			CLOCK_MONOTONIC, HRTIMER_MODE_REL);
-	rt_b->rt_period_timer.irqsafe = 1;
-	rt_b->rt_period_timer.function = sched_rt_period_timer;
+	hrtimer_init(&rq->rt_period_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	rq->rt_period_timer.irqsafe = 1;
+	rq->rt_period_timer.function = sched_rt_period_timer;
 }
 
-static void start_rt_bandwidth(struct rt_bandwidth *rt_b)
+/*
+ * Make the period timer of rq fire @expires (in rq->clock) at the
+ * latest. Always called with rq->lock held, also from the timer
+ * callback, which never returns HRTIMER_RESTART: a restart racing with
+ * a start from another cpu would enqueue the timer twice.
+ */
+static void start_rt_period_timer(struct rq *rq, u64 expires)
 {
-	if (!rt_bandwidth_enabled() || rt_b->rt_runtime == RUNTIME_INF)
-		return;
+	struct hrtimer *timer = &rq->rt_period_timer;
+	s64 delta = max_t(s64, expires - rq->clock, 0);
 
-	if (hrtimer_active(&rt_b->rt_period_timer))
+	if (hrtimer_is_queued(timer) &&
+	    ktime_to_ns(hrtimer_get_remaining(timer)) <= delta)
 		return;
 
-	raw_spin_lock(&rt_b->rt_runtime_lock);
-	start_bandwidth_timer(&rt_b->rt_period_timer, rt_b->rt_period);
-	raw_spin_unlock(&rt_b->rt_runtime_lock);
+	__hrtimer_start_range_ns(timer, ns_to_ktime(delta), 0,
+				 HRTIMER_MODE_REL, 0);
 }
 
+#ifdef CONFIG_SMP
+static void push_rt_ipi(void *arg);
+#endif
+
 void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq)
 {
 	struct rt_prio_array *array;
@@ -77,20 +82,24 @@ void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq)
 	rt_rq->rt_nr_migratory = 0;
 	rt_rq->overloaded = 0;
 	plist_head_init(&rt_rq->pushable_tasks);
+
+	rt_rq->push_flags = 0;
+	raw_spin_lock_init(&rt_rq->push_lock);
+	rt_rq->push_csd.flags = 0;
+	rt_rq->push_csd.func = push_rt_ipi;
+	rt_rq->push_csd.info = rq;
 #endif
 
 	rt_rq->rt_time = 0;
 	rt_rq->rt_throttled = 0;
 	rt_rq->rt_runtime = 0;
 	raw_spin_lock_init(&rt_rq->rt_runtime_lock);
+	rt_rq->rt_period_expires = 0;
+	rt_rq->rt_borrowed = 0;
+	INIT_LIST_HEAD(&rt_rq->throttled_list);
 }
 
 #ifdef CONFIG_RT_GROUP_SCHED
-static void destroy_rt_bandwidth(struct rt_bandwidth *rt_b)
-{
-	hrtimer_cancel(&rt_b->rt_period_timer);
-}
-
 #define rt_entity_is_task(rt_se) (!(rt_se)->my_q)
 
 static inline struct task_struct *rt_task_of(struct sched_rt_entity *rt_se)
@@ -115,10 +124,19 @@ void free_rt_sched_group(struct task_group *tg)
 {
 	int i;
 
-	if (tg->rt_se)
-		destroy_rt_bandwidth(&tg->rt_bandwidth);
-
 	for_each_possible_cpu(i) {
+		struct rt_rq *rt_rq = tg->rt_rq ? tg->rt_rq[i] : NULL;
+
+		/* The group has no tasks left, but may still be throttled */
+		if (rt_rq && !list_empty(&rt_rq->throttled_list)) {
+			struct rq *rq = cpu_rq(i);
+			unsigned long flags;
+
+			raw_spin_lock_irqsave(&rq->lock, flags);
+			list_del_init(&rt_rq->throttled_list);
+			raw_spin_unlock_irqrestore(&rq->lock, flags);
+		}
+
 		if (tg->rt_rq)
 			kfree(tg->rt_rq[i]);
 		if (tg->rt_se)
@@ -468,18 +486,6 @@ static int rt_se_boosted(struct sched_rt_entity *rt_se)
 	return p->prio != p->normal_prio;
 }
 
-#ifdef CONFIG_SMP
-static inline const struct cpumask *sched_rt_period_mask(void)
-{
-	return cpu_rq(smp_processor_id())->rd->span;
-}
-#else
-static inline const struct cpumask *sched_rt_period_mask(void)
-{
-	return cpu_online_mask;
-}
-#endif
-
 static inline
 struct rt_rq *sched_rt_period_rt_rq(struct rt_bandwidth *rt_b, int cpu)
 {
@@ -491,6 +497,14 @@ static inline struct rt_bandwidth *sched_rt_bandwidth(struct rt_rq *rt_rq)
 	return &rt_rq->tg->rt_bandwidth;
 }
 
+/* The rt_rq of the parent group on the same cpu */
+static inline struct rt_rq *parent_rt_rq(struct rt_rq *rt_rq)
+{
+	struct task_group *parent = rt_rq->tg->parent;
+
+	return parent ? parent->rt_rq[cpu_of(rq_of_rt_rq(rt_rq))] : NULL;
+}
+
 #else /* !CONFIG_RT_GROUP_SCHED */
 
 static inline u64 sched_rt_runtime(struct rt_rq *rt_rq)
@@ -542,11 +556,6 @@ static inline int rt_rq_throttled(struct rt_rq *rt_rq)
 	return rt_rq->rt_throttled;
 }
 
-static inline const struct cpumask *sched_rt_period_mask(void)
-{
-	return cpu_online_mask;
-}
-
 static inline
 struct rt_rq *sched_rt_period_rt_rq(struct rt_bandwidth *rt_b, int cpu)
 {
@@ -558,28 +567,61 @@ static inline struct rt_bandwidth *sched_rt_bandwidth(struct rt_rq *rt_rq)
 	return &def_rt_bandwidth;
 }
 
+static inline struct rt_rq *parent_rt_rq(struct rt_rq *rt_rq)
+{
+	return NULL;
+}
+
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+/*
+ * The periods of an rt_rq are replenished lazily, whenever its runtime
+ * is looked at: for every period that ended since the last time the
+ * rt_rq gets its runtime back, and what it borrowed is gone. Only the
+ * rt_rqs running RT tasks and the throttled ones cost anything, there
+ * is no timer walking the rt_rqs of all groups on all cpus.
+ *
+ * Called with rt_rq->rt_runtime_lock held.
+ */
+static void rt_rq_update_period(struct rt_rq *rt_rq, u64 now)
+{
+	u64 period, overrun;
+
+	if (likely((s64)(now - rt_rq->rt_period_expires) < 0))
+		return;
+
+	period = sched_rt_period(rt_rq);
+	overrun = div64_u64(now - rt_rq->rt_period_expires, period) + 1;
+	rt_rq->rt_period_expires += overrun * period;
+
+	if (rt_rq->rt_runtime == RUNTIME_INF)
+		rt_rq->rt_time = 0;
+	else
+		rt_rq->rt_time -= min(rt_rq->rt_time,
+				      overrun * rt_rq->rt_runtime);
+	rt_rq->rt_borrowed = 0;
+}
+
 #ifdef CONFIG_SMP
 /*
- * We ran out of runtime, see if we can borrow some from our neighbours.
+ * Take up to @want of the runtime the rt_rqs of @rt_b on the other cpus
+ * of the root domain have left in their current period. The lenders
+ * are charged for it as if they had run.
  */
-static int do_balance_runtime(struct rt_rq *rt_rq)
+static u64 borrow_slack(struct rt_bandwidth *rt_b, struct rq *rq, u64 want)
 {
-	struct rt_bandwidth *rt_b = sched_rt_bandwidth(rt_rq);
-	struct root_domain *rd = cpu_rq(smp_processor_id())->rd;
-	int i, weight, more = 0;
-	u64 rt_period;
+	struct root_domain *rd = rq->rd;
+	int i, weight;
+	u64 got = 0;
 
 	weight = cpumask_weight(rd->span);
 
 	raw_spin_lock(&rt_b->rt_runtime_lock);
-	rt_period = ktime_to_ns(rt_b->rt_period);
 	for_each_cpu(i, rd->span) {
 		struct rt_rq *iter = sched_rt_period_rt_rq(rt_b, i);
 		s64 diff;
 
-		if (iter == rt_rq)
+		if (i == cpu_of(rq))
 			continue;
 
 		raw_spin_lock(&iter->rt_runtime_lock);
@@ -588,113 +630,114 @@ static int do_balance_runtime(struct rt_rq *rt_rq)
 		 * or __disable_runtime() below sets a specific rq to inf to
 		 * indicate its been disabled and disalow stealing.
 		 */
-		if (iter->rt_runtime == RUNTIME_INF)
+		if (iter->rt_runtime == RUNTIME_INF || iter->rt_throttled)
 			goto next;
 
+		/*
+		 * A lender idle for a while has its full runtime to give,
+		 * its period is kept by the clock of its own rq.
+		 */
+		rt_rq_update_period(iter, cpu_rq(i)->clock);
+
 		/*
 		 * From runqueues with spare time, take 1/n part of their
-		 * spare time, but no more than our period.
+		 * spare time, but no more than we want.
 		 */
 		diff = iter->rt_runtime - iter->rt_time;
 		if (diff > 0) {
-			diff = div_u64((u64)diff, weight);
-			if (rt_rq->rt_runtime + diff > rt_period)
-				diff = rt_period - rt_rq->rt_runtime;
-			iter->rt_runtime -= diff;
-			rt_rq->rt_runtime += diff;
-			more = 1;
-			if (rt_rq->rt_runtime == rt_period) {
-				raw_spin_unlock(&iter->rt_runtime_lock);
-				break;
-			}
+			diff = min(div_u64((u64)diff, weight), want - got);
+			iter->rt_time += diff;
+			got += diff;
 		}
 next:
 		raw_spin_unlock(&iter->rt_runtime_lock);
+
+		if (got == want)
+			break;
 	}
 	raw_spin_unlock(&rt_b->rt_runtime_lock);
 
-	return more;
+	return got;
 }
 
 /*
- * Ensure this RQ takes back all the runtime it lend to its neighbours.
+ * We ran out of runtime, see if we can borrow some slack for the rest of
+ * the period: the runtime the other cpus have left.
+ *
+ * The slack of our group is tried first, then that of its ancestors: a
+ * parent's runtime covers that of its children, so they may use what it
+ * leaves unused. That slack is credited to every rt_rq between us and
+ * the lending ancestor, since all of them are charged for our running.
+ *
+ * Runtime is only lent for the current period of the borrower, so
+ * nothing needs to be handed back.
  */
-static void __disable_runtime(struct rq *rq)
+static int do_balance_runtime(struct rt_rq *rt_rq)
 {
-	struct root_domain *rd = rq->rd;
-	rt_rq_iter_t iter;
-	struct rt_rq *rt_rq;
-
-	if (unlikely(!scheduler_running))
-		return;
+	struct rq *rq = rq_of_rt_rq(rt_rq);
+	struct rt_rq *level, *iter;
+	int more = 0;
+	s64 want;
+	u64 got;
 
-	for_each_rt_rq(rt_rq, iter, rq) {
-		struct rt_bandwidth *rt_b = sched_rt_bandwidth(rt_rq);
-		s64 want;
-		int i;
+	for (level = rt_rq; level; level = parent_rt_rq(level)) {
+		bool done = false;
 
-		raw_spin_lock(&rt_b->rt_runtime_lock);
+		/* Never more than the whole period */
 		raw_spin_lock(&rt_rq->rt_runtime_lock);
-		/*
-		 * Either we're all inf and nobody needs to borrow, or we're
-		 * already disabled and thus have nothing to do, or we have
-		 * exactly the right amount of runtime to take out.
-		 */
-		if (rt_rq->rt_runtime == RUNTIME_INF ||
-				rt_rq->rt_runtime == rt_b->rt_runtime)
-			goto balanced;
+		want = sched_rt_period(rt_rq) - rt_rq->rt_runtime -
+		       rt_rq->rt_borrowed;
 		raw_spin_unlock(&rt_rq->rt_runtime_lock);
+		if (want <= 0)
+			break;
 
-		/*
-		 * Calculate the difference between what we started out with
-		 * and what we current have, that's the amount of runtime
-		 * we lend and now have to reclaim.
-		 */
-		want = rt_b->rt_runtime - rt_rq->rt_runtime;
-
-		/*
-		 * Greedy reclaim, take back as much as we can.
-		 */
-		for_each_cpu(i, rd->span) {
-			struct rt_rq *iter = sched_rt_period_rt_rq(rt_b, i);
-			s64 diff;
-
-			/*
-			 * Can't reclaim from ourselves or disabled runqueues.
-			 */
-			if (iter == rt_rq || iter->rt_runtime == RUNTIME_INF)
-				continue;
+		got = borrow_slack(sched_rt_bandwidth(level), rq, want);
+		if (!got)
+			continue;
+		more = 1;
 
+		for (iter = rt_rq; ; iter = parent_rt_rq(iter)) {
 			raw_spin_lock(&iter->rt_runtime_lock);
-			if (want > 0) {
-				diff = min_t(s64, iter->rt_runtime, want);
-				iter->rt_runtime -= diff;
-				want -= diff;
-			} else {
-				iter->rt_runtime -= want;
-				want -= want;
+			iter->rt_time -= min(iter->rt_time, got);
+			if (iter == rt_rq) {
+				iter->rt_borrowed += got;
+				done = iter->rt_time <= iter->rt_runtime;
 			}
 			raw_spin_unlock(&iter->rt_runtime_lock);
 
-			if (!want)
+			if (iter == level)
 				break;
 		}
 
+		if (done)
+			break;
+	}
+
+	return more;
+}
+
+/*
+ * Stop lending the runtime of this rq, it is going away. Nothing has
+ * been lent beyond the current period, so there is nothing to reclaim.
+ */
+static void __disable_runtime(struct rq *rq)
+{
+	rt_rq_iter_t iter;
+	struct rt_rq *rt_rq;
+
+	if (unlikely(!scheduler_running))
+		return;
+
+	for_each_rt_rq(rt_rq, iter, rq) {
 		raw_spin_lock(&rt_rq->rt_runtime_lock);
-		/*
-		 * We cannot be left wanting - that would mean some runtime
-		 * leaked out of the system.
-		 */
-		BUG_ON(want);
-balanced:
 		/*
 		 * Disable all the borrow logic by pretending we have inf
 		 * runtime - in which case borrowing doesn't make sense.
 		 */
 		rt_rq->rt_runtime = RUNTIME_INF;
 		rt_rq->rt_throttled = 0;
+		list_del_init(&rt_rq->throttled_list);
 		raw_spin_unlock(&rt_rq->rt_runtime_lock);
-		raw_spin_unlock(&rt_b->rt_runtime_lock);
 	}
 }
 
@@ -725,7 +768,9 @@ static void __enable_runtime(struct rq *rq)
 		raw_spin_lock(&rt_rq->rt_runtime_lock);
 		rt_rq->rt_runtime = rt_b->rt_runtime;
 		rt_rq->rt_time = 0;
+		rt_rq->rt_borrowed = 0;
 		rt_rq->rt_throttled = 0;
+		list_del_init(&rt_rq->throttled_list);
 		raw_spin_unlock(&rt_rq->rt_runtime_lock);
 		raw_spin_unlock(&rt_b->rt_runtime_lock);
 	}
@@ -784,70 +829,49 @@ static inline int balance_runtime(struct rt_rq *rt_rq)
 }
 #endif /* CONFIG_SMP */
 
-static int do_sched_rt_period_timer(struct rt_bandwidth *rt_b, int overrun)
+/*
+ * Unthrottle the throttled rt_rqs of rq whose period ended and rearm
+ * the timer for the others.
+ */
+static void do_sched_rt_period_timer(struct rq *rq)
 {
-	int i, idle = 1, throttled = 0;
-	const struct cpumask *span;
+	struct rt_rq *rt_rq, *tmp;
+	bool throttled = false;
+	u64 expires = 0;
 
-	span = sched_rt_period_mask();
-#ifdef CONFIG_RT_GROUP_SCHED
-	/*
-	 * FIXME: isolated CPUs should really leave the root task group,
-	 * whether they are isolcpus or were isolated via cpusets, lest
-	 * the timer run on a CPU which does not service all runqueues,
-	 * potentially leaving other CPUs indefinitely throttled.  If
-	 * isolation is really required, the user will turn the throttle
-	 * off to kill the perturbations it causes anyway.  Meanwhile,
-	 * this maintains functionality for boot and/or troubleshooting.
-	 */
-	if (rt_b == &root_task_group.rt_bandwidth)
-		span = cpu_online_mask;
-#endif
-	for_each_cpu(i, span) {
+	update_rq_clock(rq);
+
+	list_for_each_entry_safe(rt_rq, tmp, &rq->rt_throttled_list,
+				 throttled_list) {
 		int enqueue = 0;
-		struct rt_rq *rt_rq = sched_rt_period_rt_rq(rt_b, i);
-		struct rq *rq = rq_of_rt_rq(rt_rq);
 
-		raw_spin_lock(&rq->lock);
-		if (rt_rq->rt_time) {
-			u64 runtime;
+		raw_spin_lock(&rt_rq->rt_runtime_lock);
+		rt_rq_update_period(rt_rq, rq->clock);
+		balance_runtime(rt_rq);
+		if (rt_rq->rt_time < rt_rq->rt_runtime) {
+			rt_rq->rt_throttled = 0;
+			list_del_init(&rt_rq->throttled_list);
+			enqueue = 1;
 
-			raw_spin_lock(&rt_rq->rt_runtime_lock);
-			if (rt_rq->rt_throttled)
-				balance_runtime(rt_rq);
-			runtime = rt_rq->rt_runtime;
-			rt_rq->rt_time -= min(rt_rq->rt_time, overrun*runtime);
-			if (rt_rq->rt_throttled && rt_rq->rt_time < runtime) {
-				rt_rq->rt_throttled = 0;
-				enqueue = 1;
-
-				/*
-				 * Force a clock update if the CPU was idle,
-				 * lest wakeup -> unthrottle time accumulate.
-				 */
-				if (rt_rq->rt_nr_running && rq->curr == rq->idle)
-					rq->skip_clock_update = -1;
-			}
-			if (rt_rq->rt_time || rt_rq->rt_nr_running)
-				idle = 0;
-			raw_spin_unlock(&rt_rq->rt_runtime_lock);
-		} else if (rt_rq->rt_nr_running) {
-			idle = 0;
-			if (!rt_rq_throttled(rt_rq))
-				enqueue = 1;
+			/*
+			 * Force a clock update if the CPU was idle,
+			 * lest wakeup -> unthrottle time accumulate.
+			 */
+			if (rt_rq->rt_nr_running && rq->curr == rq->idle)
+				rq->skip_clock_update = -1;
+		} else if (!throttled ||
+			   (s64)(rt_rq->rt_period_expires - expires) < 0) {
+			expires = rt_rq->rt_period_expires;
+			throttled = true;
 		}
-		if (rt_rq->rt_throttled)
-			throttled = 1;
+		raw_spin_unlock(&rt_rq->rt_runtime_lock);
 
 		if (enqueue)
 			sched_rt_rq_enqueue(rt_rq);
-		raw_spin_unlock(&rq->lock);
 	}
 
-	if (!throttled && (!rt_bandwidth_enabled() || rt_b->rt_runtime == RUNTIME_INF))
-		return 1;
-
-	return idle;
+	if (throttled)
+		start_rt_period_timer(rq, expires);
 }
 
 static inline int rt_se_prio(struct sched_rt_entity *rt_se)
@@ -865,47 +889,43 @@ static inline int rt_se_prio(struct sched_rt_entity *rt_se)
 static int sched_rt_runtime_exceeded(struct rt_rq *rt_rq)
 {
 	u64 runtime = sched_rt_runtime(rt_rq);
+	struct rq *rq = rq_of_rt_rq(rt_rq);
+	static bool once = false;
 
 	if (rt_rq->rt_throttled)
 		return rt_rq_throttled(rt_rq);
 
-	if (runtime >= sched_rt_period(rt_rq))
+	if (runtime >= sched_rt_period(rt_rq) || rt_rq->rt_time <= runtime)
 		return 0;
 
+	/*
+	 * Don't actually throttle groups that have no runtime assigned
+	 * but accrue some time due to boosting, nor let them borrow for
+	 * it. Replenishment is a joke, since it will replenish us with
+	 * exactly 0 ns, so make the time go away.
+	 */
+	if (unlikely(!sched_rt_bandwidth(rt_rq)->rt_runtime)) {
+		rt_rq->rt_time = 0;
+		return 0;
+	}
+
 	balance_runtime(rt_rq);
 	runtime = sched_rt_runtime(rt_rq);
-	if (runtime == RUNTIME_INF)
+	if (runtime == RUNTIME_INF || rt_rq->rt_time <= runtime)
 		return 0;
 
-	if (rt_rq->rt_time > runtime) {
-		struct rt_bandwidth *rt_b = sched_rt_bandwidth(rt_rq);
+	rt_rq->rt_throttled = 1;
+	list_add(&rt_rq->throttled_list, &rq->rt_throttled_list);
+	start_rt_period_timer(rq, rt_rq->rt_period_expires);
 
-		/*
-		 * Don't actually throttle groups that have no runtime assigned
-		 * but accrue some time due to boosting.
-		 */
-		if (likely(rt_b->rt_runtime)) {
-			static bool once = false;
-
-			rt_rq->rt_throttled = 1;
-
-			if (!once) {
-				once = true;
-				printk_sched("sched: RT throttling activated\n");
-			}
-		} else {
-			/*
-			 * In case we did anyway, make it go away,
-			 * replenishment is a joke, since it will replenish us
-			 * with exactly 0 ns.
-			 */
-			rt_rq->rt_time = 0;
-		}
+	if (!once) {
+		once = true;
+		printk_sched("sched: RT throttling activated\n");
+	}
 
-		if (rt_rq_throttled(rt_rq)) {
-			sched_rt_rq_dequeue(rt_rq);
-			return 1;
-		}
+	if (rt_rq_throttled(rt_rq)) {
+		sched_rt_rq_dequeue(rt_rq);
+		return 1;
 	}
 
 	return 0;
@@ -948,6 +968,7 @@ static void update_curr_rt(struct rq *rq)
 
 		if (sched_rt_runtime(rt_rq) != RUNTIME_INF) {
 			raw_spin_lock(&rt_rq->rt_runtime_lock);
+			rt_rq_update_period(rt_rq, rq->clock);
 			rt_rq->rt_time += delta_exec;
 			if (sched_rt_runtime_exceeded(rt_rq))
 				resched_task(curr);
@@ -1037,9 +1058,6 @@ inc_rt_group(struct sched_rt_entity *rt_se, struct rt_rq *rt_rq)
 {
 	if (rt_se_boosted(rt_se))
 		rt_rq->rt_nr_boosted++;
-
-	if (rt_rq->tg)
-		start_rt_bandwidth(&rt_rq->tg->rt_bandwidth);
 }
 
 static void
@@ -1053,11 +1071,8 @@ dec_rt_group(struct sched_rt_entity *rt_se, struct rt_rq *rt_rq)
 
 #else /* CONFIG_RT_GROUP_SCHED */
 
-static void
-inc_rt_group(struct sched_rt_entity *rt_se, struct rt_rq *rt_rq)
-{
-	start_rt_bandwidth(&def_rt_bandwidth);
-}
+static inline
+void inc_rt_group(struct sched_rt_entity *rt_se, struct rt_rq *rt_rq) {}
 
 static inline
 void dec_rt_group(struct sched_rt_entity *rt_se, struct rt_rq *rt_rq) {}
@@ -1714,6 +1729,82 @@ static void push_rt_tasks(struct rq *rq)
 		;
 }
 
+/*
+ * RT_PUSH_IPI: rq->rt.push_flags, protected by rq->rt.push_lock.
+ *
+ * EXECUTING is set by the first cpu asking rq to push and cleared by
+ * push_rt_ipi() once it is done, so rq->rt.push_csd is in flight at
+ * most once. A cpu asking in the meantime sets RESTART instead, which
+ * makes push_rt_ipi() go over the pushable tasks again: the request
+ * may have come after the push had already looked at that cpu.
+ */
+#define RT_PUSH_IPI_EXECUTING		1
+#define RT_PUSH_IPI_RESTART		2
+
+/*
+ * Runs in hard interrupt context (also on PREEMPT_RT_FULL) on the cpu
+ * of rq, called through rq->rt.push_csd.
+ */
+static void push_rt_ipi(void *arg)
+{
+	struct rq *rq = arg;
+
+again:
+	raw_spin_lock(&rq->lock);
+	push_rt_tasks(rq);
+	raw_spin_unlock(&rq->lock);
+
+	raw_spin_lock(&rq->rt.push_lock);
+	if (rq->rt.push_flags & RT_PUSH_IPI_RESTART) {
+		rq->rt.push_flags &= ~RT_PUSH_IPI_RESTART;
+		raw_spin_unlock(&rq->rt.push_lock);
+		goto again;
+	}
+	/*
+	 * The csd is released only after we return, a new request can
+	 * spin on it in __smp_call_function_single() until then. That is
+	 * why nothing that can wait for another cpu may follow here.
+	 */
+	rq->rt.push_flags = 0;
+	raw_spin_unlock(&rq->rt.push_lock);
+}
+
+/*
+ * Ask the overloaded cpus that have a task of higher priority than
+ * this_rq is about to run to push it away. They pick the target with
+ * cpupri, which will find this_rq as its priority has just dropped,
+ * and only ever lock their own rq and that of the target. Asking is
+ * lockless except for the push_lock of the overloaded rq.
+ */
+static void tell_cpus_to_push(struct rq *this_rq)
+{
+	int this_cpu = this_rq->cpu, cpu;
+	struct rq *src_rq;
+
+	for_each_cpu(cpu, this_rq->rd->rto_mask) {
+		if (this_cpu == cpu || !cpu_active(cpu))
+			continue;
+
+		src_rq = cpu_rq(cpu);
+
+		/* See the same check in pull_rt_task() */
+		if (src_rq->rt.highest_prio.next >=
+		    this_rq->rt.highest_prio.curr)
+			continue;
+
+		raw_spin_lock(&src_rq->rt.push_lock);
+		if (src_rq->rt.push_flags & RT_PUSH_IPI_EXECUTING) {
+			src_rq->rt.push_flags |= RT_PUSH_IPI_RESTART;
+			raw_spin_unlock(&src_rq->rt.push_lock);
+			continue;
+		}
+		src_rq->rt.push_flags = RT_PUSH_IPI_EXECUTING;
+		raw_spin_unlock(&src_rq->rt.push_lock);
+
+		__smp_call_function_single(cpu, &src_rq->rt.push_csd, 0);
+	}
+}
+
 static int pull_rt_task(struct rq *this_rq)
 {
 	int this_cpu = this_rq->cpu, ret = 0, cpu;
@@ -1723,6 +1814,11 @@ static int pull_rt_task(struct rq *this_rq)
 	if (likely(!rt_overloaded(this_rq)))
 		return 0;
 
+	if (sched_feat(RT_PUSH_IPI)) {
+		tell_cpus_to_push(this_rq);
+		return 0;
+	}
+
 	for_each_cpu(cpu, this_rq->rd->rto_mask) {
 		if (this_cpu == cpu)
 			continue;
@@ -43,6 +43,12 @@ extern __read_mostly int scheduler_running;
  */
 #define RUNTIME_INF	((u64)~0ULL)
 
+static inline int fair_policy(int policy)
+{
+	return policy == SCHED_NORMAL || policy == SCHED_BATCH ||
+		policy == SCHED_IDLE;
+}
+
 static inline int rt_policy(int policy)
 {
 	if (policy == SCHED_FIFO || policy == SCHED_RR)
@@ -55,6 +61,24 @@ static inline int task_has_rt_policy(struct task_struct *p)
 	return rt_policy(p->policy);
 }
 
+static inline int dl_policy(int policy)
+{
+	if (unlikely(policy == SCHED_DEADLINE))
+		return 1;
+	return 0;
+}
+
+static inline int task_has_dl_policy(struct task_struct *p)
+{
+	return dl_policy(p->policy);
+}
+
+/*
+ * SCHED_DEADLINE bandwidths are multiplied in DL_SCALE reduced
+ * nanoseconds to not overflow u64.
+ */
+#define DL_SCALE		(10)
+
 /*
  * This is the priority-queue data structure of the RT scheduling class:
  */
@@ -68,7 +92,6 @@ struct rt_bandwidth {
 	raw_spinlock_t		rt_runtime_lock;
 	ktime_t			rt_period;
 	u64			rt_runtime;
-	struct hrtimer		rt_period_timer;
 };
 
 extern struct mutex sched_domains_mutex;
@@ -111,7 +134,10 @@ struct task_group {
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
 
-	atomic_t load_weight;
+#ifdef CONFIG_SMP
+	atomic_long_t load_avg;
+	atomic_t runnable_avg;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -222,6 +248,24 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	/*
+	 * CFS Load tracking
+	 * Under CFS, load is tracked on a per-entity basis and aggregated up.
+	 * This allows for the description of both thread and group usage (in
+	 * the FAIR_GROUP_SCHED case).
+	 */
+	unsigned long runnable_load_avg, blocked_load_avg;
+	atomic64_t decay_counter;
+	u64 last_decay;
+	atomic_long_t removed_load;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	/* Required to track per-cpu representation of a task_group */
+	u32 tg_runnable_contrib;
+	unsigned long tg_load_contrib;
+#endif
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -245,19 +289,6 @@ struct cfs_rq {
 	 * this group.
 	 */
 	unsigned long h_load;
-
-	/*
-	 * Maintaining per-cpu shares distribution for group scheduling
-	 *
-	 * load_stamp is the last time we updated the load average
-	 * load_last is the last time we updated the load average and saw load
-	 * load_unacc_exec_time is currently unaccounted execution time
-	 */
-	u64 load_avg;
-	u64 load_period;
-	u64 load_stamp, load_last, load_unacc_exec_time;
-
-	unsigned long load_contribution;
 #endif /* CONFIG_SMP */
 #ifdef CONFIG_CFS_BANDWIDTH
 	int runtime_enabled;
@@ -265,6 +296,7 @@ struct cfs_rq {
 	s64 runtime_remaining;
 
 	u64 throttled_timestamp;
+	u64 throttled_clock_task, throttled_clock_task_time;
 	int throttled, throttle_count;
 	struct list_head throttled_list;
 #endif /* CONFIG_CFS_BANDWIDTH */
@@ -293,12 +325,23 @@ struct rt_rq {
 	unsigned long rt_nr_total;
 	int overloaded;
 	struct plist_head pushable_tasks;
+
+	/* RT_PUSH_IPI: other cpus asking this one to push its tasks */
+	struct call_single_data push_csd;
+	raw_spinlock_t push_lock;
+	int push_flags;
 #endif
 	int rt_throttled;
 	u64 rt_time;
 	u64 rt_runtime;
 	/* Nests inside the rq lock: */
 	raw_spinlock_t rt_runtime_lock;
+	/* end of the current period in rq->clock, see rt_rq_update_period() */
+	u64 rt_period_expires;
+	/* runtime borrowed from other cpus in the current period */
+	u64 rt_borrowed;
+	/* entry in rq->rt_throttled_list while throttled */
+	struct list_head throttled_list;
 
 #ifdef CONFIG_RT_GROUP_SCHED
 	unsigned long rt_nr_boosted;
@@ -309,6 +352,39 @@ struct rt_rq {
 #endif
 };
 
+/* Deadline class' related fields in a runqueue */
+struct dl_rq {
+	/* runqueue is an rbtree, ordered by deadline */
+	struct rb_root rb_root;
+	struct rb_node *rb_leftmost;
+
+	unsigned long dl_nr_running;
+
+#ifdef CONFIG_SMP
+	/*
+	 * Deadline values of the currently executing and the
+	 * earliest ready task on this rq. Caching these facilitates
+	 * the decision whether or not a ready but not running task
+	 * should migrate somewhere else.
+	 */
+	struct {
+		u64 curr;
+		u64 next;
+	} earliest_dl;
+
+	unsigned long dl_nr_migratory;
+	int overloaded;
+
+	/*
+	 * Tasks on this rq that can be pushed away. They are kept in
+	 * an rb-tree, ordered by tasks' deadlines, with caching
+	 * of the leftmost (earliest deadline) element.
+	 */
+	struct rb_root pushable_dl_tasks_root;
+	struct rb_node *pushable_dl_tasks_leftmost;
+#endif
+};
+
 #ifdef CONFIG_SMP
 
 /*
@@ -332,6 +408,13 @@ struct root_domain {
 	 */
 	cpumask_var_t rto_mask;
 	struct cpupri cpupri;
+
+	/*
+	 * The "-deadline overload" flag: it gets set if a CPU has more
+	 * than one runnable -deadline task.
+	 */
+	atomic_t dlo_count;
+	cpumask_var_t dlo_mask;
 };
 
 extern struct root_domain def_root_domain;
@@ -370,6 +453,7 @@ struct rq {
 
 	struct cfs_rq cfs;
 	struct rt_rq rt;
+	struct dl_rq dl;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
@@ -382,6 +466,9 @@ struct rq {
 #ifdef CONFIG_RT_GROUP_SCHED
 	struct list_head leaf_rt_rq_list;
 #endif
+	/* throttled rt_rqs of this cpu and the timer unthrottling them */
+	struct list_head rt_throttled_list;
+	struct hrtimer rt_period_timer;
 
 	/*
 	 * This is part of a global counter where only the total sum
@@ -462,6 +549,12 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* select_idle_sibling() stats */
+	unsigned int sis_search;
+	unsigned int sis_found;
+	unsigned int sis_scanned;
+	unsigned int sis_saved;
 #endif
 
 #ifdef CONFIG_SMP
@@ -847,6 +940,7 @@ enum cpuacct_stat_index {
    for (class = sched_class_highest; class; class = class->next)
 
 extern const struct sched_class stop_sched_class;
+extern const struct sched_class dl_sched_class;
 extern const struct sched_class rt_sched_class;
 extern const struct sched_class fair_sched_class;
 extern const struct sched_class idle_sched_class;
@@ -856,6 +950,9 @@ extern const struct sched_class idle_sched_class;
 
 extern void trigger_load_balance(struct rq *rq, int cpu);
 extern void idle_balance(int this_cpu, struct rq *this_rq);
+extern void init_sched_domain_shared(struct sched_domain_shared *sds,
+				     const struct cpumask *span);
+extern void update_llc_idle(int cpu, bool idle);
 
 #else	/* CONFIG_SMP */
 
@@ -863,6 +960,19 @@ static inline void idle_balance(int cpu, struct rq *rq)
 {
 }
 
+static inline void update_llc_idle(int cpu, bool idle)
+{
+}
+
+#endif
+
+#ifdef CONFIG_NUMA_BALANCING
+extern void task_tick_numa(struct rq *rq, struct task_struct *curr);
+extern int migrate_task_to(struct task_struct *p, int target_cpu);
+#else
+static inline void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+}
 #endif
 
 extern void sysrq_sched_debug_show(void);
@@ -870,6 +980,7 @@ extern void sched_init_granularity(void);
 extern void update_max_interval(void);
 extern void update_group_power(struct sched_domain *sd, int cpu);
 extern int update_runtime(struct notifier_block *nfb, unsigned long action, void *hcpu);
+extern void init_sched_dl_class(void);
 extern void init_sched_rt_class(void);
 extern void init_sched_fair_class(void);
 
@@ -887,6 +998,7 @@ static inline void resched_task_lazy(struct task_struct *tsk)
 
 extern struct rt_bandwidth def_rt_bandwidth;
 extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime);
+extern void init_rt_period_timer(struct rq *rq);
 
 extern void update_idle_cpu_load(struct rq *this_rq);
 
@@ -1153,6 +1265,20 @@ extern void print_rt_stats(struct seq_file *m, int cpu);
 
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq);
+extern void init_dl_rq(struct dl_rq *dl_rq, struct rq *rq);
+
+#ifdef CONFIG_SMP
+extern void init_task_runnable_average(struct task_struct *p);
+#else
+static inline void init_task_runnable_average(struct task_struct *p) { }
+#endif
+
+extern unsigned long to_ratio(u64 period, u64 runtime);
+
+extern void init_dl_task_timer(struct sched_dl_entity *dl_se);
+extern int sched_dl_overflow(struct task_struct *p, int policy,
+			     const struct sched_attr *attr);
+extern int sched_dl_global_constraints(void);
 
 extern void account_cfs_bandwidth_used(int enabled, int was_enabled);
 
@@ -11,6 +11,7 @@
  */
 
 #include <linux/export.h>
+#include <linux/ctype.h>
 #include <linux/kernel_stat.h>
 #include <linux/interrupt.h>
 #include <linux/init.h>
@@ -153,30 +154,37 @@ static inline void softirq_set_runner(unsigned int sirq) { }
 static inline void softirq_clr_runner(unsigned int sirq) { }
 #endif
 
+#ifdef CONFIG_PREEMPT_SOFTIRQ_SPLIT
 /*
- * we cannot loop indefinitely here to avoid userspace starvation,
- * but we also don't want to introduce a worst case 1/HZ latency
- * to the pending events, so lets the scheduler to balance
- * the softirq load for us.
+ * Account the time from entry to exit of a handler. This includes
+ * the time the handler was preempted, which is what a lower priority
+ * vector waiting for its turn cares about.
  */
-static void wakeup_softirqd(void)
+static inline u64 softirq_time_start(void)
 {
-	/* Interrupts are disabled: no need to stop preemption */
-	struct task_struct *tsk = __this_cpu_read(ksoftirqd);
+	return local_clock();
+}
 
-	if (tsk && tsk->state != TASK_RUNNING)
-		wake_up_process(tsk);
+static inline void softirq_time_end(unsigned int vec_nr, u64 start)
+{
+	kstat_add_softirq_time_this_cpu(vec_nr, local_clock() - start);
 }
+#else
+static inline u64 softirq_time_start(void) { return 0; }
+static inline void softirq_time_end(unsigned int vec_nr, u64 start) { }
+#endif
 
 static void handle_softirq(unsigned int vec_nr, int cpu, int need_rcu_bh_qs)
 {
 	struct softirq_action *h = softirq_vec + vec_nr;
 	unsigned int prev_count = preempt_count();
+	u64 start = softirq_time_start();
 
 	kstat_incr_softirqs_this_cpu(vec_nr);
 	trace_softirq_entry(vec_nr);
 	h->action(h);
 	trace_softirq_exit(vec_nr);
+	softirq_time_end(vec_nr, start);
 
 	if (unlikely(prev_count != preempt_count())) {
 		pr_err("softirq %u %s %p preempt count leak: %08x -> %08x\n",
@@ -189,6 +197,21 @@ static void handle_softirq(unsigned int vec_nr, int cpu, int need_rcu_bh_qs)
 }
 
 #ifndef CONFIG_PREEMPT_RT_FULL
+/*
+ * we cannot loop indefinitely here to avoid userspace starvation,
+ * but we also don't want to introduce a worst case 1/HZ latency
+ * to the pending events, so lets the scheduler to balance
+ * the softirq load for us.
+ */
+static void wakeup_softirqd(void)
+{
+	/* Interrupts are disabled: no need to stop preemption */
+	struct task_struct *tsk = __this_cpu_read(ksoftirqd);
+
+	if (tsk && tsk->state != TASK_RUNNING)
+		wake_up_process(tsk);
+}
+
 static void handle_pending_softirqs(u32 pending, int cpu, int need_rcu_bh_qs)
 {
 	unsigned int vec_nr;
@@ -441,7 +464,7 @@ void __raise_softirq_irqoff(unsigned int nr)
 
 static inline void local_bh_disable_nort(void) { local_bh_disable(); }
 static inline void _local_bh_enable_nort(void) { _local_bh_enable(); }
-static inline void ksoftirqd_set_sched_params(void) { }
+static inline void ksoftirqd_set_sched_params(int cpu) { }
 static inline void ksoftirqd_clr_sched_params(void) { }
 
 static inline int ksoftirqd_softirq_pending(void)
@@ -456,6 +479,107 @@ static inline int ksoftirqd_softirq_pending(void)
  */
 static DEFINE_PER_CPU(struct local_irq_lock [NR_SOFTIRQS], local_softirq_locks);
 
+#ifdef CONFIG_PREEMPT_SOFTIRQ_SPLIT
+/*
+ * Instead of a single ksoftirqd each vector gets a thread per cpu,
+ * so a flood of one vector does not delay the others, and each of
+ * them can run at its own priority.
+ */
+DEFINE_PER_CPU(struct task_struct * [NR_SOFTIRQS], ksoftirqd_vec);
+
+static int softirq_prio[NR_SOFTIRQS] = {
+	[0 ... NR_SOFTIRQS - 1] = 1,
+};
+
+/*
+ * softirq_prio=<vector>:<prio>[,<vector>:<prio>...] sets the initial
+ * SCHED_FIFO priority of the sirq threads of a vector, e.g.
+ * softirq_prio=hrtimer:60,timer:50,net_rx:5
+ */
+static int __init softirq_prio_setup(char *str)
+{
+	char *opt;
+
+	while ((opt = strsep(&str, ",")) != NULL) {
+		char *val = strchr(opt, ':');
+		int i, prio;
+
+		if (!*opt)
+			continue;
+		if (!val || kstrtoint(val + 1, 0, &prio) ||
+		    prio < 1 || prio >= MAX_USER_RT_PRIO) {
+			pr_warn("softirq_prio: ignoring '%s'\n", opt);
+			continue;
+		}
+		*val = '\0';
+		for (i = 0; i < NR_SOFTIRQS; i++) {
+			if (!strcasecmp(opt, softirq_to_name[i]))
+				break;
+		}
+		if (i == NR_SOFTIRQS) {
+			pr_warn("softirq_prio: unknown vector '%s'\n", opt);
+			continue;
+		}
+		softirq_prio[i] = prio;
+	}
+	return 1;
+}
+__setup("softirq_prio=", softirq_prio_setup);
+
+static inline struct task_struct *softirq_thread(unsigned int nr)
+{
+	return __this_cpu_read(ksoftirqd_vec[nr]);
+}
+
+/* Vector handled by the calling sirq thread */
+static int softirq_thread_vec(int cpu)
+{
+	int i;
+
+	for (i = 0; i < NR_SOFTIRQS; i++) {
+		if (per_cpu(ksoftirqd_vec[i], cpu) == current)
+			return i;
+	}
+	return -1;
+}
+#else
+static inline struct task_struct *softirq_thread(unsigned int nr)
+{
+	return __this_cpu_read(ksoftirqd);
+}
+
+static inline int softirq_thread_vec(int cpu)
+{
+	return -1;
+}
+#endif
+
+static void wakeup_softirq_thread(unsigned int nr)
+{
+	struct task_struct *tsk = softirq_thread(nr);
+
+	if (tsk && tsk->state != TASK_RUNNING)
+		wake_up_process(tsk);
+}
+
+/*
+ * Wake the threads which got softirqs delegated. Called with
+ * interrupts disabled.
+ */
+static void wakeup_raised_softirqs(void)
+{
+	u32 pending = local_softirq_pending();
+
+	while (pending) {
+		int i = __ffs(pending);
+		struct task_struct *tsk = softirq_thread(i);
+
+		pending &= ~(1U << i);
+		if (tsk && tsk->softirqs_raised)
+			wakeup_softirq_thread(i);
+	}
+}
+
 void __init softirq_early_init(void)
 {
 	int i;
@@ -626,15 +750,15 @@ static void do_raise_softirq_irqoff(unsigned int nr)
 	 */
 	if (!in_irq() && current->softirq_nestcnt)
 		current->softirqs_raised |= (1U << nr);
-	else if (__this_cpu_read(ksoftirqd))
-		__this_cpu_read(ksoftirqd)->softirqs_raised |= (1U << nr);
+	else if (softirq_thread(nr))
+		softirq_thread(nr)->softirqs_raised |= (1U << nr);
 }
 
 void __raise_softirq_irqoff(unsigned int nr)
 {
 	do_raise_softirq_irqoff(nr);
 	if (!in_irq() && !current->softirq_nestcnt)
-		wakeup_softirqd();
+		wakeup_softirq_thread(nr);
 }
 
 /*
@@ -661,7 +785,7 @@ void raise_softirq_irqoff(unsigned int nr)
 	 * raise a WARN() if the condition is met.
 	 */
 	if (!current->softirq_nestcnt)
-		wakeup_softirqd();
+		wakeup_softirq_thread(nr);
 }
 
 static inline int ksoftirqd_softirq_pending(void)
@@ -672,14 +796,20 @@ static inline int ksoftirqd_softirq_pending(void)
 static inline void local_bh_disable_nort(void) { }
 static inline void _local_bh_enable_nort(void) { }
 
-static inline void ksoftirqd_set_sched_params(void)
+static inline void ksoftirqd_set_sched_params(int cpu)
 {
+	int vec = softirq_thread_vec(cpu);
 	struct sched_param param = { .sched_priority = 1 };
+	u32 mask = ~0U;
 
+	if (vec >= 0) {
+		param.sched_priority = softirq_prio[vec];
+		mask = 1U << vec;
+	}
 	sched_setscheduler(current, SCHED_FIFO, &param);
-	/* Take over all pending softirqs when starting */
+	/* Take over all pending softirqs we are responsible for */
 	local_irq_disable();
-	current->softirqs_raised = local_softirq_pending();
+	current->softirqs_raised = local_softirq_pending() & mask;
 	local_irq_enable();
 }
 
@@ -731,9 +861,7 @@ static inline void invoke_softirq(void)
 	unsigned long flags;
 
 	local_irq_save(flags);
-	if (__this_cpu_read(ksoftirqd) &&
-	    __this_cpu_read(ksoftirqd)->softirqs_raised)
-		wakeup_softirqd();
+	wakeup_raised_softirqs();
 	local_irq_restore(flags);
 #endif
 }
@@ -1212,7 +1340,7 @@ EXPORT_SYMBOL(tasklet_unlock_wait);
 
 static int run_ksoftirqd(void * __bind_cpu)
 {
-	ksoftirqd_set_sched_params();
+	ksoftirqd_set_sched_params((long) __bind_cpu);
 
 	set_current_state(TASK_INTERRUPTIBLE);
 
@@ -1309,45 +1437,91 @@ static void takeover_tasklets(unsigned int cpu)
 }
 #endif /* CONFIG_HOTPLUG_CPU */
 
+#ifdef CONFIG_PREEMPT_SOFTIRQ_SPLIT
+# define NR_SOFTIRQ_THREADS	NR_SOFTIRQS
+
+static struct task_struct **softirq_thread_slot(int cpu, int nr)
+{
+	return &per_cpu(ksoftirqd_vec[nr], cpu);
+}
+
+static struct task_struct * __cpuinit softirq_thread_create(int cpu, int nr)
+{
+	char name[TASK_COMM_LEN];
+	int i;
+
+	for (i = 0; softirq_to_name[nr][i] && i < TASK_COMM_LEN - 1; i++)
+		name[i] = tolower(softirq_to_name[nr][i]);
+	name[i] = '\0';
+
+	return kthread_create_on_node(run_ksoftirqd, (void *)(long)cpu,
+				      cpu_to_node(cpu), "sirq-%s/%d",
+				      name, cpu);
+}
+#else
+# define NR_SOFTIRQ_THREADS	1
+
+static struct task_struct **softirq_thread_slot(int cpu, int nr)
+{
+	return &per_cpu(ksoftirqd, cpu);
+}
+
+static struct task_struct * __cpuinit softirq_thread_create(int cpu, int nr)
+{
+	return kthread_create_on_node(run_ksoftirqd, (void *)(long)cpu,
+				      cpu_to_node(cpu), "ksoftirqd/%d", cpu);
+}
+#endif
+
 static int __cpuinit cpu_callback(struct notifier_block *nfb,
 				  unsigned long action,
 				  void *hcpu)
 {
 	int hotcpu = (unsigned long)hcpu;
-	struct task_struct *p;
+	struct task_struct *p, **slot;
+	int i;
 
 	switch (action & ~CPU_TASKS_FROZEN) {
 	case CPU_UP_PREPARE:
-		p = kthread_create_on_node(run_ksoftirqd,
-					   hcpu,
-					   cpu_to_node(hotcpu),
-					   "ksoftirqd/%d", hotcpu);
-		if (IS_ERR(p)) {
-			printk("ksoftirqd for %i failed\n", hotcpu);
-			return notifier_from_errno(PTR_ERR(p));
+		for (i = 0; i < NR_SOFTIRQ_THREADS; i++) {
+			p = softirq_thread_create(hotcpu, i);
+			if (IS_ERR(p)) {
+				printk("ksoftirqd for %i failed\n", hotcpu);
+				while (--i >= 0) {
+					slot = softirq_thread_slot(hotcpu, i);
+					kthread_stop(*slot);
+					*slot = NULL;
+				}
+				return notifier_from_errno(PTR_ERR(p));
+			}
+			kthread_bind(p, hotcpu);
+			*softirq_thread_slot(hotcpu, i) = p;
 		}
-		kthread_bind(p, hotcpu);
-  		per_cpu(ksoftirqd, hotcpu) = p;
- 		break;
+		break;
 	case CPU_ONLINE:
-		wake_up_process(per_cpu(ksoftirqd, hotcpu));
+		for (i = 0; i < NR_SOFTIRQ_THREADS; i++)
+			wake_up_process(*softirq_thread_slot(hotcpu, i));
 		break;
 #ifdef CONFIG_HOTPLUG_CPU
 	case CPU_UP_CANCELED:
-		if (!per_cpu(ksoftirqd, hotcpu))
+		if (!*softirq_thread_slot(hotcpu, 0))
 			break;
-		/* Unbind so it can run.  Fall thru. */
-		kthread_bind(per_cpu(ksoftirqd, hotcpu),
-			     cpumask_any(cpu_online_mask));
+		/* Unbind so they can run.  Fall thru. */
+		for (i = 0; i < NR_SOFTIRQ_THREADS; i++)
+			kthread_bind(*softirq_thread_slot(hotcpu, i),
+				     cpumask_any(cpu_online_mask));
 	case CPU_POST_DEAD: {
 		static const struct sched_param param = {
 			.sched_priority = MAX_RT_PRIO-1
 		};
 
-		p = per_cpu(ksoftirqd, hotcpu);
-		per_cpu(ksoftirqd, hotcpu) = NULL;
-		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
-		kthread_stop(p);
+		for (i = 0; i < NR_SOFTIRQ_THREADS; i++) {
+			slot = softirq_thread_slot(hotcpu, i);
+			p = *slot;
+			*slot = NULL;
+			sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
+			kthread_stop(p);
+		}
 		takeover_tasklets(hotcpu);
 		break;
 	}
@@ -55,36 +55,78 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * Per-CPU timer wheel definitions.
+ *
+ * The wheel has LVL_DEPTH levels of LVL_SIZE buckets each. The buckets
+ * of level 0 are one jiffy apart, every further level is LVL_CLK_DIV
+ * times coarser. A timer is queued once, into the level whose range
+ * covers its timeout, and stays there until it expires or is deleted:
+ * instead of cascading it down the levels as its expiry comes closer,
+ * the expiry is rounded up to the granularity of the level. A timer
+ * never fires early and at most about 1/8th of its timeout late. With
+ * HZ=1000:
+ *
+ *  Level  Granularity     Range
+ *    0       1 ms           0 ms -  62 ms
+ *    1       8 ms          63 ms - ~0.5 s
+ *    2      64 ms        ~0.5 s  - ~4 s
+ *    3     512 ms          ~4 s  - ~32 s
+ *    4      ~4 s          ~32 s  - ~4 min
+ *    5     ~33 s          ~4 min - ~34 min
+ *    6    ~4.4 min       ~34 min - ~4.6 h
+ *    7     ~35 min       ~4.6 h  - ~1.5 days
+ *    8    ~4.7 h        ~1.5 days - ~12 days
+ *
+ * Longer timeouts are cut to the range of the last level. A tick only
+ * looks at the one bucket per level which is due, and pending_map tells
+ * which buckets hold timers, so neither the tick nor the search for the
+ * next timer event walks the queued timers.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-#define MAX_TVAL ((unsigned long)((1ULL << (TVR_BITS + 4*TVN_BITS)) - 1))
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* The shortest timeout which goes into level n */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+#define WHEEL_SIZE		(LVL_SIZE * LVL_DEPTH)
+
+/*
+ * With NO_HZ the deferrable timers have a wheel of their own, which the
+ * search for the next timer event of an idle cpu skips.
+ */
+#ifdef CONFIG_NO_HZ
+# define NR_WHEELS	2
+#else
+# define NR_WHEELS	1
+#endif
 
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
-	wait_queue_head_t wait_for_running_timer;
+#ifdef CONFIG_PREEMPT_RT_FULL
+	struct swait_head wait_for_running_timer;
+#endif
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
 	unsigned long active_timers;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	DECLARE_BITMAP(pending_map, NR_WHEELS * WHEEL_SIZE);
+	struct list_head vectors[NR_WHEELS * WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -324,8 +366,10 @@ EXPORT_SYMBOL_GPL(round_jiffies_up_relative);
  * will schedule the actual timer somewhere between
  * the time mod_timer() asks for, and that time plus the slack.
  *
- * By setting the slack to -1, a percentage of the delay is used
- * instead.
+ * By setting the slack to -1, which is the default, the timer gets
+ * the slack of the timer wheel only: the expiry is rounded up to the
+ * granularity of the wheel level the timeout falls into, which is
+ * at most about 1/8th of the timeout.
  */
 void set_timer_slack(struct timer_list *timer, int slack_hz)
 {
@@ -333,59 +377,157 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
-static void
-__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
-{
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+/*
+ * Bucket of level @lvl for @expires. The expiry is rounded up to the
+ * granularity of the level, *bucket_expiry is when the bucket is due.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl,
+				      unsigned long *bucket_expiry)
+{
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	*bucket_expiry = expires << LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk,
+				     unsigned long *bucket_expiry)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long)delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than MAX_TVAL (on 64-bit
-		 * architectures or with CONFIG_BASE_SMALL=1) then we
-		 * use the maximum timeout.
-		 */
-		if (idx > MAX_TVAL) {
-			idx = MAX_TVAL;
-			expires = idx + base->timer_jiffies;
+		*bucket_expiry = clk;
+		return clk & LVL_MASK;
+	}
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		/* Larger timeouts expire at the capacity limit of the wheel */
+		delta = WHEEL_TIMEOUT_MAX;
+		expires = clk + delta;
+	}
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++) {
+		if (delta < LVL_START(lvl + 1))
+			break;
+	}
+	return calc_index(expires, lvl, bucket_expiry);
+}
+
+/* Offset of the wheel the timer goes into in base->vectors */
+static inline unsigned int timer_wheel_offs(struct timer_list *timer)
+{
+	if (NR_WHEELS > 1 && tbase_get_deferrable(timer->base))
+		return WHEEL_SIZE;
+	return 0;
+}
+
+/*
+ * Distance in buckets from @clk to the next pending bucket of the level
+ * at @offset, -1 if there is none.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
+
+	pos = find_next_bit(base->pending_map, end, start);
+	if (pos < end)
+		return pos - start;
+
+	pos = find_next_bit(base->pending_map, start, offset);
+	return pos < start ? pos + LVL_SIZE - start : -1;
+}
+
+/*
+ * Find out when the first pending bucket of the wheel at @offset is
+ * due. Called with base->lock held.
+ */
+static unsigned long __next_timer_interrupt(struct tvec_base *base,
+					    unsigned int offset)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned long next = clk + NEXT_TIMER_MAX_DELTA;
+	unsigned int lvl;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(base, offset, clk & LVL_MASK);
+		unsigned long adj;
+
+		if (pos >= 0) {
+			unsigned long tmp = (clk + pos) << LVL_SHIFT(lvl);
+
+			if (time_before(tmp, next))
+				next = tmp;
 		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		/*
+		 * On to the next level: its first bucket which is not due
+		 * before timer_jiffies is clk / LVL_CLK_DIV rounded up.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
 	}
-	/*
-	 * Timers are FIFO:
-	 */
-	list_add_tail(&timer->entry, vec);
+	return next;
+}
+
+static unsigned long next_pending_expiry(struct tvec_base *base)
+{
+	unsigned long next = __next_timer_interrupt(base, 0);
+	unsigned long next_def;
+
+	if (NR_WHEELS > 1) {
+		next_def = __next_timer_interrupt(base, WHEEL_SIZE);
+		if (time_before(next_def, next))
+			next = next_def;
+	}
+	return next;
+}
+
+/*
+ * The timer softirq doesn't run while a cpu idles with the tick
+ * stopped, so timer_jiffies falls behind jiffies. Timers are queued
+ * relative to it, a stale timer_jiffies would put them into too coarse
+ * a level, and __run_timers() would have to step over every missed
+ * jiffy. Move it forward over the jiffies in which no bucket is due.
+ */
+static void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long jnow = ACCESS_ONCE(jiffies);
+	unsigned long next;
+
+	if ((long)(jnow - base->timer_jiffies) < 2)
+		return;
+
+	next = next_pending_expiry(base);
+	if (time_after(next, jnow))
+		base->timer_jiffies = jnow;
+	else if (time_after(next, base->timer_jiffies))
+		base->timer_jiffies = next;
 }
 
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
-	__internal_add_timer(base, timer);
+	unsigned long bucket_expiry;
+	unsigned int idx;
+
+	forward_timer_base(base);
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies,
+			       &bucket_expiry);
+	idx += timer_wheel_offs(timer);
+	/*
+	 * Timers are FIFO:
+	 */
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
 	/*
 	 * Update base->active_timers and base->next_timer
 	 */
 	if (!tbase_get_deferrable(timer->base)) {
-		if (time_before(timer->expires, base->next_timer))
-			base->next_timer = timer->expires;
+		if (time_before(bucket_expiry, base->next_timer))
+			base->next_timer = bucket_expiry;
 		base->active_timers++;
 	}
 }
@@ -695,15 +837,27 @@ detach_expired_timer(struct timer_list *timer, struct tvec_base *base)
 static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
 			     bool clear_pending)
 {
+	struct list_head *entry = &timer->entry;
+	struct list_head *head = entry->next;
+
 	if (!timer_pending(timer))
 		return 0;
 
-	detach_timer(timer, clear_pending);
-	if (!tbase_get_deferrable(timer->base)) {
-		timer->base->active_timers--;
-		if (timer->expires == base->next_timer)
+	/*
+	 * The last timer of a wheel bucket clears its pending bit. A timer
+	 * which is not in a bucket sits on the list of expired timers of
+	 * __run_timers(), which has cleared the bit already.
+	 */
+	if (entry->prev == head && head >= base->vectors &&
+	    head < base->vectors + ARRAY_SIZE(base->vectors)) {
+		__clear_bit(head - base->vectors, base->pending_map);
+		if (!tbase_get_deferrable(timer->base))
 			base->next_timer = base->timer_jiffies;
 	}
+
+	detach_timer(timer, clear_pending);
+	if (!tbase_get_deferrable(timer->base))
+		timer->base->active_timers--;
 	return 1;
 }
 
@@ -713,7 +867,7 @@ static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
  * locked, and the base itself is locked too.
  *
  * So __run_timers/migrate_timers can safely modify all timers which could
- * be found on ->tvX lists.
+ * be found in the wheel buckets.
  *
  * When the timer's base is locked, and the timer removed from list, it is
  * possible to set timer->base = NULL and drop the lock: the timer remains
@@ -792,7 +946,8 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	cpu = smp_processor_id();
 
 #if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
-	if (!pinned && get_sysctl_timer_migration() && idle_cpu(cpu))
+	if (!pinned && get_sysctl_timer_migration() &&
+	    (idle_cpu(cpu) || !is_housekeeping_cpu(cpu)))
 		cpu = get_nohz_timer_target();
 #endif
 	preempt_enable_rt();
@@ -845,6 +1000,9 @@ EXPORT_SYMBOL(mod_timer_pending);
  *   3) use this bit to make a mask
  *   4) use the bitmask to round down the maximum time, so that all last
  *      bits are zeros
+ *
+ * Without an explicit slack the timer is left alone, the granularity of
+ * its wheel level is slack enough.
  */
 static inline
 unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
@@ -852,16 +1010,10 @@ unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
 	unsigned long expires_limit, mask;
 	int bit;
 
-	if (timer->slack >= 0) {
-		expires_limit = expires + timer->slack;
-	} else {
-		long delta = expires - jiffies;
-
-		if (delta < 256)
-			return expires;
+	if (timer->slack < 0)
+		return expires;
 
-		expires_limit = expires + delta / 256;
-	}
+	expires_limit = expires + timer->slack;
 	mask = expires ^ expires_limit;
 	if (mask == 0)
 		return expires;
@@ -1000,11 +1152,11 @@ static void wait_for_running_timer(struct timer_list *timer)
 	struct tvec_base *base = timer->base;
 
 	if (base->running_timer == timer)
-		wait_event(base->wait_for_running_timer,
-			   base->running_timer != timer);
+		swait_event(base->wait_for_running_timer,
+			    base->running_timer != timer);
 }
 
-# define wakeup_timer_waiters(b)	wake_up(&(b)->wait_for_tunning_timer)
+# define wakeup_timer_waiters(b)	swait_wake_all(&(b)->wait_for_running_timer)
 #else
 static inline void wait_for_running_timer(struct timer_list *timer)
 {
@@ -1137,27 +1289,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		/* No accounting, while moving them */
-		__internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1201,134 +1332,82 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
-
-/**
- * __run_timers - run all expired timers (if any) on this CPU.
- * @base: the timer vector to be processed.
- *
- * This function cascades all vectors and executes all expired timer
- * vectors.
- */
-static inline void __run_timers(struct tvec_base *base)
+static void expire_timers(struct tvec_base *base, struct list_head *head)
 {
 	struct timer_list *timer;
 
-	spin_lock_irq(&base->lock);
-	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
-
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
 
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
+		timer = list_first_entry(head, struct timer_list, entry);
+		fn = timer->function;
+		data = timer->data;
 
-			timer_stats_account_timer(timer);
+		timer_stats_account_timer(timer);
 
-			base->running_timer = timer;
-			detach_expired_timer(timer, base);
+		base->running_timer = timer;
+		detach_expired_timer(timer, base);
 
-			spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn, data);
-			base->running_timer = NULL;
-			spin_lock_irq(&base->lock);
-		}
+		spin_unlock_irq(&base->lock);
+		call_timer_fn(timer, fn, data);
+		base->running_timer = NULL;
+		spin_lock_irq(&base->lock);
 	}
-	wake_up(&base->wait_for_running_timer);
-	spin_unlock_irq(&base->lock);
 }
 
-#ifdef CONFIG_NO_HZ
 /*
- * Find out when the next timer event is due to happen. This
- * is used on S/390 to stop all activity when a CPU is idle.
- * This function needs to be called with interrupts disabled.
+ * Move the buckets which are due at base->timer_jiffies to @heads, at
+ * most one per level and wheel. Returns the number of lists filled.
  */
-static unsigned long __next_timer_interrupt(struct tvec_base *base)
-{
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
+{
+	unsigned long clk = base->timer_jiffies;
+	int lvl, nr = 0;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		unsigned int idx = LVL_OFFS(lvl) + (clk & LVL_MASK);
+		int i;
+
+		for (i = 0; i < NR_WHEELS; i++, idx += WHEEL_SIZE) {
+			if (__test_and_clear_bit(idx, base->pending_map))
+				list_replace_init(base->vectors + idx,
+						  heads + nr++);
 		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
+		/* The next level is due only at its bucket boundaries */
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return nr;
+}
 
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
+/**
+ * __run_timers - run all expired timers (if any) on this CPU.
+ * @base: the timer vector to be processed.
+ *
+ * This function executes the expired buckets of all wheel levels. The
+ * coarser levels go first, their timers have been due the longest.
+ */
+static inline void __run_timers(struct tvec_base *base)
+{
+	struct list_head heads[NR_WHEELS * LVL_DEPTH];
+	int nr;
+
+	spin_lock_irq(&base->lock);
+	while (time_after_eq(jiffies, base->timer_jiffies)) {
+		forward_timer_base(base);
+		nr = collect_expired_timers(base, heads);
+		++base->timer_jiffies;
+		while (nr--)
+			expire_timers(base, heads + nr);
 	}
-	return expires;
+	wakeup_timer_waiters(base);
+	spin_unlock_irq(&base->lock);
 }
 
+#ifdef CONFIG_NO_HZ
 /*
  * Check, if the next hrtimer event is before the next timer wheel
  * event:
@@ -1403,7 +1482,7 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 #endif
 	if (base->active_timers) {
 		if (time_before_eq(base->next_timer, base->timer_jiffies))
-			base->next_timer = __next_timer_interrupt(base);
+			base->next_timer = __next_timer_interrupt(base, 0);
 		expires = base->next_timer;
 	}
 #ifdef CONFIG_PREEMPT_RT_FULL
@@ -1768,16 +1847,13 @@ static int __cpuinit init_timers_cpu(int cpu)
 	}
 
 	spin_lock_init(&base->lock);
-	init_waitqueue_head(&base->wait_for_running_timer);
+#ifdef CONFIG_PREEMPT_RT_FULL
+	init_swait_head(&base->wait_for_running_timer);
+#endif
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < ARRAY_SIZE(base->vectors); j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, ARRAY_SIZE(base->vectors));
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
@@ -1817,14 +1893,9 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for_each_set_bit(i, old_base->pending_map, ARRAY_SIZE(old_base->vectors))
+		migrate_timer_list(new_base, old_base->vectors + i);
+	bitmap_zero(old_base->pending_map, ARRAY_SIZE(old_base->vectors));
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
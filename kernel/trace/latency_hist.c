@@ -21,7 +21,9 @@
 #include <linux/uaccess.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <asm/atomic.h>
+#include <asm/local.h>
 #include <asm/div64.h>
 
 #include "trace.h"
@@ -43,20 +45,70 @@ enum {
 	MAX_LATENCY_TYPE,
 };
 
-#define MAX_ENTRY_NUM 10240
+/*
+ * Latencies are recorded in nanoseconds into log-linear buckets: values
+ * below HIST_SUB_COUNT get a bucket each, above that every power of two
+ * is split into HIST_SUB_COUNT buckets, i.e. the bucket width is at most
+ * 1/HIST_SUB_COUNT of the value. Values of 2^HIST_MAX_BITS nanoseconds
+ * (about 4.3 seconds) and above are only counted.
+ */
+#define HIST_SUB_BITS	3
+#define HIST_SUB_COUNT	(1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS	32
+#define HIST_MAX_LAT	(1ULL << HIST_MAX_BITS)
+#define HIST_NR_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
 
+/*
+ * A histogram is only updated by its own CPU with preemption disabled,
+ * so the buckets are local_t and readers never stop the updates.
+ */
 struct hist_data {
-	atomic_t hist_mode; /* 0 log, 1 don't log */
-	long offset; /* set it to MAX_ENTRY_NUM/2 for a bipolar scale */
+	atomic_t hist_mode; /* 0 don't log, 1 log */
 	long min_lat;
 	long max_lat;
 	unsigned long long below_hist_bound_samples;
 	unsigned long long above_hist_bound_samples;
 	long long accumulate_lat;
 	unsigned long long total_samples;
-	unsigned long long hist_array[MAX_ENTRY_NUM];
+	local_t hist_array[HIST_NR_BUCKETS];
 };
 
+/* Per-CPU record of the binary "snapshot" files */
+struct hist_snapshot {
+	u32 cpu;
+	u32 nr_buckets;
+	u32 sub_bits;
+	u32 pad;
+	s64 min_lat;
+	s64 max_lat;
+	u64 total_samples;
+	u64 accumulate_lat;
+	u64 below_hist_bound_samples;
+	u64 above_hist_bound_samples;
+	u64 buckets[HIST_NR_BUCKETS];
+};
+
+static inline int hist_bucket(u64 latency)
+{
+	int shift;
+
+	if (latency < HIST_SUB_COUNT)
+		return latency;
+
+	shift = fls64(latency) - 1 - HIST_SUB_BITS;
+	return ((shift + 1) << HIST_SUB_BITS) +
+	    ((latency >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+static inline u64 hist_bucket_start(int index)
+{
+	int shift = (index >> HIST_SUB_BITS) - 1;
+
+	if (shift < 0)
+		return index;
+	return (u64) (HIST_SUB_COUNT | (index & (HIST_SUB_COUNT - 1))) << shift;
+}
+
 struct enable_data {
 	int latency_type;
 	int enabled;
@@ -212,18 +264,15 @@ void notrace latency_hist(int latency_type, int cpu, long latency,
 		return;
 	}
 
-	latency += my_hist->offset;
-
 	if (atomic_read(&my_hist->hist_mode) == 0)
 		return;
 
-	if (latency < 0 || latency >= MAX_ENTRY_NUM) {
-		if (latency < 0)
-			my_hist->below_hist_bound_samples++;
-		else
-			my_hist->above_hist_bound_samples++;
-	} else
-		my_hist->hist_array[latency]++;
+	if (latency < 0)
+		my_hist->below_hist_bound_samples++;
+	else if ((u64) latency >= HIST_MAX_LAT)
+		my_hist->above_hist_bound_samples++;
+	else
+		local_inc(&my_hist->hist_array[hist_bucket(latency)]);
 
 	if (unlikely(latency > my_hist->max_lat ||
 	    my_hist->min_lat == LONG_MAX)) {
@@ -262,41 +311,36 @@ static void *l_start(struct seq_file *m, loff_t *pos)
 	if (index == 0) {
 		char minstr[32], avgstr[32], maxstr[32];
 
-		atomic_dec(&my_hist->hist_mode);
-
 		if (likely(my_hist->total_samples)) {
 			long avg = (long) div64_s64(my_hist->accumulate_lat,
 			    my_hist->total_samples);
 			snprintf(minstr, sizeof(minstr), "%ld",
-			    my_hist->min_lat - my_hist->offset);
-			snprintf(avgstr, sizeof(avgstr), "%ld",
-			    avg - my_hist->offset);
+			    my_hist->min_lat);
+			snprintf(avgstr, sizeof(avgstr), "%ld", avg);
 			snprintf(maxstr, sizeof(maxstr), "%ld",
-			    my_hist->max_lat - my_hist->offset);
+			    my_hist->max_lat);
 		} else {
 			strcpy(minstr, "<undef>");
 			strcpy(avgstr, minstr);
 			strcpy(maxstr, minstr);
 		}
 
-		seq_printf(m, "#Minimum latency: %s microseconds\n"
-			   "#Average latency: %s microseconds\n"
-			   "#Maximum latency: %s microseconds\n"
+		seq_printf(m, "#Minimum latency: %s nanoseconds\n"
+			   "#Average latency: %s nanoseconds\n"
+			   "#Maximum latency: %s nanoseconds\n"
 			   "#Total samples: %llu\n"
-			   "#There are %llu samples lower than %ld"
-			   " microseconds.\n"
+			   "#There are %llu samples lower than 0"
+			   " nanoseconds.\n"
 			   "#There are %llu samples greater or equal"
-			   " than %ld microseconds.\n"
-			   "#usecs\t%16s\n",
+			   " than %llu nanoseconds.\n"
+			   "#nsecs\t%16s\n",
 			   minstr, avgstr, maxstr,
 			   my_hist->total_samples,
 			   my_hist->below_hist_bound_samples,
-			   -my_hist->offset,
 			   my_hist->above_hist_bound_samples,
-			   MAX_ENTRY_NUM - my_hist->offset,
-			   "samples");
+			   HIST_MAX_LAT, "samples");
 	}
-	if (index < MAX_ENTRY_NUM) {
+	if (index < HIST_NR_BUCKETS) {
 		index_ptr = kmalloc(sizeof(loff_t), GFP_KERNEL);
 		if (index_ptr)
 			*index_ptr = index;
@@ -308,12 +352,9 @@ static void *l_start(struct seq_file *m, loff_t *pos)
 static void *l_next(struct seq_file *m, void *p, loff_t *pos)
 {
 	loff_t *index_ptr = p;
-	struct hist_data *my_hist = m->private;
 
-	if (++*pos >= MAX_ENTRY_NUM) {
-		atomic_inc(&my_hist->hist_mode);
+	if (++*pos >= HIST_NR_BUCKETS)
 		return NULL;
-	}
 	*index_ptr = *pos;
 	return index_ptr;
 }
@@ -328,8 +369,8 @@ static int l_show(struct seq_file *m, void *p)
 	int index = *(loff_t *) p;
 	struct hist_data *my_hist = m->private;
 
-	seq_printf(m, "%6ld\t%16llu\n", index - my_hist->offset,
-	    my_hist->hist_array[index]);
+	seq_printf(m, "%10llu\t%16lu\n", hist_bucket_start(index),
+	    local_read(&my_hist->hist_array[index]));
 	return 0;
 }
 
@@ -359,6 +400,111 @@ static struct file_operations latency_hist_fops = {
 	.release = seq_release,
 };
 
+static struct hist_data *get_hist_data(int latency_type, int cpu)
+{
+	switch (latency_type) {
+#ifdef CONFIG_INTERRUPT_OFF_HIST
+	case IRQSOFF_LATENCY:
+		return &per_cpu(irqsoff_hist, cpu);
+#endif
+#ifdef CONFIG_PREEMPT_OFF_HIST
+	case PREEMPTOFF_LATENCY:
+		return &per_cpu(preemptoff_hist, cpu);
+#endif
+#if defined(CONFIG_PREEMPT_OFF_HIST) && defined(CONFIG_INTERRUPT_OFF_HIST)
+	case PREEMPTIRQSOFF_LATENCY:
+		return &per_cpu(preemptirqsoff_hist, cpu);
+#endif
+#ifdef CONFIG_WAKEUP_LATENCY_HIST
+	case WAKEUP_LATENCY:
+		return &per_cpu(wakeup_latency_hist, cpu);
+	case WAKEUP_LATENCY_SHAREDPRIO:
+		return &per_cpu(wakeup_latency_hist_sharedprio, cpu);
+#endif
+#ifdef CONFIG_MISSED_TIMER_OFFSETS_HIST
+	case MISSED_TIMER_OFFSETS:
+		return &per_cpu(missed_timer_offsets, cpu);
+#endif
+#if defined(CONFIG_WAKEUP_LATENCY_HIST) && \
+    defined(CONFIG_MISSED_TIMER_OFFSETS_HIST)
+	case TIMERANDWAKEUP_LATENCY:
+		return &per_cpu(timerandwakeup_latency_hist, cpu);
+#endif
+	default:
+		return NULL;
+	}
+}
+
+struct hist_snapshot_buf {
+	size_t len;
+	struct hist_snapshot snap[0];
+};
+
+/*
+ * Copy the histograms of all possible CPUs at open time, the
+ * histograms keep being updated meanwhile.
+ */
+static int latency_hist_snapshot_open(struct inode *inode, struct file *file)
+{
+	off_t latency_type = (off_t) inode->i_private;
+	struct hist_snapshot_buf *buf;
+	struct hist_snapshot *snap;
+	struct hist_data *hist;
+	size_t len;
+	int cpu, i;
+
+	len = num_possible_cpus() * sizeof(struct hist_snapshot);
+	buf = vzalloc(sizeof(*buf) + len);
+	if (!buf)
+		return -ENOMEM;
+	buf->len = len;
+
+	snap = buf->snap;
+	for_each_possible_cpu(cpu) {
+		hist = get_hist_data(latency_type, cpu);
+		if (!hist)
+			continue;
+
+		snap->cpu = cpu;
+		snap->nr_buckets = HIST_NR_BUCKETS;
+		snap->sub_bits = HIST_SUB_BITS;
+		snap->min_lat = hist->min_lat;
+		snap->max_lat = hist->max_lat;
+		snap->total_samples = hist->total_samples;
+		snap->accumulate_lat = hist->accumulate_lat;
+		snap->below_hist_bound_samples = hist->below_hist_bound_samples;
+		snap->above_hist_bound_samples = hist->above_hist_bound_samples;
+		for (i = 0; i < HIST_NR_BUCKETS; i++)
+			snap->buckets[i] = local_read(&hist->hist_array[i]);
+		snap++;
+	}
+
+	file->private_data = buf;
+	return 0;
+}
+
+static ssize_t latency_hist_snapshot_read(struct file *file, char __user *ubuf,
+					  size_t cnt, loff_t *ppos)
+{
+	struct hist_snapshot_buf *buf = file->private_data;
+
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf->snap, buf->len);
+}
+
+static int latency_hist_snapshot_release(struct inode *inode,
+					 struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations latency_hist_snapshot_fops = {
+	.open = latency_hist_snapshot_open,
+	.read = latency_hist_snapshot_read,
+	.llseek = default_llseek,
+	.release = latency_hist_snapshot_release,
+};
+
 #if defined(CONFIG_WAKEUP_LATENCY_HIST) || \
     defined(CONFIG_MISSED_TIMER_OFFSETS_HIST)
 static void clear_maxlatprocdata(struct maxlatproc_data *mp)
@@ -518,7 +664,8 @@ show_maxlatproc(struct file *file, char __user *ubuf, size_t cnt, loff_t *ppos)
 	secs = (unsigned long) t;
 	r = snprintf(buf, strmaxlen,
 	    "%d %d %ld (%ld) %s <- %d %d %s %lu.%06lu\n", mp->pid,
-	    MAX_RT_PRIO-1 - mp->prio, mp->latency, mp->timeroffset, mp->comm,
+	    MAX_RT_PRIO-1 - mp->prio, mp->latency / NSECS_PER_USECS,
+	    mp->timeroffset / NSECS_PER_USECS, mp->comm,
 	    mp->current_pid, MAX_RT_PRIO-1 - mp->current_prio, mp->current_comm,
 	    secs, usecs);
 	r = simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
@@ -538,26 +685,10 @@ show_enable(struct file *file, char __user *ubuf, size_t cnt, loff_t *ppos)
 	return simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
 }
 
-static ssize_t
-do_enable(struct file *file, const char __user *ubuf, size_t cnt, loff_t *ppos)
+static int latency_hist_set_enable(struct enable_data *ed, long enable)
 {
-	char buf[64];
-	long enable;
-	struct enable_data *ed = file->private_data;
-
-	if (cnt >= sizeof(buf))
-		return -EINVAL;
-
-	if (copy_from_user(&buf, ubuf, cnt))
-		return -EFAULT;
-
-	buf[cnt] = 0;
-
-	if (strict_strtol(buf, 10, &enable))
-		return(-EINVAL);
-
 	if ((enable && ed->enabled) || (!enable && !ed->enabled))
-		return cnt;
+		return 0;
 
 	if (enable) {
 		int ret;
@@ -710,7 +841,30 @@ do_enable(struct file *file, const char __user *ubuf, size_t cnt, loff_t *ppos)
 		}
 	}
 	ed->enabled = enable;
-	return cnt;
+	return 0;
+}
+
+static ssize_t
+do_enable(struct file *file, const char __user *ubuf, size_t cnt, loff_t *ppos)
+{
+	char buf[64];
+	long enable;
+	int ret;
+	struct enable_data *ed = file->private_data;
+
+	if (cnt >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(&buf, ubuf, cnt))
+		return -EFAULT;
+
+	buf[cnt] = 0;
+
+	if (strict_strtol(buf, 10, &enable))
+		return(-EINVAL);
+
+	ret = latency_hist_set_enable(ed, enable);
+	return ret ? ret : cnt;
 }
 
 static const struct file_operations latency_hist_reset_fops = {
@@ -792,8 +946,7 @@ static notrace void probe_preemptirqsoff_hist(void *v, int reason,
 			stop = ftrace_now(cpu);
 			time_set++;
 			if (start) {
-				long latency = ((long) (stop - start)) /
-				    NSECS_PER_USECS;
+				long latency = (long) (stop - start);
 
 				latency_hist(IRQSOFF_LATENCY, cpu, latency, 0,
 				    stop, NULL);
@@ -810,8 +963,7 @@ static notrace void probe_preemptirqsoff_hist(void *v, int reason,
 			if (!(time_set++))
 				stop = ftrace_now(cpu);
 			if (start) {
-				long latency = ((long) (stop - start)) /
-				    NSECS_PER_USECS;
+				long latency = (long) (stop - start);
 
 				latency_hist(PREEMPTOFF_LATENCY, cpu, latency,
 				    0, stop, NULL);
@@ -829,8 +981,7 @@ static notrace void probe_preemptirqsoff_hist(void *v, int reason,
 			if (!time_set)
 				stop = ftrace_now(cpu);
 			if (start) {
-				long latency = ((long) (stop - start)) /
-				    NSECS_PER_USECS;
+				long latency = (long) (stop - start);
 
 				latency_hist(PREEMPTIRQSOFF_LATENCY, cpu,
 				    latency, 0, stop, NULL);
@@ -944,8 +1095,7 @@ static notrace void probe_wakeup_latency_hist_stop(void *v,
 	 */
 	stop = ftrace_now(raw_smp_processor_id());
 
-	latency = ((long) (stop - next->preempt_timestamp_hist)) /
-	    NSECS_PER_USECS;
+	latency = (long) (stop - next->preempt_timestamp_hist);
 
 	if (per_cpu(wakeup_sharedprio, cpu)) {
 		latency_hist(WAKEUP_LATENCY_SHAREDPRIO, cpu, latency, 0, stop,
@@ -991,7 +1141,7 @@ static notrace void probe_hrtimer_interrupt(void *v, int cpu,
 		}
 
 		now = ftrace_now(cpu);
-		latency = (long) div_s64(-latency_ns, NSECS_PER_USECS);
+		latency = (long) min_t(long long, -latency_ns, LONG_MAX);
 		latency_hist(MISSED_TIMER_OFFSETS, cpu, latency, latency, now,
 		    task);
 #ifdef CONFIG_WAKEUP_LATENCY_HIST
@@ -1001,6 +1151,36 @@ static notrace void probe_hrtimer_interrupt(void *v, int cpu,
 }
 #endif
 
+/* Histograms enabled on the kernel command line, e.g. latency_hist=wakeup */
+static char latency_hist_bootup[128] __initdata;
+
+static int __init set_cmdline_latency_hist(char *str)
+{
+	strlcpy(latency_hist_bootup, str, sizeof(latency_hist_bootup));
+	return 1;
+}
+__setup("latency_hist=", set_cmdline_latency_hist);
+
+static void __init latency_hist_boot_enable(const char *name,
+    struct enable_data *ed)
+{
+	const char *p = latency_hist_bootup;
+	size_t len = strlen(name);
+
+	while (*p) {
+		if (!strncmp(p, name, len) && (p[len] == ',' || !p[len])) {
+			if (latency_hist_set_enable(ed, 1))
+				pr_warn("latency_hist: Couldn't enable %s\n",
+				    name);
+			return;
+		}
+		p = strchr(p, ',');
+		if (!p)
+			break;
+		p++;
+	}
+}
+
 static __init int latency_hist_init(void)
 {
 	struct dentry *latency_hist_root = NULL;
@@ -1036,6 +1216,8 @@ static __init int latency_hist_init(void)
 	}
 	entry = debugfs_create_file("reset", 0644, dentry,
 	    (void *)IRQSOFF_LATENCY, &latency_hist_reset_fops);
+	entry = debugfs_create_file("snapshot", 0444, dentry,
+	    (void *)IRQSOFF_LATENCY, &latency_hist_snapshot_fops);
 #endif
 
 #ifdef CONFIG_PREEMPT_OFF_HIST
@@ -1051,6 +1233,8 @@ static __init int latency_hist_init(void)
 	}
 	entry = debugfs_create_file("reset", 0644, dentry,
 	    (void *)PREEMPTOFF_LATENCY, &latency_hist_reset_fops);
+	entry = debugfs_create_file("snapshot", 0444, dentry,
+	    (void *)PREEMPTOFF_LATENCY, &latency_hist_snapshot_fops);
 #endif
 
 #if defined(CONFIG_INTERRUPT_OFF_HIST) && defined(CONFIG_PREEMPT_OFF_HIST)
@@ -1066,6 +1250,8 @@ static __init int latency_hist_init(void)
 	}
 	entry = debugfs_create_file("reset", 0644, dentry,
 	    (void *)PREEMPTIRQSOFF_LATENCY, &latency_hist_reset_fops);
+	entry = debugfs_create_file("snapshot", 0444, dentry,
+	    (void *)PREEMPTIRQSOFF_LATENCY, &latency_hist_snapshot_fops);
 #endif
 
 #if defined(CONFIG_INTERRUPT_OFF_HIST) || defined(CONFIG_PREEMPT_OFF_HIST)
@@ -1112,8 +1298,12 @@ static __init int latency_hist_init(void)
 	    (void *)&wakeup_pid, &pid_fops);
 	entry = debugfs_create_file("reset", 0644, dentry,
 	    (void *)WAKEUP_LATENCY, &latency_hist_reset_fops);
+	entry = debugfs_create_file("snapshot", 0444, dentry,
+	    (void *)WAKEUP_LATENCY, &latency_hist_snapshot_fops);
 	entry = debugfs_create_file("reset", 0644, dentry_sharedprio,
 	    (void *)WAKEUP_LATENCY_SHAREDPRIO, &latency_hist_reset_fops);
+	entry = debugfs_create_file("snapshot", 0444, dentry_sharedprio,
+	    (void *)WAKEUP_LATENCY_SHAREDPRIO, &latency_hist_snapshot_fops);
 	entry = debugfs_create_file("wakeup", 0644,
 	    enable_root, (void *)&wakeup_latency_enabled_data,
 	    &enable_fops);
@@ -1140,6 +1330,8 @@ static __init int latency_hist_init(void)
 	    (void *)&missed_timer_offsets_pid, &pid_fops);
 	entry = debugfs_create_file("reset", 0644, dentry,
 	    (void *)MISSED_TIMER_OFFSETS, &latency_hist_reset_fops);
+	entry = debugfs_create_file("snapshot", 0444, dentry,
+	    (void *)MISSED_TIMER_OFFSETS, &latency_hist_snapshot_fops);
 	entry = debugfs_create_file("missed_timer_offsets", 0644,
 	    enable_root, (void *)&missed_timer_offsets_enabled_data,
 	    &enable_fops);
@@ -1166,10 +1358,28 @@ static __init int latency_hist_init(void)
 	}
 	entry = debugfs_create_file("reset", 0644, dentry,
 	    (void *)TIMERANDWAKEUP_LATENCY, &latency_hist_reset_fops);
+	entry = debugfs_create_file("snapshot", 0444, dentry,
+	    (void *)TIMERANDWAKEUP_LATENCY, &latency_hist_snapshot_fops);
 	entry = debugfs_create_file("timerandwakeup", 0644,
 	    enable_root, (void *)&timerandwakeup_enabled_data,
 	    &enable_fops);
 #endif
+
+#if defined(CONFIG_INTERRUPT_OFF_HIST) || defined(CONFIG_PREEMPT_OFF_HIST)
+	latency_hist_boot_enable("preemptirqsoff", &preemptirqsoff_enabled_data);
+#endif
+#ifdef CONFIG_WAKEUP_LATENCY_HIST
+	latency_hist_boot_enable("wakeup", &wakeup_latency_enabled_data);
+#endif
+#ifdef CONFIG_MISSED_TIMER_OFFSETS_HIST
+	latency_hist_boot_enable("missed_timer_offsets",
+	    &missed_timer_offsets_enabled_data);
+#endif
+#if defined(CONFIG_WAKEUP_LATENCY_HIST) && \
+    defined(CONFIG_MISSED_TIMER_OFFSETS_HIST)
+	latency_hist_boot_enable("timerandwakeup",
+	    &timerandwakeup_enabled_data);
+#endif
 	return 0;
 }
 
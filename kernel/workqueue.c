@@ -41,6 +41,8 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/moduleparam.h>
+#include <linux/device.h>
 
 #include "workqueue_sched.h"
 
@@ -73,14 +75,21 @@ enum {
 	WORKER_DIE		= 1 << 1,	/* die die die */
 	WORKER_IDLE		= 1 << 2,	/* is idle */
 	WORKER_PREP		= 1 << 3,	/* preparing to run works */
+	WORKER_RT		= 1 << 4,	/* serves the WQ_RT pool */
 	WORKER_REBIND		= 1 << 5,	/* mom is home, come back */
 	WORKER_CPU_INTENSIVE	= 1 << 6,	/* cpu intensive */
 	WORKER_UNBOUND		= 1 << 7,	/* worker is unbound */
 
 	WORKER_NOT_RUNNING	= WORKER_PREP | WORKER_REBIND | WORKER_UNBOUND |
-				  WORKER_CPU_INTENSIVE,
+				  WORKER_CPU_INTENSIVE | WORKER_RT,
 
+	HIGHPRI_WORKER_POOL	= 1,		/* index of the highpri pool */
+#ifdef CONFIG_PREEMPT_RT_FULL
+	RT_WORKER_POOL		= 2,		/* index of the WQ_RT pool */
+	NR_WORKER_POOLS		= 3,		/* # worker pools per gcwq */
+#else
 	NR_WORKER_POOLS		= 2,		/* # worker pools per gcwq */
+#endif
 
 	BUSY_WORKER_HASH_ORDER	= 6,		/* 64 pointers */
 	BUSY_WORKER_HASH_SIZE	= 1 << BUSY_WORKER_HASH_ORDER,
@@ -148,6 +157,8 @@ struct worker {
 	unsigned long		last_active;	/* L: last active timestamp */
 	unsigned int		flags;		/* X: flags */
 	int			id;		/* I: worker id */
+	int			prio;		/* L: prio of an RT pool worker */
+	unsigned int		cpus_seq;	/* gcwq->cpus_seq applied */
 
 	/* for rebinding worker to CPU */
 	struct idle_rebind	*idle_rebind;	/* L: for idle worker */
@@ -173,18 +184,21 @@ struct worker_pool {
 /*
  * Global per-cpu workqueue.  There's one and only one for each cpu
  * and all works are queued and processed here regardless of their
- * target workqueues.
+ * target workqueues.  Unbound works go to the unbound gcwq, or to the
+ * one of their NUMA node.
  */
 struct global_cwq {
 	spinlock_t		lock;		/* the gcwq lock */
 	unsigned int		cpu;		/* I: the associated cpu */
 	unsigned int		flags;		/* L: GCWQ_* flags */
+	unsigned int		cpus_seq;	/* bumped on node cpu online */
 
 	/* workers are chained either in busy_hash or pool idle_list */
 	struct hlist_head	busy_hash[BUSY_WORKER_HASH_SIZE];
 						/* L: hash of busy workers */
 
-	struct worker_pool	pools[2];	/* normal and highpri pools */
+	struct worker_pool	pools[NR_WORKER_POOLS];
+						/* normal, highpri and RT pools */
 
 	wait_queue_head_t	rebind_hold;	/* rebind hold wait */
 } ____cacheline_aligned_in_smp;
@@ -192,7 +206,8 @@ struct global_cwq {
 /*
  * The per-CPU workqueue.  The lower WORK_STRUCT_FLAG_BITS of
  * work_struct->data are used for flags and thus cwqs need to be
- * aligned at two's power of the number of flag bits.
+ * aligned at two's power of the number of flag bits.  The alignment
+ * is part of the type so that arrays of cwqs stay aligned.
  */
 struct cpu_workqueue_struct {
 	struct worker_pool	*pool;		/* I: the associated pool */
@@ -204,7 +219,7 @@ struct cpu_workqueue_struct {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
-};
+} __aligned(1 << WORK_STRUCT_FLAG_BITS);
 
 /*
  * Structure used to wait for workqueue flush.
@@ -238,7 +253,8 @@ typedef unsigned long mayday_mask_t;
 
 /*
  * The externally visible workqueue abstraction is an array of
- * per-CPU workqueues:
+ * per-CPU workqueues.  Unbound workqueues have one cwq for the unbound
+ * gcwq followed by one for each NUMA node gcwq.
  */
 struct workqueue_struct {
 	unsigned int		flags;		/* W: WQ_* flags */
@@ -248,6 +264,7 @@ struct workqueue_struct {
 		unsigned long				v;
 	} cpu_wq;				/* I: cwq's */
 	struct list_head	list;		/* W: list of all workqueues */
+	int			affn_scope;	/* W: WQ_AFFN_* if unbound */
 
 	struct mutex		flush_mutex;	/* protects wq flushing */
 	int			work_color;	/* F: current work color */
@@ -262,6 +279,9 @@ struct workqueue_struct {
 
 	int			nr_drainers;	/* W: drain in progress */
 	int			saved_max_active; /* W: saved cwq max_active */
+#ifdef CONFIG_SYSFS
+	struct wq_device	*wq_dev;	/* I: affinity_scope knob */
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
 #endif
@@ -292,6 +312,18 @@ EXPORT_SYMBOL_GPL(system_nrt_freezable_wq);
 	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)			\
 		hlist_for_each_entry(worker, pos, &gcwq->busy_hash[i], hentry)
 
+/* the gcwq ID of the unbound gcwq of @node */
+#define WORK_CPU_NODE(node)	(WORK_CPU_UNBOUND + 1 + (node))
+
+/*
+ * Unbound works are served by per NUMA node gcwqs on machines with more
+ * than one node, unless "workqueue.disable_numa" is given.
+ */
+static bool wq_disable_numa;
+module_param_named(disable_numa, wq_disable_numa, bool, 0444);
+
+static bool wq_numa_enabled __read_mostly;	/* I: NUMA gcwqs exist */
+
 static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 				  unsigned int sw)
 {
@@ -303,6 +335,13 @@ static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 		}
 		if (sw & 2)
 			return WORK_CPU_UNBOUND;
+	} else if ((sw & 2) && wq_numa_enabled && cpu < WORK_CPU_NONE) {
+		/* the NUMA gcwqs follow the unbound one */
+		int node = cpu - WORK_CPU_NODE(0);
+
+		node = next_node(node, node_possible_map);
+		if (node < MAX_NUMNODES)
+			return WORK_CPU_NODE(node);
 	}
 	return WORK_CPU_NONE;
 }
@@ -318,13 +357,15 @@ static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
  *
  * An extra gcwq is defined for an invalid cpu number
  * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
+ * specific CPU, plus one for each possible NUMA node
+ * (WORK_CPU_NODE(node)) if wq_numa_enabled.  The following iterators
+ * are similar to for_each_*_cpu() iterators but also consider the
+ * unbound gcwqs.
  *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
- * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
+ * for_each_gcwq_cpu()		: possible CPUs + unbound gcwqs
+ * for_each_online_gcwq_cpu()	: online CPUs + unbound gcwqs
  * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
- *				  WORK_CPU_UNBOUND for unbound workqueues
+ *				  unbound gcwqs for unbound workqueues
  */
 #define for_each_gcwq_cpu(cpu)						\
 	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
@@ -473,12 +514,15 @@ static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, pool_nr_running[NR_WORKER_POOLS])
 /*
  * Global cpu workqueue and nr_running counter for unbound gcwq.  The
  * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
- * workers have WORKER_UNBOUND set.
+ * workers have WORKER_UNBOUND set.  The same goes for the NUMA node
+ * gcwqs, which share the nr_running counter.
  */
 static struct global_cwq unbound_global_cwq;
 static atomic_t unbound_pool_nr_running[NR_WORKER_POOLS] = {
 	[0 ... NR_WORKER_POOLS - 1]	= ATOMIC_INIT(0),	/* always 0 */
 };
+static struct global_cwq **unbound_node_gcwq;	/* I: [nr_node_ids] */
+static int nr_unbound_cwqs __read_mostly = 1;	/* I: cwqs of unbound wqs */
 
 static int worker_thread(void *__worker);
 
@@ -489,10 +533,20 @@ static int worker_pool_pri(struct worker_pool *pool)
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(global_cwq, cpu);
-	else
+	else if (cpu == WORK_CPU_UNBOUND)
 		return &unbound_global_cwq;
+	else
+		return unbound_node_gcwq[cpu - WORK_CPU_NODE(0)];
+}
+
+/* the node of a NUMA gcwq, NUMA_NO_NODE for the others */
+static int gcwq_node(struct global_cwq *gcwq)
+{
+	if (gcwq->cpu > WORK_CPU_UNBOUND)
+		return gcwq->cpu - WORK_CPU_NODE(0);
+	return NUMA_NO_NODE;
 }
 
 static atomic_t *get_pool_nr_running(struct worker_pool *pool)
@@ -500,23 +554,63 @@ static atomic_t *get_pool_nr_running(struct worker_pool *pool)
 	int cpu = pool->gcwq->cpu;
 	int idx = worker_pool_pri(pool);
 
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(pool_nr_running, cpu)[idx];
 	else
 		return &unbound_pool_nr_running[idx];
 }
 
+#ifdef CONFIG_PREEMPT_RT_FULL
+static bool pool_is_rt(struct worker_pool *pool)
+{
+	return worker_pool_pri(pool) == RT_WORKER_POOL;
+}
+
+static int get_work_prio(struct work_struct *work)
+{
+	return work->prio;
+}
+
+static void set_work_prio(struct work_struct *work, int prio)
+{
+	work->prio = prio;
+}
+#else
+static inline bool pool_is_rt(struct worker_pool *pool) { return false; }
+static inline int get_work_prio(struct work_struct *work)
+{
+	return DEFAULT_PRIO;
+}
+static inline void set_work_prio(struct work_struct *work, int prio) { }
+#endif
+
 static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 					    struct workqueue_struct *wq)
 {
 	if (!(wq->flags & WQ_UNBOUND)) {
 		if (likely(cpu < nr_cpu_ids))
 			return per_cpu_ptr(wq->cpu_wq.pcpu, cpu);
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
-		return wq->cpu_wq.single;
+	} else if (likely(cpu >= WORK_CPU_UNBOUND && cpu < WORK_CPU_NONE))
+		return wq->cpu_wq.single + (cpu - WORK_CPU_UNBOUND);
 	return NULL;
 }
 
+/*
+ * The gcwq unbound works queued on @cpu go to: the one of the node of
+ * @cpu, or of the local cpu for WORK_CPU_UNBOUND, unless @wq has system
+ * affinity scope.
+ */
+static struct global_cwq *get_unbound_gcwq(struct workqueue_struct *wq,
+					   unsigned int cpu)
+{
+	if (!wq_numa_enabled || ACCESS_ONCE(wq->affn_scope) != WQ_AFFN_NUMA)
+		return get_gcwq(WORK_CPU_UNBOUND);
+
+	if (cpu >= nr_cpu_ids)
+		cpu = raw_smp_processor_id();
+	return get_gcwq(WORK_CPU_NODE(cpu_to_node(cpu)));
+}
+
 static unsigned int work_color_to_flags(int color)
 {
 	return color << WORK_STRUCT_COLOR_SHIFT;
@@ -595,7 +689,7 @@ static struct global_cwq *get_work_gcwq(struct work_struct *work)
 	if (cpu == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
+	BUG_ON(cpu >= nr_cpu_ids && cpu < WORK_CPU_UNBOUND);
 	return get_gcwq(cpu);
 }
 
@@ -660,6 +754,87 @@ static bool too_many_workers(struct worker_pool *pool)
 	return nr_idle > 2 && (nr_idle - 2) * MAX_IDLE_WORKERS_RATIO >= nr_busy;
 }
 
+/*
+ * WQ_RT priority handling.
+ *
+ * Works of WQ_RT workqueues are served by the RT pool of the gcwq which
+ * only exists on PREEMPT_RT_FULL.  Each work carries the priority of the
+ * task which queued it, the pool's worklist and the cwq's delayed_works
+ * are kept sorted by it and the worker executing a work runs at its
+ * priority.  The RT pool isn't concurrency managed, so a work never
+ * waits for a lower priority one running on the same cpu to finish.
+ * flush_work() of a higher priority task boosts the flushed work, the
+ * worker executing it if it's already running.
+ *
+ * Priorities are in kernel prio units, lower is higher.  All works
+ * queued by !RT tasks get DEFAULT_PRIO and run as SCHED_NORMAL.
+ */
+
+static int current_wq_prio(void)
+{
+	if (!rt_task(current))
+		return DEFAULT_PRIO;
+	/* SCHED_DEADLINE tasks get the highest RT priority */
+	return max_t(int, current->prio, MAX_DL_PRIO);
+}
+
+/**
+ * worker_set_prio - change the priority an RT pool worker runs at
+ * @worker: worker of interest
+ * @prio: new kernel priority
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void worker_set_prio(struct worker *worker, int prio)
+{
+	struct sched_param param = { .sched_priority = 0 };
+	int policy = SCHED_NORMAL;
+
+	if (worker->prio == prio)
+		return;
+
+	if (rt_prio(prio)) {
+		policy = SCHED_FIFO;
+		param.sched_priority = MAX_RT_PRIO - 1 - prio;
+	}
+	sched_setscheduler_nocheck(worker->task, policy, &param);
+	worker->prio = prio;
+}
+
+/**
+ * work_insert_pos - find where to queue a work
+ * @cwq: cwq @work belongs to
+ * @list: pool worklist or delayed_works of @cwq
+ * @work: work to queue
+ *
+ * Returns the list entry to insert @work in front of.  That's the tail
+ * of @list unless @cwq is served by the RT pool: then it's the first
+ * work of lower priority which isn't linked to its predecessor.  Works
+ * of the same priority stay in FIFO order.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static struct list_head *work_insert_pos(struct cpu_workqueue_struct *cwq,
+					 struct list_head *list,
+					 struct work_struct *work)
+{
+	int prio = get_work_prio(work);
+	struct work_struct *pos;
+	bool linked = false;
+
+	if (!pool_is_rt(cwq->pool))
+		return list;
+
+	list_for_each_entry(pos, list, entry) {
+		if (!linked && get_work_prio(pos) > prio)
+			return &pos->entry;
+		linked = *work_data_bits(pos) & WORK_STRUCT_LINKED;
+	}
+	return list;
+}
+
 /*
  * Wake up functions.
  */
@@ -686,8 +861,17 @@ static void wake_up_worker(struct worker_pool *pool)
 {
 	struct worker *worker = first_worker(pool);
 
-	if (likely(worker))
-		wake_up_process(worker->task);
+	if (unlikely(!worker))
+		return;
+
+	/* let it reach the first work at the priority of that work */
+	if (pool_is_rt(pool) && !list_empty(&pool->worklist)) {
+		struct work_struct *work = list_first_entry(&pool->worklist,
+						struct work_struct, entry);
+
+		worker_set_prio(worker, get_work_prio(work));
+	}
+	wake_up_process(worker->task);
 }
 
 /**
@@ -978,7 +1162,7 @@ static bool is_chained_work(struct workqueue_struct *wq)
 static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
-	struct global_cwq *gcwq;
+	struct global_cwq *gcwq, *last_gcwq;
 	struct cpu_workqueue_struct *cwq;
 	struct list_head *worklist;
 	unsigned int work_flags;
@@ -993,39 +1177,36 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 
 	/* determine gcwq to use */
 	if (!(wq->flags & WQ_UNBOUND)) {
-		struct global_cwq *last_gcwq;
-
 		if (unlikely(cpu == WORK_CPU_UNBOUND))
 			cpu = raw_smp_processor_id();
-
-		/*
-		 * It's multi cpu.  If @wq is non-reentrant and @work
-		 * was previously on a different cpu, it might still
-		 * be running there, in which case the work needs to
-		 * be queued on that cpu to guarantee non-reentrance.
-		 */
 		gcwq = get_gcwq(cpu);
-		if (wq->flags & WQ_NON_REENTRANT &&
-		    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
-			struct worker *worker;
+	} else
+		gcwq = get_unbound_gcwq(wq, cpu);
 
-			spin_lock_irqsave(&last_gcwq->lock, flags);
+	/*
+	 * It's multi cpu.  If @wq is non-reentrant and @work was
+	 * previously on a different gcwq, it might still be running
+	 * there, in which case the work needs to be queued on that gcwq
+	 * to guarantee non-reentrance.  Unbound workqueues are always
+	 * non-reentrant, they used to have a single gcwq.
+	 */
+	if (wq->flags & (WQ_NON_REENTRANT | WQ_UNBOUND) &&
+	    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
+		struct worker *worker;
 
-			worker = find_worker_executing_work(last_gcwq, work);
+		spin_lock_irqsave(&last_gcwq->lock, flags);
 
-			if (worker && worker->current_cwq->wq == wq)
-				gcwq = last_gcwq;
-			else {
-				/* meh... not running there, queue here */
-				spin_unlock_irqrestore(&last_gcwq->lock, flags);
-				spin_lock_irqsave(&gcwq->lock, flags);
-			}
-		} else
+		worker = find_worker_executing_work(last_gcwq, work);
+
+		if (worker && worker->current_cwq->wq == wq)
+			gcwq = last_gcwq;
+		else {
+			/* meh... not running there, queue here */
+			spin_unlock_irqrestore(&last_gcwq->lock, flags);
 			spin_lock_irqsave(&gcwq->lock, flags);
-	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
+		}
+	} else
 		spin_lock_irqsave(&gcwq->lock, flags);
-	}
 
 	/* gcwq determined, get cwq and queue */
 	cwq = get_cwq(gcwq->cpu, wq);
@@ -1048,7 +1229,8 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 		worklist = &cwq->delayed_works;
 	}
 
-	insert_work(cwq, work, worklist, work_flags);
+	insert_work(cwq, work, work_insert_pos(cwq, worklist, work),
+		    work_flags);
 
 	spin_unlock_irqrestore(&gcwq->lock, flags);
 }
@@ -1061,13 +1243,17 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
  * Returns 0 if @work was already on a queue, non-zero otherwise.
  *
  * We queue the work to the CPU on which it was submitted, but if the CPU dies
- * it can be processed by another CPU.
+ * it can be processed by another CPU. Work submitted on a cpu isolated with
+ * "isolcpus=full," goes to a housekeeping cpu instead.
  */
 int queue_work(struct workqueue_struct *wq, struct work_struct *work)
 {
-	int ret;
+	int ret, cpu;
 
-	ret = queue_work_on(get_cpu_light(), wq, work);
+	cpu = get_cpu_light();
+	if (!is_housekeeping_cpu(cpu))
+		cpu = housekeeping_any_cpu();
+	ret = queue_work_on(cpu, wq, work);
 	put_cpu_light();
 
 	return ret;
@@ -1091,6 +1277,7 @@ queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work)
 	int ret = 0;
 
 	if (!test_and_set_bit(WORK_STRUCT_PENDING_BIT, work_data_bits(work))) {
+		set_work_prio(work, current_wq_prio());
 		__queue_work(cpu, wq, work);
 		ret = 1;
 	}
@@ -1148,6 +1335,9 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 
 		timer_stats_timer_set_start_info(&dwork->timer);
 
+		/* the timer queues it, record who asked for it */
+		set_work_prio(work, current_wq_prio());
+
 		/*
 		 * This stores cwq for the moment, for the timer_fn.
 		 * Note that the work's gcwq is preserved to allow
@@ -1156,12 +1346,18 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		if (!(wq->flags & WQ_UNBOUND)) {
 			struct global_cwq *gcwq = get_work_gcwq(work);
 
-			if (gcwq && gcwq->cpu != WORK_CPU_UNBOUND)
+			if (gcwq && gcwq->cpu < WORK_CPU_UNBOUND)
 				lcpu = gcwq->cpu;
 			else
 				lcpu = raw_smp_processor_id();
-		} else
-			lcpu = WORK_CPU_UNBOUND;
+		} else {
+			struct global_cwq *gcwq = get_work_gcwq(work);
+
+			if (gcwq && gcwq->cpu > WORK_CPU_UNBOUND)
+				lcpu = gcwq->cpu;
+			else
+				lcpu = WORK_CPU_UNBOUND;
+		}
 
 		set_work_cwq(work, get_cwq(lcpu, wq), 0);
 
@@ -1501,10 +1697,40 @@ static struct worker *alloc_worker(void)
 		INIT_WORK(&worker->rebind_work, busy_worker_rebind_fn);
 		/* on creation a worker is in !idle && prep state */
 		worker->flags = WORKER_PREP;
+		worker->prio = DEFAULT_PRIO;
 	}
 	return worker;
 }
 
+/*
+ * Workers of a NUMA gcwq stay on the housekeeping cpus of their node.
+ * If none of them is online the worker may run on any housekeeping
+ * cpu.  That's the case for the initial workers, which are created
+ * before the other cpus are brought up, so the workers call this again
+ * when cpus of the node come online, see worker_thread().
+ *
+ * Once the worker has PF_THREAD_BOUND set only it may do so itself.
+ */
+static void worker_set_node_cpus(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->pool->gcwq;
+	const struct cpumask *allowed = housekeeping_cpumask();
+	cpumask_var_t mask;
+
+	worker->cpus_seq = ACCESS_ONCE(gcwq->cpus_seq);
+	smp_rmb();
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return;
+
+	if (cpumask_and(mask, cpumask_of_node(gcwq_node(gcwq)), allowed) &&
+	    cpumask_intersects(mask, cpu_online_mask))
+		allowed = mask;
+	set_cpus_allowed_ptr(worker->task, allowed);
+
+	free_cpumask_var(mask);
+}
+
 /**
  * create_worker - create a new workqueue worker
  * @pool: pool the new worker will belong to
@@ -1522,7 +1748,8 @@ static struct worker *alloc_worker(void)
 static struct worker *create_worker(struct worker_pool *pool)
 {
 	struct global_cwq *gcwq = pool->gcwq;
-	const char *pri = worker_pool_pri(pool) ? "H" : "";
+	const char *pri = pool_is_rt(pool) ? "R" :
+			  worker_pool_pri(pool) ? "H" : "";
 	struct worker *worker = NULL;
 	int id = -1;
 
@@ -1542,19 +1769,28 @@ static struct worker *create_worker(struct worker_pool *pool)
 	worker->pool = pool;
 	worker->id = id;
 
-	if (gcwq->cpu != WORK_CPU_UNBOUND)
+	if (gcwq->cpu < WORK_CPU_UNBOUND)
 		worker->task = kthread_create_on_node(worker_thread,
 					worker, cpu_to_node(gcwq->cpu),
 					"kworker/%u:%d%s", gcwq->cpu, id, pri);
+	else if (gcwq->cpu > WORK_CPU_UNBOUND)
+		worker->task = kthread_create_on_node(worker_thread,
+					worker, gcwq_node(gcwq),
+					"kworker/u%d:%d%s", gcwq_node(gcwq),
+					id, pri);
 	else
 		worker->task = kthread_create(worker_thread, worker,
 					      "kworker/u:%d%s", id, pri);
 	if (IS_ERR(worker->task))
 		goto fail;
 
-	if (worker_pool_pri(pool))
+	if (worker_pool_pri(pool) == HIGHPRI_WORKER_POOL)
 		set_user_nice(worker->task, HIGHPRI_NICE_LEVEL);
 
+	/* RT pool workers aren't concurrency managed */
+	if (pool_is_rt(pool))
+		worker->flags |= WORKER_RT;
+
 	/*
 	 * Determine CPU binding of the new worker depending on
 	 * %GCWQ_DISASSOCIATED.  The caller is responsible for ensuring the
@@ -1567,6 +1803,12 @@ static struct worker *create_worker(struct worker_pool *pool)
 	if (!(gcwq->flags & GCWQ_DISASSOCIATED)) {
 		kthread_bind(worker->task, gcwq->cpu);
 	} else {
+		/* Keep unbound workers off fully isolated cpus */
+		if (gcwq->cpu > WORK_CPU_UNBOUND)
+			worker_set_node_cpus(worker);
+		else if (gcwq->cpu == WORK_CPU_UNBOUND && housekeeping_full)
+			set_cpus_allowed_ptr(worker->task,
+					     housekeeping_cpumask());
 		worker->task->flags |= PF_THREAD_BOUND;
 		worker->flags |= WORKER_UNBOUND;
 	}
@@ -1673,8 +1915,8 @@ static bool send_mayday(struct work_struct *work)
 
 	/* mayday mayday mayday */
 	cpu = cwq->pool->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
+	/* unbound gcwqs can't be set in cpumask, use cpu 0 instead */
+	if (cpu >= WORK_CPU_UNBOUND)
 		cpu = 0;
 	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
 		wake_up_process(wq->rescuer->task);
@@ -1932,7 +2174,8 @@ static void cwq_activate_delayed_work(struct work_struct *work)
 	struct cpu_workqueue_struct *cwq = get_work_cwq(work);
 
 	trace_workqueue_activate_work(work);
-	move_linked_works(work, &cwq->pool->worklist, NULL);
+	move_linked_works(work, work_insert_pos(cwq, &cwq->pool->worklist, work),
+			  NULL);
 	__clear_bit(WORK_STRUCT_DELAYED_BIT, work_data_bits(work));
 	cwq->nr_active++;
 }
@@ -2072,12 +2315,18 @@ __acquires(&gcwq->lock)
 		worker_set_flags(worker, WORKER_CPU_INTENSIVE, true);
 
 	/*
-	 * Unbound gcwq isn't concurrency managed and work items should be
-	 * executed ASAP.  Wake up another worker if necessary.
+	 * Unbound gcwq and the RT pool aren't concurrency managed and work
+	 * items should be executed ASAP.  Wake up another worker if
+	 * necessary.
 	 */
-	if ((worker->flags & WORKER_UNBOUND) && need_more_worker(pool))
+	if ((worker->flags & (WORKER_UNBOUND | WORKER_RT)) &&
+	    need_more_worker(pool))
 		wake_up_worker(pool);
 
+	/* run at the priority of the work, see worker_set_prio() */
+	if (pool_is_rt(cwq->pool))
+		worker_set_prio(worker, get_work_prio(work));
+
 	spin_unlock_irq(&gcwq->lock);
 
 	smp_wmb();	/* paired with test_and_set_bit(PENDING) */
@@ -2158,6 +2407,10 @@ static int worker_thread(void *__worker)
 	/* tell the scheduler that this is a workqueue worker */
 	worker->task->flags |= PF_WQ_WORKER;
 woke_up:
+	/* cpus of our node came online, see worker_set_node_cpus() */
+	if (unlikely(worker->cpus_seq != ACCESS_ONCE(gcwq->cpus_seq)))
+		worker_set_node_cpus(worker);
+
 	spin_lock_irq(&gcwq->lock);
 
 	/*
@@ -2235,6 +2488,41 @@ sleep:
 	goto woke_up;
 }
 
+/* process the works of @cwq on the worklist of its pool with @rescuer */
+static void rescue_cwq(struct worker *rescuer,
+		       struct cpu_workqueue_struct *cwq)
+{
+	struct list_head *scheduled = &rescuer->scheduled;
+	struct worker_pool *pool = cwq->pool;
+	struct global_cwq *gcwq = pool->gcwq;
+	struct work_struct *work, *n;
+
+	/* migrate to the target cpu if possible */
+	rescuer->pool = pool;
+	worker_maybe_bind_and_lock(rescuer);
+
+	/*
+	 * Slurp in all works issued via this workqueue and
+	 * process'em.
+	 */
+	BUG_ON(!list_empty(&rescuer->scheduled));
+	list_for_each_entry_safe(work, n, &pool->worklist, entry)
+		if (get_work_cwq(work) == cwq)
+			move_linked_works(work, scheduled, &n);
+
+	process_scheduled_works(rescuer);
+
+	/*
+	 * Leave this gcwq.  If keep_working() is %true, notify a
+	 * regular worker; otherwise, we end up with 0 concurrency
+	 * and stalling the execution.
+	 */
+	if (keep_working(pool))
+		wake_up_worker(pool);
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
 /**
  * rescuer_thread - the rescuer thread function
  * @__wq: the associated workqueue
@@ -2258,9 +2546,8 @@ static int rescuer_thread(void *__wq)
 {
 	struct workqueue_struct *wq = __wq;
 	struct worker *rescuer = wq->rescuer;
-	struct list_head *scheduled = &rescuer->scheduled;
 	bool is_unbound = wq->flags & WQ_UNBOUND;
-	unsigned int cpu;
+	unsigned int cpu, tcpu;
 
 	set_user_nice(current, RESCUER_NICE_LEVEL);
 repeat:
@@ -2273,42 +2560,18 @@ repeat:
 
 	/*
 	 * See whether any cpu is asking for help.  Unbounded
-	 * workqueues use cpu 0 in mayday_mask for CPU_UNBOUND.
+	 * workqueues use cpu 0 in mayday_mask for all their unbound
+	 * gcwqs, go through all of them.
 	 */
 	for_each_mayday_cpu(cpu, wq->mayday_mask) {
-		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
-		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
-		struct worker_pool *pool = cwq->pool;
-		struct global_cwq *gcwq = pool->gcwq;
-		struct work_struct *work, *n;
-
 		__set_current_state(TASK_RUNNING);
 		mayday_clear_cpu(cpu, wq->mayday_mask);
 
-		/* migrate to the target cpu if possible */
-		rescuer->pool = pool;
-		worker_maybe_bind_and_lock(rescuer);
-
-		/*
-		 * Slurp in all works issued via this workqueue and
-		 * process'em.
-		 */
-		BUG_ON(!list_empty(&rescuer->scheduled));
-		list_for_each_entry_safe(work, n, &pool->worklist, entry)
-			if (get_work_cwq(work) == cwq)
-				move_linked_works(work, scheduled, &n);
-
-		process_scheduled_works(rescuer);
-
-		/*
-		 * Leave this gcwq.  If keep_working() is %true, notify a
-		 * regular worker; otherwise, we end up with 0 concurrency
-		 * and stalling the execution.
-		 */
-		if (keep_working(pool))
-			wake_up_worker(pool);
-
-		spin_unlock_irq(&gcwq->lock);
+		if (is_unbound) {
+			for_each_cwq_cpu(tcpu, wq)
+				rescue_cwq(rescuer, get_cwq(tcpu, wq));
+		} else
+			rescue_cwq(rescuer, get_cwq(cpu, wq));
 	}
 
 	schedule();
@@ -2326,6 +2589,60 @@ static void wq_barrier_func(struct work_struct *work)
 	complete(&barr->done);
 }
 
+/**
+ * boost_flushed_work - lend the flusher's priority to a WQ_RT work
+ * @cwq: cwq @target belongs to
+ * @target: work being flushed
+ * @worker: worker currently executing @target, NULL if @target is not executing
+ *
+ * If @cwq is served by the RT pool and current has a higher priority
+ * than @target, an executing @target gets its worker boosted until the
+ * worker moves on to its next work.  A pending one gets its priority
+ * raised and is moved up the list it's on accordingly, unless it's
+ * linked to its predecessor or already scheduled to a worker.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void boost_flushed_work(struct cpu_workqueue_struct *cwq,
+			       struct work_struct *target,
+			       struct worker *worker)
+{
+	int prio = current_wq_prio();
+	struct list_head *list, *head = NULL;
+	struct work_struct *pos;
+	bool linked = false;
+
+	if (!pool_is_rt(cwq->pool))
+		return;
+
+	if (worker) {
+		if (prio < worker->prio)
+			worker_set_prio(worker, prio);
+		return;
+	}
+
+	if (prio >= get_work_prio(target))
+		return;
+	set_work_prio(target, prio);
+
+	if (*work_data_bits(target) & WORK_STRUCT_DELAYED)
+		list = &cwq->delayed_works;
+	else
+		list = &cwq->pool->worklist;
+
+	list_for_each_entry(pos, list, entry) {
+		if (pos == target) {
+			if (head)
+				move_linked_works(target, head, NULL);
+			return;
+		}
+		if (!head && !linked && get_work_prio(pos) > prio)
+			head = &pos->entry;
+		linked = *work_data_bits(pos) & WORK_STRUCT_LINKED;
+	}
+}
+
 /**
  * insert_wq_barrier - insert a barrier work
  * @cwq: cwq to insert barrier into
@@ -2367,15 +2684,20 @@ static void insert_wq_barrier(struct cpu_workqueue_struct *cwq,
 	__set_bit(WORK_STRUCT_PENDING_BIT, work_data_bits(&barr->work));
 	init_completion(&barr->done);
 
+	/* don't wait for @target at a lower priority than ours */
+	boost_flushed_work(cwq, target, worker);
+
 	/*
 	 * If @target is currently being executed, schedule the
 	 * barrier to the worker; otherwise, put it after @target.
 	 */
-	if (worker)
+	if (worker) {
+		set_work_prio(&barr->work, worker->prio);
 		head = worker->scheduled.next;
-	else {
+	} else {
 		unsigned long *bits = work_data_bits(target);
 
+		set_work_prio(&barr->work, get_work_prio(target));
 		head = target->entry.next;
 		/* there can already be other linked works, inherit and set */
 		linked = *bits & WORK_STRUCT_LINKED;
@@ -3152,14 +3474,15 @@ static int alloc_cwqs(struct workqueue_struct *wq)
 		void *ptr;
 
 		/*
-		 * Allocate enough room to align cwq and put an extra
+		 * Allocate enough room to align the cwqs and put an extra
 		 * pointer at the end pointing back to the originally
 		 * allocated pointer which will be used for free.
 		 */
-		ptr = kzalloc(size + align + sizeof(void *), GFP_KERNEL);
+		ptr = kzalloc(size * nr_unbound_cwqs + align + sizeof(void *),
+			      GFP_KERNEL);
 		if (ptr) {
 			wq->cpu_wq.single = PTR_ALIGN(ptr, align);
-			*(void **)(wq->cpu_wq.single + 1) = ptr;
+			*(void **)(wq->cpu_wq.single + nr_unbound_cwqs) = ptr;
 		}
 	}
 
@@ -3173,8 +3496,8 @@ static void free_cwqs(struct workqueue_struct *wq)
 	if (!(wq->flags & WQ_UNBOUND))
 		free_percpu(wq->cpu_wq.pcpu);
 	else if (wq->cpu_wq.single) {
-		/* the pointer to free is stored right after the cwq */
-		kfree(*(void **)(wq->cpu_wq.single + 1));
+		/* the pointer to free is stored right after the cwqs */
+		kfree(*(void **)(wq->cpu_wq.single + nr_unbound_cwqs));
 	}
 }
 
@@ -3191,6 +3514,144 @@ static int wq_clamp_max_active(int max_active, unsigned int flags,
 	return clamp_val(max_active, 1, lim);
 }
 
+/*
+ * Workqueues are added to and removed from the workqueues list with
+ * wq_sysfs_mutex held too, so that wq_sysfs_init() can walk the list
+ * while it registers the early ones.
+ */
+static DEFINE_MUTEX(wq_sysfs_mutex);
+
+#ifdef CONFIG_SYSFS
+/*
+ * Unbound workqueues which aren't ordered show up under
+ * /sys/devices/system/workqueue/ with the affinity_scope knob.
+ */
+struct wq_device {
+	struct workqueue_struct	*wq;
+	struct device		dev;
+};
+
+static bool wq_sysfs_ready;		/* protected by wq_sysfs_mutex */
+
+static const char * const wq_affn_names[WQ_AFFN_NR] = {
+	[WQ_AFFN_NUMA]		= "numa",
+	[WQ_AFFN_SYSTEM]	= "system",
+};
+
+static struct workqueue_struct *dev_to_wq(struct device *dev)
+{
+	return container_of(dev, struct wq_device, dev)->wq;
+}
+
+static ssize_t wq_affinity_scope_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return sprintf(buf, "%s\n", wq_affn_names[ACCESS_ONCE(wq->affn_scope)]);
+}
+
+static ssize_t wq_affinity_scope_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int scope, ret;
+
+	for (scope = 0; scope < WQ_AFFN_NR; scope++)
+		if (sysfs_streq(buf, wq_affn_names[scope]))
+			break;
+
+	ret = workqueue_set_affinity_scope(wq, scope);
+	return ret ?: count;
+}
+
+static struct device_attribute wq_sysfs_attrs[] = {
+	__ATTR(affinity_scope, 0644, wq_affinity_scope_show,
+	       wq_affinity_scope_store),
+	__ATTR_NULL,
+};
+
+static struct bus_type wq_subsys = {
+	.name		= "workqueue",
+	.dev_attrs	= wq_sysfs_attrs,
+};
+
+static void wq_device_release(struct device *dev)
+{
+	kfree(container_of(dev, struct wq_device, dev));
+}
+
+static void wq_sysfs_register(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev;
+	struct device *dev;
+
+	lockdep_assert_held(&wq_sysfs_mutex);
+
+	if (!wq_sysfs_ready || !(wq->flags & WQ_UNBOUND) ||
+	    wq->flags & WQ_ORDERED)
+		return;
+
+	/* names aren't unique, the first one gets the knob */
+	dev = bus_find_device_by_name(&wq_subsys, NULL, wq->name);
+	if (dev) {
+		put_device(dev);
+		return;
+	}
+
+	wq_dev = kzalloc(sizeof(*wq_dev), GFP_KERNEL);
+	if (!wq_dev)
+		goto fail;
+
+	wq_dev->wq = wq;
+	wq_dev->dev.bus = &wq_subsys;
+	wq_dev->dev.parent = wq_subsys.dev_root;
+	wq_dev->dev.release = wq_device_release;
+	dev_set_name(&wq_dev->dev, "%s", wq->name);
+
+	if (device_register(&wq_dev->dev)) {
+		put_device(&wq_dev->dev);
+		goto fail;
+	}
+	wq->wq_dev = wq_dev;
+	return;
+fail:
+	printk(KERN_WARNING "workqueue: failed to register %s with sysfs\n",
+	       wq->name);
+}
+
+static void wq_sysfs_unregister(struct workqueue_struct *wq)
+{
+	lockdep_assert_held(&wq_sysfs_mutex);
+
+	if (wq->wq_dev)
+		device_unregister(&wq->wq_dev->dev);
+	wq->wq_dev = NULL;
+}
+
+static int __init wq_sysfs_init(void)
+{
+	struct workqueue_struct *wq;
+	int ret;
+
+	ret = subsys_system_register(&wq_subsys, NULL);
+	if (ret)
+		return ret;
+
+	mutex_lock(&wq_sysfs_mutex);
+	wq_sysfs_ready = true;
+	list_for_each_entry(wq, &workqueues, list)
+		wq_sysfs_register(wq);
+	mutex_unlock(&wq_sysfs_mutex);
+	return 0;
+}
+core_initcall(wq_sysfs_init);
+#else
+static inline void wq_sysfs_register(struct workqueue_struct *wq) { }
+static inline void wq_sysfs_unregister(struct workqueue_struct *wq) { }
+#endif
+
 struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 					       unsigned int flags,
 					       int max_active,
@@ -3222,11 +3683,25 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if (flags & WQ_MEM_RECLAIM)
 		flags |= WQ_RESCUER;
 
+	/* without the RT pool WQ_RT is the closest thing to highpri */
+#ifndef CONFIG_PREEMPT_RT_FULL
+	if (flags & WQ_RT)
+		flags = (flags & ~WQ_RT) | WQ_HIGHPRI;
+#endif
+
 	max_active = max_active ?: WQ_DFL_ACTIVE;
 	max_active = wq_clamp_max_active(max_active, flags, wq->name);
 
+	/*
+	 * An unbound workqueue with max_active of one executes its works
+	 * one by one in queueing order, which needs a single gcwq.
+	 */
+	if (flags & WQ_UNBOUND && max_active == 1)
+		flags |= WQ_ORDERED;
+
 	/* init wq */
 	wq->flags = flags;
+	wq->affn_scope = flags & WQ_ORDERED ? WQ_AFFN_SYSTEM : WQ_AFFN_NUMA;
 	wq->saved_max_active = max_active;
 	mutex_init(&wq->flush_mutex);
 	atomic_set(&wq->nr_cwqs_to_flush, 0);
@@ -3244,6 +3719,10 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 		struct global_cwq *gcwq = get_gcwq(cpu);
 		int pool_idx = (bool)(flags & WQ_HIGHPRI);
 
+#ifdef CONFIG_PREEMPT_RT_FULL
+		if (flags & WQ_RT)
+			pool_idx = RT_WORKER_POOL;
+#endif
 		BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
 		cwq->pool = &gcwq->pools[pool_idx];
 		cwq->wq = wq;
@@ -3276,6 +3755,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	 * list.  Grab it, set max_active accordingly and add the new
 	 * workqueue to workqueues list.
 	 */
+	mutex_lock(&wq_sysfs_mutex);
 	spin_lock(&workqueue_lock);
 
 	if (workqueue_freezing && wq->flags & WQ_FREEZABLE)
@@ -3286,6 +3766,9 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 
 	spin_unlock(&workqueue_lock);
 
+	wq_sysfs_register(wq);
+	mutex_unlock(&wq_sysfs_mutex);
+
 	return wq;
 err:
 	if (wq) {
@@ -3315,9 +3798,12 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	 * wq list is used to freeze wq, remove from list after
 	 * flushing is complete in case freeze races us.
 	 */
+	mutex_lock(&wq_sysfs_mutex);
+	wq_sysfs_unregister(wq);
 	spin_lock(&workqueue_lock);
 	list_del(&wq->list);
 	spin_unlock(&workqueue_lock);
+	mutex_unlock(&wq_sysfs_mutex);
 
 	/* sanity check */
 	for_each_cwq_cpu(cpu, wq) {
@@ -3377,6 +3863,36 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 }
 EXPORT_SYMBOL_GPL(workqueue_set_max_active);
 
+/**
+ * workqueue_set_affinity_scope - set where the works of a workqueue run
+ * @wq: target unbound workqueue
+ * @scope: new affinity scope
+ *
+ * With %WQ_AFFN_NUMA the works queued on @wq are served by the workers
+ * of the NUMA node of the cpu they are queued on, with %WQ_AFFN_SYSTEM
+ * by the workers of the whole system.  Works already queued stay where
+ * they are.  The scope of ordered workqueues can't be changed.
+ *
+ * CONTEXT:
+ * Don't call from IRQ context.
+ *
+ * RETURNS:
+ * 0 on success, -EINVAL if @wq is bound or ordered or @scope invalid.
+ */
+int workqueue_set_affinity_scope(struct workqueue_struct *wq,
+				 enum wq_affn_scope scope)
+{
+	if (!(wq->flags & WQ_UNBOUND) || wq->flags & WQ_ORDERED ||
+	    scope < 0 || scope >= WQ_AFFN_NR)
+		return -EINVAL;
+
+	spin_lock(&workqueue_lock);
+	wq->affn_scope = scope;
+	spin_unlock(&workqueue_lock);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(workqueue_set_affinity_scope);
+
 /**
  * workqueue_congested - test whether a workqueue is congested
  * @cpu: CPU in question
@@ -3384,14 +3900,19 @@ EXPORT_SYMBOL_GPL(workqueue_set_max_active);
  *
  * Test whether @wq's cpu workqueue for @cpu is congested.  There is
  * no synchronization around this function and the test result is
- * unreliable and only useful as advisory hints or for debugging.
+ * unreliable and only useful as advisory hints or for debugging.  For
+ * unbound workqueues the cwq works queued on @cpu go to is tested.
  *
  * RETURNS:
  * %true if congested, %false otherwise.
  */
 bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq)
 {
-	struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	struct cpu_workqueue_struct *cwq;
+
+	if (wq->flags & WQ_UNBOUND)
+		cpu = get_unbound_gcwq(wq, cpu)->cpu;
+	cwq = get_cwq(cpu, wq);
 
 	return !list_empty(&cwq->delayed_works);
 }
@@ -3403,12 +3924,15 @@ EXPORT_SYMBOL_GPL(workqueue_congested);
  *
  * RETURNS:
  * CPU number if @work was ever queued.  WORK_CPU_NONE otherwise.
+ * WORK_CPU_UNBOUND for works last queued on an unbound workqueue.
  */
 unsigned int work_cpu(struct work_struct *work)
 {
 	struct global_cwq *gcwq = get_work_gcwq(work);
 
-	return gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	if (!gcwq)
+		return WORK_CPU_NONE;
+	return min_t(unsigned int, gcwq->cpu, WORK_CPU_UNBOUND);
 }
 EXPORT_SYMBOL_GPL(work_cpu);
 
@@ -3569,6 +4093,13 @@ static int __devinit workqueue_cpu_up_callback(struct notifier_block *nfb,
 		gcwq->flags &= ~GCWQ_DISASSOCIATED;
 		rebind_workers(gcwq);
 		gcwq_release_management_and_unlock(gcwq);
+
+		/* the workers of the node may use @cpu now */
+		if (wq_numa_enabled) {
+			gcwq = get_gcwq(WORK_CPU_NODE(cpu_to_node(cpu)));
+			smp_wmb();
+			ACCESS_ONCE(gcwq->cpus_seq)++;
+		}
 		break;
 	}
 	return NOTIFY_OK;
@@ -3785,6 +4316,25 @@ static int __init init_workqueues(void)
 	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
 	cpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
 
+	/* allocate the NUMA gcwqs on their nodes */
+	if (nr_node_ids > 1 && !wq_disable_numa) {
+		int node;
+
+		unbound_node_gcwq = kcalloc(nr_node_ids,
+					    sizeof(unbound_node_gcwq[0]),
+					    GFP_KERNEL);
+		BUG_ON(!unbound_node_gcwq);
+
+		for_each_node(node) {
+			unbound_node_gcwq[node] =
+				kzalloc_node(sizeof(struct global_cwq),
+					     GFP_KERNEL, node);
+			BUG_ON(!unbound_node_gcwq[node]);
+		}
+		nr_unbound_cwqs = 1 + nr_node_ids;
+		wq_numa_enabled = true;
+	}
+
 	/* initialize gcwqs */
 	for_each_gcwq_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
@@ -3821,7 +4371,7 @@ static int __init init_workqueues(void)
 		struct global_cwq *gcwq = get_gcwq(cpu);
 		struct worker_pool *pool;
 
-		if (cpu != WORK_CPU_UNBOUND)
+		if (cpu < WORK_CPU_UNBOUND)
 			gcwq->flags &= ~GCWQ_DISASSOCIATED;
 
 		for_each_worker_pool(pool, gcwq) {
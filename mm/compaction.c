@@ -91,6 +91,40 @@ static inline bool compact_trylock_irqsave(spinlock_t *lock,
 	return compact_checklock_irqsave(lock, flags, false, cc);
 }
 
+/*
+ * The same for the lru_lock, which is taken for the lruvec of each page
+ * as needed: drop the lruvec held in *@locked, if any, when the process
+ * needs to be scheduled or the lock is contended.
+ *
+ * Returns false if compaction should abort, with no lock held.
+ */
+static bool compact_checklock_lruvec(struct lruvec **locked,
+				     unsigned long *flags,
+				     struct compact_control *cc)
+{
+	struct lruvec *lruvec = *locked;
+
+	if (need_resched() ||
+	    (lruvec && spin_is_contended(&lruvec->lru_lock))) {
+		if (lruvec) {
+			spin_unlock_irqrestore(&lruvec->lru_lock, *flags);
+			*locked = NULL;
+		}
+
+		/* async aborts if taking too long or contended */
+		if (!cc->sync) {
+			if (cc->contended)
+				*cc->contended = true;
+			return false;
+		}
+
+		cond_resched();
+		if (fatal_signal_pending(current))
+			return false;
+	}
+	return true;
+}
+
 /*
  * Isolate free pages onto a private freelist. Caller must hold zone->lock.
  * If @strict is true, will abort returning 0 on any invalid PFNs or non-free
@@ -274,9 +308,8 @@ isolate_migratepages_range(struct zone *zone, struct compact_control *cc,
 	unsigned long nr_scanned = 0, nr_isolated = 0;
 	struct list_head *migratelist = &cc->migratepages;
 	isolate_mode_t mode = 0;
-	struct lruvec *lruvec;
-	unsigned long flags;
-	bool locked;
+	struct lruvec *locked = NULL;
+	unsigned long uninitialized_var(flags);
 
 	/*
 	 * Ensure that there are not too many pages isolated from the LRU
@@ -296,21 +329,17 @@ isolate_migratepages_range(struct zone *zone, struct compact_control *cc,
 
 	/* Time to isolate some pages for migration */
 	cond_resched();
-	spin_lock_irqsave(&zone->lru_lock, flags);
-	locked = true;
 	for (; low_pfn < end_pfn; low_pfn++) {
 		struct page *page;
 
 		/* give a chance to irqs before checking need_resched() */
-		if (!((low_pfn+1) % SWAP_CLUSTER_MAX)) {
-			spin_unlock_irqrestore(&zone->lru_lock, flags);
-			locked = false;
+		if (locked && !((low_pfn+1) % SWAP_CLUSTER_MAX)) {
+			spin_unlock_irqrestore(&locked->lru_lock, flags);
+			locked = NULL;
 		}
 
 		/* Check if it is ok to still hold the lock */
-		locked = compact_checklock_irqsave(&zone->lru_lock, &flags,
-								locked, cc);
-		if (!locked)
+		if (!compact_checklock_lruvec(&locked, &flags, cc))
 			break;
 
 		/*
@@ -358,6 +387,10 @@ isolate_migratepages_range(struct zone *zone, struct compact_control *cc,
 			continue;
 		}
 
+		if (!PageLRU(page))
+			continue;
+
+		locked = relock_page_lruvec_irqsave(page, locked, &flags);
 		if (!PageLRU(page))
 			continue;
 
@@ -374,8 +407,6 @@ isolate_migratepages_range(struct zone *zone, struct compact_control *cc,
 		if (!cc->sync)
 			mode |= ISOLATE_ASYNC_MIGRATE;
 
-		lruvec = mem_cgroup_page_lruvec(page, zone);
-
 		/* Try isolate the page */
 		if (__isolate_lru_page(page, mode) != 0)
 			continue;
@@ -383,7 +414,7 @@ isolate_migratepages_range(struct zone *zone, struct compact_control *cc,
 		VM_BUG_ON(PageTransCompound(page));
 
 		/* Successfully isolated */
-		del_page_from_lru_list(page, lruvec, page_lru(page));
+		del_page_from_lru_list(page, locked, page_lru(page));
 		list_add(&page->lru, migratelist);
 		cc->nr_migratepages++;
 		nr_isolated++;
@@ -395,10 +426,10 @@ isolate_migratepages_range(struct zone *zone, struct compact_control *cc,
 		}
 	}
 
-	acct_isolated(zone, locked, cc);
+	acct_isolated(zone, locked != NULL, cc);
 
 	if (locked)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		spin_unlock_irqrestore(&locked->lru_lock, flags);
 
 	trace_mm_compaction_isolate_migratepages(nr_scanned, nr_isolated);
 
@@ -17,6 +17,8 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/shmem_fs.h>
+#include <linux/file.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -750,6 +752,56 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+/*
+ * Map the HPAGE_PMD_NR locked and uptodate page cache pages starting at
+ * @page, which are contiguous and aligned in memory, with a huge pmd.
+ * They stay small pages: each is mapped and referenced on its own, so
+ * the pmd can be replaced by ptes at any time. The references of the
+ * caller on the pages are taken over by the mapping, or dropped if the
+ * pmd could not be set up.
+ */
+int do_huge_pmd_file_page(struct vm_area_struct *vma, unsigned long address,
+			  pmd_t *pmd, struct page *page, unsigned int flags)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgtable_t pgtable;
+	pmd_t entry;
+	int i, ret = 0;
+
+	VM_BUG_ON(page_to_pfn(page) & (HPAGE_PMD_NR - 1));
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		ret = VM_FAULT_OOM;
+		goto release;
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		goto release;
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_file_rmap(page + i);
+	entry = mk_pmd(page, vma->vm_page_prot);
+	if (flags & FAULT_FLAG_WRITE)
+		entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
+	entry = pmd_mkhuge(entry);
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	mm->nr_ptes++;
+	spin_unlock(&mm->page_table_lock);
+	count_vm_event(THP_FILE_MAPPED);
+	return 0;
+
+release:
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_cache_release(page + i);
+	return ret;
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -783,6 +835,12 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out;
 	}
 	src_page = pmd_page(pmd);
+	if (!PageAnon(src_page)) {
+		/* page cache is mapped again by faults in the child */
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
 	VM_BUG_ON(!PageHead(src_page));
 	get_page(src_page);
 	page_dup_rmap(src_page);
@@ -997,11 +1055,12 @@ out:
 	return ret;
 }
 
-struct page *follow_trans_huge_pmd(struct mm_struct *mm,
+struct page *follow_trans_huge_pmd(struct vm_area_struct *vma,
 				   unsigned long addr,
 				   pmd_t *pmd,
 				   unsigned int flags)
 {
+	struct mm_struct *mm = vma->vm_mm;
 	struct page *page = NULL;
 
 	assert_spin_locked(&mm->page_table_lock);
@@ -1010,6 +1069,31 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		/* page cache: the subpage is a page of its own */
+		page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
+		if (flags & FOLL_GET)
+			get_page(page);
+		if (flags & FOLL_TOUCH) {
+			if ((flags & FOLL_WRITE) && !pmd_dirty(*pmd) &&
+			    !PageDirty(page))
+				set_page_dirty(page);
+			mark_page_accessed(page);
+		}
+		/*
+		 * mlock() walks the range page by page, so this mlocks
+		 * each page of the team in turn, like follow_page() does
+		 * for a pte. A locked page is left to vmscan.
+		 */
+		if ((flags & FOLL_MLOCK) && (vma->vm_flags & VM_LOCKED) &&
+		    page->mapping && trylock_page(page)) {
+			lru_add_drain();
+			if (page->mapping)
+				mlock_vma_page(page);
+			unlock_page(page);
+		}
+		goto out;
+	}
 	VM_BUG_ON(!PageHead(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
@@ -1033,6 +1117,40 @@ out:
 	return page;
 }
 
+/*
+ * Zap a huge pmd which maps page cache: like zap_pte_range() does with
+ * the ptes, the dirty and young bits of the pmd are passed on to each
+ * page of the team. Called with page_table_lock held, returns with it
+ * released.
+ */
+static void zap_file_huge_pmd(struct mmu_gather *tlb,
+			      struct vm_area_struct *vma,
+			      pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	struct page *page = pmd_page(*pmd);
+	pgtable_t pgtable;
+	pmd_t orig_pmd;
+	int i;
+
+	pgtable = get_pmd_huge_pte(mm);
+	orig_pmd = pmdp_get_and_clear(mm, addr, pmd);
+	tlb_remove_pmd_tlb_entry(tlb, pmd, addr);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (pmd_dirty(orig_pmd))
+			set_page_dirty(page + i);
+		if (pmd_young(orig_pmd) && likely(!VM_SequentialReadHint(vma)))
+			mark_page_accessed(page + i);
+		page_remove_rmap(page + i);
+	}
+	add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		tlb_remove_page(tlb, page + i);
+	pte_free(mm, pgtable);
+}
+
 int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 		 pmd_t *pmd, unsigned long addr)
 {
@@ -1041,6 +1159,10 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 	if (__pmd_trans_huge_lock(pmd, vma) == 1) {
 		struct page *page;
 		pgtable_t pgtable;
+		if (!PageAnon(pmd_page(*pmd))) {
+			zap_file_huge_pmd(tlb, vma, pmd, addr);
+			return 1;
+		}
 		pgtable = get_pmd_huge_pte(tlb->mm);
 		page = pmd_page(*pmd);
 		pmd_clear(pmd);
@@ -1235,10 +1357,12 @@ static void __split_huge_page_refcount(struct page *page)
 	int tail_count = 0;
 
 	/* prevent PageLRU to go away from under us, and freeze lru stats */
-	spin_lock_irq(&zone->lru_lock);
-	lruvec = mem_cgroup_page_lruvec(page, zone);
+	lruvec = lock_page_lruvec_irq(page);
 
 	compound_lock(page);
+	/* the tails inherit pc->mem_cgroup, make it match lruvec */
+	if (!PageLRU(page))
+		mem_cgroup_lru_add_page(page);
 	/* complete memcg works before add pages to LRU */
 	mem_cgroup_split_huge_fixup(page);
 
@@ -1322,7 +1446,7 @@ static void __split_huge_page_refcount(struct page *page)
 
 	ClearPageCompound(page);
 	compound_unlock(page);
-	spin_unlock_irq(&zone->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	for (i = 1; i < HPAGE_PMD_NR; i++) {
 		struct page *page_tail = page + i;
@@ -2080,6 +2204,114 @@ out:
 	return ret;
 }
 
+static bool khugepaged_file_vma(struct vm_area_struct *vma)
+{
+	return vma->vm_ops && vma->vm_ops->pmd_fault &&
+		shmem_huge_enabled(vma);
+}
+
+/*
+ * Drop the page table which maps the collapsed team at @address, so the
+ * next fault maps it with a huge pmd. Called with mmap_sem held for
+ * writing, which keeps faults from filling the page table again.
+ */
+static void retract_page_table(struct vm_area_struct *vma,
+			       unsigned long address)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	struct mm_struct *mm = vma->vm_mm;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	spinlock_t *ptl;
+	int i;
+
+	zap_page_range(vma, address, HPAGE_PMD_SIZE, NULL);
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return;
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return;
+
+	/* the i_mmap_mutex keeps the rmap walks out of the page table */
+	mutex_lock(&mapping->i_mmap_mutex);
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (!pte_none(pte[i]))
+			break;
+	pte_unmap_unlock(pte, ptl);
+	if (i < HPAGE_PMD_NR) {
+		mutex_unlock(&mapping->i_mmap_mutex);
+		return;
+	}
+
+	spin_lock(&mm->page_table_lock);
+	/* the flush also waits for the lockless get_user_pages() */
+	_pmd = pmdp_clear_flush(vma, address, pmd);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	mutex_unlock(&mapping->i_mmap_mutex);
+	pte_free(mm, pmd_pgtable(_pmd));
+}
+
+/*
+ * Collapse the page cache mapped with ptes at @address into a team, then
+ * retract the page table. Called with mmap_sem held for reading, which
+ * is always released: returns 1 like collapse_huge_page() would.
+ */
+static int khugepaged_scan_file(struct mm_struct *mm,
+				struct vm_area_struct *vma,
+				unsigned long address)
+{
+	struct file *file = vma->vm_file;
+	pgoff_t index = linear_page_index(vma, address);
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	/* Only what is mapped with ptes needs collapsing */
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return 0;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return 0;
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return 0;
+
+	get_file(file);
+	up_read(&mm->mmap_sem);
+
+	if (!shmem_collapse_huge(file->f_mapping, index,
+				 khugepaged_max_ptes_none)) {
+		down_write(&mm->mmap_sem);
+		if (khugepaged_test_exit(mm))
+			goto out;
+		/* the vma may have changed while mmap_sem was released */
+		vma = find_vma(mm, address);
+		if (!vma || vma->vm_file != file || address < vma->vm_start ||
+		    address + HPAGE_PMD_SIZE > vma->vm_end ||
+		    linear_page_index(vma, address) != index ||
+		    !khugepaged_file_vma(vma))
+			goto out;
+		retract_page_table(vma, address);
+		khugepaged_pages_collapsed++;
+out:
+		up_write(&mm->mmap_sem);
+	}
+	fput(file);
+	return 1;
+}
+
 static void collect_mm_slot(struct mm_slot *mm_slot)
 {
 	struct mm_struct *mm = mm_slot->mm;
@@ -2136,6 +2368,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	progress++;
 	for (; vma; vma = vma->vm_next) {
 		unsigned long hstart, hend;
+		bool file;
 
 		cond_resched();
 		if (unlikely(khugepaged_test_exit(mm))) {
@@ -2143,23 +2376,28 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			break;
 		}
 
-		if ((!(vma->vm_flags & VM_HUGEPAGE) &&
-		     !khugepaged_always()) ||
-		    (vma->vm_flags & VM_NOHUGEPAGE)) {
+		/* the filesystem decides whether its page cache goes huge */
+		file = khugepaged_file_vma(vma);
+		if (!file &&
+		    ((!(vma->vm_flags & VM_HUGEPAGE) &&
+		      !khugepaged_always()) ||
+		     (vma->vm_flags & VM_NOHUGEPAGE))) {
 		skip:
 			progress++;
 			continue;
 		}
-		if (!vma->anon_vma || vma->vm_ops)
-			goto skip;
-		if (is_vma_temporary_stack(vma))
-			goto skip;
-		/*
-		 * If is_pfn_mapping() is true is_learn_pfn_mapping()
-		 * must be true too, verify it here.
-		 */
-		VM_BUG_ON(is_linear_pfn_mapping(vma) ||
-			  vma->vm_flags & VM_NO_THP);
+		if (!file) {
+			if (!vma->anon_vma || vma->vm_ops)
+				goto skip;
+			if (is_vma_temporary_stack(vma))
+				goto skip;
+			/*
+			 * If is_pfn_mapping() is true is_learn_pfn_mapping()
+			 * must be true too, verify it here.
+			 */
+			VM_BUG_ON(is_linear_pfn_mapping(vma) ||
+				  vma->vm_flags & VM_NO_THP);
+		}
 
 		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 		hend = vma->vm_end & HPAGE_PMD_MASK;
@@ -2180,9 +2418,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (file)
+				ret = khugepaged_scan_file(mm, vma,
+						khugepaged_scan.address);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2375,8 +2617,98 @@ static int khugepaged(void *none)
 	return 0;
 }
 
-void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+/*
+ * Split the huge pmd at @haddr which maps page cache. The pages of a team
+ * are not compound and they stay in the page cache, so instead of filling
+ * a page table like __split_huge_page_map() the pmd is just unmapped, as
+ * zap_file_huge_pmd() does, and the next faults map the pages with ptes.
+ * Then a racing zap_pmd_range(), which reads the pmd locklessly, can only
+ * miss a pmd which maps nothing. Called with page_table_lock held, the
+ * caller has invalidated the range for the mmu notifiers.
+ */
+static void __split_file_huge_pmd(struct vm_area_struct *vma,
+				  unsigned long haddr, pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page = pmd_page(*pmd);
+	pmd_t orig_pmd;
+	int i;
+
+	orig_pmd = pmdp_clear_flush(vma, haddr, pmd);
+	pte_free(mm, get_pmd_huge_pte(mm));
+	mm->nr_ptes--;
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (pmd_dirty(orig_pmd))
+			set_page_dirty(page + i);
+		if (pmd_young(orig_pmd))
+			mark_page_accessed(page + i);
+		page_remove_rmap(page + i);
+		page_cache_release(page + i);
+	}
+	add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+}
+
+/*
+ * Return the huge pmd which maps the page cache page @page at @address,
+ * with page_table_lock held, or NULL.
+ */
+pmd_t *page_check_address_file_pmd(struct page *page, struct mm_struct *mm,
+				   unsigned long address)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, haddr);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, haddr);
+	if (!pud_present(*pud))
+		return NULL;
+
+	pmd = pmd_offset(pud, haddr);
+	if (!pmd_trans_huge(*pmd))
+		return NULL;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) &&
+	    page_to_pfn(pmd_page(*pmd)) + ((address - haddr) >> PAGE_SHIFT) ==
+	    page_to_pfn(page))
+		return pmd;
+	spin_unlock(&mm->page_table_lock);
+	return NULL;
+}
+
+/*
+ * Split the huge pmd which maps the page cache page @page at @address
+ * in @vma, which unmaps the page there. Returns 1 if there was one.
+ */
+int split_file_huge_pmd(struct page *page, struct vm_area_struct *vma,
+			unsigned long address)
 {
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pmd_t *pmd;
+	int ret = 0;
+
+	VM_BUG_ON(PageAnon(page));
+	mmu_notifier_invalidate_range_start(mm, haddr, haddr + HPAGE_PMD_SIZE);
+	pmd = page_check_address_file_pmd(page, mm, address);
+	if (pmd) {
+		__split_file_huge_pmd(vma, haddr, pmd);
+		spin_unlock(&mm->page_table_lock);
+		ret = 1;
+	}
+	mmu_notifier_invalidate_range_end(mm, haddr, haddr + HPAGE_PMD_SIZE);
+	return ret;
+}
+
+void __split_huge_page_pmd(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
 	struct page *page;
 
 	spin_lock(&mm->page_table_lock);
@@ -2385,6 +2717,20 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 		return;
 	}
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		unsigned long haddr = address & HPAGE_PMD_MASK;
+
+		spin_unlock(&mm->page_table_lock);
+		mmu_notifier_invalidate_range_start(mm, haddr,
+						    haddr + HPAGE_PMD_SIZE);
+		spin_lock(&mm->page_table_lock);
+		if (pmd_trans_huge(*pmd))
+			__split_file_huge_pmd(vma, haddr, pmd);
+		spin_unlock(&mm->page_table_lock);
+		mmu_notifier_invalidate_range_end(mm, haddr,
+						  haddr + HPAGE_PMD_SIZE);
+		return;
+	}
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
@@ -2395,9 +2741,22 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	BUG_ON(pmd_trans_huge(*pmd));
 }
 
-static void split_huge_page_address(struct mm_struct *mm,
+void split_huge_page_pmd_mm(struct mm_struct *mm, unsigned long address,
+			    pmd_t *pmd)
+{
+	struct vm_area_struct *vma;
+
+	if (!pmd_trans_huge(*pmd))
+		return;
+	vma = find_vma(mm, address);
+	BUG_ON(vma == NULL);
+	split_huge_page_pmd(vma, address, pmd);
+}
+
+static void split_huge_page_address(struct vm_area_struct *vma,
 				    unsigned long address)
 {
+	struct mm_struct *mm = vma->vm_mm;
 	pgd_t *pgd;
 	pud_t *pud;
 	pmd_t *pmd;
@@ -2419,7 +2778,7 @@ static void split_huge_page_address(struct mm_struct *mm,
 	 * Caller holds the mmap_sem write mode, so a huge pmd cannot
 	 * materialize from under us.
 	 */
-	split_huge_page_pmd(mm, pmd);
+	split_huge_page_pmd(vma, address, pmd);
 }
 
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
@@ -2435,7 +2794,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (start & ~HPAGE_PMD_MASK &&
 	    (start & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (start & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, start);
+		split_huge_page_address(vma, start);
 
 	/*
 	 * If the new end address isn't hpage aligned and it could
@@ -2445,7 +2804,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (end & ~HPAGE_PMD_MASK &&
 	    (end & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (end & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, end);
+		split_huge_page_address(vma, end);
 
 	/*
 	 * If we're also updating the vma->vm_next->vm_start, if the new
@@ -2459,6 +2818,6 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 		if (nstart & ~HPAGE_PMD_MASK &&
 		    (nstart & HPAGE_PMD_MASK) >= next->vm_start &&
 		    (nstart & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= next->vm_end)
-			split_huge_page_address(next->vm_mm, nstart);
+			split_huge_page_address(next, nstart);
 	}
 }
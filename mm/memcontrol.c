@@ -1093,12 +1093,19 @@ out:
  * It is added to LRU before charge.
  * If PCG_USED bit is not set, page_cgroup is not added to this private LRU.
  * When moving account, the page is not on LRU. It's isolated.
+ *
+ * Each lruvec has its own lru_lock. Whatever changes the lruvec a page
+ * belongs to, as returned by mem_cgroup_page_lruvec(), holds the lru_lock
+ * of the lruvec the page leaves, see lock_page_lruvec_irq().
  */
 
 /**
- * mem_cgroup_page_lruvec - return lruvec for adding an lru page
+ * mem_cgroup_page_lruvec - return the lruvec a page belongs to
  * @page: the page
  * @zone: zone of the page
+ *
+ * The result is stable only under the lru_lock of the returned lruvec,
+ * use lock_page_lruvec_irq() to get it locked.
  */
 struct lruvec *mem_cgroup_page_lruvec(struct page *page, struct zone *zone)
 {
@@ -1113,19 +1120,23 @@ struct lruvec *mem_cgroup_page_lruvec(struct page *page, struct zone *zone)
 	}
 
 	pc = lookup_page_cgroup(page);
-	memcg = pc->mem_cgroup;
 
 	/*
-	 * Surreptitiously switch any uncharged offlist page to root:
-	 * an uncharged page off lru does nothing to secure
-	 * its former mem_cgroup from sudden removal.
-	 *
-	 * Our caller holds lru_lock, and PageCgroupUsed is updated
-	 * under page_cgroup lock: between them, they make all uses
-	 * of pc->mem_cgroup safe.
+	 * An uncharged page off lru does nothing to secure its former
+	 * mem_cgroup from sudden removal: it belongs to root, and
+	 * mem_cgroup_lru_add_page() switches it there for good when it
+	 * is put back on the lru.
 	 */
-	if (!PageLRU(page) && !PageCgroupUsed(pc) && memcg != root_mem_cgroup)
-		pc->mem_cgroup = memcg = root_mem_cgroup;
+	if (!PageLRU(page) && !PageCgroupUsed(pc))
+		memcg = root_mem_cgroup;
+	else {
+		/* See __mem_cgroup_commit_charge() */
+		smp_rmb();
+		memcg = ACCESS_ONCE(pc->mem_cgroup);
+		/* Only when racing with the page's first charge */
+		if (unlikely(!memcg))
+			memcg = root_mem_cgroup;
+	}
 
 	mz = page_cgroup_zoneinfo(memcg, page);
 	lruvec = &mz->lruvec;
@@ -1140,6 +1151,30 @@ out:
 	return lruvec;
 }
 
+/**
+ * mem_cgroup_lru_add_page - prepare a page for being put on the lru
+ * @page: the page, off the lru
+ *
+ * Must be called under the lru_lock of the page's lruvec, before setting
+ * PageLRU: from then on the lruvec of the page is that of pc->mem_cgroup.
+ */
+void mem_cgroup_lru_add_page(struct page *page)
+{
+	struct page_cgroup *pc;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	pc = lookup_page_cgroup(page);
+	/*
+	 * Surreptitiously switch any uncharged offlist page to root.
+	 * Charging the page needs the lru_lock we hold, uncharging it
+	 * is done already.
+	 */
+	if (!PageCgroupUsed(pc) && pc->mem_cgroup != root_mem_cgroup)
+		pc->mem_cgroup = root_mem_cgroup;
+}
+
 /**
  * mem_cgroup_update_lru_size - account for adding or removing an lru page
  * @lruvec: mem_cgroup per zone lru vector
@@ -2568,8 +2603,7 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 				       bool lrucare)
 {
 	struct page_cgroup *pc = lookup_page_cgroup(page);
-	struct zone *uninitialized_var(zone);
-	struct lruvec *lruvec;
+	struct lruvec *uninitialized_var(lruvec);
 	bool was_on_lru = false;
 	bool anon;
 
@@ -2585,10 +2619,8 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 	 * may already be on some other mem_cgroup's LRU.  Take care of it.
 	 */
 	if (lrucare) {
-		zone = page_zone(page);
-		spin_lock_irq(&zone->lru_lock);
+		lruvec = lock_page_lruvec_irq(page);
 		if (PageLRU(page)) {
-			lruvec = mem_cgroup_zone_lruvec(zone, pc->mem_cgroup);
 			ClearPageLRU(page);
 			del_page_from_lru_list(page, lruvec, page_lru(page));
 			was_on_lru = true;
@@ -2607,13 +2639,16 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 	SetPageCgroupUsed(pc);
 
 	if (lrucare) {
+		/* The page belongs to the lruvec of memcg from now on */
+		spin_unlock_irq(&lruvec->lru_lock);
 		if (was_on_lru) {
-			lruvec = mem_cgroup_zone_lruvec(zone, pc->mem_cgroup);
+			lruvec = mem_cgroup_zone_lruvec(page_zone(page), memcg);
+			spin_lock_irq(&lruvec->lru_lock);
 			VM_BUG_ON(PageLRU(page));
 			SetPageLRU(page);
 			add_page_to_lru_list(page, lruvec, page_lru(page));
+			spin_unlock_irq(&lruvec->lru_lock);
 		}
-		spin_unlock_irq(&zone->lru_lock);
 	}
 
 	if (ctype == MEM_CGROUP_CHARGE_TYPE_ANON)
@@ -2637,7 +2672,7 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 #define PCGF_NOCOPY_AT_SPLIT (1 << PCG_LOCK | 1 << PCG_MIGRATION)
 /*
  * Because tail pages are not marked as "used", set it. We're under
- * zone->lru_lock, 'splitting on pmd' and compound_lock.
+ * the lru_lock of the head page, 'splitting on pmd' and compound_lock.
  * charge/uncharge will be never happen and move_account() is done under
  * compound_lock(), so we don't have to take care of races.
  */
@@ -2679,7 +2714,8 @@ static int mem_cgroup_move_account(struct page *page,
 				   struct mem_cgroup *from,
 				   struct mem_cgroup *to)
 {
-	unsigned long flags;
+	unsigned long flags, lru_flags;
+	struct lruvec *lruvec;
 	int ret;
 	bool anon = PageAnon(page);
 
@@ -2713,7 +2749,9 @@ static int mem_cgroup_move_account(struct page *page,
 	mem_cgroup_charge_statistics(from, anon, -nr_pages);
 
 	/* caller should have done css_get */
+	lruvec = lock_page_lruvec_irqsave(page, &lru_flags);
 	pc->mem_cgroup = to;
+	spin_unlock_irqrestore(&lruvec->lru_lock, lru_flags);
 	mem_cgroup_charge_statistics(to, anon, nr_pages);
 	/*
 	 * We charges against "to" which may not have any tasks. Then, "to"
@@ -3015,6 +3053,21 @@ direct_uncharge:
 		memcg_oom_recover(memcg);
 }
 
+/*
+ * Uncharging a page off the lru moves it to the root lruvec, see
+ * mem_cgroup_page_lruvec(), so do it under the lru_lock of the lruvec
+ * the page leaves.  Caller holds lock_page_cgroup().
+ */
+static void clear_page_cgroup_used(struct page *page, struct page_cgroup *pc)
+{
+	struct lruvec *lruvec;
+	unsigned long flags;
+
+	lruvec = lock_page_lruvec_irqsave(page, &flags);
+	ClearPageCgroupUsed(pc);
+	spin_unlock_irqrestore(&lruvec->lru_lock, flags);
+}
+
 /*
  * uncharge if !page_mapped(page)
  */
@@ -3088,7 +3141,7 @@ __mem_cgroup_uncharge_common(struct page *page, enum charge_type ctype,
 
 	mem_cgroup_charge_statistics(memcg, anon, -nr_pages);
 
-	ClearPageCgroupUsed(pc);
+	clear_page_cgroup_used(page, pc);
 	/*
 	 * pc->mem_cgroup is not cleared here. It will be accessed when it's
 	 * freed from LRU. This is safe because uncharged page is expected not
@@ -3442,7 +3495,7 @@ void mem_cgroup_replace_page_cache(struct page *oldpage,
 	if (PageCgroupUsed(pc)) {
 		memcg = pc->mem_cgroup;
 		mem_cgroup_charge_statistics(memcg, false, -1);
-		ClearPageCgroupUsed(pc);
+		clear_page_cgroup_used(oldpage, pc);
 	}
 	unlock_page_cgroup(pc);
 
@@ -3745,19 +3798,19 @@ static bool mem_cgroup_force_empty_list(struct mem_cgroup *memcg,
 		struct page_cgroup *pc;
 		struct page *page;
 
-		spin_lock_irqsave(&zone->lru_lock, flags);
+		spin_lock_irqsave(&lruvec->lru_lock, flags);
 		if (list_empty(list)) {
-			spin_unlock_irqrestore(&zone->lru_lock, flags);
+			spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 			break;
 		}
 		page = list_entry(list->prev, struct page, lru);
 		if (busy == page) {
 			list_move(&page->lru, list);
 			busy = NULL;
-			spin_unlock_irqrestore(&zone->lru_lock, flags);
+			spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 			continue;
 		}
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 
 		pc = lookup_page_cgroup(page);
 
@@ -4821,11 +4874,15 @@ out_free:
  * Helpers for freeing a kmalloc()ed/vzalloc()ed mem_cgroup by RCU,
  * but in process context.  The work_freeing structure is overlaid
  * on the rcu_freeing structure, which itself is overlaid on memsw.
+ *
+ * The per-node info goes with it: lock_page_lruvec_irq() may still
+ * take the lru_lock of one of its lruvecs under rcu_read_lock().
  */
 static void free_work(struct work_struct *work)
 {
 	struct mem_cgroup *memcg;
 	int size = sizeof(struct mem_cgroup);
+	int node;
 
 	memcg = container_of(work, struct mem_cgroup, work_freeing);
 	/*
@@ -4840,6 +4897,10 @@ static void free_work(struct work_struct *work)
 	 * the cgroup_lock.
 	 */
 	disarm_sock_keys(memcg);
+
+	for_each_node(node)
+		free_mem_cgroup_per_zone_info(memcg, node);
+
 	if (size < PAGE_SIZE)
 		kfree(memcg);
 	else
@@ -4868,14 +4929,9 @@ static void free_rcu(struct rcu_head *rcu_head)
 
 static void __mem_cgroup_free(struct mem_cgroup *memcg)
 {
-	int node;
-
 	mem_cgroup_remove_from_trees(memcg);
 	free_css_id(&mem_cgroup_subsys, &memcg->css);
 
-	for_each_node(node)
-		free_mem_cgroup_per_zone_info(memcg, node);
-
 	free_percpu(memcg->stat);
 	call_rcu(&memcg->rcu_freeing, free_rcu);
 }
@@ -5257,7 +5313,8 @@ static enum mc_target_type get_mctgt_type(struct vm_area_struct *vma,
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 /*
  * We don't consider swapping or file mapped pages because THP does not
- * support them for now.
+ * support them for now: huge pmds of shmem map teams of small pages,
+ * which are left where they are.
  * Caller should make sure that pmd_trans_huge(pmd) is true.
  */
 static enum mc_target_type get_mctgt_type_thp(struct vm_area_struct *vma,
@@ -5268,6 +5325,8 @@ static enum mc_target_type get_mctgt_type_thp(struct vm_area_struct *vma,
 	enum mc_target_type ret = MC_TARGET_NONE;
 
 	page = pmd_page(pmd);
+	if (!PageAnon(page))
+		return ret;
 	VM_BUG_ON(!page || !PageHead(page));
 	if (!move_anon())
 		return ret;
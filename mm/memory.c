@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/migrate.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1235,7 +1236,9 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		if (pmd_trans_huge(*pmd)) {
 			if (next - addr != HPAGE_PMD_SIZE) {
 #ifdef CONFIG_DEBUG_VM
-				if (!rwsem_is_locked(&tlb->mm->mmap_sem)) {
+				/* truncation splits page cache without it */
+				if (!vma->vm_ops &&
+				    !rwsem_is_locked(&tlb->mm->mmap_sem)) {
 					pr_err("%s: mmap_sem is unlocked! addr=0x%lx end=0x%lx vma->vm_start=0x%lx vma->vm_end=0x%lx\n",
 						__func__, addr, end,
 						vma->vm_start,
@@ -1243,7 +1246,7 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 					BUG();
 				}
 #endif
-				split_huge_page_pmd(vma->vm_mm, pmd);
+				split_huge_page_pmd(vma, addr, pmd);
 			} else if (zap_huge_pmd(tlb, vma, pmd, addr))
 				goto next;
 			/* fall through */
@@ -1511,8 +1514,9 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 		goto out;
 	}
 	if (pmd_trans_huge(*pmd)) {
-		if (flags & FOLL_SPLIT) {
-			split_huge_page_pmd(mm, pmd);
+		/* the pages of page cache are not compound */
+		if ((flags & FOLL_SPLIT) && !vma->vm_ops) {
+			split_huge_page_pmd(vma, address, pmd);
 			goto split_fallthrough;
 		}
 		spin_lock(&mm->page_table_lock);
@@ -1521,7 +1525,7 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 				spin_unlock(&mm->page_table_lock);
 				wait_split_huge_page(vma->anon_vma, pmd);
 			} else {
-				page = follow_trans_huge_pmd(mm, address,
+				page = follow_trans_huge_pmd(vma, address,
 							     pmd, flags);
 				spin_unlock(&mm->page_table_lock);
 				goto out;
@@ -3431,6 +3435,87 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
  * but allow concurrent faults), and pte mapped but not yet locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
  */
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A NUMA hinting pte is a present pte of an accessible vma which was
+ * given the protection of vma_prot_none() by change_prot_numa().
+ */
+static bool pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	if (pte_same(pte, pte_modify(pte, vma->vm_page_prot)))
+		return false;
+
+	return pte_same(pte, pte_modify(pte, vma_prot_none(vma)));
+}
+
+/*
+ * The task touched a page the NUMA scanner took access away from:
+ * restore the pte, tell the scheduler on which node the task used the
+ * memory and move the page to the node of the task if it is elsewhere.
+ *
+ * The pte is restored to vm_page_prot, a write to a private page takes
+ * one more (write protect) fault to get write access back.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long address, pte_t *ptep, pmd_t *pmd,
+			pte_t entry)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	int node, this_node;
+	bool local;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*ptep, entry))) {
+		pte_unmap_unlock(ptep, ptl);
+		return 0;
+	}
+
+	entry = pte_mkyoung(pte_modify(entry, vma->vm_page_prot));
+	set_pte_at(mm, address, ptep, entry);
+	update_mmu_cache(vma, address, ptep);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(ptep, ptl);
+		return 0;
+	}
+	get_page(page);
+	pte_unmap_unlock(ptep, ptl);
+
+	this_node = numa_node_id();
+	node = page_to_nid(page);
+	local = node == this_node;
+	count_vm_event(NUMA_HINT_FAULTS);
+	if (local)
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+
+	/* An explicit memory policy overrides the placement of the scanner */
+	if (local || vma->vm_policy || current->mempolicy)
+		put_page(page);
+	else if (migrate_misplaced_page(page, this_node))
+		node = this_node;
+
+	task_numa_fault(node, 1, local);
+	return 0;
+}
+#else
+static inline bool pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	return false;
+}
+
+static inline int do_numa_page(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address, pte_t *ptep, pmd_t *pmd,
+			       pte_t entry)
+{
+	BUG();
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 int handle_pte_fault(struct mm_struct *mm,
 		     struct vm_area_struct *vma, unsigned long address,
 		     pte_t *pte, pmd_t *pmd, unsigned int flags)
@@ -3456,6 +3541,9 @@ int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
+	if (pte_numa(vma, entry))
+		return do_numa_page(mm, vma, address, pte, pmd, entry);
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -3540,10 +3628,17 @@ retry:
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
-		if (!vma->vm_ops)
+	if (pmd_none(*pmd)) {
+		if (!vma->vm_ops && transparent_hugepage_enabled(vma))
 			return do_huge_pmd_anonymous_page(mm, vma, address,
 							  pmd, flags);
+		if (vma->vm_ops && vma->vm_ops->pmd_fault) {
+			int ret;
+
+			ret = vma->vm_ops->pmd_fault(vma, address, pmd, flags);
+			if (!(ret & VM_FAULT_FALLBACK))
+				return ret;
+		}
 	} else {
 		pmd_t orig_pmd = *pmd;
 		int ret;
@@ -3553,6 +3648,11 @@ retry:
 			if (flags & FAULT_FLAG_WRITE &&
 			    !pmd_write(orig_pmd) &&
 			    !pmd_trans_splitting(orig_pmd)) {
+				/* page cache is not copied, only mapped */
+				if (vma->vm_ops) {
+					split_huge_page_pmd(vma, address, pmd);
+					goto pte_fault;
+				}
 				ret = do_huge_pmd_wp_page(mm, vma, address, pmd,
 							  orig_pmd);
 				/*
@@ -3568,6 +3668,7 @@ retry:
 		}
 	}
 
+pte_fault:
 	/*
 	 * Use __pte_alloc instead of pte_alloc_map, because we can't
 	 * run pte_offset_map on the pmd, if an huge pmd could
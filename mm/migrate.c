@@ -1035,6 +1035,68 @@ out:
 	return rc;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data,
+					     int **result)
+{
+	int nid = (int) data;
+
+	/*
+	 * Only take free memory of the target node: a misplaced page is
+	 * not worth reclaim or compaction there.
+	 */
+	return alloc_pages_exact_node(nid,
+				      (GFP_HIGHUSER_MOVABLE | __GFP_THISNODE |
+				       __GFP_NOMEMALLOC | __GFP_NORETRY |
+				       __GFP_NOWARN) & ~GFP_IOFS, 0);
+}
+
+/*
+ * Attempt to migrate a misplaced page to the specified destination
+ * node, called from the NUMA hinting fault with a reference on the
+ * page which is dropped here. Only private anonymous pages are moved,
+ * a page shared by several tasks has no right node to move to.
+ *
+ * Returns 1 if the page was migrated, 0 otherwise.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+	int nr_remaining;
+
+	if (!PageAnon(page) || PageKsm(page) || PageTransHuge(page) ||
+	    page_mapcount(page) != 1 || page_to_nid(page) == node) {
+		put_page(page);
+		return 0;
+	}
+
+	if (isolate_lru_page(page)) {
+		put_page(page);
+		return 0;
+	}
+
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add(&page->lru, &migratepages);
+
+	/*
+	 * The isolation holds its own reference, migration expects the
+	 * page to be held by the isolation and its mapping only.
+	 */
+	put_page(page);
+
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, false, MIGRATE_ASYNC);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 #ifdef CONFIG_NUMA
 /*
  * Move a list of individual pages
@@ -156,7 +156,10 @@ unsigned long move_page_tables(struct vm_area_struct *vma,
 				need_flush = true;
 				continue;
 			} else if (!err) {
-				split_huge_page_pmd(vma->vm_mm, old_pmd);
+				split_huge_page_pmd(vma, old_addr, old_pmd);
+				/* page cache is refaulted after a split */
+				if (pmd_none(*old_pmd))
+					continue;
 			}
 			VM_BUG_ON(pmd_trans_huge(*old_pmd));
 		}
@@ -1213,32 +1213,37 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
  *
  * The processor must either be the current processor and the
  * thread pinned to the current processor or a processor that
- * is not online.
+ * is not online. On RT the pcp lists are protected by the per cpu
+ * pa_lock, so any processor can be drained from anywhere.
  */
-static void drain_pages(unsigned int cpu)
+static void drain_pages_zone(unsigned int cpu, struct zone *zone)
 {
 	unsigned long flags;
-	struct zone *zone;
-
-	for_each_populated_zone(zone) {
-		struct per_cpu_pageset *pset;
-		struct per_cpu_pages *pcp;
-		LIST_HEAD(dst);
-		int count;
+	struct per_cpu_pageset *pset;
+	struct per_cpu_pages *pcp;
+	LIST_HEAD(dst);
+	int count;
 
-		cpu_lock_irqsave(cpu, flags);
-		pset = per_cpu_ptr(zone->pageset, cpu);
+	cpu_lock_irqsave(cpu, flags);
+	pset = per_cpu_ptr(zone->pageset, cpu);
 
-		pcp = &pset->pcp;
-		count = pcp->count;
-		if (count) {
-			isolate_pcp_pages(count, pcp, &dst);
-			pcp->count = 0;
-		}
-		cpu_unlock_irqrestore(cpu, flags);
-		if (count)
-			free_pcppages_bulk(zone, count, &dst);
+	pcp = &pset->pcp;
+	count = pcp->count;
+	if (count) {
+		isolate_pcp_pages(count, pcp, &dst);
+		pcp->count = 0;
 	}
+	cpu_unlock_irqrestore(cpu, flags);
+	if (count)
+		free_pcppages_bulk(zone, count, &dst);
+}
+
+static void drain_pages(unsigned int cpu)
+{
+	struct zone *zone;
+
+	for_each_populated_zone(zone)
+		drain_pages_zone(cpu, zone);
 }
 
 /*
@@ -1293,11 +1298,39 @@ void drain_all_pages(void)
 #ifndef CONFIG_PREEMPT_RT_BASE
 	on_each_cpu_mask(&cpus_with_pcps, drain_local_pages, NULL, 1);
 #else
-	for_each_cpu(cpu, &cpus_with_pcps)
+	/*
+	 * Take the pa_lock of each cpu and drain its lists from here
+	 * instead of interrupting it, which would hit isolated cpus
+	 * running RT workloads as well.
+	 */
+	for_each_cpu(cpu, &cpus_with_pcps) {
 		drain_pages(cpu);
+		if (cpu != raw_smp_processor_id())
+			count_vm_event(PCP_REMOTE_DRAIN);
+	}
 #endif
 }
 
+#if defined(CONFIG_NUMA) && defined(CONFIG_PREEMPT_RT_BASE)
+/*
+ * Spill the per-cpu pages of @cpu which belong to zones of other nodes
+ * back into the buddy allocator, like refresh_cpu_vm_stats() does for
+ * the cpus which run vmstat_update(). Only RT can take the pa_lock of
+ * @cpu from here, otherwise this would have to interrupt @cpu.
+ */
+void drain_remote_pages(unsigned int cpu)
+{
+	struct zone *zone;
+
+	for_each_populated_zone(zone) {
+		if (zone_to_nid(zone) != cpu_to_node(cpu))
+			drain_pages_zone(cpu, zone);
+	}
+	if (cpu != raw_smp_processor_id())
+		count_vm_event(PCP_REMOTE_DRAIN);
+}
+#endif
+
 #ifdef CONFIG_HIBERNATION
 
 void mark_free_pages(struct zone *zone)
@@ -3922,6 +3955,14 @@ static int __meminit zone_batchsize(struct zone *zone)
 #endif
 }
 
+static void pageset_set_batch(struct per_cpu_pageset *p, unsigned long batch)
+{
+	struct per_cpu_pages *pcp = &p->pcp;
+
+	pcp->high = 6 * batch;
+	pcp->batch = max(1UL, 1 * batch);
+}
+
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
@@ -3931,8 +3972,7 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 
 	pcp = &p->pcp;
 	pcp->count = 0;
-	pcp->high = 6 * batch;
-	pcp->batch = max(1UL, 1 * batch);
+	pageset_set_batch(p, batch);
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
 }
@@ -4508,7 +4548,6 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 #endif
 		zone->name = zone_names[j];
 		spin_lock_init(&zone->lock);
-		spin_lock_init(&zone->lru_lock);
 		zone_seqlock_init(zone);
 		zone->zone_pgdat = pgdat;
 
@@ -5926,23 +5965,40 @@ static int __meminit __zone_pcp_update(void *data)
 		struct per_cpu_pageset *pset;
 		struct per_cpu_pages *pcp;
 		LIST_HEAD(dst);
+		int count;
 
 		pset = per_cpu_ptr(zone->pageset, cpu);
 		pcp = &pset->pcp;
 
+		/*
+		 * Only the pcp lists and their limits change, the vmstat
+		 * deltas and thresholds of the pageset are left alone.
+		 */
 		cpu_lock_irqsave(cpu, flags);
-		if (pcp->count > 0) {
-			isolate_pcp_pages(pcp->count, pcp, &dst);
-			free_pcppages_bulk(zone, pcp->count, &dst);
-		}
+		count = pcp->count;
+		if (count)
+			isolate_pcp_pages(count, pcp, &dst);
+		pcp->count = 0;
+		if (percpu_pagelist_fraction)
+			setup_pagelist_highmark(pset, zone->present_pages /
+						percpu_pagelist_fraction);
+		else
+			pageset_set_batch(pset, batch);
 		cpu_unlock_irqrestore(cpu, flags);
+		if (count)
+			free_pcppages_bulk(zone, count, &dst);
 	}
 	return 0;
 }
 
 void __meminit zone_pcp_update(struct zone *zone)
 {
+#ifndef CONFIG_PREEMPT_RT_BASE
 	stop_machine(__zone_pcp_update, zone, NULL);
+#else
+	/* pa_lock serializes against the cpus, no need to stop them */
+	__zone_pcp_update(zone);
+#endif
 }
 #endif
 
@@ -16,18 +16,23 @@
 #include <linux/pagemap.h>
 #include <linux/swap.h>
 #include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
 #include <linux/swapops.h>
 #include <linux/buffer_head.h>
 #include <linux/writeback.h>
 #include <linux/frontswap.h>
 #include <asm/pgtable.h>
 
-static struct bio *get_swap_bio(gfp_t gfp_flags,
+/* Pages collected in one bio by swap_writepage(), see swap_plug_merge() */
+#define SWAP_PLUG_PAGES	SWAP_CLUSTER_MAX
+
+static struct bio *get_swap_bio(gfp_t gfp_flags, int nr_vecs,
 				struct page *page, bio_end_io_t end_io)
 {
 	struct bio *bio;
 
-	bio = bio_alloc(gfp_flags, 1);
+	bio = bio_alloc(gfp_flags, nr_vecs);
 	if (bio) {
 		bio->bi_sector = map_swap_page(page, &bio->bi_bdev);
 		bio->bi_sector <<= PAGE_SHIFT - 9;
@@ -42,29 +47,35 @@ static struct bio *get_swap_bio(gfp_t gfp_flags,
 	return bio;
 }
 
-static void end_swap_bio_write(struct bio *bio, int err)
+void end_swap_bio_write(struct bio *bio, int err)
 {
 	const int uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
-	struct page *page = bio->bi_io_vec[0].bv_page;
+	struct bio_vec *bvec;
+	int i;
 
 	if (!uptodate) {
-		SetPageError(page);
 		/*
-		 * We failed to write the page out to swap-space.
-		 * Re-dirty the page in order to avoid it being reclaimed.
+		 * We failed to write the pages out to swap-space.
+		 * Re-dirty them in order to avoid them being reclaimed.
 		 * Also print a dire warning that things will go BAD (tm)
 		 * very quickly.
-		 *
-		 * Also clear PG_reclaim to avoid rotate_reclaimable_page()
 		 */
-		set_page_dirty(page);
 		printk(KERN_ALERT "Write-error on swap-device (%u:%u:%Lu)\n",
 				imajor(bio->bi_bdev->bd_inode),
 				iminor(bio->bi_bdev->bd_inode),
 				(unsigned long long)bio->bi_sector);
-		ClearPageReclaim(page);
 	}
-	end_page_writeback(page);
+	__bio_for_each_segment(bvec, bio, i, 0) {
+		struct page *page = bvec->bv_page;
+
+		if (!uptodate) {
+			SetPageError(page);
+			set_page_dirty(page);
+			/* Avoid rotate_reclaimable_page() */
+			ClearPageReclaim(page);
+		}
+		end_page_writeback(page);
+	}
 	bio_put(bio);
 }
 
@@ -179,15 +190,82 @@ bad_bmap:
 	goto out;
 }
 
+/*
+ * Under a blk_plug, swap_writepage() collects contiguous pages in one bio
+ * hung off the plug. It is submitted when it is full, when the next page
+ * does not fit, or when the plug is flushed: by blk_finish_plug() or when
+ * the task blocks, so that nobody waits on the writeback of a page whose
+ * bio is still held back.
+ */
+struct swap_plug {
+	struct blk_plug_cb	cb;
+	struct bio		*bio;
+	struct work_struct	work;
+};
+
+static void swap_plug_work(struct work_struct *work)
+{
+	struct swap_plug *sp = container_of(work, struct swap_plug, work);
+
+	submit_bio(WRITE, sp->bio);
+	kfree(sp);
+}
+
+static void swap_unplug(struct blk_plug_cb *cb, bool from_schedule)
+{
+	struct swap_plug *sp = container_of(cb, struct swap_plug, cb);
+
+	if (sp->bio && from_schedule) {
+		/* submit_bio() can sleep, not on the way into schedule() */
+		INIT_WORK(&sp->work, swap_plug_work);
+		kblockd_schedule_work(bdev_get_queue(sp->bio->bi_bdev),
+				      &sp->work);
+		return;
+	}
+	if (sp->bio)
+		submit_bio(WRITE, sp->bio);
+	kfree(sp);
+}
+
+/*
+ * The swap_plug of the current task's blk_plug, if any. The task must not
+ * sleep while using it: the plug is flushed and the swap_plug freed when
+ * it does.
+ */
+static struct swap_plug *swap_plug_current(void)
+{
+	struct blk_plug_cb *cb;
+
+	cb = blk_check_plugged(swap_unplug, NULL, sizeof(struct swap_plug));
+	return cb ? container_of(cb, struct swap_plug, cb) : NULL;
+}
+
+/*
+ * Add @page to the plugged swap bio if it is the next page on the device
+ * and the bio completes the same way.
+ */
+static bool swap_plug_merge(struct bio *bio, struct page *page,
+			    bio_end_io_t end_io)
+{
+	struct block_device *bdev;
+	sector_t sector;
+
+	if (bio->bi_end_io != end_io)
+		return false;
+	sector = map_swap_page(page, &bdev) << (PAGE_SHIFT - 9);
+	if (bdev != bio->bi_bdev ||
+	    sector != bio->bi_sector + (bio->bi_size >> 9))
+		return false;
+	return bio_add_page(bio, page, PAGE_SIZE, 0) == PAGE_SIZE;
+}
+
 /*
  * We may have stale swap cache pages in memory: notice
  * them here and get rid of the unnecessary final write.
  */
 int swap_writepage(struct page *page, struct writeback_control *wbc)
 {
-	struct bio *bio;
-	int ret = 0, rw = WRITE;
-	struct swap_info_struct *sis = page_swap_info(page);
+	int ret = 0;
 
 	if (try_to_free_swap(page)) {
 		unlock_page(page);
@@ -199,6 +277,24 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 		end_page_writeback(page);
 		goto out;
 	}
+	ret = __swap_writepage(page, wbc, end_swap_bio_write);
+out:
+	return ret;
+}
+
+/*
+ * Write a locked swap cache page to the swap device, bypassing
+ * frontswap: used by swap_writepage() and by frontswap backends which
+ * write their pages back to the swap device.
+ */
+int __swap_writepage(struct page *page, struct writeback_control *wbc,
+		     void (*end_write_func)(struct bio *, int))
+{
+	struct swap_plug *sp;
+	struct bio *bio;
+	bool plugged;
+	int ret = 0, rw = WRITE;
+	struct swap_info_struct *sis = page_swap_info(page);
 
 	if (sis->flags & SWP_FILE) {
 		struct kiocb kiocb;
@@ -226,7 +322,29 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 		return ret;
 	}
 
-	bio = get_swap_bio(GFP_NOIO, page, end_swap_bio_write);
+	plugged = wbc->sync_mode == WB_SYNC_NONE && current->plug;
+	if (plugged) {
+		sp = swap_plug_current();
+		if (sp && sp->bio) {
+			bio = sp->bio;
+			if (swap_plug_merge(bio, page, end_write_func)) {
+				count_vm_event(PSWPOUT);
+				set_page_writeback(page);
+				unlock_page(page);
+				if (bio->bi_vcnt == bio->bi_max_vecs) {
+					sp->bio = NULL;
+					submit_bio(WRITE, bio);
+				}
+				goto out;
+			}
+			/* Not contiguous: send what we have, start a new bio */
+			sp->bio = NULL;
+			submit_bio(WRITE, bio);
+		}
+	}
+
+	bio = get_swap_bio(GFP_NOIO, plugged ? SWAP_PLUG_PAGES : 1, page,
+			   end_write_func);
 	if (bio == NULL) {
 		set_page_dirty(page);
 		unlock_page(page);
@@ -238,6 +356,14 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 	count_vm_event(PSWPOUT);
 	set_page_writeback(page);
 	unlock_page(page);
+	if (plugged) {
+		/* Look it up again, the allocation may have slept */
+		sp = swap_plug_current();
+		if (sp) {
+			sp->bio = bio;
+			goto out;
+		}
+	}
 	submit_bio(rw, bio);
 out:
 	return ret;
@@ -267,7 +393,7 @@ int swap_readpage(struct page *page)
 		return ret;
 	}
 
-	bio = get_swap_bio(GFP_KERNEL, page, end_swap_bio_read);
+	bio = get_swap_bio(GFP_KERNEL, 1, page, end_swap_bio_read);
 	if (bio == NULL) {
 		unlock_page(page);
 		ret = -ENOMEM;
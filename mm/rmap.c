@@ -26,7 +26,7 @@
  *       mapping->i_mmap_mutex
  *         anon_vma->mutex
  *           mm->page_table_lock or pte_lock
- *             zone->lru_lock (in mark_page_accessed, isolate_lru_page)
+ *             lruvec->lru_lock (in mark_page_accessed, isolate_lru_page)
  *             swap_lock (in swap_duplicate, swap_info_get)
  *               mmlist_lock (in mmput, drain_mmlist and others)
  *               mapping->private_lock (in __set_page_dirty_buffers)
@@ -732,8 +732,31 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		 * these out using page_check_address().
 		 */
 		pte = page_check_address(page, mm, address, &ptl, 0);
-		if (!pte)
-			goto out;
+		if (!pte) {
+			pmd_t *pmd;
+
+			/* page cache may be mapped by a huge pmd */
+			if (PageAnon(page))
+				goto out;
+			pmd = page_check_address_file_pmd(page, mm, address);
+			if (!pmd)
+				goto out;
+
+			if (vma->vm_flags & VM_LOCKED) {
+				spin_unlock(&mm->page_table_lock);
+				*mapcount = 0;	/* break early from loop */
+				*vm_flags |= VM_LOCKED;
+				goto out;
+			}
+
+			/* the young bit is shared by the whole team */
+			if (pmdp_clear_flush_young_notify(vma,
+					address & HPAGE_PMD_MASK, pmd) &&
+			    likely(!VM_SequentialReadHint(vma)))
+				referenced++;
+			spin_unlock(&mm->page_table_lock);
+			goto mapped;
+		}
 
 		if (vma->vm_flags & VM_LOCKED) {
 			pte_unmap_unlock(pte, ptl);
@@ -756,6 +779,7 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		pte_unmap_unlock(pte, ptl);
 	}
 
+mapped:
 	(*mapcount)--;
 
 	if (referenced)
@@ -1242,8 +1266,22 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	int ret = SWAP_AGAIN;
 
 	pte = page_check_address(page, mm, address, &ptl, 0);
-	if (!pte)
+	if (!pte) {
+		/* page cache may be mapped by a huge pmd */
+		if (PageAnon(page))
+			goto out;
+		if (!(flags & TTU_IGNORE_MLOCK) &&
+		    (vma->vm_flags & VM_LOCKED)) {
+			if (!page_check_address_file_pmd(page, mm, address))
+				goto out;
+			spin_unlock(&mm->page_table_lock);
+			goto out_mlock_pmd;
+		}
+		/* splitting the huge pmd unmaps the team */
+		if (TTU_ACTION(flags) != TTU_MUNLOCK)
+			split_file_huge_pmd(page, vma, address);
 		goto out;
+	}
 
 	/*
 	 * If the page is mlock()d, we cannot swap it out.
@@ -1333,8 +1371,7 @@ out:
 
 out_mlock:
 	pte_unmap_unlock(pte, ptl);
-
-
+out_mlock_pmd:
 	/*
 	 * We need mmap_sem locking, Otherwise VM_LOCKED check makes
 	 * unstable result and race. Plus, We can't wait here because
@@ -1412,6 +1449,7 @@ static int try_to_unmap_cluster(unsigned long cursor, unsigned int *mapcount,
 		return ret;
 
 	pmd = pmd_offset(pud, address);
+	split_huge_page_pmd(vma, address, pmd);
 	if (!pmd_present(*pmd))
 		return ret;
 
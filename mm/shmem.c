@@ -64,10 +64,14 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/khugepaged.h>
+#include <linux/mm_inline.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
 
+#include "internal.h"
+
 #define BLOCKS_PER_PAGE  (PAGE_CACHE_SIZE/512)
 #define VM_ACCT(size)    (PAGE_CACHE_ALIGN(size) >> PAGE_SHIFT)
 
@@ -105,6 +109,11 @@ enum sgp_type {
 	SGP_FALLOC,	/* like SGP_WRITE, but make existing page Uptodate */
 };
 
+/* Values of the huge= mount option */
+#define SHMEM_HUGE_NEVER	0	/* small pages only */
+#define SHMEM_HUGE_ALWAYS	1	/* teams wherever they fit */
+#define SHMEM_HUGE_WITHIN_SIZE	2	/* teams only within i_size */
+
 #ifdef CONFIG_TMPFS
 static unsigned long shmem_default_max_blocks(void)
 {
@@ -159,10 +168,11 @@ static inline void shmem_unacct_size(unsigned long flags, loff_t size)
  * shmem_getpage reports shmem_acct_block failure as -ENOSPC not -ENOMEM,
  * so that a failure on a sparse tmpfs mapping will give SIGBUS not OOM.
  */
-static inline int shmem_acct_block(unsigned long flags)
+static inline int shmem_acct_block(unsigned long flags, long pages)
 {
 	return (flags & VM_NORESERVE) ?
-		security_vm_enough_memory_mm(current->mm, VM_ACCT(PAGE_CACHE_SIZE)) : 0;
+		security_vm_enough_memory_mm(current->mm,
+				pages * VM_ACCT(PAGE_CACHE_SIZE)) : 0;
 }
 
 static inline void shmem_unacct_blocks(unsigned long flags, long pages)
@@ -959,6 +969,29 @@ static struct page *shmem_alloc_page(gfp_t gfp,
 
 	return page;
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	struct vm_area_struct pvma;
+	struct page *page;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	/* Bias interleave by inode number to distribute better across nodes */
+	pvma.vm_pgoff = index + info->vfs_inode.i_ino;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, index);
+
+	page = alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0, numa_node_id());
+
+	/* Drop reference taken by mpol_shared_policy_lookup() */
+	mpol_cond_put(pvma.vm_policy);
+
+	return page;
+}
+#endif
 #else /* !CONFIG_NUMA */
 #ifdef CONFIG_TMPFS
 static inline void shmem_show_mpol(struct seq_file *seq, struct mempolicy *mpol)
@@ -977,6 +1010,14 @@ static inline struct page *shmem_alloc_page(gfp_t gfp,
 {
 	return alloc_page(gfp);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+}
+#endif
 #endif /* CONFIG_NUMA */
 
 #if !defined(CONFIG_NUMA) || !defined(CONFIG_TMPFS)
@@ -1069,6 +1110,142 @@ static int shmem_replace_page(struct page **pagep, gfp_t gfp,
 	return error;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Transparent huge pages of tmpfs are teams: the HPAGE_PMD_NR pages of an
+ * aligned huge page block, at the huge page aligned offsets of a file,
+ * which go into the page cache, the lru and the memcg as small pages.
+ * shmem_pmd_fault() maps a team with one huge pmd; anything which wants
+ * to deal with a single page (truncation, swap, migration) replaces the
+ * pmd by ptes and breaks up the team, khugepaged builds it up again.
+ */
+static int shmem_alloc_team(struct inode *inode, pgoff_t index, gfp_t gfp,
+			    struct page **pagep)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	pgoff_t hindex = round_down(index, HPAGE_PMD_NR);
+	struct page *head, *page;
+	pgoff_t indices[1];
+	int i, error = 0;
+
+	switch (sbinfo->huge) {
+	case SHMEM_HUGE_NEVER:
+		return -EINVAL;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		if ((loff_t)(hindex + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT >
+		    i_size_read(inode))
+			return -EINVAL;
+		break;
+	}
+
+	/* The whole range must be a hole */
+	if (shmem_find_get_pages_and_swap(mapping, hindex, 1, &page,
+					  indices)) {
+		if (!radix_tree_exceptional_entry(page))
+			page_cache_release(page);
+		if (indices[0] < hindex + HPAGE_PMD_NR)
+			return -EEXIST;
+	}
+
+	if (shmem_acct_block(info->flags, HPAGE_PMD_NR))
+		return -ENOSPC;
+	if (sbinfo->max_blocks) {
+		if (sbinfo->max_blocks < HPAGE_PMD_NR ||
+		    percpu_counter_compare(&sbinfo->used_blocks,
+				sbinfo->max_blocks - HPAGE_PMD_NR) > 0) {
+			error = -ENOSPC;
+			goto unacct;
+		}
+		percpu_counter_add(&sbinfo->used_blocks, HPAGE_PMD_NR);
+	}
+
+	/* Like a huge page fault, only compact if defrag is enabled */
+	gfp |= __GFP_NORETRY | __GFP_NOWARN;
+	if (!(transparent_hugepage_flags &
+	      (1<<TRANSPARENT_HUGEPAGE_DEFRAG_FLAG)))
+		gfp &= ~__GFP_WAIT;
+	head = shmem_alloc_hugepage(gfp, info, hindex);
+	if (!head) {
+		error = -ENOMEM;
+		goto decused;
+	}
+	split_page(head, HPAGE_PMD_ORDER);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = head + i;
+		SetPageSwapBacked(page);
+		__set_page_locked(page);
+		clear_highpage(page);
+		flush_dcache_page(page);
+		SetPageUptodate(page);
+
+		error = mem_cgroup_cache_charge(page, current->mm,
+						gfp & GFP_RECLAIM_MASK);
+		if (error)
+			break;
+		error = radix_tree_preload(gfp & GFP_RECLAIM_MASK);
+		if (!error) {
+			error = shmem_add_to_page_cache(page, mapping,
+							hindex + i, gfp, NULL);
+			radix_tree_preload_end();
+		}
+		if (error) {
+			mem_cgroup_uncharge_cache_page(page);
+			break;
+		}
+		lru_cache_add_anon(page);
+
+		if (hindex + i == index) {
+			*pagep = page;
+			continue;
+		}
+		unlock_page(page);
+		page_cache_release(page);
+	}
+
+	spin_lock(&info->lock);
+	info->alloced += i;
+	inode->i_blocks += i * BLOCKS_PER_PAGE;
+	shmem_recalc_inode(inode);
+	spin_unlock(&info->lock);
+
+	if (i == HPAGE_PMD_NR) {
+		count_vm_event(THP_FILE_ALLOC);
+		return 0;
+	}
+
+	/*
+	 * Lost a race or ran out of memory: the pages added so far stay,
+	 * as holes which were filled, the others are given back.
+	 */
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, i - HPAGE_PMD_NR);
+	shmem_unacct_blocks(info->flags, HPAGE_PMD_NR - i);
+	if (index >= hindex + i)
+		*pagep = NULL;
+	for (; i < HPAGE_PMD_NR; i++) {
+		unlock_page(head + i);
+		page_cache_release(head + i);
+	}
+	return *pagep ? 0 : error;
+
+decused:
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -HPAGE_PMD_NR);
+unacct:
+	shmem_unacct_blocks(info->flags, HPAGE_PMD_NR);
+	return error;
+}
+#else
+static inline int shmem_alloc_team(struct inode *inode, pgoff_t index,
+				   gfp_t gfp, struct page **pagep)
+{
+	return -EINVAL;
+}
+#endif
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
@@ -1189,8 +1366,13 @@ repeat:
 		set_page_dirty(page);
 		swap_free(swap);
 
+	} else if (sgp != SGP_FALLOC && sbinfo->huge &&
+		   !shmem_alloc_team(inode, index, gfp, &page)) {
+		alloced = true;
+		if (sgp == SGP_DIRTY)
+			set_page_dirty(page);
 	} else {
-		if (shmem_acct_block(info->flags)) {
+		if (shmem_acct_block(info->flags, 1)) {
 			error = -ENOSPC;
 			goto failed;
 		}
@@ -1321,6 +1503,220 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Teams are mapped huge in shared mappings only, at addresses where the
+ * file offsets of the huge pages line up with the page tables.
+ */
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+
+	if (SHMEM_SB(inode->i_sb)->huge == SHMEM_HUGE_NEVER)
+		return false;
+	if ((vma->vm_flags & (VM_SHARED | VM_NOHUGEPAGE | VM_NONLINEAR)) !=
+	    VM_SHARED)
+		return false;
+	return !(((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff) &
+		 (HPAGE_PMD_NR - 1));
+}
+
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	struct address_space *mapping = inode->i_mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	unsigned long pfn;
+	struct page *page;
+	pgoff_t index, hindex;
+	int i, ret;
+
+	if (!shmem_huge_enabled(vma) || haddr < vma->vm_start ||
+	    haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	/* Pages beyond the end of the file are not mapped huge */
+	hindex = linear_page_index(vma, haddr);
+	if (hindex + HPAGE_PMD_NR >
+	    DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE))
+		return VM_FAULT_FALLBACK;
+
+	/* Allocates a team if the range is a hole */
+	index = linear_page_index(vma, address);
+	if (shmem_getpage(inode, index, &page, SGP_CACHE, NULL))
+		return VM_FAULT_FALLBACK;
+	pfn = page_to_pfn(page) - (index - hindex);
+	unlock_page(page);
+	page_cache_release(page);
+	if (pfn & (HPAGE_PMD_NR - 1))
+		return VM_FAULT_FALLBACK;
+
+	/*
+	 * Lock all pages of the team, in index order, and check that it is
+	 * still complete: holding the locks keeps truncation and
+	 * migration away until the pmd is set up.
+	 */
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = find_lock_page(mapping, hindex + i);
+		if (!page)
+			break;
+		if (radix_tree_exceptional_entry(page))
+			break;
+		if (page_to_pfn(page) != pfn + i || !PageUptodate(page)) {
+			unlock_page(page);
+			page_cache_release(page);
+			break;
+		}
+	}
+	if (i < HPAGE_PMD_NR) {
+		while (i--) {
+			page = pfn_to_page(pfn + i);
+			unlock_page(page);
+			page_cache_release(page);
+		}
+		return VM_FAULT_FALLBACK;
+	}
+
+	page = pfn_to_page(pfn);
+	ret = do_huge_pmd_file_page(vma, address, pmd, page, flags);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		unlock_page(page + i);
+	return ret;
+}
+
+struct shmem_collapse {
+	struct page *head;	/* of the huge page block */
+	pgoff_t index;		/* of the first page of the team */
+	DECLARE_BITMAP(used, HPAGE_PMD_NR);
+};
+
+static struct page *shmem_collapse_new_page(struct page *page,
+					    unsigned long private, int **result)
+{
+	struct shmem_collapse *cc = (struct shmem_collapse *)private;
+	pgoff_t offset = page->index - cc->index;
+
+	if (offset >= HPAGE_PMD_NR || test_and_set_bit(offset, cc->used))
+		return NULL;
+	return cc->head + offset;
+}
+
+/*
+ * Make the pages at @index, which is huge page aligned, a team: fill the
+ * holes, at most @max_none, and migrate all pages into a new huge page
+ * block. Called by khugepaged. Returns 0 if the range is a team now.
+ */
+int shmem_collapse_huge(struct address_space *mapping, pgoff_t index,
+			int max_none)
+{
+	struct inode *inode = mapping->host;
+	struct shmem_collapse cc;
+	LIST_HEAD(pagelist);
+	unsigned long pfn = 0;
+	struct page *page;
+	bool team = true;
+	int i, none = 0, error = 0;
+	gfp_t gfp;
+
+	VM_BUG_ON(index & (HPAGE_PMD_NR - 1));
+	if (index + HPAGE_PMD_NR >
+	    DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE))
+		return -EINVAL;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, index + i);
+		if (!page) {
+			none++;
+			team = false;
+			continue;
+		}
+		/* Like for anonymous memory, nothing is read back from swap */
+		if (radix_tree_exceptional_entry(page))
+			return -EAGAIN;
+		if (!i)
+			pfn = page_to_pfn(page);
+		if (pfn & (HPAGE_PMD_NR - 1) || page_to_pfn(page) != pfn + i ||
+		    !PageUptodate(page))
+			team = false;
+		page_cache_release(page);
+	}
+	if (team)
+		return 0;
+	if (none > max_none)
+		return -EBUSY;
+
+	for (i = 0; none && i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, index + i);
+		if (radix_tree_exceptional_entry(page))
+			return -EAGAIN;
+		if (page) {
+			page_cache_release(page);
+			continue;
+		}
+		error = shmem_getpage(inode, index + i, &page, SGP_CACHE, NULL);
+		if (error)
+			return error;
+		unlock_page(page);
+		page_cache_release(page);
+		none--;
+	}
+
+	gfp = mapping_gfp_mask(mapping) | __GFP_NORETRY | __GFP_NOWARN;
+	if (!khugepaged_defrag())
+		gfp &= ~__GFP_WAIT;
+	cc.head = shmem_alloc_hugepage(gfp, SHMEM_I(inode), index);
+	if (!cc.head) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		return -ENOMEM;
+	}
+	count_vm_event(THP_COLLAPSE_ALLOC);
+	split_page(cc.head, HPAGE_PMD_ORDER);
+	cc.index = index;
+	bitmap_zero(cc.used, HPAGE_PMD_NR);
+
+	lru_add_drain_all();
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, index + i);
+		if (!page || radix_tree_exceptional_entry(page)) {
+			error = -EAGAIN;
+			break;
+		}
+		if (isolate_lru_page(page)) {
+			page_cache_release(page);
+			error = -EBUSY;
+			break;
+		}
+		inc_zone_page_state(page, NR_ISOLATED_ANON +
+				    page_is_file_cache(page));
+		list_add_tail(&page->lru, &pagelist);
+		page_cache_release(page);
+	}
+	if (!error)
+		migrate_pages(&pagelist, shmem_collapse_new_page,
+			      (unsigned long)&cc, false, MIGRATE_SYNC);
+	putback_lru_pages(&pagelist);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (!test_bit(i, cc.used)) {
+			__free_page(cc.head + i);
+			error = -EAGAIN;
+		}
+	}
+	if (error)
+		return error;
+
+	/* Some pages may have been truncated or replaced meanwhile */
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, index + i);
+		if (page != cc.head + i)
+			error = -EAGAIN;
+		if (page && !radix_tree_exceptional_entry(page))
+			page_cache_release(page);
+	}
+	return error;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *mpol)
 {
@@ -1369,6 +1765,8 @@ static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 	file_accessed(file);
 	vma->vm_ops = &shmem_vm_ops;
 	vma->vm_flags |= VM_CAN_NONLINEAR;
+	if (shmem_huge_enabled(vma) && khugepaged_enter_file(vma))
+		return -ENOMEM;
 	return 0;
 }
 
@@ -2438,6 +2836,28 @@ static const struct export_operations shmem_export_ops = {
 	.fh_to_dentry	= shmem_fh_to_dentry,
 };
 
+static const char *shmem_huge_names[] = {
+	[SHMEM_HUGE_NEVER]	= "never",
+	[SHMEM_HUGE_ALWAYS]	= "always",
+	[SHMEM_HUGE_WITHIN_SIZE] = "within_size",
+};
+
+static int shmem_parse_huge(const char *str)
+{
+	int huge;
+
+	for (huge = 0; huge < ARRAY_SIZE(shmem_huge_names); huge++)
+		if (!strcmp(str, shmem_huge_names[huge]))
+			break;
+	if (huge == ARRAY_SIZE(shmem_huge_names))
+		return -EINVAL;
+	/* Without transparent hugepages, teams could never be mapped */
+	if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE) &&
+	    huge != SHMEM_HUGE_NEVER)
+		return -EINVAL;
+	return huge;
+}
+
 static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 			       bool remount)
 {
@@ -2521,6 +2941,12 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+		} else if (!strcmp(this_char,"huge")) {
+			int huge = shmem_parse_huge(value);
+
+			if (huge < 0)
+				goto bad_val;
+			sbinfo->huge = huge;
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2566,6 +2992,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge        = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2591,6 +3018,8 @@ static int shmem_show_options(struct seq_file *seq, struct dentry *root)
 	if (!gid_eq(sbinfo->gid, GLOBAL_ROOT_GID))
 		seq_printf(seq, ",gid=%u",
 				from_kgid_munged(&init_user_ns, sbinfo->gid));
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_huge_names[sbinfo->huge]);
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2804,6 +3233,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -179,9 +179,129 @@ static int wait_for_discard(void *word)
 	return 0;
 }
 
-#define SWAPFILE_CLUSTER	256
 #define LATENCY_LIMIT		256
 
+/*
+ * Free clusters of a solid state device are kept on a list, in the order
+ * they became free.  A cluster on the list can still be allocated from by
+ * the fallback scan of scan_swap_map(): free_cluster_get() skips it then.
+ */
+#define CLUSTER_NONE		UINT_MAX
+#define CLUSTER_FLAG_FREE	1	/* on the free cluster list */
+#define CLUSTER_FLAG_OWNED	2	/* the cluster of some CPU */
+
+static void free_cluster_add(struct swap_info_struct *si, unsigned int idx)
+{
+	struct swap_cluster_info *ci = &si->cluster_info[idx];
+
+	ci->flags |= CLUSTER_FLAG_FREE;
+	ci->next = CLUSTER_NONE;
+	if (si->free_cluster_head == CLUSTER_NONE)
+		si->free_cluster_head = idx;
+	else
+		si->cluster_info[si->free_cluster_tail].next = idx;
+	si->free_cluster_tail = idx;
+}
+
+static unsigned int free_cluster_get(struct swap_info_struct *si)
+{
+	struct swap_cluster_info *ci;
+	unsigned int idx;
+
+	while ((idx = si->free_cluster_head) != CLUSTER_NONE) {
+		ci = &si->cluster_info[idx];
+		si->free_cluster_head = ci->next;
+		ci->flags &= ~CLUSTER_FLAG_FREE;
+		if (!ci->count)
+			return idx;
+	}
+	return CLUSTER_NONE;
+}
+
+static void inc_cluster_info_page(struct swap_info_struct *si,
+				  unsigned long offset)
+{
+	if (si->cluster_info)
+		si->cluster_info[offset / SWAPFILE_CLUSTER].count++;
+}
+
+static void dec_cluster_info_page(struct swap_info_struct *si,
+				  unsigned long offset)
+{
+	unsigned int idx = offset / SWAPFILE_CLUSTER;
+	struct swap_cluster_info *ci;
+
+	if (!si->cluster_info)
+		return;
+	ci = &si->cluster_info[idx];
+	if (!--ci->count && !ci->flags)
+		free_cluster_add(si, idx);
+}
+
+/*
+ * Find a free slot in the cluster of this CPU, taking a new cluster from
+ * the free list when it is used up: so slots are handed out in ascending
+ * order within a cluster, and the pages reclaimed together by one CPU are
+ * written next to each other.  A new cluster is discarded first, if the
+ * device supports it.  Returns 0 if there are no free clusters left.
+ *
+ * Called with swap_lock held, which serializes all users of the per cpu
+ * clusters, and which is dropped while discarding.
+ */
+static unsigned long scan_swap_map_cluster(struct swap_info_struct *si)
+{
+	struct percpu_cluster *pcl;
+	struct swap_cluster_info *ci;
+	unsigned long offset, end;
+	unsigned int idx;
+
+again:
+	pcl = __this_cpu_ptr(si->percpu_cluster);
+	if (pcl->cluster != CLUSTER_NONE) {
+		end = min_t(unsigned long, (pcl->cluster + 1) * SWAPFILE_CLUSTER,
+			    si->max);
+		for (offset = pcl->next; offset < end; offset++) {
+			if (!si->swap_map[offset]) {
+				pcl->next = offset + 1;
+				return offset;
+			}
+		}
+		/* Used up: it goes back on the free list once it is free */
+		ci = &si->cluster_info[pcl->cluster];
+		ci->flags &= ~CLUSTER_FLAG_OWNED;
+		if (!ci->count)
+			free_cluster_add(si, pcl->cluster);
+		pcl->cluster = CLUSTER_NONE;
+	}
+
+	idx = free_cluster_get(si);
+	if (idx == CLUSTER_NONE)
+		return 0;
+	si->cluster_info[idx].flags |= CLUSTER_FLAG_OWNED;
+	pcl->cluster = idx;
+	pcl->next = idx * SWAPFILE_CLUSTER;
+
+	/*
+	 * Slots allocated from the cluster while we discard it wait in
+	 * scan_swap_map() until the discard has been issued.  Only one
+	 * discard is in flight at a time, a cluster found while another
+	 * one is discarded is just used.
+	 */
+	if ((si->flags & SWP_DISCARDABLE) && !(si->flags & SWP_DISCARDING)) {
+		si->flags |= SWP_DISCARDING;
+		spin_unlock(&swap_lock);
+
+		discard_swap_cluster(si, idx * SWAPFILE_CLUSTER,
+				     SWAPFILE_CLUSTER);
+
+		spin_lock(&swap_lock);
+		si->flags &= ~SWP_DISCARDING;
+		smp_mb();	/* wake_up_bit advises this */
+		wake_up_bit(&si->flags, ilog2(SWP_DISCARDING));
+	}
+	goto again;
+}
+
 static unsigned long scan_swap_map(struct swap_info_struct *si,
 				   unsigned char usage)
 {
@@ -203,6 +323,14 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 	 */
 
 	si->flags += SWP_SCANNING;
+
+	/* Solid state devices scan only when they run out of free clusters */
+	if (si->cluster_info) {
+		scan_base = offset = scan_swap_map_cluster(si);
+		if (offset)
+			goto checks;
+	}
+
 	scan_base = offset = si->cluster_next;
 
 	if (unlikely(!si->cluster_nr--)) {
@@ -210,7 +338,7 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 			si->cluster_nr = SWAPFILE_CLUSTER - 1;
 			goto checks;
 		}
-		if (si->flags & SWP_DISCARDABLE) {
+		if ((si->flags & SWP_DISCARDABLE) && !si->cluster_info) {
 			/*
 			 * Start range check on racing allocations, in case
 			 * they overlap the cluster we eventually decide on
@@ -315,9 +443,21 @@ checks:
 		si->highest_bit = 0;
 	}
 	si->swap_map[offset] = usage;
+	inc_cluster_info_page(si, offset);
 	si->cluster_next = offset + 1;
 	si->flags -= SWP_SCANNING;
 
+	if (si->cluster_info && (si->flags & SWP_DISCARDING)) {
+		/*
+		 * The slot may be in the cluster scan_swap_map_cluster()
+		 * discards: don't let it be written before the discard.
+		 */
+		spin_unlock(&swap_lock);
+		wait_on_bit(&si->flags, ilog2(SWP_DISCARDING),
+			wait_for_discard, TASK_UNINTERRUPTIBLE);
+		spin_lock(&swap_lock);
+	}
+
 	if (si->lowest_alloc) {
 		/*
 		 * Only set when SWP_DISCARDABLE, and there's a scan
@@ -475,6 +615,39 @@ swp_entry_t get_swap_page_of_type(int type)
 	return (swp_entry_t) {0};
 }
 
+/**
+ * swap_readahead_window - the swap slots to read for a fault on @entry
+ * @entry: the swap entry faulted on
+ * @window: number of slots to read, a power of two
+ * @start: first offset to read
+ * @end: last offset to read
+ *
+ * Rotating disks read an aligned block of slots around @entry, which costs
+ * no seek time.  Solid state devices hand out the slots of a cluster in
+ * ascending order, so the slots after @entry hold the pages which were
+ * reclaimed right after it: read ahead of @entry, within its cluster,
+ * the rest of which were written by other CPUs or at other times.
+ */
+void swap_readahead_window(swp_entry_t entry, unsigned long window,
+			   unsigned long *start, unsigned long *end)
+{
+	struct swap_info_struct *si = swap_info[swp_type(entry)];
+	unsigned long offset = swp_offset(entry);
+	unsigned long first;
+
+	if (si->flags & SWP_SOLIDSTATE) {
+		window = min(window, (unsigned long)SWAPFILE_CLUSTER);
+		first = offset & ~(SWAPFILE_CLUSTER - 1UL);
+		*end = min(offset + window - 1, first + SWAPFILE_CLUSTER - 1);
+		*start = max(*end + 1 - window, first);
+	} else {
+		*start = offset & ~(window - 1);
+		*end = offset | (window - 1);
+	}
+	if (!*start)	/* First page is swap header. */
+		(*start)++;
+}
+
 static struct swap_info_struct *swap_info_get(swp_entry_t entry)
 {
 	struct swap_info_struct *p;
@@ -558,6 +731,7 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 			swap_list.next = p->type;
 		nr_swap_pages++;
 		p->inuse_pages--;
+		dec_cluster_info_page(p, offset);
 		frontswap_invalidate_page(p->type, offset);
 		if (p->flags & SWP_BLKDEV) {
 			struct gendisk *disk = p->bdev->bd_disk;
@@ -1480,6 +1654,8 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 {
 	struct swap_info_struct *p = NULL;
 	unsigned char *swap_map;
+	struct swap_cluster_info *cluster_info;
+	struct percpu_cluster __percpu *percpu_cluster;
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -1582,11 +1758,17 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->max = 0;
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
+	cluster_info = p->cluster_info;
+	p->cluster_info = NULL;
+	percpu_cluster = p->percpu_cluster;
+	p->percpu_cluster = NULL;
 	p->flags = 0;
 	frontswap_invalidate_area(type);
 	spin_unlock(&swap_lock);
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
+	vfree(cluster_info);
+	free_percpu(percpu_cluster);
 	vfree(frontswap_map_get(p));
 	/* Destroy swap account informatin */
 	swap_cgroup_swapoff(type);
@@ -1933,6 +2115,36 @@ static int setup_swap_map_and_extents(struct swap_info_struct *p,
 	return nr_extents;
 }
 
+/*
+ * Set up the clusters of a solid state device: slots in use, bad or beyond
+ * the end of the device count as used, the completely free clusters go on
+ * the free list.
+ */
+static int setup_swap_clusters(struct swap_info_struct *p,
+			       unsigned char *swap_map)
+{
+	unsigned long nr_clusters = DIV_ROUND_UP(p->max, SWAPFILE_CLUSTER);
+	unsigned long i, offset;
+	int cpu;
+
+	p->cluster_info = vzalloc(nr_clusters * sizeof(*p->cluster_info));
+	p->percpu_cluster = alloc_percpu(struct percpu_cluster);
+	if (!p->cluster_info || !p->percpu_cluster)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu)
+		per_cpu_ptr(p->percpu_cluster, cpu)->cluster = CLUSTER_NONE;
+
+	for (offset = 0; offset < nr_clusters * SWAPFILE_CLUSTER; offset++)
+		if (offset >= p->max || swap_map[offset])
+			p->cluster_info[offset / SWAPFILE_CLUSTER].count++;
+
+	p->free_cluster_head = CLUSTER_NONE;
+	for (i = 0; i < nr_clusters; i++)
+		if (!p->cluster_info[i].count)
+			free_cluster_add(p, i);
+	return 0;
+}
+
 SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 {
 	struct swap_info_struct *p;
@@ -2039,6 +2251,9 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 		if (blk_queue_nonrot(bdev_get_queue(p->bdev))) {
 			p->flags |= SWP_SOLIDSTATE;
 			p->cluster_next = 1 + (random32() % p->highest_bit);
+			error = setup_swap_clusters(p, swap_map);
+			if (error)
+				goto bad_swap;
 		}
 		if ((swap_flags & SWAP_FLAG_DISCARD) && discard_swap(p) == 0)
 			p->flags |= SWP_DISCARDABLE;
@@ -2079,6 +2294,10 @@ bad_swap:
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	vfree(swap_map);
+	vfree(p->cluster_info);
+	p->cluster_info = NULL;
+	free_percpu(p->percpu_cluster);
+	p->percpu_cluster = NULL;
 	if (swap_file) {
 		if (inode && S_ISREG(inode->i_mode)) {
 			mutex_unlock(&inode->i_mutex);
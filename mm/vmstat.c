@@ -154,6 +154,16 @@ int calculate_normal_threshold(struct zone *zone)
 	return threshold;
 }
 
+/*
+ * Cpus isolated with "isolcpus=full," do not run vmstat_update(), so
+ * they fold every counter update into the zone right away. On RT their
+ * pcp lists of remote zones are drained by vmstat_isolated_update().
+ */
+static inline int cpu_stat_threshold(int cpu, int threshold)
+{
+	return is_housekeeping_cpu(cpu) ? threshold : 0;
+}
+
 /*
  * Refresh the thresholds for each zone.
  */
@@ -170,7 +180,7 @@ void refresh_zone_stat_thresholds(void)
 
 		for_each_online_cpu(cpu)
 			per_cpu_ptr(zone->pageset, cpu)->stat_threshold
-							= threshold;
+					= cpu_stat_threshold(cpu, threshold);
 
 		/*
 		 * Only set percpu_drift_mark if there is a danger that
@@ -201,7 +211,7 @@ void set_pgdat_percpu_threshold(pg_data_t *pgdat,
 		threshold = (*calculate_pressure)(zone);
 		for_each_possible_cpu(cpu)
 			per_cpu_ptr(zone->pageset, cpu)->stat_threshold
-							= threshold;
+					= cpu_stat_threshold(cpu, threshold);
 	}
 }
 
@@ -767,6 +777,17 @@ const char * const vmstat_text[] = {
 
 	"pgrotated",
 
+#ifdef CONFIG_PREEMPT_RT_BASE
+	"pcp_remote_drain",
+#endif
+
+#ifdef CONFIG_NUMA_BALANCING
+	"numa_pte_updates",
+	"numa_hint_faults",
+	"numa_hint_faults_local",
+	"numa_pages_migrated",
+#endif
+
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
 	"compact_pages_moved",
@@ -795,6 +816,8 @@ const char * const vmstat_text[] = {
 	"thp_collapse_alloc",
 	"thp_collapse_alloc_failed",
 	"thp_split",
+	"thp_file_alloc",
+	"thp_file_mapped",
 #endif
 
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
@@ -1159,11 +1182,73 @@ static void vmstat_update(struct work_struct *w)
 		round_jiffies_relative(sysctl_stat_interval));
 }
 
+#if defined(CONFIG_NUMA) && defined(CONFIG_PREEMPT_RT_BASE)
+/*
+ * Cpus isolated with "isolcpus=full," do not run vmstat_update(), which
+ * drains the pcp lists of remote zones once they expired. Expire and
+ * drain them from a housekeeping cpu instead. Their counter updates are
+ * folded right away, so the pages merely have to sit there for three
+ * intervals.
+ *
+ * Without RT the lists of another cpu can only be drained by an IPI,
+ * which isolation is meant to avoid. There the remote pages stay until
+ * drain_all_pages().
+ */
+static void vmstat_isolated_update(struct work_struct *w);
+static DECLARE_DEFERRED_WORK(vmstat_isolated_work, vmstat_isolated_update);
+
+static void vmstat_isolated_update(struct work_struct *w)
+{
+	struct zone *zone;
+	int cpu;
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		bool expired = false;
+
+		if (is_housekeeping_cpu(cpu))
+			continue;
+
+		for_each_populated_zone(zone) {
+			struct per_cpu_pageset *p;
+
+			p = per_cpu_ptr(zone->pageset, cpu);
+			if (zone_to_nid(zone) == cpu_to_node(cpu) ||
+			    !p->pcp.count) {
+				p->expire = 0;
+				continue;
+			}
+			if (!p->expire)
+				p->expire = 3;
+			else if (!--p->expire)
+				expired = true;
+		}
+		if (expired)
+			drain_remote_pages(cpu);
+	}
+	put_online_cpus();
+
+	queue_delayed_work(system_unbound_wq, &vmstat_isolated_work,
+			   round_jiffies_relative(sysctl_stat_interval));
+}
+
+static void __init start_isolated_timer(void)
+{
+	if (housekeeping_full)
+		queue_delayed_work(system_unbound_wq, &vmstat_isolated_work,
+				   round_jiffies_relative(HZ));
+}
+#else
+static inline void start_isolated_timer(void) { }
+#endif
+
 static void __cpuinit start_cpu_timer(int cpu)
 {
 	struct delayed_work *work = &per_cpu(vmstat_work, cpu);
 
 	INIT_DELAYED_WORK_DEFERRABLE(work, vmstat_update);
+	if (!is_housekeeping_cpu(cpu))
+		return;
 	schedule_delayed_work_on(cpu, work, __round_jiffies_relative(HZ, cpu));
 }
 
@@ -1216,6 +1301,7 @@ static int __init setup_vmstat(void)
 
 	for_each_online_cpu(cpu)
 		start_cpu_timer(cpu);
+	start_isolated_timer();
 #endif
 #ifdef CONFIG_PROC_FS
 	proc_create("buddyinfo", S_IRUGO, NULL, &fragmentation_file_operations);
@@ -0,0 +1,365 @@
+/*
+ * zbud.c - allocator for compressed pages
+ *
+ * zbud stores up to two compressed pages ("buddies") in one page frame:
+ * one aligned to the start of the page after the zbud header, the other
+ * aligned to its end. Allocations are rounded up to chunks of
+ * PAGE_SIZE / NCHUNKS bytes. A page whose buddies fill it completely is
+ * on the buddied list, a page with free chunks on the unbuddied list for
+ * its number of free chunks, where a new allocation looks for the best
+ * fit first.
+ *
+ * The density is worse than that of a general purpose allocator, at
+ * most two compressed pages share a page frame, but a page frame can be
+ * freed again by evicting at most two buddies: zbud keeps the pages on
+ * an LRU list and zbud_reclaim_page() evicts the buddies of the least
+ * recently used page through the evict callback of the user.
+ *
+ * The handles returned by zbud_alloc() are the addresses of the data,
+ * pages are allocated without __GFP_HIGHMEM, so zbud_map() is free.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/zbud.h>
+
+#define NCHUNKS_ORDER	6
+
+#define CHUNK_SHIFT	(PAGE_SHIFT - NCHUNKS_ORDER)
+#define CHUNK_SIZE	(1 << CHUNK_SHIFT)
+#define NCHUNKS		(PAGE_SIZE >> CHUNK_SHIFT)
+#define ZHDR_SIZE_ALIGNED CHUNK_SIZE
+
+/**
+ * struct zbud_pool - stores metadata for each zbud pool
+ * @lock:	protects all pool fields and the first/last_chunks fields
+ *		of any zbud page in the pool
+ * @unbuddied:	lists of pages with one free buddy, indexed by the
+ *		number of free chunks
+ * @buddied:	list of pages with both buddies in use
+ * @lru:	list of all pages, most recently used first
+ * @pages_nr:	number of pages in the pool
+ * @ops:	user callbacks, evict is called by zbud_reclaim_page()
+ */
+struct zbud_pool {
+	spinlock_t lock;
+	struct list_head unbuddied[NCHUNKS];
+	struct list_head buddied;
+	struct list_head lru;
+	u64 pages_nr;
+	struct zbud_ops *ops;
+};
+
+/*
+ * struct zbud_header - zbud page metadata, at the start of each page
+ * @buddy:	links the page into the unbuddied/buddied lists
+ * @lru:	links the page into the lru list
+ * @first_chunks: size of the first buddy in chunks, 0 if free
+ * @last_chunks: size of the last buddy in chunks, 0 if free
+ * @under_reclaim: the page is being reclaimed, zbud_free() must not
+ *		free it
+ */
+struct zbud_header {
+	struct list_head buddy;
+	struct list_head lru;
+	unsigned int first_chunks;
+	unsigned int last_chunks;
+	bool under_reclaim;
+};
+
+enum buddy {
+	FIRST,
+	LAST
+};
+
+static int size_to_chunks(int size)
+{
+	return (size + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+}
+
+#define for_each_unbuddied_list(_iter, _begin) \
+	for ((_iter) = (_begin); (_iter) < NCHUNKS; (_iter)++)
+
+static struct zbud_header *init_zbud_page(struct page *page)
+{
+	struct zbud_header *zhdr = page_address(page);
+
+	zhdr->first_chunks = 0;
+	zhdr->last_chunks = 0;
+	INIT_LIST_HEAD(&zhdr->buddy);
+	INIT_LIST_HEAD(&zhdr->lru);
+	zhdr->under_reclaim = false;
+	return zhdr;
+}
+
+static void free_zbud_page(struct zbud_header *zhdr)
+{
+	__free_page(virt_to_page(zhdr));
+}
+
+/* The handle of a buddy is the address of its data */
+static unsigned long encode_handle(struct zbud_header *zhdr, enum buddy bud)
+{
+	unsigned long handle = (unsigned long)zhdr;
+
+	if (bud == FIRST)
+		handle += ZHDR_SIZE_ALIGNED;
+	else
+		handle += PAGE_SIZE - (zhdr->last_chunks << CHUNK_SHIFT);
+	return handle;
+}
+
+static struct zbud_header *handle_to_zbud_header(unsigned long handle)
+{
+	return (struct zbud_header *)(handle & PAGE_MASK);
+}
+
+/* Number of free chunks of a page, the header takes one */
+static int num_free_chunks(struct zbud_header *zhdr)
+{
+	return NCHUNKS - zhdr->first_chunks - zhdr->last_chunks - 1;
+}
+
+/* Put a page with buddies in use back on the buddied or unbuddied list */
+static void zbud_list_add(struct zbud_pool *pool, struct zbud_header *zhdr)
+{
+	if (zhdr->first_chunks == 0 || zhdr->last_chunks == 0)
+		list_add(&zhdr->buddy,
+			 &pool->unbuddied[num_free_chunks(zhdr)]);
+	else
+		list_add(&zhdr->buddy, &pool->buddied);
+}
+
+/**
+ * zbud_create_pool() - create a new zbud pool
+ * @gfp:	gfp flags for the pool structure
+ * @ops:	user callbacks, may be NULL if the pool is never reclaimed
+ *
+ * Return: the new pool, NULL if it could not be allocated
+ */
+struct zbud_pool *zbud_create_pool(gfp_t gfp, struct zbud_ops *ops)
+{
+	struct zbud_pool *pool;
+	int i;
+
+	pool = kmalloc(sizeof(struct zbud_pool), gfp);
+	if (!pool)
+		return NULL;
+	spin_lock_init(&pool->lock);
+	for_each_unbuddied_list(i, 0)
+		INIT_LIST_HEAD(&pool->unbuddied[i]);
+	INIT_LIST_HEAD(&pool->buddied);
+	INIT_LIST_HEAD(&pool->lru);
+	pool->pages_nr = 0;
+	pool->ops = ops;
+	return pool;
+}
+
+/**
+ * zbud_destroy_pool() - destroy an empty zbud pool
+ * @pool:	the pool, all of its allocations must have been freed
+ */
+void zbud_destroy_pool(struct zbud_pool *pool)
+{
+	kfree(pool);
+}
+
+/**
+ * zbud_alloc() - allocate a buddy from the pool
+ * @pool:	pool to allocate from
+ * @size:	size in bytes
+ * @gfp:	gfp flags for a new page, must not contain __GFP_HIGHMEM
+ * @handle:	the handle of the allocation is stored here
+ *
+ * Return: 0 on success, -EINVAL for a bad size or gfp, -ENOSPC if size
+ * is too large to share a page, -ENOMEM if no page could be allocated.
+ */
+int zbud_alloc(struct zbud_pool *pool, int size, gfp_t gfp,
+	       unsigned long *handle)
+{
+	int chunks, i;
+	struct zbud_header *zhdr = NULL;
+	enum buddy bud;
+	struct page *page;
+
+	if (size <= 0 || gfp & __GFP_HIGHMEM)
+		return -EINVAL;
+	if (size > PAGE_SIZE - ZHDR_SIZE_ALIGNED - CHUNK_SIZE)
+		return -ENOSPC;
+	chunks = size_to_chunks(size);
+
+	spin_lock(&pool->lock);
+	/* Best fit: the page with the least free chunks which fits */
+	for_each_unbuddied_list(i, chunks) {
+		if (!list_empty(&pool->unbuddied[i])) {
+			zhdr = list_first_entry(&pool->unbuddied[i],
+						struct zbud_header, buddy);
+			list_del(&zhdr->buddy);
+			bud = zhdr->first_chunks == 0 ? FIRST : LAST;
+			goto found;
+		}
+	}
+
+	/* No fit, allocate a new page */
+	spin_unlock(&pool->lock);
+	page = alloc_page(gfp);
+	if (!page)
+		return -ENOMEM;
+	spin_lock(&pool->lock);
+	pool->pages_nr++;
+	zhdr = init_zbud_page(page);
+	bud = FIRST;
+
+found:
+	if (bud == FIRST)
+		zhdr->first_chunks = chunks;
+	else
+		zhdr->last_chunks = chunks;
+	zbud_list_add(pool, zhdr);
+
+	/* The page is the most recently used one now */
+	list_del(&zhdr->lru);
+	list_add(&zhdr->lru, &pool->lru);
+
+	*handle = encode_handle(zhdr, bud);
+	spin_unlock(&pool->lock);
+
+	return 0;
+}
+
+/**
+ * zbud_free() - free a buddy
+ * @pool:	pool the buddy was allocated from
+ * @handle:	handle of the buddy
+ *
+ * The page is freed once both of its buddies are free, unless it is
+ * being reclaimed: zbud_reclaim_page() frees it then.
+ */
+void zbud_free(struct zbud_pool *pool, unsigned long handle)
+{
+	struct zbud_header *zhdr;
+
+	spin_lock(&pool->lock);
+	zhdr = handle_to_zbud_header(handle);
+
+	if ((handle - ZHDR_SIZE_ALIGNED) & ~PAGE_MASK)
+		zhdr->last_chunks = 0;
+	else
+		zhdr->first_chunks = 0;
+
+	if (zhdr->under_reclaim) {
+		spin_unlock(&pool->lock);
+		return;
+	}
+
+	list_del(&zhdr->buddy);
+	if (zhdr->first_chunks == 0 && zhdr->last_chunks == 0) {
+		list_del(&zhdr->lru);
+		free_zbud_page(zhdr);
+		pool->pages_nr--;
+	} else {
+		list_add(&zhdr->buddy,
+			 &pool->unbuddied[num_free_chunks(zhdr)]);
+	}
+
+	spin_unlock(&pool->lock);
+}
+
+/**
+ * zbud_reclaim_page() - evict the buddies of the least recently used page
+ * @pool:	pool to reclaim from
+ * @retries:	number of pages to try before giving up
+ *
+ * Calls the evict callback of the pool for each buddy of the page. The
+ * callback writes the data back wherever it belongs and frees the
+ * buddy with zbud_free(), or returns non-zero if it cannot.
+ *
+ * Return: 0 if a page was freed, -EINVAL if there are no pages or no
+ * evict callback, -EAGAIN if no page could be freed within @retries.
+ */
+int zbud_reclaim_page(struct zbud_pool *pool, unsigned int retries)
+{
+	int i, ret;
+	struct zbud_header *zhdr;
+	unsigned long first_handle, last_handle;
+
+	spin_lock(&pool->lock);
+	if (!pool->ops || !pool->ops->evict || list_empty(&pool->lru) ||
+	    retries == 0) {
+		spin_unlock(&pool->lock);
+		return -EINVAL;
+	}
+	for (i = 0; i < retries; i++) {
+		zhdr = list_entry(pool->lru.prev, struct zbud_header, lru);
+		list_del(&zhdr->lru);
+		list_del(&zhdr->buddy);
+		/* Keep zbud_free() from freeing the page under us */
+		zhdr->under_reclaim = true;
+		first_handle = 0;
+		last_handle = 0;
+		if (zhdr->first_chunks)
+			first_handle = encode_handle(zhdr, FIRST);
+		if (zhdr->last_chunks)
+			last_handle = encode_handle(zhdr, LAST);
+		spin_unlock(&pool->lock);
+
+		/* The callback takes locks which nest outside of ours */
+		if (first_handle) {
+			ret = pool->ops->evict(pool, first_handle);
+			if (ret)
+				goto next;
+		}
+		if (last_handle) {
+			ret = pool->ops->evict(pool, last_handle);
+			if (ret)
+				goto next;
+		}
+next:
+		spin_lock(&pool->lock);
+		zhdr->under_reclaim = false;
+		if (zhdr->first_chunks == 0 && zhdr->last_chunks == 0) {
+			free_zbud_page(zhdr);
+			pool->pages_nr--;
+			spin_unlock(&pool->lock);
+			return 0;
+		}
+
+		/* At least one buddy is still in use, put the page back */
+		zbud_list_add(pool, zhdr);
+		list_add(&zhdr->lru, &pool->lru);
+	}
+	spin_unlock(&pool->lock);
+	return -EAGAIN;
+}
+
+/**
+ * zbud_map() - get the address of the data of a buddy
+ * @pool:	pool the buddy was allocated from
+ * @handle:	handle of the buddy
+ */
+void *zbud_map(struct zbud_pool *pool, unsigned long handle)
+{
+	return (void *)(handle);
+}
+
+/**
+ * zbud_unmap() - counterpart of zbud_map()
+ * @pool:	pool the buddy was allocated from
+ * @handle:	handle of the buddy
+ */
+void zbud_unmap(struct zbud_pool *pool, unsigned long handle)
+{
+}
+
+/**
+ * zbud_get_pool_size() - number of pages in a pool
+ * @pool:	pool to query
+ */
+u64 zbud_get_pool_size(struct zbud_pool *pool)
+{
+	return pool->pages_nr;
+}
@@ -0,0 +1,704 @@
+/*
+ * zswap.c - compressed cache for swap pages
+ *
+ * zswap is a frontswap backend: a page being swapped out is compressed
+ * with LZO and stored in a zbud pool in RAM instead of being written to
+ * the swap device, swapping it back in is a decompression. This trades
+ * cpu time for swap I/O, which pays off where the swap device is slow.
+ *
+ * The pool may grow up to max_pool_percent of RAM. When it is full, the
+ * least recently used page of the pool is reclaimed: the entries stored
+ * in it are decompressed into the swap cache and written back to the
+ * swap device, in LRU order.
+ *
+ * Each swap device has its own tree of entries, indexed by swap offset,
+ * and its own zbud pool. An entry is referenced by the tree and by loads
+ * and writebacks in progress, the last reference frees its zbud buddy.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/debugfs.h>
+#include <linux/frontswap.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/locallock.h>
+#include <linux/lzo.h>
+#include <linux/module.h>
+#include <linux/pagemap.h>
+#include <linux/percpu.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/writeback.h>
+#include <linux/zbud.h>
+
+/*
+ * Statistics
+ */
+
+/* Number of pages used by the pools */
+static u64 zswap_pool_pages;
+/* Number of pages stored in the pools */
+static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+
+/*
+ * The counters below are available in /sys/kernel/debug/zswap. They are
+ * for information only and not protected against increment races.
+ */
+
+/* Store hit the pool limit */
+static u64 zswap_pool_limit_hit;
+/* Pages written back to the swap device when the pool was full */
+static u64 zswap_written_back_pages;
+/* Store failed, the pool was full and could not be reclaimed from */
+static u64 zswap_reject_reclaim_fail;
+/* Store failed, no page for the pool could be allocated */
+static u64 zswap_reject_alloc_fail;
+/* Store failed, no entry could be allocated */
+static u64 zswap_reject_kmemcache_fail;
+/* Store failed, the page did not compress to less than a zbud buddy */
+static u64 zswap_reject_compress_poor;
+/* Store replaced an entry still in the tree */
+static u64 zswap_duplicate_entry;
+
+/*
+ * Tunables
+ */
+
+/* Enable/disable zswap, only at boot: zswap.enabled=1 */
+static bool zswap_enabled;
+module_param_named(enabled, zswap_enabled, bool, 0444);
+
+/* Pool size limit in percent of RAM */
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/* Pages a full pool tries to reclaim from before a store is rejected */
+#define ZSWAP_MAX_RECLAIM_RETRIES	8
+
+/*
+ * Compression buffers, per cpu. The local lock disables preemption on
+ * !PREEMPT_RT_FULL, so the pool allocation under it must not sleep.
+ */
+struct zswap_pcpu {
+	void *wrkmem;
+	u8 *dstmem;
+};
+
+static DEFINE_PER_CPU(struct zswap_pcpu, zswap_pcpu);
+static DEFINE_LOCAL_IRQ_LOCK(zswap_pcpu_lock);
+
+/*
+ * struct zswap_entry - a compressed page
+ * @rbnode:	links the entry into the tree of its swap device
+ * @offset:	swap offset of the page, the index of the tree
+ * @refcount:	references of the tree and of loads and writebacks in
+ *		progress, protected by the tree lock
+ * @length:	length of the compressed data
+ * @handle:	zbud handle of the zswap_header and the compressed data
+ */
+struct zswap_entry {
+	struct rb_node rbnode;
+	pgoff_t offset;
+	int refcount;
+	unsigned int length;
+	unsigned long handle;
+};
+
+/* Stored in front of the compressed data, for writeback */
+struct zswap_header {
+	swp_entry_t swpentry;
+};
+
+/*
+ * struct zswap_tree - the entries of a swap device
+ * @rbroot:	tree of entries, indexed by swap offset
+ * @lock:	protects the tree and the entry refcounts
+ * @pool:	zbud pool of the compressed data
+ */
+struct zswap_tree {
+	struct rb_root rbroot;
+	spinlock_t lock;
+	struct zbud_pool *pool;
+};
+
+static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+static struct kmem_cache *zswap_entry_cache;
+
+static void zswap_update_pool_pages(void)
+{
+	u64 pages = 0;
+	int type;
+
+	for (type = 0; type < MAX_SWAPFILES; type++) {
+		struct zswap_tree *tree = zswap_trees[type];
+
+		if (tree)
+			pages += zbud_get_pool_size(tree->pool);
+	}
+	zswap_pool_pages = pages;
+}
+
+static bool zswap_is_full(void)
+{
+	return totalram_pages * zswap_max_pool_percent / 100 <
+		zswap_pool_pages;
+}
+
+/*
+ * Tree and entry functions, called with the tree lock held
+ */
+
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (entry->offset > offset)
+			node = node->rb_left;
+		else if (entry->offset < offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+static void zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *myentry;
+
+	while (*link) {
+		parent = *link;
+		myentry = rb_entry(parent, struct zswap_entry, rbnode);
+		BUG_ON(myentry->offset == entry->offset);
+		if (myentry->offset > entry->offset)
+			link = &(*link)->rb_left;
+		else
+			link = &(*link)->rb_right;
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+}
+
+static void zswap_entry_get(struct zswap_entry *entry)
+{
+	entry->refcount++;
+}
+
+static void zswap_entry_put(struct zswap_tree *tree,
+			    struct zswap_entry *entry)
+{
+	BUG_ON(entry->refcount <= 0);
+	if (--entry->refcount)
+		return;
+
+	zbud_free(tree->pool, entry->handle);
+	kmem_cache_free(zswap_entry_cache, entry);
+	atomic_dec(&zswap_stored_pages);
+	zswap_update_pool_pages();
+}
+
+/* Remove the entry of offset from the tree and drop the tree reference */
+static bool zswap_invalidate_entry(struct zswap_tree *tree, pgoff_t offset)
+{
+	struct zswap_entry *entry;
+
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry)
+		return false;
+
+	rb_erase(&entry->rbnode, &tree->rbroot);
+	zswap_entry_put(tree, entry);
+	return true;
+}
+
+/*
+ * Writeback
+ */
+
+enum zswap_get_swap_ret {
+	ZSWAP_SWAPCACHE_NEW,
+	ZSWAP_SWAPCACHE_EXIST,
+	ZSWAP_SWAPCACHE_FAIL,
+};
+
+/*
+ * Add a new, locked page for entry to the swap cache like
+ * read_swap_cache_async() does, without reading it.
+ *
+ * Returns ZSWAP_SWAPCACHE_NEW with the new page in *retpage, or
+ * ZSWAP_SWAPCACHE_EXIST with a reference to the page which already was
+ * in the swap cache, or ZSWAP_SWAPCACHE_FAIL if there is no memory or
+ * the swap entry was freed.
+ */
+static int zswap_get_swap_cache_page(swp_entry_t entry,
+				     struct page **retpage)
+{
+	struct page *found_page, *new_page = NULL;
+	int err;
+
+	*retpage = NULL;
+	do {
+		found_page = find_get_page(&swapper_space, entry.val);
+		if (found_page)
+			break;
+
+		if (!new_page) {
+			new_page = alloc_page(GFP_KERNEL);
+			if (!new_page)
+				break;
+		}
+
+		err = radix_tree_preload(GFP_KERNEL);
+		if (err)
+			break;
+
+		/* The swap entry may have been freed meanwhile */
+		err = swapcache_prepare(entry);
+		if (err == -EEXIST) {
+			radix_tree_preload_end();
+			continue;
+		}
+		if (err) {
+			radix_tree_preload_end();
+			break;
+		}
+
+		__set_page_locked(new_page);
+		SetPageSwapBacked(new_page);
+		err = __add_to_swap_cache(new_page, entry);
+		if (likely(!err)) {
+			radix_tree_preload_end();
+			*retpage = new_page;
+			return ZSWAP_SWAPCACHE_NEW;
+		}
+		radix_tree_preload_end();
+		ClearPageSwapBacked(new_page);
+		__clear_page_locked(new_page);
+		swapcache_free(entry, NULL);
+	} while (err != -ENOMEM);
+
+	if (new_page)
+		page_cache_release(new_page);
+	if (!found_page)
+		return ZSWAP_SWAPCACHE_FAIL;
+	*retpage = found_page;
+	return ZSWAP_SWAPCACHE_EXIST;
+}
+
+static void zswap_decompress(struct zswap_tree *tree,
+			     struct zswap_entry *entry, struct page *page)
+{
+	size_t dlen = PAGE_SIZE;
+	u8 *src, *dst;
+	int ret;
+
+	src = (u8 *)zbud_map(tree->pool, entry->handle) +
+		sizeof(struct zswap_header);
+	dst = kmap_atomic(page);
+	ret = lzo1x_decompress_safe(src, entry->length, dst, &dlen);
+	kunmap_atomic(dst);
+	zbud_unmap(tree->pool, entry->handle);
+	BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+}
+
+/*
+ * The evict callback of the zbud pools: write the page of the entry
+ * stored at handle to the swap device and free the entry.
+ *
+ * Returns 0 if the entry is gone, non-zero if it has to stay.
+ */
+static int zswap_writeback_entry(struct zbud_pool *pool, unsigned long handle)
+{
+	struct zswap_header *zhdr;
+	swp_entry_t swpentry;
+	struct zswap_tree *tree;
+	struct zswap_entry *entry;
+	struct page *page;
+	pgoff_t offset;
+	int ret;
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+	};
+
+	zhdr = zbud_map(pool, handle);
+	swpentry = zhdr->swpentry;
+	zbud_unmap(pool, handle);
+	tree = zswap_trees[swp_type(swpentry)];
+	offset = swp_offset(swpentry);
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry || entry->handle != handle) {
+		/*
+		 * Invalidated or replaced: the buddy is freed, or will be
+		 * by the load still holding a reference.
+		 */
+		spin_unlock(&tree->lock);
+		return 0;
+	}
+	zswap_entry_get(entry);
+	spin_unlock(&tree->lock);
+
+	switch (zswap_get_swap_cache_page(swpentry, &page)) {
+	case ZSWAP_SWAPCACHE_FAIL:
+		ret = -ENOMEM;
+		goto fail;
+
+	case ZSWAP_SWAPCACHE_EXIST:
+		/* Being swapped in, the entry is not cold after all */
+		page_cache_release(page);
+		ret = -EEXIST;
+		goto fail;
+
+	case ZSWAP_SWAPCACHE_NEW:
+		/*
+		 * The swap entry may have been freed and reused before
+		 * the page got it: if so the entry is gone from the tree.
+		 * With the page in the swap cache the entry stays put.
+		 */
+		spin_lock(&tree->lock);
+		if (zswap_rb_search(&tree->rbroot, offset) != entry) {
+			spin_unlock(&tree->lock);
+			delete_from_swap_cache(page);
+			unlock_page(page);
+			page_cache_release(page);
+			ret = -EAGAIN;
+			goto fail;
+		}
+		spin_unlock(&tree->lock);
+
+		zswap_decompress(tree, entry, page);
+		SetPageUptodate(page);
+		lru_cache_add_anon(page);
+		break;
+	}
+
+	/* Rotate to the tail of the LRU once written, to be freed soon */
+	SetPageReclaim(page);
+	__swap_writepage(page, &wbc, end_swap_bio_write);
+	page_cache_release(page);
+	zswap_written_back_pages++;
+
+	/*
+	 * Drop the tree reference, unless the entry was invalidated, or
+	 * replaced by a store of the page after the write, meanwhile.
+	 */
+	spin_lock(&tree->lock);
+	if (zswap_rb_search(&tree->rbroot, offset) == entry)
+		zswap_invalidate_entry(tree, offset);
+	zswap_entry_put(tree, entry);
+	spin_unlock(&tree->lock);
+	return 0;
+
+fail:
+	spin_lock(&tree->lock);
+	zswap_entry_put(tree, entry);
+	spin_unlock(&tree->lock);
+	return ret;
+}
+
+static struct zbud_ops zswap_zbud_ops = {
+	.evict = zswap_writeback_entry,
+};
+
+/*
+ * Frontswap hooks
+ */
+
+static int zswap_frontswap_store(unsigned type, pgoff_t offset,
+				 struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	struct zswap_header *zhdr;
+	struct zswap_pcpu *pcpu;
+	size_t dlen = PAGE_SIZE;
+	unsigned long handle;
+	u8 *src;
+	int ret;
+
+	if (!tree)
+		return -ENODEV;
+
+	/*
+	 * A stale copy must not outlive a failed store: frontswap only
+	 * forgets about the offset then.
+	 */
+	spin_lock(&tree->lock);
+	if (zswap_invalidate_entry(tree, offset))
+		zswap_duplicate_entry++;
+	spin_unlock(&tree->lock);
+
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		if (zbud_reclaim_page(tree->pool, ZSWAP_MAX_RECLAIM_RETRIES)) {
+			zswap_reject_reclaim_fail++;
+			return -ENOMEM;
+		}
+	}
+
+	entry = kmem_cache_alloc(zswap_entry_cache, GFP_KERNEL);
+	if (!entry) {
+		zswap_reject_kmemcache_fail++;
+		return -ENOMEM;
+	}
+
+	pcpu = &get_locked_var(zswap_pcpu_lock, zswap_pcpu);
+	src = kmap_atomic(page);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, pcpu->dstmem, &dlen,
+			       pcpu->wrkmem);
+	kunmap_atomic(src);
+	if (ret != LZO_E_OK) {
+		ret = -EINVAL;
+		goto out_put;
+	}
+
+	ret = zbud_alloc(tree->pool, dlen + sizeof(struct zswap_header),
+			 __GFP_NORETRY | __GFP_NOWARN, &handle);
+	if (ret == -ENOSPC) {
+		zswap_reject_compress_poor++;
+		goto out_put;
+	}
+	if (ret) {
+		zswap_reject_alloc_fail++;
+		goto out_put;
+	}
+
+	zhdr = zbud_map(tree->pool, handle);
+	zhdr->swpentry = swp_entry(type, offset);
+	memcpy(zhdr + 1, pcpu->dstmem, dlen);
+	zbud_unmap(tree->pool, handle);
+	put_locked_var(zswap_pcpu_lock, zswap_pcpu);
+
+	entry->offset = offset;
+	entry->handle = handle;
+	entry->length = dlen;
+	entry->refcount = 1;
+
+	/* The page is locked in the swap cache, nobody stores it meanwhile */
+	spin_lock(&tree->lock);
+	zswap_rb_insert(&tree->rbroot, entry);
+	spin_unlock(&tree->lock);
+
+	atomic_inc(&zswap_stored_pages);
+	zswap_update_pool_pages();
+	return 0;
+
+out_put:
+	put_locked_var(zswap_pcpu_lock, zswap_pcpu);
+	kmem_cache_free(zswap_entry_cache, entry);
+	return ret;
+}
+
+/*
+ * Returns 0 if the page was found and decompressed, -1 if it was written
+ * back to the swap device meanwhile.
+ */
+static int zswap_frontswap_load(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+
+	if (!tree)
+		return -1;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry) {
+		spin_unlock(&tree->lock);
+		return -1;
+	}
+	zswap_entry_get(entry);
+	spin_unlock(&tree->lock);
+
+	zswap_decompress(tree, entry, page);
+
+	spin_lock(&tree->lock);
+	zswap_entry_put(tree, entry);
+	spin_unlock(&tree->lock);
+	return 0;
+}
+
+static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	zswap_invalidate_entry(tree, offset);
+	spin_unlock(&tree->lock);
+}
+
+/* Called at swapoff, the tree and pool are kept for the next swapon */
+static void zswap_frontswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	struct rb_node *node;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot))) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		zswap_invalidate_entry(tree, entry->offset);
+	}
+	spin_unlock(&tree->lock);
+}
+
+static void zswap_frontswap_init(unsigned type)
+{
+	struct zswap_tree *tree;
+
+	if (zswap_trees[type])
+		return;
+
+	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
+	if (!tree)
+		goto err;
+	tree->pool = zbud_create_pool(GFP_KERNEL, &zswap_zbud_ops);
+	if (!tree->pool)
+		goto freetree;
+	tree->rbroot = RB_ROOT;
+	spin_lock_init(&tree->lock);
+	zswap_trees[type] = tree;
+	return;
+
+freetree:
+	kfree(tree);
+err:
+	pr_err("alloc failed, zswap disabled for swap type %d\n", type);
+}
+
+static struct frontswap_ops zswap_frontswap_ops = {
+	.store = zswap_frontswap_store,
+	.load = zswap_frontswap_load,
+	.invalidate_page = zswap_frontswap_invalidate_page,
+	.invalidate_area = zswap_frontswap_invalidate_area,
+	.init = zswap_frontswap_init,
+};
+
+/*
+ * debugfs
+ */
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zswap_debugfs_root;
+
+static int __init zswap_debugfs_init(void)
+{
+	if (!debugfs_initialized())
+		return -ENODEV;
+
+	zswap_debugfs_root = debugfs_create_dir("zswap", NULL);
+	if (!zswap_debugfs_root)
+		return -ENOMEM;
+
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			   zswap_debugfs_root, &zswap_pool_limit_hit);
+	debugfs_create_u64("reject_reclaim_fail", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_reclaim_fail);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_alloc_fail);
+	debugfs_create_u64("reject_kmemcache_fail", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_kmemcache_fail);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("written_back_pages", S_IRUGO,
+			   zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("duplicate_entry", S_IRUGO,
+			   zswap_debugfs_root, &zswap_duplicate_entry);
+	debugfs_create_u64("pool_pages", S_IRUGO,
+			   zswap_debugfs_root, &zswap_pool_pages);
+	debugfs_create_u32("stored_pages", S_IRUGO,
+			   zswap_debugfs_root,
+			   (u32 *)&zswap_stored_pages.counter);
+	return 0;
+}
+#else
+static int __init zswap_debugfs_init(void)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Initialization
+ */
+
+static int __init zswap_pcpu_init(void)
+{
+	int cpu;
+
+	local_irq_lock_init(zswap_pcpu_lock);
+	for_each_possible_cpu(cpu) {
+		struct zswap_pcpu *pcpu = &per_cpu(zswap_pcpu, cpu);
+
+		/* LZO may expand incompressible data */
+		pcpu->dstmem = kmalloc_node(lzo1x_worst_compress(PAGE_SIZE),
+					    GFP_KERNEL, cpu_to_node(cpu));
+		pcpu->wrkmem = kmalloc_node(LZO1X_MEM_COMPRESS, GFP_KERNEL,
+					    cpu_to_node(cpu));
+		if (!pcpu->dstmem || !pcpu->wrkmem)
+			goto cleanup;
+	}
+	return 0;
+
+cleanup:
+	for_each_possible_cpu(cpu) {
+		struct zswap_pcpu *pcpu = &per_cpu(zswap_pcpu, cpu);
+
+		kfree(pcpu->dstmem);
+		kfree(pcpu->wrkmem);
+		pcpu->dstmem = NULL;
+		pcpu->wrkmem = NULL;
+	}
+	return -ENOMEM;
+}
+
+static int __init init_zswap(void)
+{
+	if (!zswap_enabled)
+		return 0;
+
+	pr_info("loading zswap\n");
+
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache) {
+		pr_err("entry cache creation failed\n");
+		goto error;
+	}
+	if (zswap_pcpu_init()) {
+		pr_err("per-cpu initialization failed\n");
+		goto pcpufail;
+	}
+
+	frontswap_register_ops(&zswap_frontswap_ops);
+	if (zswap_debugfs_init())
+		pr_warn("debugfs initialization failed\n");
+	return 0;
+
+pcpufail:
+	kmem_cache_destroy(zswap_entry_cache);
+error:
+	return -ENOMEM;
+}
+late_initcall(init_zswap);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed cache for swap pages");
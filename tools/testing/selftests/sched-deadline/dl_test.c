@@ -0,0 +1,295 @@
+/*
+ * SCHED_DEADLINE selftest
+ *
+ * 1) sched_setattr()/sched_getattr() round trip and parameter checks.
+ * 2) Bandwidth enforcement: a SCHED_DEADLINE hog with a 2ms/10ms
+ *    reservation must not get much more than 20% of a cpu.
+ * 3) Periodic threads (one per cpu, 30% bandwidth each) sleep until
+ *    the start of every period and run 1ms of work. Like cyclictest
+ *    the wakeup latency is measured, and every instance completing
+ *    after its absolute deadline is counted as a miss.
+ *
+ * Needs CAP_SYS_NICE, the test is skipped without it.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <linux/types.h>
+#include <sys/syscall.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE		6
+#endif
+
+#ifndef __NR_sched_setattr
+# if defined(__x86_64__)
+#  define __NR_sched_setattr	314
+#  define __NR_sched_getattr	315
+# elif defined(__i386__)
+#  define __NR_sched_setattr	351
+#  define __NR_sched_getattr	352
+# else
+#  error "sched_setattr() syscall number unknown"
+# endif
+#endif
+
+#define NSEC_PER_SEC		1000000000ULL
+#define NSEC_PER_MSEC		1000000ULL
+
+struct sched_attr {
+	__u32 size;
+
+	__u32 sched_policy;
+	__u64 sched_flags;
+
+	__s32 sched_nice;
+	__u32 sched_priority;
+
+	__u64 sched_runtime;
+	__u64 sched_deadline;
+	__u64 sched_period;
+};
+
+static int sched_setattr(pid_t pid, const struct sched_attr *attr,
+			 unsigned int flags)
+{
+	return syscall(__NR_sched_setattr, pid, attr, flags);
+}
+
+static int sched_getattr(pid_t pid, struct sched_attr *attr,
+			 unsigned int size, unsigned int flags)
+{
+	return syscall(__NR_sched_getattr, pid, attr, size, flags);
+}
+
+static int set_deadline(__u64 runtime, __u64 deadline, __u64 period)
+{
+	struct sched_attr attr = {
+		.size		= sizeof(attr),
+		.sched_policy	= SCHED_DEADLINE,
+		.sched_runtime	= runtime,
+		.sched_deadline	= deadline,
+		.sched_period	= period,
+	};
+
+	return sched_setattr(0, &attr, 0);
+}
+
+static int set_normal(void)
+{
+	struct sched_attr attr = {
+		.size		= sizeof(attr),
+		.sched_policy	= SCHED_OTHER,
+	};
+
+	return sched_setattr(0, &attr, 0);
+}
+
+static unsigned long long ts_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static unsigned long long now_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts_ns(&ts);
+}
+
+static void ns_ts(unsigned long long ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static int test_attr(void)
+{
+	struct sched_attr attr;
+	int ret = 0;
+
+	/* runtime > deadline must be rejected */
+	if (set_deadline(20 * NSEC_PER_MSEC, 10 * NSEC_PER_MSEC, 0) == 0 ||
+	    errno != EINVAL) {
+		printf("attr: runtime > deadline accepted\n");
+		ret = 1;
+	}
+
+	if (set_deadline(2 * NSEC_PER_MSEC, 5 * NSEC_PER_MSEC,
+			 10 * NSEC_PER_MSEC)) {
+		perror("attr: sched_setattr");
+		return 1;
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	if (sched_getattr(0, &attr, sizeof(attr), 0)) {
+		perror("attr: sched_getattr");
+		ret = 1;
+	} else if (attr.sched_policy != SCHED_DEADLINE ||
+		   attr.sched_runtime != 2 * NSEC_PER_MSEC ||
+		   attr.sched_deadline != 5 * NSEC_PER_MSEC ||
+		   attr.sched_period != 10 * NSEC_PER_MSEC) {
+		printf("attr: sched_getattr returned policy %u, "
+		       "%llu/%llu/%llu\n", attr.sched_policy,
+		       (unsigned long long)attr.sched_runtime,
+		       (unsigned long long)attr.sched_deadline,
+		       (unsigned long long)attr.sched_period);
+		ret = 1;
+	}
+
+	if (set_normal()) {
+		perror("attr: back to SCHED_OTHER");
+		ret = 1;
+	}
+
+	printf("attr: %s\n", ret ? "FAIL" : "ok");
+	return ret;
+}
+
+/* A hog with a 20% reservation must be throttled to about 20% */
+static int test_throttle(void)
+{
+	unsigned long long start, cpu_start, wall, cpu;
+	int ret = 0;
+
+	if (set_deadline(2 * NSEC_PER_MSEC, 10 * NSEC_PER_MSEC,
+			 10 * NSEC_PER_MSEC)) {
+		perror("throttle: sched_setattr");
+		return 1;
+	}
+
+	start = now_ns(CLOCK_MONOTONIC);
+	cpu_start = now_ns(CLOCK_THREAD_CPUTIME_ID);
+	do {
+		wall = now_ns(CLOCK_MONOTONIC) - start;
+	} while (wall < NSEC_PER_SEC);
+	cpu = now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+	set_normal();
+
+	/* Allow for the tick granularity of the runtime accounting */
+	if (cpu * 100 / wall > 30)
+		ret = 1;
+
+	printf("throttle: used %llu%% of a cpu with a 20%% reservation: %s\n",
+	       cpu * 100 / wall, ret ? "FAIL" : "ok");
+	return ret;
+}
+
+struct periodic {
+	pthread_t		thread;
+	int			err;
+	unsigned long		instances;
+	unsigned long		misses;
+	unsigned long long	max_latency;
+};
+
+static unsigned long long period = 10 * NSEC_PER_MSEC;
+static unsigned long long work = 1 * NSEC_PER_MSEC;
+static int duration = 5;
+
+static void *periodic_fn(void *arg)
+{
+	struct periodic *pt = arg;
+	unsigned long long next, end, t, lat, deadline;
+	struct timespec ts;
+
+	if (set_deadline(3 * period / 10, period, period)) {
+		pt->err = errno;
+		return NULL;
+	}
+
+	next = now_ns(CLOCK_MONOTONIC) + period;
+	end = next + duration * NSEC_PER_SEC;
+	while (next < end) {
+		ns_ts(next, &ts);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		t = now_ns(CLOCK_MONOTONIC);
+		lat = t > next ? t - next : 0;
+		if (lat > pt->max_latency)
+			pt->max_latency = lat;
+
+		/* Burn the cpu time of this instance */
+		t = now_ns(CLOCK_THREAD_CPUTIME_ID);
+		while (now_ns(CLOCK_THREAD_CPUTIME_ID) - t < work)
+			;
+
+		deadline = next + period;
+		if (now_ns(CLOCK_MONOTONIC) > deadline)
+			pt->misses++;
+		pt->instances++;
+		next = deadline;
+	}
+	return NULL;
+}
+
+static int test_periodic(void)
+{
+	long nr = sysconf(_SC_NPROCESSORS_ONLN);
+	struct periodic *threads;
+	unsigned long misses = 0;
+	int i, ret = 0;
+
+	threads = calloc(nr, sizeof(*threads));
+	if (!threads)
+		return 1;
+
+	for (i = 0; i < nr; i++)
+		pthread_create(&threads[i].thread, NULL, periodic_fn, &threads[i]);
+
+	for (i = 0; i < nr; i++) {
+		struct periodic *pt = &threads[i];
+
+		pthread_join(pt->thread, NULL);
+		if (pt->err) {
+			printf("periodic: thread %d: sched_setattr: %s\n",
+			       i, strerror(pt->err));
+			ret = 1;
+			continue;
+		}
+		printf("periodic: thread %d: %lu instances, %lu misses, "
+		       "max latency %llu us\n", i, pt->instances, pt->misses,
+		       pt->max_latency / 1000);
+		misses += pt->misses;
+	}
+	free(threads);
+
+	if (misses)
+		ret = 1;
+	printf("periodic: %s\n", ret ? "FAIL" : "ok");
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+
+	if (set_deadline(NSEC_PER_MSEC, 10 * NSEC_PER_MSEC, 0)) {
+		if (errno == ENOSYS || errno == EPERM || errno == EINVAL) {
+			printf("SCHED_DEADLINE not available (%s), skipping\n",
+			       strerror(errno));
+			return 0;
+		}
+		perror("sched_setattr");
+		return 1;
+	}
+	set_normal();
+
+	if (argc > 1)
+		duration = atoi(argv[1]);
+
+	ret |= test_attr();
+	ret |= test_throttle();
+	ret |= test_periodic();
+
+	return ret;
+}
@@ -0,0 +1,261 @@
+/*
+ * memcg-stream: page cache streaming in many memory cgroups at once, for
+ * measuring the contention on the lru_lock
+ *
+ * One process per memory cgroup reads its own file over and over. The
+ * files are larger than the memory limit of the cgroups, so every read
+ * inserts pages into the page cache and every cgroup reclaims its own
+ * lru lists all the time.
+ *
+ * Once per second the aggregate read throughput is printed. At the end,
+ * the lru_lock lines of /proc/lock_stat are printed, if the kernel has
+ * CONFIG_LOCK_STAT; the statistics are cleared when the streaming starts.
+ *
+ *	memcg-stream -n 200 -l 32 -f 64 -d /mnt/scratch
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define BUF_SIZE	(256 << 10)
+#define LOCK_STAT	"/proc/lock_stat"
+
+static int nr_groups = 16;
+static size_t limit_mb = 32;
+static size_t file_mb = 64;
+static int run_time = 30;
+static const char *data_dir = ".";
+static const char *memcg_root = "/sys/fs/cgroup/memory";
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n groups] [-l MB] [-f MB] [-s seconds] [-d dir]\n"
+		"       [-c memcg]\n"
+		"  -n  number of memory cgroups (default: 16)\n"
+		"  -l  memory limit of each cgroup in MB (default: 32)\n"
+		"  -f  size of the file of each cgroup in MB (default: 64)\n"
+		"  -s  run time in seconds (default: 30)\n"
+		"  -d  directory for the files (default: .)\n"
+		"  -c  memory cgroup mount point (default: %s)\n",
+		prog, memcg_root);
+	exit(1);
+}
+
+static int write_file(const char *path, const char *val)
+{
+	int fd = open(path, O_WRONLY);
+	int ret = 0;
+
+	if (fd < 0)
+		return -1;
+	if (write(fd, val, strlen(val)) != (ssize_t)strlen(val))
+		ret = -1;
+	close(fd);
+	return ret;
+}
+
+static void group_path(char *buf, size_t size, int group, const char *file)
+{
+	snprintf(buf, size, "%s/memcg-stream-%d%s%s", memcg_root, group,
+		 file ? "/" : "", file ? file : "");
+}
+
+static void data_path(char *buf, size_t size, int group)
+{
+	snprintf(buf, size, "%s/memcg-stream-%d.dat", data_dir, group);
+}
+
+static int create_file(const char *path, size_t size)
+{
+	static char buf[BUF_SIZE];
+	size_t done;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+	memset(buf, 0x5a, sizeof(buf));
+	for (done = 0; done < size; done += sizeof(buf)) {
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			close(fd);
+			return -1;
+		}
+	}
+	fsync(fd);
+	close(fd);
+	return 0;
+}
+
+/* Read the file of @group over and over, counting the bytes in @bytes */
+static void stream(int group, volatile unsigned long long *bytes)
+{
+	static char buf[BUF_SIZE];
+	char path[256], pid[32];
+	ssize_t ret;
+	int fd;
+
+	group_path(path, sizeof(path), group, "tasks");
+	snprintf(pid, sizeof(pid), "%d", getpid());
+	if (write_file(path, pid)) {
+		perror(path);
+		exit(1);
+	}
+
+	data_path(path, sizeof(path), group);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	for (;;) {
+		ret = read(fd, buf, sizeof(buf));
+		if (ret < 0) {
+			perror("read");
+			exit(1);
+		}
+		if (ret == 0) {
+			lseek(fd, 0, SEEK_SET);
+			continue;
+		}
+		*bytes += ret;
+	}
+}
+
+static void print_lock_stat(void)
+{
+	char line[512];
+	int header = 0;
+	FILE *f;
+
+	f = fopen(LOCK_STAT, "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		/* The column headers, then the lines of the lru_lock class */
+		if (!header && strstr(line, "class name")) {
+			fputs(line, stdout);
+			header = 1;
+		}
+		if (strstr(line, "lru_lock") && strchr(line, ':'))
+			fputs(line, stdout);
+	}
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	volatile unsigned long long *bytes;
+	unsigned long long total, last = 0;
+	char path[256], val[32];
+	pid_t *pids;
+	int opt, i, t;
+
+	while ((opt = getopt(argc, argv, "n:l:f:s:d:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_groups = atoi(optarg);
+			break;
+		case 'l':
+			limit_mb = atoi(optarg);
+			break;
+		case 'f':
+			file_mb = atoi(optarg);
+			break;
+		case 's':
+			run_time = atoi(optarg);
+			break;
+		case 'd':
+			data_dir = optarg;
+			break;
+		case 'c':
+			memcg_root = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_groups <= 0 || !limit_mb || !file_mb || run_time <= 0)
+		usage(argv[0]);
+
+	/* One counter per reader, shared with the parent */
+	bytes = mmap(NULL, nr_groups * sizeof(*bytes), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pids = calloc(nr_groups, sizeof(*pids));
+	if (bytes == MAP_FAILED || !pids) {
+		perror("memory");
+		return 1;
+	}
+
+	printf("creating %d cgroups with %zu MB limit and %zu MB files\n",
+	       nr_groups, limit_mb, file_mb);
+	for (i = 0; i < nr_groups; i++) {
+		group_path(path, sizeof(path), i, NULL);
+		if (mkdir(path, 0755) && errno != EEXIST) {
+			perror(path);
+			return 1;
+		}
+		group_path(path, sizeof(path), i, "memory.limit_in_bytes");
+		snprintf(val, sizeof(val), "%zuM", limit_mb);
+		if (write_file(path, val)) {
+			perror(path);
+			return 1;
+		}
+		data_path(path, sizeof(path), i);
+		if (create_file(path, file_mb << 20)) {
+			perror(path);
+			return 1;
+		}
+	}
+	/* Start from a cold page cache */
+	sync();
+	write_file("/proc/sys/vm/drop_caches", "1");
+	write_file(LOCK_STAT, "0");
+
+	for (i = 0; i < nr_groups; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pids[i])
+			stream(i, &bytes[i]);
+	}
+
+	printf("%4s %10s\n", "sec", "MB/s");
+	for (t = 1; t <= run_time; t++) {
+		sleep(1);
+		for (total = 0, i = 0; i < nr_groups; i++)
+			total += bytes[i];
+		printf("%4d %10llu\n", t, (total - last) >> 20);
+		fflush(stdout);
+		last = total;
+	}
+
+	for (i = 0; i < nr_groups; i++) {
+		kill(pids[i], SIGKILL);
+		waitpid(pids[i], NULL, 0);
+	}
+	print_lock_stat();
+
+	for (i = 0; i < nr_groups; i++) {
+		data_path(path, sizeof(path), i);
+		unlink(path);
+		group_path(path, sizeof(path), i, NULL);
+		rmdir(path);
+	}
+	return 0;
+}
@@ -0,0 +1,266 @@
+/*
+ * numa-bench: memory bandwidth and locality of a multi-threaded
+ * memory-bound workload, for automatic NUMA balancing
+ *
+ * Every thread allocates its buffer while bound to the cpus of node 0,
+ * so all of the memory starts out on node 0. The threads are then
+ * unbound and repeatedly sum up their buffers; the load balancer spreads
+ * them over all nodes, and most of them end up using remote memory
+ * unless the kernel moves the memory or the threads back together.
+ *
+ * Once per second the aggregate throughput, the share of the sampled
+ * pages which are on another node than the thread using them, and the
+ * numa_* counters of /proc/vmstat are printed. Compare a run with
+ *
+ *	echo 0 > /proc/sys/kernel/numa_balancing
+ *
+ * against one with automatic NUMA balancing enabled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+
+#define SAMPLE_PAGES	64
+
+struct bench_thread {
+	pthread_t	thread;
+	unsigned long	*buf;
+	size_t		size;
+	volatile unsigned long long	bytes;
+	volatile int	node;
+	void		*sample[SAMPLE_PAGES];
+};
+
+static const char *vmstat_names[] = {
+	"numa_pte_updates",
+	"numa_hint_faults",
+	"numa_hint_faults_local",
+	"numa_pages_migrated",
+};
+#define NR_VMSTAT	(sizeof(vmstat_names) / sizeof(vmstat_names[0]))
+
+static int nr_threads;
+static size_t thread_mb = 256;
+static int run_time = 60;
+static cpu_set_t node0_cpus, all_cpus;
+static pthread_barrier_t touched;
+static volatile int stop;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t threads] [-m MB per thread] [-s seconds]\n"
+		"  -t  number of threads (default: # of online cpus)\n"
+		"  -m  buffer size of each thread in MB (default: 256)\n"
+		"  -s  run time in seconds (default: 60)\n", prog);
+	exit(1);
+}
+
+/* Parse a cpulist like "0-3,8-11" into set */
+static int parse_cpulist(const char *path, cpu_set_t *set)
+{
+	FILE *f = fopen(path, "r");
+	int first, last;
+	char sep;
+
+	if (!f)
+		return -1;
+
+	CPU_ZERO(set);
+	while (fscanf(f, "%d", &first) == 1) {
+		last = first;
+		sep = fgetc(f);
+		if (sep == '-') {
+			if (fscanf(f, "%d", &last) != 1)
+				break;
+			sep = fgetc(f);
+		}
+		for (; first <= last; first++)
+			CPU_SET(first, set);
+		if (sep != ',')
+			break;
+	}
+	fclose(f);
+	return CPU_COUNT(set) ? 0 : -1;
+}
+
+static int current_node(void)
+{
+	unsigned int cpu, node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL))
+		return -1;
+	return node;
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	size_t i, nr = bt->size / sizeof(unsigned long);
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	unsigned long sum = 0;
+
+	/* First touch: all of the buffer is allocated on node 0 */
+	sched_setaffinity(0, sizeof(node0_cpus), &node0_cpus);
+	bt->buf = malloc(bt->size);
+	if (!bt->buf) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(bt->buf, 1, bt->size);
+	for (i = 0; i < SAMPLE_PAGES; i++)
+		bt->sample[i] = (char *)bt->buf +
+			(bt->size / SAMPLE_PAGES * i & ~(page_size - 1));
+
+	pthread_barrier_wait(&touched);
+	sched_setaffinity(0, sizeof(all_cpus), &all_cpus);
+
+	while (!stop) {
+		for (i = 0; i < nr; i++)
+			sum += bt->buf[i];
+		bt->bytes += bt->size;
+		bt->node = current_node();
+	}
+
+	/* Keep the loop from being optimized away */
+	if (sum == 42)
+		printf("%lu\n", sum);
+	return NULL;
+}
+
+static void read_vmstat(unsigned long long *vals)
+{
+	FILE *f = fopen("/proc/vmstat", "r");
+	unsigned long long val;
+	char name[64];
+	unsigned int i;
+
+	memset(vals, 0, NR_VMSTAT * sizeof(*vals));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &val) == 2) {
+		for (i = 0; i < NR_VMSTAT; i++)
+			if (!strcmp(name, vmstat_names[i]))
+				vals[i] = val;
+	}
+	fclose(f);
+}
+
+/* Share of the sampled pages not on the node of their thread, in % */
+static double remote_ratio(struct bench_thread *threads)
+{
+	int status[SAMPLE_PAGES];
+	int i, j, nr = 0, remote = 0;
+
+	for (i = 0; i < nr_threads; i++) {
+		struct bench_thread *bt = &threads[i];
+		int node = bt->node;
+
+		/* move_pages() without nodes only queries the node of pages */
+		if (node < 0 || syscall(SYS_move_pages, 0, SAMPLE_PAGES,
+					bt->sample, NULL, status, 0))
+			continue;
+		for (j = 0; j < SAMPLE_PAGES; j++) {
+			if (status[j] < 0)
+				continue;
+			nr++;
+			if (status[j] != node)
+				remote++;
+		}
+	}
+	return nr ? 100.0 * remote / nr : 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long vm_start[NR_VMSTAT], vm_now[NR_VMSTAT];
+	unsigned long long last_bytes = 0;
+	struct bench_thread *threads;
+	int opt, i, t;
+	unsigned int v;
+
+	nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "t:m:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'm':
+			thread_mb = atoi(optarg);
+			break;
+		case 's':
+			run_time = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads <= 0 || !thread_mb || run_time <= 0)
+		usage(argv[0]);
+
+	if (parse_cpulist("/sys/devices/system/node/node0/cpulist",
+			  &node0_cpus)) {
+		fprintf(stderr, "cannot read the cpus of node 0\n");
+		return 1;
+	}
+	sched_getaffinity(0, sizeof(all_cpus), &all_cpus);
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return 1;
+	}
+	pthread_barrier_init(&touched, NULL, nr_threads + 1);
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].size = thread_mb << 20;
+		threads[i].node = -1;
+		if (pthread_create(&threads[i].thread, NULL, bench_thread_fn,
+				   &threads[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	pthread_barrier_wait(&touched);
+	read_vmstat(vm_start);
+
+	printf("%d threads, %zu MB each, memory allocated on node 0\n",
+	       nr_threads, thread_mb);
+	printf("%4s %10s %8s", "sec", "MB/s", "remote%");
+	for (v = 0; v < NR_VMSTAT; v++)
+		printf(" %s", vmstat_names[v]);
+	printf("\n");
+
+	for (t = 1; t <= run_time; t++) {
+		unsigned long long bytes = 0;
+
+		sleep(1);
+		for (i = 0; i < nr_threads; i++)
+			bytes += threads[i].bytes;
+		read_vmstat(vm_now);
+
+		printf("%4d %10llu %7.1f%%", t, (bytes - last_bytes) >> 20,
+		       remote_ratio(threads));
+		for (v = 0; v < NR_VMSTAT; v++)
+			printf(" %*llu", (int)strlen(vmstat_names[v]),
+			       vm_now[v] - vm_start[v]);
+		printf("\n");
+		fflush(stdout);
+		last_bytes = bytes;
+	}
+
+	stop = 1;
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i].thread, NULL);
+	return 0;
+}
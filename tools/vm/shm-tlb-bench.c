@@ -0,0 +1,209 @@
+/*
+ * shm-tlb-bench: random read rate of a shared tmpfs mapping, for comparing
+ * tmpfs mounted with huge=always against huge=never
+ *
+ * A file is created and mapped shared, at a huge page aligned address,
+ * and a chain of pointers which visits every page in random order is
+ * written into it. Following the chain makes nearly every read miss the
+ * TLB, unless the file is mapped with huge pmds:
+ *
+ *	mount -t tmpfs -o huge=always,size=2g none /mnt/huge
+ *	shm-tlb-bench -f /mnt/huge/bench -m 1024
+ *
+ * Once per second the reads per second and the thp_file_alloc and
+ * thp_file_mapped counters of /proc/vmstat since the start are printed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#define HPAGE_SIZE	(2UL << 20)
+#define CACHELINE	64
+
+static const char *vmstat_names[] = {
+	"thp_file_alloc",
+	"thp_file_mapped",
+};
+#define NR_VMSTAT	(sizeof(vmstat_names) / sizeof(vmstat_names[0]))
+
+static size_t size_mb = 1024;
+static int run_time = 10;
+static const char *path = "/dev/shm/shm-tlb-bench";
+static volatile sig_atomic_t tick;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-m MB] [-s seconds] [-f file]\n"
+		"  -m  size of the file in MB (default: 1024)\n"
+		"  -s  run time in seconds (default: 10)\n"
+		"  -f  file to create on tmpfs (default: %s)\n",
+		prog, path);
+	exit(1);
+}
+
+static void on_alarm(int sig __attribute__((unused)))
+{
+	tick = 1;
+}
+
+static void read_vmstat(unsigned long long *vals)
+{
+	FILE *f = fopen("/proc/vmstat", "r");
+	unsigned long long val;
+	char name[64];
+	unsigned int i;
+
+	memset(vals, 0, NR_VMSTAT * sizeof(*vals));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &val) == 2) {
+		for (i = 0; i < NR_VMSTAT; i++)
+			if (!strcmp(name, vmstat_names[i]))
+				vals[i] = val;
+	}
+	fclose(f);
+}
+
+/* Map the file shared at a huge page aligned address */
+static char *map_aligned(int fd, size_t size)
+{
+	char *area, *addr;
+
+	area = mmap(NULL, size + HPAGE_SIZE, PROT_NONE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		return area;
+	addr = (char *)(((unsigned long)area + HPAGE_SIZE - 1) &
+			~(HPAGE_SIZE - 1));
+	return mmap(addr, size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_FIXED, fd, 0);
+}
+
+/*
+ * Link the pages into one cycle in random order (Sattolo's algorithm).
+ * The pointer of each page is at a different cache line, so the chain
+ * does not only use a few sets of the cache.
+ */
+static size_t link_pages(char *buf, size_t nr_pages, size_t page_size)
+{
+	size_t *order, i, j, tmp;
+
+	order = malloc(nr_pages * sizeof(*order));
+	if (!order)
+		return -1;
+	for (i = 0; i < nr_pages; i++)
+		order[i] = i;
+	for (i = nr_pages - 1; i > 0; i--) {
+		j = random() % i;
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for (i = 0; i < nr_pages; i++) {
+		size_t from = order[i], to = order[(i + 1) % nr_pages];
+
+		*(size_t *)(buf + from * page_size +
+			    from * CACHELINE % page_size) =
+			to * page_size + to * CACHELINE % page_size;
+	}
+	tmp = order[0] * page_size + order[0] * CACHELINE % page_size;
+	free(order);
+	return tmp;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long vm_start[NR_VMSTAT], vm_now[NR_VMSTAT];
+	unsigned long long reads = 0, last_reads = 0;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t size, nr_pages, off;
+	unsigned int v;
+	char *buf;
+	int opt, fd, t;
+
+	while ((opt = getopt(argc, argv, "m:s:f:")) != -1) {
+		switch (opt) {
+		case 'm':
+			size_mb = atoi(optarg);
+			break;
+		case 's':
+			run_time = atoi(optarg);
+			break;
+		case 'f':
+			path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!size_mb || run_time <= 0)
+		usage(argv[0]);
+
+	size = size_mb << 20;
+	nr_pages = size / page_size;
+	read_vmstat(vm_start);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	unlink(path);
+	if (ftruncate(fd, size)) {
+		perror("ftruncate");
+		return 1;
+	}
+	buf = map_aligned(fd, size);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	off = link_pages(buf, nr_pages, page_size);
+	if (off == (size_t)-1) {
+		perror("malloc");
+		return 1;
+	}
+
+	printf("%zu MB at %p\n", size_mb, buf);
+	printf("%4s %12s", "sec", "reads/s");
+	for (v = 0; v < NR_VMSTAT; v++)
+		printf(" %s", vmstat_names[v]);
+	printf("\n");
+
+	signal(SIGALRM, on_alarm);
+	for (t = 1; t <= run_time; t++) {
+		alarm(1);
+		while (!tick) {
+			int i;
+
+			/* Each read depends on the one before */
+			for (i = 0; i < 1024; i++)
+				off = *(volatile size_t *)(buf + off);
+			reads += 1024;
+		}
+		tick = 0;
+
+		read_vmstat(vm_now);
+		printf("%4d %12llu", t, reads - last_reads);
+		for (v = 0; v < NR_VMSTAT; v++)
+			printf(" %*llu", (int)strlen(vmstat_names[v]),
+			       vm_now[v] - vm_start[v]);
+		printf("\n");
+		fflush(stdout);
+		last_reads = reads;
+	}
+
+	munmap(buf, size);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * swap-bench: swap-out and swap-in throughput of sequential passes over a
+ * working set which does not fit into memory
+ *
+ * A buffer of incompressible anonymous memory is written once and then
+ * read and dirtied page by page in a number of passes. Run it with a
+ * working set larger than the memory it may use, e.g. in a memory cgroup
+ * with a lower limit:
+ *
+ *	echo 256M > /sys/fs/cgroup/memory/bench/memory.limit_in_bytes
+ *	echo $$ > /sys/fs/cgroup/memory/bench/tasks
+ *	swap-bench -m 1024 -d nvme0n1
+ *
+ * For each pass the MB/s of the pass, of swap-out and of swap-in are
+ * printed. With -d, also the average size of the write and read requests
+ * completed by the swap device, from /proc/diskstats.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+struct sample {
+	double time;
+	unsigned long long pswpin, pswpout;
+	unsigned long long rd_ios, rd_sectors, wr_ios, wr_sectors;
+};
+
+static size_t size_mb = 1024;
+static int nr_passes = 3;
+static const char *disk;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-m MB] [-p passes] [-d disk]\n"
+		"  -m  size of the working set in MB (default: 1024)\n"
+		"  -p  number of passes after the first one (default: 3)\n"
+		"  -d  swap device as named in /proc/diskstats, e.g. sda2\n",
+		prog);
+	exit(1);
+}
+
+static void read_vmstat(struct sample *s)
+{
+	FILE *f = fopen("/proc/vmstat", "r");
+	unsigned long long val;
+	char name[64];
+
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &val) == 2) {
+		if (!strcmp(name, "pswpin"))
+			s->pswpin = val;
+		else if (!strcmp(name, "pswpout"))
+			s->pswpout = val;
+	}
+	fclose(f);
+}
+
+static void read_diskstats(struct sample *s)
+{
+	unsigned long long rd_merges, rd_ticks, wr_merges;
+	char line[256], name[64];
+	FILE *f;
+
+	if (!disk)
+		return;
+	f = fopen("/proc/diskstats", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%*u %*u %63s %llu %llu %llu %llu"
+			   " %llu %llu %llu", name, &s->rd_ios, &rd_merges,
+			   &s->rd_sectors, &rd_ticks, &s->wr_ios, &wr_merges,
+			   &s->wr_sectors) == 8 && !strcmp(name, disk))
+			break;
+	}
+	fclose(f);
+}
+
+static void take_sample(struct sample *s)
+{
+	struct timeval tv;
+
+	memset(s, 0, sizeof(*s));
+	gettimeofday(&tv, NULL);
+	s->time = tv.tv_sec + tv.tv_usec / 1e6;
+	read_vmstat(s);
+	read_diskstats(s);
+}
+
+/* Average request size in KB */
+static double req_kb(unsigned long long sectors, unsigned long long ios)
+{
+	return ios ? sectors / 2.0 / ios : 0;
+}
+
+static void print_pass(const char *name, struct sample *a, struct sample *b,
+		       size_t page_size)
+{
+	double secs = b->time - a->time;
+	double mb = page_size / 1048576.0;
+
+	printf("%-6s %8.1f %10.1f %10.1f %10.1f", name, secs,
+	       size_mb / secs, (b->pswpout - a->pswpout) * mb / secs,
+	       (b->pswpin - a->pswpin) * mb / secs);
+	if (disk)
+		printf(" %8.1f %8.1f",
+		       req_kb(b->wr_sectors - a->wr_sectors,
+			      b->wr_ios - a->wr_ios),
+		       req_kb(b->rd_sectors - a->rd_sectors,
+			      b->rd_ios - a->rd_ios));
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	struct sample before, after;
+	size_t i, j, nr_pages;
+	unsigned long sum = 0;
+	unsigned char *buf;
+	char name[16];
+	int opt, pass;
+
+	while ((opt = getopt(argc, argv, "m:p:d:")) != -1) {
+		switch (opt) {
+		case 'm':
+			size_mb = atoi(optarg);
+			break;
+		case 'p':
+			nr_passes = atoi(optarg);
+			break;
+		case 'd':
+			disk = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!size_mb || nr_passes < 0)
+		usage(argv[0]);
+
+	nr_pages = (size_mb << 20) / page_size;
+	buf = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	printf("%zu MB working set\n", size_mb);
+	printf("%-6s %8s %10s %10s %10s", "pass", "sec", "MB/s",
+	       "out MB/s", "in MB/s");
+	if (disk)
+		printf(" %8s %8s", "wr KB", "rd KB");
+	printf("\n");
+
+	/* The first pass only swaps out */
+	take_sample(&before);
+	for (i = 0; i < nr_pages; i++) {
+		unsigned char *p = buf + i * page_size;
+
+		for (j = 0; j < page_size; j += sizeof(long))
+			*(long *)(p + j) = random();
+	}
+	take_sample(&after);
+	print_pass("fill", &before, &after, page_size);
+
+	/* The others read each page back in and dirty it again */
+	for (pass = 1; pass <= nr_passes; pass++) {
+		take_sample(&before);
+		for (i = 0; i < nr_pages; i++) {
+			unsigned char *p = buf + i * page_size;
+
+			sum += p[page_size - 1];
+			p[0]++;
+		}
+		take_sample(&after);
+		snprintf(name, sizeof(name), "%d", pass);
+		print_pass(name, &before, &after, page_size);
+	}
+
+	/* Keep the loop from being optimized away */
+	if (sum == 42)
+		printf("%lu\n", sum);
+	return 0;
+}
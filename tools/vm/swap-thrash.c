@@ -0,0 +1,196 @@
+/*
+ * swap-thrash: page access rate of a workload which does not fit into
+ * memory, for comparing swap setups like zswap against plain swap
+ *
+ * A buffer of compressible anonymous memory is allocated and then read
+ * and written at random pages. Run it with a working set larger than the
+ * memory it may use, e.g. in a memory cgroup with a lower limit:
+ *
+ *	echo 256M > /sys/fs/cgroup/memory/thrash/memory.limit_in_bytes
+ *	echo $$ > /sys/fs/cgroup/memory/thrash/tasks
+ *	swap-thrash -m 512
+ *
+ * Once per second the page accesses per second, the pswpin/pswpout
+ * counters of /proc/vmstat and, if debugfs is mounted, the stored_pages,
+ * pool_pages and written_back_pages counters of zswap are printed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#define ZSWAP_DIR	"/sys/kernel/debug/zswap/"
+
+static const char *vmstat_names[] = {
+	"pswpin",
+	"pswpout",
+};
+#define NR_VMSTAT	(sizeof(vmstat_names) / sizeof(vmstat_names[0]))
+
+static const char *zswap_names[] = {
+	"stored_pages",
+	"pool_pages",
+	"written_back_pages",
+};
+#define NR_ZSWAP	(sizeof(zswap_names) / sizeof(zswap_names[0]))
+
+static size_t size_mb = 512;
+static int run_time = 60;
+static int random_pct = 25;
+static volatile sig_atomic_t tick;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-m MB] [-s seconds] [-r percent]\n"
+		"  -m  size of the working set in MB (default: 512)\n"
+		"  -s  run time in seconds (default: 60)\n"
+		"  -r  share of random bytes in each page, the rest is\n"
+		"      repetitive and compresses well (default: 25)\n", prog);
+	exit(1);
+}
+
+static void on_alarm(int sig __attribute__((unused)))
+{
+	tick = 1;
+}
+
+static void read_vmstat(unsigned long long *vals)
+{
+	FILE *f = fopen("/proc/vmstat", "r");
+	unsigned long long val;
+	char name[64];
+	unsigned int i;
+
+	memset(vals, 0, NR_VMSTAT * sizeof(*vals));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &val) == 2) {
+		for (i = 0; i < NR_VMSTAT; i++)
+			if (!strcmp(name, vmstat_names[i]))
+				vals[i] = val;
+	}
+	fclose(f);
+}
+
+/* Return 0 if the zswap counters are available */
+static int read_zswap(unsigned long long *vals)
+{
+	char path[128];
+	unsigned int i;
+	FILE *f;
+
+	for (i = 0; i < NR_ZSWAP; i++) {
+		snprintf(path, sizeof(path), ZSWAP_DIR "%s", zswap_names[i]);
+		f = fopen(path, "r");
+		if (!f)
+			return -1;
+		if (fscanf(f, "%llu", &vals[i]) != 1)
+			vals[i] = 0;
+		fclose(f);
+	}
+	return 0;
+}
+
+/* Fill a page with random_pct random bytes, the rest a repeated pattern */
+static void fill_page(unsigned char *p, size_t page_size)
+{
+	size_t i, nr_random = page_size * random_pct / 100;
+
+	for (i = 0; i < nr_random; i++)
+		p[i] = random();
+	for (; i < page_size; i++)
+		p[i] = i & 0xf;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long vm_start[NR_VMSTAT], vm_now[NR_VMSTAT];
+	unsigned long long zswap[NR_ZSWAP];
+	unsigned long long accesses = 0, last_accesses = 0;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t i, nr_pages;
+	unsigned long sum = 0;
+	unsigned char *buf;
+	int opt, t, have_zswap;
+	unsigned int v;
+
+	while ((opt = getopt(argc, argv, "m:s:r:")) != -1) {
+		switch (opt) {
+		case 'm':
+			size_mb = atoi(optarg);
+			break;
+		case 's':
+			run_time = atoi(optarg);
+			break;
+		case 'r':
+			random_pct = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!size_mb || run_time <= 0 || random_pct < 0 || random_pct > 100)
+		usage(argv[0]);
+
+	nr_pages = (size_mb << 20) / page_size;
+	buf = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	for (i = 0; i < nr_pages; i++)
+		fill_page(buf + i * page_size, page_size);
+
+	have_zswap = !read_zswap(zswap);
+	read_vmstat(vm_start);
+	printf("%zu MB, %d%% random bytes per page\n", size_mb, random_pct);
+	printf("%4s %12s", "sec", "accesses/s");
+	for (v = 0; v < NR_VMSTAT; v++)
+		printf(" %10s", vmstat_names[v]);
+	if (have_zswap)
+		for (v = 0; v < NR_ZSWAP; v++)
+			printf(" %s", zswap_names[v]);
+	printf("\n");
+
+	signal(SIGALRM, on_alarm);
+	for (t = 1; t <= run_time; t++) {
+		alarm(1);
+		while (!tick) {
+			unsigned char *p;
+
+			/* Read and dirty a page, so it is swapped out again */
+			p = buf + (random() % nr_pages) * page_size;
+			sum += p[page_size - 1];
+			p[0]++;
+			accesses++;
+		}
+		tick = 0;
+
+		read_vmstat(vm_now);
+		printf("%4d %12llu", t, accesses - last_accesses);
+		for (v = 0; v < NR_VMSTAT; v++)
+			printf(" %10llu", vm_now[v] - vm_start[v]);
+		if (have_zswap && !read_zswap(zswap))
+			for (v = 0; v < NR_ZSWAP; v++)
+				printf(" %*llu", (int)strlen(zswap_names[v]),
+				       zswap[v]);
+		printf("\n");
+		fflush(stdout);
+		last_accesses = accesses;
+	}
+
+	/* Keep the loop from being optimized away */
+	if (sum == 42)
+		printf("%lu\n", sum);
+	return 0;
+}